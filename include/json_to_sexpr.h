@@ -6,11 +6,14 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* Maximum buffer sizes */
 #define MAX_TOKEN_SIZE 1024
 #define MAX_STRING_SIZE 2048
 #define MAX_DEPTH 64
+#define MAX_NESTING_DEPTH 10000   // open containers; bounds the recursive writers' stack use
+#define MAX_NUMBER_TEXT 32
 
 /* Token types for JSON parsing */
 typedef enum {
@@ -34,6 +37,8 @@ typedef struct {
     token_type_t type;
     char value[MAX_TOKEN_SIZE];
     double number_value;
+    const char *string;         // decoded TOKEN_STRING contents (NUL-terminated)
+    size_t string_length;
 } token_t;
 
 /* JSON value types */
@@ -43,9 +48,20 @@ typedef enum {
     JSON_STRING,
     JSON_NUMBER,
     JSON_BOOLEAN,
-    JSON_NULL
+    JSON_NULL,
+    JSON_TYPED_ARRAY,
+    JSON_RECORD_ARRAY,
+    JSON_ELIDED             // preview marker for entries that were skipped
 } json_type_t;
 
+/* Element kinds for homogeneous arrays stored in packed form */
+typedef enum {
+    TYPED_ARRAY_INT64,
+    TYPED_ARRAY_DOUBLE,
+    TYPED_ARRAY_BOOLEAN,
+    TYPED_ARRAY_VALUE       // generic value pointers (record columns only)
+} typed_array_kind_t;
+
 /* Forward declaration */
 struct json_value;
 
@@ -62,54 +78,463 @@ typedef struct json_element {
     struct json_element *next;
 } json_element_t;
 
+/* Homogeneous numeric or boolean array packed into a single node */
+typedef struct json_typed_array {
+    typed_array_kind_t kind;
+    size_t count;
+    size_t capacity;
+    union {
+        int64_t *integers;
+        double *doubles;
+        unsigned char *bits;    // one bit per element, LSB first
+        struct json_value **values;
+    } items;
+} json_typed_array_t;
+
+/* Array of objects sharing one key sequence, stored column-wise */
+typedef struct json_record_array {
+    size_t key_count;
+    char **keys;                        // shared by every record
+    json_typed_array_t **columns;       // one value vector per key
+    size_t record_count;
+    bool borrowed_keys;                 // keys point into the input buffer
+} json_record_array_t;
+
+/* JSON value flags for storage borrowed from a mutable input buffer */
+#define JSON_VALUE_BORROWED_STRING 0x01     // data.string points into the input
+#define JSON_VALUE_BORROWED_KEYS   0x02     // object member keys point into the input
+
 /* JSON value structure */
 typedef struct json_value {
     json_type_t type;
+    unsigned char flags;
     union {
         json_member_t *object;
         json_element_t *array;
+        json_typed_array_t *typed_array;
+        json_record_array_t *record_array;
         char *string;
         double number;
         bool boolean;
+        size_t elided_count;
     } data;
 } json_value_t;
 
+/* How non-ASCII characters are written in Lisp strings */
+typedef enum {
+    SEXPR_UNICODE_RAW,          // UTF-8 bytes as-is
+    SEXPR_UNICODE_ESCAPE        // \uHHHH / \UHHHHHH escapes (Guile syntax)
+} sexpr_unicode_mode_t;
+
+/* Rendered subtree kept by the memoizing writer */
+typedef struct {
+    uint64_t hash;
+    int indentation_level;
+    const json_value_t *value;  // subtree the text was rendered from
+    char *text;
+    size_t length;
+} sexpr_memo_entry_t;
+
+/* Bounded cache of rendered subtrees */
+typedef struct {
+    sexpr_memo_entry_t *entries;    // direct-mapped slots
+    FILE *scratch;                  // memory stream subtrees are rendered into
+    char *scratch_buffer;
+    size_t scratch_size;
+    size_t lookups;
+    size_t hits;
+} sexpr_memo_t;
+
+/* Periodic progress reporter (defined in progress.c) */
+typedef struct json_progress json_progress_t;
+
+/* S-expression writer context */
+typedef struct {
+    FILE *output;
+    sexpr_unicode_mode_t unicode_mode;
+    sexpr_memo_t *memo;         // NULL unless repeated subtrees are memoized
+    json_progress_t *progress;  // NULL unless progress is reported
+} sexpr_writer_t;
+
+/* Limits for a preview rendering */
+typedef struct {
+    size_t max_entries;         // entries shown per array or object
+    size_t max_depth;           // containers nested deeper are elided whole
+} json_preview_limits_t;
+
 /* Parser context */
 typedef struct {
     const char *input;
+    char *mutable_input;        // same buffer when strings are unescaped in place
     size_t pos;
     size_t length;
     token_t current_token;
     int line;
     int column;
+    char *string_buffer;        // scratch space for decoded strings
+    size_t string_capacity;
+    json_progress_t *progress;  // told the position at container boundaries, or NULL
+    const json_preview_limits_t *preview;  // entries past these limits are elided, or NULL
 } parser_t;
 
+/* Settings for writing a document as one shard per top-level entry */
+typedef struct {
+    const char *directory;      // receives the shards and manifest.lisp
+    size_t chunk_size;          // array elements per shard
+    size_t workers;             // rendering threads, 0 for one per processor
+    sexpr_unicode_mode_t unicode_mode;
+} json_split_options_t;
+
+/* Settings for converting with forked worker processes */
+typedef struct {
+    const char *output_filename;    // NULL for standard output
+    size_t processes;               // workers, 0 for one per processor
+    bool validate_utf8;
+    sexpr_unicode_mode_t unicode_mode;
+} json_process_options_t;
+
+/* Settings for a profiled conversion */
+typedef struct {
+    const char *report_filename;    // sorted report; folded stacks go to REPORT.folded
+    size_t max_depth;               // deepest paths costs are attributed to
+} json_profile_options_t;
+
+/* Measurements of one run for the metrics file */
+typedef struct {
+    const char *filename;       // metrics file, or NULL when none is written
+    const char *input_filename; // sized after the run; NULL for stdin
+    const char *output_filename;
+    bool converts;              // the run converts a document (not only checks it)
+    bool phases_measured;       // parse and render times were taken
+    double start;
+    double parse_seconds;
+    double render_seconds;
+    uint64_t input_bytes;       // bytes read from stdin
+    uint64_t output_bytes;      // bytes written, counted as they are produced
+    uint64_t output_resumed_at; // part of the -o file kept from an earlier run
+    uint64_t heap_peak_bytes;   // largest heap use sampled
+} json_metrics_t;
+
+/* Open containers a checkpoint can record */
+#define JSON_CHECKPOINT_MAX_DEPTH 16
+
+/* Resumable position in a streaming conversion, at a top-level entry boundary */
+typedef struct {
+    uint64_t input_offset;      // start of the next entry
+    uint64_t output_offset;     // output written before it
+    uint64_t line;              // input position of input_offset, for warnings
+    uint64_t column;
+    sexpr_unicode_mode_t unicode_mode;
+    uint32_t depth;             // containers open at input_offset
+    char stack[JSON_CHECKPOINT_MAX_DEPTH];  // their opening brackets, outermost first
+} json_checkpoint_t;
+
+/* Settings for the pipelined conversion */
+typedef struct {
+    bool validate_utf8;
+    const char *input_filename;         // identify the files in checkpoints
+    const char *output_filename;
+    const char *checkpoint_filename;    // NULL for no checkpoints
+    size_t checkpoint_interval;         // input bytes between checkpoints
+    const json_checkpoint_t *resume;    // position to continue from, or NULL
+    json_progress_t *progress;          // told the input offset after each chunk, or NULL
+} json_pipeline_options_t;
+
+/* Container recorded in a structural index */
+typedef struct {
+    uint64_t start;             // offset of the opening bracket
+    uint64_t end;               // offset just past the closing bracket
+    uint64_t first_child;       // position of its first child record
+    uint64_t entries;           // members or elements in the container
+    uint32_t child_count;       // child records stored for it
+    uint32_t is_object;
+} json_structure_container_t;
+
+/* Member key or array element position recorded in a structural index */
+typedef struct {
+    uint64_t offset;            // key's opening quote, or element start
+    uint64_t key_hash;          // hash of the raw key; 0 for elements and escaped keys
+} json_structure_child_t;
+
+/* Structural index of a document, built in memory or mapped from a file */
+typedef struct {
+    const json_structure_container_t *containers;   // sorted by start offset
+    size_t container_count;
+    const json_structure_child_t *children;
+    size_t child_count;
+    void *mapping;              // mapped index file, or NULL when built here
+    size_t mapping_size;
+} json_structure_t;
+
+/* Outcome of a validation-only pass */
+typedef struct {
+    bool valid;
+    size_t error_offset;        // byte offset of the first error
+    int line;                   // 1-based position of the first error
+    int column;
+    const char *message;        // static description, NULL when valid
+} json_check_result_t;
+
+/* Distinct keys are counted exactly up to this many */
+#define JSON_STATS_MAX_DISTINCT_KEYS 65536
+
+/* Document metrics gathered during a validation pass */
+typedef struct {
+    size_t objects;
+    size_t arrays;
+    size_t strings;
+    size_t integers;
+    size_t floats;
+    size_t booleans;
+    size_t nulls;
+    size_t members;
+    size_t max_depth;
+    size_t largest_array;       // most elements in one array
+    size_t largest_object;      // most members in one object
+    size_t string_bytes;        // string value contents as written, quotes excluded
+    size_t key_bytes;
+    size_t distinct_keys;
+    uint64_t *key_hashes;       // open-addressing set of key hashes (0 = empty)
+    size_t key_hash_capacity;
+} json_stats_t;
+
+/* Incremental UTF-8 validator state */
+typedef struct {
+    size_t offset;              // bytes consumed by previous chunks
+    size_t sequence_start;      // offset of the lead byte being completed
+    unsigned remaining;         // continuation bytes still expected
+    unsigned char next_min;     // allowed range for the next continuation byte
+    unsigned char next_max;
+    size_t error_offset;        // offset of the first invalid sequence
+    bool failed;
+} utf8_validator_t;
+
+/* One open container while hashing a JSON event stream */
+typedef struct {
+    uint64_t hash;              // running hash of the entries so far
+    uint64_t key_hash;          // hash of the key awaiting its value
+    bool has_key;
+} json_digest_frame_t;
+
+/* Per-subtree hashes of a JSON event stream, checked entry by entry
+ * against a parsed document */
+typedef struct {
+    json_digest_frame_t *frames;
+    size_t depth;
+    size_t capacity;
+    uint64_t string_hash;       // hash of the string being written
+    uint64_t root_hash;
+    bool complete;              // the root value has ended
+    const json_value_t *document;
+    const json_member_t *next_member;   // next expected top-level entry
+    const json_element_t *next_element;
+    size_t entries;             // top-level entries checked so far
+    size_t overflow;            // containers open past an allocation failure
+    bool failed;
+} json_digest_t;
+
+/* Output stream drained by a dedicated I/O thread (defined in async_output.c) */
+typedef struct async_output async_output_t;
+
+/* Bytes buffered by the JSON writer between writes to its stream */
+#define JSON_WRITER_BUFFER_SIZE 65536
+
+/* Buffered JSON text writer used by the reverse converter */
+typedef struct {
+    FILE *output;
+    json_digest_t *digest;      // when set, events are hashed instead of written
+    bool need_comma;            // a value was written at the current level
+    size_t used;
+    char buffer[JSON_WRITER_BUFFER_SIZE];
+} json_writer_t;
+
 /* Parser initialization and tokenization */
 void parser_initialize(parser_t *parser, const char *input);
+void parser_initialize_in_place(parser_t *parser, char *input);
+void parser_release(parser_t *parser);
 token_t tokenizer_get_next_token(parser_t *parser);
 void tokenizer_skip_whitespace(parser_t *parser);
 token_t tokenizer_parse_string_literal(parser_t *parser);
 token_t tokenizer_parse_numeric_literal(parser_t *parser);
 token_t tokenizer_parse_keyword_literal(parser_t *parser);
+bool tokenizer_scan_string(parser_t *parser, const char **text, size_t *length);
+bool tokenizer_scan_number(parser_t *parser, char *text, double *number);
+size_t tokenizer_token_extent(const char *text, size_t length);
+void tokenizer_report_trailing(const char *text, int line, int column);
 
 /* JSON parsing functions */
 json_value_t *json_parser_parse_document(parser_t *parser);
-json_value_t *json_parser_parse_value(parser_t *parser);
-json_value_t *json_parser_parse_object(parser_t *parser);
-json_value_t *json_parser_parse_array(parser_t *parser);
+bool json_parser_scan_integer_run(parser_t *parser, json_typed_array_t *typed_array);
+
+/* Preview functions */
+json_value_t *json_preview_parse_document(parser_t *parser, const json_preview_limits_t *limits);
+bool json_preview_elide_rest(parser_t *parser, json_value_t *container, json_member_t *last_member,
+                             json_element_t *last_element);
+
+/* Packed homogeneous array functions */
+json_typed_array_t *json_typed_array_create(typed_array_kind_t kind);
+bool json_typed_array_reserve(json_typed_array_t *typed_array);
+bool json_typed_array_append_number(json_typed_array_t *typed_array, double number);
+bool json_typed_array_append_boolean(json_typed_array_t *typed_array, bool boolean);
+bool json_typed_array_get_boolean(const json_typed_array_t *typed_array, size_t index);
+bool json_typed_array_append_value(json_typed_array_t *typed_array, json_value_t *value);
+json_value_t *json_typed_array_take_value(json_typed_array_t *typed_array, size_t index);
+json_value_t *json_typed_array_pop_value(json_typed_array_t *typed_array);
+json_element_t *json_typed_array_expand_elements(json_typed_array_t *typed_array,
+                                                 json_element_t **last_element);
+
+/* Columnar record array functions */
+json_record_array_t *json_record_array_create_from_object(json_value_t *object);
+bool json_record_array_key_matches(const json_record_array_t *record_array, size_t key_index,
+                                   const char *key);
+json_member_t *json_record_array_pop_partial_record(json_record_array_t *record_array,
+                                                    size_t member_count, json_member_t **last_member);
+json_element_t *json_record_array_expand_elements(json_record_array_t *record_array,
+                                                  json_element_t **last_element);
+
+/* Validation-only functions */
+bool json_validator_check(const char *input, size_t length, json_check_result_t *result);
+bool json_validator_collect_stats(const char *input, size_t length, json_check_result_t *result,
+                                  json_stats_t *stats);
+bool json_validator_skip_container(const char *input, size_t length, size_t *pos, size_t *entries);
+bool json_validator_skip_entry(const char *input, size_t length, size_t *pos);
+size_t json_validator_skip_whitespace(const char *input, size_t pos);
+size_t json_validator_skip_string(const char *input, size_t length, size_t pos);
+size_t json_validator_find_structural(const char *input, size_t pos, size_t length);
+size_t json_validator_find_string_special(const char *input, size_t pos, size_t length);
+
+/* Structural index functions */
+bool json_structure_build(json_structure_t *structure, const char *input, size_t length);
+bool json_structure_load(json_structure_t *structure, const char *index_filename,
+                         const char *input_filename, const char *input, size_t length);
+bool json_structure_save(const json_structure_t *structure, const char *index_filename,
+                         const char *input_filename, const char *input, size_t length);
+void json_structure_release(json_structure_t *structure);
+bool json_structure_locate(const json_structure_t *structure, const char *input, size_t length,
+                           const char *path, size_t *start, size_t *end, bool *stale);
+
+/* Sharded output functions */
+bool json_split_document(const char *input, size_t length, const json_split_options_t *options,
+                         uint64_t *bytes_written);
+
+/* Document statistics functions */
+void json_stats_initialize(json_stats_t *stats);
+void json_stats_release(json_stats_t *stats);
+bool json_stats_add_key(json_stats_t *stats, const char *key, size_t length);
+void json_stats_write(const json_stats_t *stats, FILE *output);
+
+/* UTF-8 validation functions */
+void utf8_validator_init(utf8_validator_t *validator);
+bool utf8_validator_feed(utf8_validator_t *validator, const char *data, size_t length);
+bool utf8_validator_finish(utf8_validator_t *validator);
+bool utf8_validate(const char *data, size_t length, size_t *error_offset);
 
 /* S-expression output functions */
-void sexpr_writer_write_value(json_value_t *value, FILE *output, int indentation_level);
-void sexpr_writer_write_object_members(json_member_t *member, FILE *output, int indentation_level);
-void sexpr_writer_write_array_elements(json_element_t *element, FILE *output, int indentation_level);
+void sexpr_writer_initialize(sexpr_writer_t *writer, FILE *output, sexpr_unicode_mode_t unicode_mode);
+void sexpr_writer_write_value(json_value_t *value, sexpr_writer_t *writer, int indentation_level);
+void sexpr_writer_write_object_members(json_member_t *member, sexpr_writer_t *writer, int indentation_level);
+void sexpr_writer_write_array_elements(json_element_t *element, sexpr_writer_t *writer, int indentation_level);
+void sexpr_writer_write_typed_array_elements(json_typed_array_t *typed_array, sexpr_writer_t *writer, int indentation_level);
+void sexpr_writer_write_record_array_elements(json_record_array_t *record_array, sexpr_writer_t *writer, int indentation_level);
+void sexpr_writer_write_entries(json_value_t *container, sexpr_writer_t *writer, int indentation_level);
+void sexpr_writer_write_typed_item(json_typed_array_t *typed_array, size_t index,
+                                   sexpr_writer_t *writer, int indentation_level);
+void sexpr_writer_write_record(json_record_array_t *record_array, size_t record_index,
+                               sexpr_writer_t *writer, int indentation_level);
+
+/* JSON output functions */
+void json_writer_initialize(json_writer_t *writer, FILE *output);
+bool json_writer_flush(json_writer_t *writer);
+void json_writer_write_raw(json_writer_t *writer, const char *text, size_t length);
+void json_writer_write_string_bytes(json_writer_t *writer, const char *text, size_t length);
+void json_writer_begin_container(json_writer_t *writer, char bracket);
+void json_writer_end_container(json_writer_t *writer, char bracket);
+void json_writer_begin_string(json_writer_t *writer);
+void json_writer_end_string(json_writer_t *writer);
+void json_writer_write_key(json_writer_t *writer, const char *key, size_t length);
+void json_writer_write_literal(json_writer_t *writer, const char *text, size_t length);
+void json_writer_write_code_point(json_writer_t *writer, uint32_t code_point);
+
+/* S-expression reader functions */
+bool sexpr_reader_convert(const char *input, size_t length, json_writer_t *writer,
+                          json_check_result_t *result);
+bool sexpr_reader_key_is_readable(const char *key, size_t length);
+
+/* Round-trip verification functions */
+bool json_digest_initialize(json_digest_t *digest, const json_value_t *document);
+void json_digest_release(json_digest_t *digest);
+void json_digest_begin_container(json_digest_t *digest, char bracket);
+void json_digest_end_container(json_digest_t *digest, char bracket);
+void json_digest_key(json_digest_t *digest, const char *key, size_t length);
+void json_digest_begin_string(json_digest_t *digest);
+void json_digest_string_bytes(json_digest_t *digest, const char *text, size_t length);
+void json_digest_end_string(json_digest_t *digest);
+void json_digest_literal(json_digest_t *digest, const char *text, size_t length);
+bool json_verify_output(const json_value_t *document, const char *filename, size_t *entries);
+
+/* Asynchronous output functions */
+async_output_t *async_output_open(const char *filename, FILE **stream);
+bool async_output_close(async_output_t *async, FILE *report);
+
+/* Pipelined conversion functions */
+bool json_pipeline_convert(FILE *input, const json_pipeline_options_t *options, sexpr_writer_t *writer);
+
+/* Progress reporting functions */
+json_progress_t *json_progress_start(FILE *report);
+void json_progress_phase(json_progress_t *progress, const char *phase, const char *unit,
+                         uint64_t done, uint64_t total, FILE *output);
+void json_progress_update(json_progress_t *progress, uint64_t done);
+void json_progress_finish(json_progress_t *progress);
+
+/* Run metrics functions */
+double json_metrics_now(void);
+void json_metrics_initialize(json_metrics_t *metrics);
+void json_metrics_sample_heap(json_metrics_t *metrics);
+bool json_metrics_start_output(const json_metrics_t *metrics, bool seekable_stdout);
+bool json_metrics_finish_output(json_metrics_t *metrics);
+bool json_metrics_write(const json_metrics_t *metrics, bool success);
+
+/* Checkpoint functions */
+bool json_checkpoint_save(const json_checkpoint_t *checkpoint, const char *checkpoint_filename,
+                          const char *input_filename, const char *output_filename);
+bool json_checkpoint_load(json_checkpoint_t *checkpoint, const char *checkpoint_filename,
+                          const char *input_filename, const char *output_filename);
+bool json_checkpoint_seek(const json_checkpoint_t *checkpoint, FILE *input, const char *output_filename);
+
+/* Conversion profiling functions */
+bool json_profile_convert(const char *input, size_t length, const json_profile_options_t *options,
+                          sexpr_writer_t *writer);
+
+/* Multi-process conversion functions */
+bool json_process_convert(const char *input_filename, const json_process_options_t *options);
+
+/* AST snapshot functions */
+bool json_snapshot_save(const json_value_t *value, const char *filename);
+bool json_snapshot_write(const char *filename, sexpr_writer_t *writer);
+
+/* Subtree memoization functions */
+bool sexpr_memo_initialize(sexpr_memo_t *memo);
+void sexpr_memo_release(sexpr_memo_t *memo);
+bool sexpr_memo_write_value(sexpr_memo_t *memo, json_value_t *value, sexpr_writer_t *writer,
+                            int indentation_level);
+void sexpr_memo_write_stats(const sexpr_memo_t *memo, FILE *output);
+
+/* Offset index functions */
+bool sexpr_index_write_document(json_value_t *value, sexpr_writer_t *writer, FILE *index_output);
+char *sexpr_index_child_path(const char *parent, const char *key, size_t element_index);
 
 /* Memory management functions */
 void json_memory_free_value(json_value_t *value);
 void json_memory_free_object_member(json_member_t *member);
+void json_memory_free_member_list(json_member_t *member, bool owns_keys);
 void json_memory_free_array_element(json_element_t *element);
+void json_memory_free_typed_array(json_typed_array_t *typed_array);
+void json_memory_free_record_array(json_record_array_t *record_array);
 
 /* String utility functions */
-char *string_utils_escape_for_lisp(const char *input_string);
+char *string_utils_escape_for_lisp(const char *input_string, sexpr_unicode_mode_t unicode_mode);
 void output_formatter_write_indentation(FILE *output, int indentation_level);
+size_t output_formatter_format_integer(int64_t integer_value, char *buffer);
+size_t output_formatter_format_number(double number_value, char *buffer);
 
 #endif /* JSON_TO_SEXPR_H */
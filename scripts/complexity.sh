@@ -0,0 +1,200 @@
+#!/bin/bash
+# Algorithmic-complexity guard: converts adversarial inputs at two sizes and
+# fails when time or peak memory grows faster than the input.
+#
+# Usage: scripts/complexity.sh [--full] [PROGRAM]
+#
+# Each input is generated at N and 4N bytes (N = 4 MB, or 25 MB with --full,
+# so the largest inputs are 100 MB) and converted normally and with
+# --pipeline. Linear work grows about 4x; quadratic work grows 16x. A case
+# fails when the larger run takes more than 8x the time of the smaller one, or
+# when its peak RSS above an empty document's grows more than 8x plus the
+# size of the larger input, which a normal run holds whole. Deep nesting
+# writes one indented line per level, so its output grows with the square of
+# the depth; its time is compared against the output size instead.
+
+PROG="./json_to_sexpr"
+SIZE=$((4 * 1000 * 1000))
+RATIO=4
+ALLOWED=8
+REPEATS=3
+TIME_FLOOR=0.05        # seconds; differences below this are timer noise
+MEMORY_FLOOR=1024      # KiB; differences below this are allocator noise
+PASS=0
+FAIL=0
+TOTAL=0
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --full) SIZE=$((25 * 1000 * 1000)) ;;
+        *) PROG="$1" ;;
+    esac
+    shift
+done
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+if [ ! -x "$PROG" ]; then
+    echo -e "${RED}Program $PROG not found; build it first${NC}"
+    exit 1
+fi
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+# Writes an adversarial document of about SIZE bytes (DEPTH levels for the
+# deep_nesting kind) to FILE: generate.py KIND SIZE FILE
+cat > "$WORK_DIR/generate.py" << 'EOF'
+import sys
+
+kind, size, filename = sys.argv[1], int(sys.argv[2]), sys.argv[3]
+with open(filename, 'w') as output:
+    if kind == 'deep_nesting':
+        output.write('[' * size + ']' * size)
+    elif kind == 'too_deep_nesting':
+        output.write('{"a":[' * (size // 6) + '0' + ']}' * (size // 6))
+    elif kind == 'long_string':
+        output.write('"' + 'a' * size + '"')
+    elif kind == 'escape_string':
+        unit = '\\"\\\\\\/\\b\\f\\n\\r\\t\\u00e9\\ud83d\\ude00'
+        output.write('"' + unit * (size // len(unit)) + '"')
+    elif kind == 'long_number':
+        output.write('-1.' + '7' * size + 'e-300')
+    elif kind == 'long_numbers':
+        numbers = ['9' * 3000, '-1.' + '5' * 3000, '1' * 3000 + 'e+10']
+        output.write('[' + ','.join(numbers * (size // 9010)) + ']')
+    elif kind == 'tiny_keys':
+        output.write('{' + ','.join('"k%x":0' % key for key in range(size // 10)) + '}')
+    elif kind == 'whitespace_runs':
+        run = ' \t\r\n' * (size // 16)
+        output.write(run + '[' + run + '1' + run + ',"x"' + run + ']' + run)
+EOF
+
+# Runs PROGRAM ARGS REPEATS times with stdout in a file and prints the best
+# wall time, the largest peak RSS in KiB, the exit status (negative for a
+# signal) and the output size: measure.py REPEATS OUTPUT PROGRAM ARGS...
+cat > "$WORK_DIR/measure.py" << 'EOF'
+import os
+import sys
+import time
+
+repeats, output_name, command = int(sys.argv[1]), sys.argv[2], sys.argv[3:]
+best, peak, status, output_bytes = None, 0, 0, 0
+for _ in range(repeats):
+    start = time.perf_counter()
+    pid = os.fork()
+    if pid == 0:
+        output = os.open(output_name, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o600)
+        silent = os.open(os.devnull, os.O_WRONLY)
+        os.dup2(output, 1)
+        os.dup2(silent, 2)
+        os.execv(command[0], command)
+    _, wait_status, usage = os.wait4(pid, 0)
+    elapsed = time.perf_counter() - start
+    best = elapsed if best is None else min(best, elapsed)
+    peak = max(peak, usage.ru_maxrss)
+    status = os.waitstatus_to_exitcode(wait_status)
+    output_bytes = os.path.getsize(output_name)
+print('%.6f %d %d %d' % (best, peak, status, output_bytes))
+EOF
+
+# Measures one run; sets SECONDS_TAKEN, PEAK_KB, EXIT_STATUS and OUTPUT_BYTES
+measure() {
+    read -r SECONDS_TAKEN PEAK_KB EXIT_STATUS OUTPUT_BYTES < <(
+        python3 "$WORK_DIR/measure.py" "$REPEATS" "$WORK_DIR/output" "$PROG" "$@")
+    rm -f "$WORK_DIR/output"
+}
+
+# Baseline peak RSS of converting an empty document
+echo '[]' > "$WORK_DIR/empty.json"
+measure "$WORK_DIR/empty.json"
+BASE_KB=$PEAK_KB
+
+# Test function
+run_scaling_test() {
+    local kind="$1"
+    local small="$2"
+    local expected_exit="$3"
+    local scale="$4"            # "input" or "output": what time should be linear in
+    local description="$5"
+    shift 5
+    local large=$((small * RATIO))
+
+    echo -e "${BLUE}SCALING TEST: $kind $*${NC}"
+    echo -e "  Description: $description"
+
+    TOTAL=$((TOTAL + 1))
+
+    python3 "$WORK_DIR/generate.py" "$kind" "$small" "$WORK_DIR/small.json"
+    python3 "$WORK_DIR/generate.py" "$kind" "$large" "$WORK_DIR/large.json"
+    local small_input large_input
+    small_input=$(wc -c < "$WORK_DIR/small.json")
+    large_input=$(wc -c < "$WORK_DIR/large.json")
+
+    measure "$@" "$WORK_DIR/small.json"
+    local small_seconds=$SECONDS_TAKEN small_kb=$PEAK_KB small_exit=$EXIT_STATUS small_output=$OUTPUT_BYTES
+    measure "$@" "$WORK_DIR/large.json"
+    local large_seconds=$SECONDS_TAKEN large_kb=$PEAK_KB large_exit=$EXIT_STATUS large_output=$OUTPUT_BYTES
+    rm -f "$WORK_DIR/small.json" "$WORK_DIR/large.json"
+
+    echo -e "  Input: $small_input -> $large_input bytes, output: $small_output -> $large_output bytes"
+    echo -e "  Time: ${small_seconds}s -> ${large_seconds}s, peak RSS: ${small_kb} -> ${large_kb} KiB"
+
+    local problems=""
+    if [ "$small_exit" -ne "$expected_exit" ] || [ "$large_exit" -ne "$expected_exit" ]; then
+        problems="$problems exit status $small_exit/$large_exit, expected $expected_exit;"
+    fi
+    local growth=$RATIO
+    if [ "$scale" = "output" ]; then
+        growth=$(awk -v a="$small_output" -v b="$large_output" 'BEGIN { print (a > 0 ? b / a : 1) }')
+    fi
+    if awk -v a="$small_seconds" -v b="$large_seconds" -v g="$growth" -v r="$RATIO" -v k="$ALLOWED" \
+           -v f="$TIME_FLOOR" 'BEGIN { exit !(b > a * g * k / r + f) }'; then
+        problems="$problems time grew faster than the $scale;"
+    fi
+    local small_growth=$((small_kb > BASE_KB ? small_kb - BASE_KB : 0))
+    if [ $((large_kb - BASE_KB)) -gt $((small_growth * ALLOWED + large_input / 1024 + MEMORY_FLOOR)) ]; then
+        problems="$problems peak memory grew faster than the input;"
+    fi
+
+    if [ -z "$problems" ]; then
+        echo -e "  ${GREEN}PASS${NC}"
+        PASS=$((PASS + 1))
+    else
+        echo -e "  ${RED}FAIL${NC} ($problems)"
+        FAIL=$((FAIL + 1))
+    fi
+    echo
+}
+
+echo -e "${YELLOW}=== Algorithmic Complexity Guard ($PROG, $SIZE -> $((SIZE * RATIO)) bytes) ===${NC}"
+echo
+
+for MODE in "" "--pipeline"; do
+    run_scaling_test deep_nesting 2500 0 output "Nested arrays up to the nesting limit" $MODE
+    run_scaling_test too_deep_nesting "$SIZE" 1 input "Nesting past the limit is rejected, not a stack overflow" $MODE
+    run_scaling_test long_string "$SIZE" 0 input "One string spanning the whole input" $MODE
+    run_scaling_test escape_string "$SIZE" 0 input "A string made only of escape sequences" $MODE
+    run_scaling_test long_number "$SIZE" 0 input "One number with millions of digits" $MODE
+    run_scaling_test long_numbers "$SIZE" 0 input "Numbers thousands of digits long" $MODE
+    run_scaling_test tiny_keys "$SIZE" 0 input "An object with millions of tiny keys" $MODE
+    run_scaling_test whitespace_runs "$SIZE" 0 input "Huge whitespace runs around every token" $MODE
+done
+
+echo -e "${YELLOW}=== COMPLEXITY SUMMARY ===${NC}"
+echo -e "Total tests: $TOTAL"
+echo -e "${GREEN}Passed: $PASS${NC}"
+echo -e "${RED}Failed: $FAIL${NC}"
+
+if [ $FAIL -eq 0 ]; then
+    echo -e "${GREEN}All inputs scale linearly! ${NC}"
+    exit 0
+else
+    echo -e "${RED}Super-linear growth detected. Review the output above.${NC}"
+    exit 1
+fi
@@ -76,7 +76,7 @@ echo
 
 # Build the program
 echo -e "${BLUE}Building program...${NC}"
-gcc -std=c99 -Wall -Wextra -pedantic -O2 -Iinclude src/*.c -o json_to_sexpr
+gcc -std=c99 -Wall -Wextra -pedantic -O2 -pthread -Iinclude src/*.c -o json_to_sexpr
 if [ $? -ne 0 ]; then
     echo -e "${RED}BUILD FAILED${NC}"
     exit 1
@@ -116,16 +116,41 @@ run_test "string_with_quotes" '"He said \"hello\""' 0 "String with escaped quote
 run_test "string_with_backslash" '"C:\\\\path\\\\file"' 0 "String with backslashes"
 run_test "string_with_newline" '"line1\\nline2"' 0 "String with newline escape"
 run_test "string_with_tab" '"col1\\tcol2"' 0 "String with tab escape"
+run_test "unicode_escape" '"caf\\u00e9"' 0 "Unicode escape should decode"
+run_test "surrogate_pair" '"\\ud83d\\ude00"' 0 "Surrogate pair should decode"
+run_test "lone_surrogate" '"\\udc00"' 0 "Lone surrogate becomes U+FFFD"
+run_test "bad_unicode_escape" '"\\u00zz"' 1 "Non-hex unicode escape should fail"
+run_test "short_unicode_escape" '"\\u12"' 1 "Truncated unicode escape should fail"
+
+run_test "utf8_string" '"caf\xc3\xa9 \xf0\x9f\x98\x80"' 0 "Valid multi-byte UTF-8 should pass"
+run_test "invalid_utf8_byte" '"\xff"' 1 "Invalid UTF-8 byte should fail"
+run_test "truncated_utf8" '"ab\xc3"' 1 "Truncated UTF-8 sequence should fail"
+run_test "utf8_surrogate" '"\xed\xa0\x80"' 1 "Encoded surrogate should fail"
 
 echo -e "${YELLOW}=== CATEGORY 5: Array Edge Cases ===${NC}"
 run_test "single_element_array" '[1]' 0 "Array with single element"
 run_test "mixed_type_array" '[1,"hello",true,null]' 0 "Array with mixed types"
 run_test "nested_arrays" '[[1,2],[3,4]]' 0 "Nested arrays"
+run_test "integer_run" '[0, -7, 12345678, 1234567890123456789,\n  42]' 0 "Integer run scanned without tokens"
+run_test "integer_run_leading_zero" '[1, 2, 03]' 1 "Leading zero inside integer run should fail"
+run_test "boolean_array" '[true,false,true]' 0 "Homogeneous boolean array (packed)"
+run_test "int_then_float_array" '[1,2,3.5,-4]' 0 "Integer run promoted to doubles"
+run_test "numbers_then_string" '[1,2,"three"]' 0 "Packed prefix expanded on mismatch"
+run_test "trailing_comma_bool_array" '[true,false,]' 1 "Trailing comma after packed run should fail"
 
 echo -e "${YELLOW}=== CATEGORY 6: Object Edge Cases ===${NC}"
 run_test "single_member_object" '{"key":"value"}' 0 "Object with single member"
 run_test "multiple_members" '{"a":1,"b":2,"c":3}' 0 "Object with multiple members"
 run_test "nested_objects" '{"outer":{"inner":"value"}}' 0 "Nested objects"
+run_test "uniform_records" '[{"a":1,"b":"x"},{"a":2,"b":"y"}]' 0 "Same-shaped objects stored column-wise"
+run_test "records_then_mismatch" '[{"a":1},{"a":2,"b":3},{"b":4},5]' 0 "Record array falls back on a different shape"
+run_test "record_missing_colon" '[{"a":1},{"a" 2}]' 1 "Malformed record should fail"
+run_test "nested_containers" '{"x":[[1,2],[true],{"a":[{"b":1},{"b":[3]}]}],"y":{}}' 0 "Mixed nesting through every container state"
+run_test "record_truncated_row" '[{"a":1},{"a":2' 1 "Truncated record should fail"
+run_test "truncated_after_empty_object" '[{}' 1 "Array truncated after an empty object should fail"
+run_test "truncated_open_object" '[{' 1 "Array truncated inside its first object should fail"
+run_test "records_truncated_after_split" '[{"a":1},{"b":2}' 1 "Array truncated after a mismatched record should fail"
+run_test "records_truncated_in_row" '[{"a":true,"d":false},{"a":false},{"a":[],' 1 "Array truncated inside a partial record should fail"
 run_test "duplicate_keys" '{"a":1,"a":2}' 0 "Duplicate keys (last wins semantically)"
 
 echo -e "${YELLOW}=== CATEGORY 7: Invalid JSON - Syntax Errors ===${NC}"
@@ -163,7 +188,7 @@ run_file_test "nonexistent_file" "nonexistent.json" 1 "Nonexistent file should f
 
 echo -e "${YELLOW}=== CATEGORY 12: Deep Nesting Test ===${NC}"
 # Create deep nesting test
-python3 - << 'EOF' > deep_test.json 2>/dev/null || python - << 'EOF' > deep_test.json
+python3 - << 'EOF' > deep_test.json
 import json
 # Create deeply nested structure
 data = 0
@@ -177,12 +202,19 @@ if [ -f "deep_test.json" ]; then
     rm -f deep_test.json
 fi
 
+# Nesting past the limit must fail cleanly instead of overflowing the stack
+python3 -c "print('[' * 200000 + ']' * 200000)" > deep_test.json 2>/dev/null
+if [ -s "deep_test.json" ]; then
+    run_file_test "too_deep_nesting" "deep_test.json" 1 "Nesting deeper than 10000 levels should be rejected"
+    rm -f deep_test.json
+fi
+
 echo -e "${YELLOW}=== CATEGORY 13: Large String Test ===${NC}"
 # Test buffer limits
-python3 - << 'EOF' > large_string_test.json 2>/dev/null || python - << 'EOF' > large_string_test.json
+python3 - << 'EOF' > large_string_test.json
 import json
-# Create string near buffer limit (MAX_TOKEN_SIZE = 1024)
-large_string = "a" * 1000
+# Strings are no longer bounded by MAX_TOKEN_SIZE
+large_string = "a" * 100000
 data = {"large": large_string}
 print(json.dumps(data))
 EOF
@@ -209,6 +241,353 @@ else
     echo -e "  ${RED}FAIL${NC} (output to file failed)"
 fi
 
+echo -e "${BLUE}CLI TEST: Skip UTF-8 check${NC}"
+if printf '"\xff"' | $PROG --no-utf8-check > /dev/null 2>&1; then
+    echo -e "  ${GREEN}PASS${NC} (--no-utf8-check accepts trusted input)"
+else
+    echo -e "  ${RED}FAIL${NC} (--no-utf8-check failed)"
+fi
+
+echo -e "${BLUE}CLI TEST: In-place string unescaping${NC}"
+IN_PLACE_REJECTED=true
+for mode in --pipeline "--processes 2" "--split-by-top-level $(mktemp -u)" "--profile $(mktemp -u)"; do
+    if $PROG --in-place $mode tests/data/sample.json > /dev/null 2>&1; then
+        IN_PLACE_REJECTED=false
+    fi
+done
+if [ "$(echo '{"k\"ey":["a\tb","\\c"]}' | $PROG --in-place)" = "$(echo '{"k\"ey":["a\tb","\\c"]}' | $PROG)" ] && \
+   $IN_PLACE_REJECTED; then
+    echo -e "  ${GREEN}PASS${NC} (--in-place output matches default mode)"
+else
+    echo -e "  ${RED}FAIL${NC} (--in-place output differs)"
+fi
+
+echo -e "${BLUE}CLI TEST: ASCII output${NC}"
+if [ "$(echo '"\ud83d\ude00 caf\u00e9"' | $PROG --ascii-output | tail -n 1)" = '"\U01f600 caf\u00e9"' ]; then
+    echo -e "  ${GREEN}PASS${NC} (--ascii-output escapes non-ASCII characters)"
+else
+    echo -e "  ${RED}FAIL${NC} (--ascii-output escaping wrong)"
+fi
+
+echo -e "${BLUE}CLI TEST: Validation-only mode${NC}"
+if [ -z "$(echo '{"a":[1,"x",null]}' | $PROG --check)" ] && \
+   ! echo '{"a":[1,' | $PROG --check > /dev/null 2>&1 && \
+   ! echo '1 2' | $PROG --check > /dev/null 2>&1; then
+    echo -e "  ${GREEN}PASS${NC} (--check validates without output)"
+else
+    echo -e "  ${RED}FAIL${NC} (--check result wrong)"
+fi
+
+echo -e "${BLUE}CLI TEST: Statistics mode${NC}"
+if echo '{"a":[1,2.5,{"a":null}],"b":"xy"}' | $PROG --stats-only | grep -q '(distinct-keys 2))' && \
+   ! echo '{"a":' | $PROG --stats-only > /dev/null 2>&1; then
+    echo -e "  ${GREEN}PASS${NC} (--stats-only reports metrics)"
+else
+    echo -e "  ${RED}FAIL${NC} (--stats-only result wrong)"
+fi
+
+echo -e "${BLUE}CLI TEST: Preview mode${NC}"
+if echo '{"a":[1,2,3],"b":{"c":{"d":1}},"e":"s"}' | $PROG --preview 2 --preview-depth 2 | \
+       tr -d ' \n' | grep -q '(json:a(json:array12(preview:elided1)))(json:b(json:object(json:c(json:object(preview:elided1)))))(preview:elided1))$' && \
+   [ "$(python3 -c "print('[' * 100 + '1,2' + ']' * 100)" | $PROG --preview 1 --preview-depth 1000 | \
+        grep -c 'json:array')" -eq 100 ]; then
+    echo -e "  ${GREEN}PASS${NC} (--preview elides entries past the limits)"
+else
+    echo -e "  ${RED}FAIL${NC} (--preview output wrong)"
+fi
+
+echo -e "${BLUE}CLI TEST: Offset index${NC}"
+INDEX_DIR=$(mktemp -d)
+INDEX_REJECTED=true
+for mode in "--split-by-top-level $INDEX_DIR/split" --to-json --check --stats-only; do
+    for option in "--index $INDEX_DIR/ignored.idx" --memoize; do
+        if $PROG $option $mode tests/data/sample.json > /dev/null 2>&1; then
+            INDEX_REJECTED=false
+        fi
+    done
+done
+if $INDEX_REJECTED && echo '{"a":[1,2],"b c":"x"}' | $PROG -o "$INDEX_DIR/out.lisp" --index "$INDEX_DIR/out.idx" && \
+   grep -q '(json:key "b c") (json:path "$\[\\"b c\\"\]") (json:offset 91) (json:length 14)' "$INDEX_DIR/out.idx" && \
+   [ "$(tail -c +92 "$INDEX_DIR/out.lisp" | head -c 14)" = '(json:b c "x")' ]; then
+    echo -e "  ${GREEN}PASS${NC} (--index records entry offsets)"
+else
+    echo -e "  ${RED}FAIL${NC} (--index offsets wrong)"
+fi
+rm -rf "$INDEX_DIR"
+
+echo -e "${BLUE}CLI TEST: Subtree selection with structural index${NC}"
+SELECT_DIR=$(mktemp -d)
+awk 'BEGIN { printf "{\"pad\":\""; for (i = 0; i < 5000; i++) printf "x"; printf "\",\"list\":["; for (i = 0; i < 200; i++) printf "%s{\"n\":%d}", (i ? "," : ""), i; printf "]}\n" }' > "$SELECT_DIR/in.json"
+if [ "$($PROG --select '$.list[150].n' --structure-index "$SELECT_DIR/in.idx" "$SELECT_DIR/in.json" | tail -1)" = '150' ] && \
+   [ -s "$SELECT_DIR/in.idx" ] && \
+   [ "$($PROG --select '$.list[199]' --structure-index "$SELECT_DIR/in.idx" "$SELECT_DIR/in.json" | tr -d ' \n')" = ';;JSONtoS-expressionconversion(json:object(json:n199))' ] && \
+   ! $PROG --select '$.list[200]' "$SELECT_DIR/in.json" > /dev/null 2>&1; then
+    echo -e "  ${GREEN}PASS${NC} (--select finds subtrees with and without the index)"
+else
+    echo -e "  ${RED}FAIL${NC} (--select result wrong)"
+fi
+rm -rf "$SELECT_DIR"
+
+echo -e "${BLUE}CLI TEST: Structural index that no longer matches its input${NC}"
+SELECT_DIR=$(mktemp -d)
+# Over 128 KiB, so edits in the middle miss the hashed ends; "stamp" then
+# copies the edited file's status into the index as if nothing had changed
+cat > "$SELECT_DIR/edit.py" << 'EOF'
+import os, struct, sys
+name = sys.argv[2]
+if sys.argv[1] == 'make':
+    open(name, 'w').write('{' + ','.join('"k%05d":%d' % (i, i) for i in range(20000)) + '}')
+elif sys.argv[1] == 'swap':
+    text = open(name).read().replace('"k10000"', '"XXXXXX"').replace('"k10001"', '"k10000"')
+    open(name, 'w').write(text.replace('"XXXXXX"', '"k10001"'))
+elif sys.argv[1] == 'rename':
+    text = open(name).read().replace('"k10000"', '"q10000"')
+    open(name, 'w').write(text)
+else:
+    status = os.stat(name)
+    with open(sys.argv[3], 'r+b') as index:
+        index.seek(16)
+        index.write(struct.pack('=Qqqqq', status.st_ino, status.st_mtime_ns // 10**9, status.st_mtime_ns % 10**9,
+                                status.st_ctime_ns // 10**9, status.st_ctime_ns % 10**9))
+EOF
+select_edited() {
+    python3 "$SELECT_DIR/edit.py" make "$SELECT_DIR/in.json"
+    $PROG --select '$.k10000' --structure-index "$SELECT_DIR/in.idx" "$SELECT_DIR/in.json" > /dev/null
+    python3 "$SELECT_DIR/edit.py" "$1" "$SELECT_DIR/in.json"
+    python3 "$SELECT_DIR/edit.py" stamp "$SELECT_DIR/in.json" "$SELECT_DIR/in.idx"
+    $PROG --select "$2" --structure-index "$SELECT_DIR/in.idx" "$SELECT_DIR/in.json" 2>/dev/null | tail -1
+}
+if [ "$(select_edited swap '$.k10000')" = '10001' ] && [ "$(select_edited rename '$.q10000')" = '10000' ]; then
+    echo -e "  ${GREEN}PASS${NC} (--select rebuilds an index that disagrees with the input)"
+else
+    echo -e "  ${RED}FAIL${NC} (--select trusted a stale index)"
+fi
+rm -rf "$SELECT_DIR"
+
+echo -e "${BLUE}CLI TEST: AST snapshot round trip${NC}"
+AST_FILE=$(mktemp)
+DOC='{"n":[1,2,3],"r":[{"a":1,"b":"x"},{"a":2.5,"b":null}],"s":"q\"","f":[true,false],"e":{}}'
+CONVERTED=$(echo "$DOC" | $PROG --save-ast "$AST_FILE")
+RELOADED=$($PROG --load-ast "$AST_FILE")
+echo 'not a snapshot' > "$AST_FILE"
+$PROG --load-ast "$AST_FILE" > /dev/null 2>&1
+NOT_SNAPSHOT_EXIT=$?
+# 200000 nested one-element arrays around a null
+python3 -c "
+import struct, sys
+body = (b'\x02' + struct.pack('<Q', 1)) * 200000 + b'\x0a'
+sys.stdout.buffer.write(b'J2SAST01' + struct.pack('<Q', 16 + len(body)) + body)" > "$AST_FILE"
+$PROG --load-ast "$AST_FILE" > /dev/null 2>&1
+TOO_DEEP_EXIT=$?
+echo "$DOC" | $PROG --save-ast "$AST_FILE" > /dev/null
+SNAPSHOT_REJECTED=true
+for mode in tests/data/sample.json "--index $(mktemp -u)" "--save-ast $(mktemp -u)" --memoize \
+            "--select \$.n" --async-output; do
+    if $PROG --load-ast "$AST_FILE" $mode > /dev/null 2>&1; then
+        SNAPSHOT_REJECTED=false
+    fi
+done
+for mode in "--split-by-top-level $(mktemp -u)" --check --stats-only --to-json; do
+    if $PROG --save-ast "$(mktemp -u)" $mode tests/data/sample.json > /dev/null 2>&1; then
+        SNAPSHOT_REJECTED=false
+    fi
+done
+if [ -n "$CONVERTED" ] && [ "$CONVERTED" = "$RELOADED" ] && \
+   [ "$NOT_SNAPSHOT_EXIT" -eq 1 ] && [ "$TOO_DEEP_EXIT" -eq 1 ] && $SNAPSHOT_REJECTED; then
+    echo -e "  ${GREEN}PASS${NC} (--load-ast reproduces the conversion)"
+else
+    echo -e "  ${RED}FAIL${NC} (--load-ast output differs)"
+fi
+rm -f "$AST_FILE"
+
+echo -e "${BLUE}CLI TEST: Split by top-level entry${NC}"
+SPLIT_DIR=$(mktemp -d)
+if echo '[1,2,3,4,5]' | $PROG --split-by-top-level "$SPLIT_DIR" --chunk-size 2 --jobs 2 && \
+   [ "$(tr -d ' \n' < "$SPLIT_DIR/part-00002.lisp")" = ';;JSONtoS-expressionconversion(json:array5)' ] && \
+   grep -q '(json:shard "part-00001.lisp" (json:first 2) (json:count 2))' "$SPLIT_DIR/manifest.lisp"; then
+    echo -e "  ${GREEN}PASS${NC} (--split-by-top-level writes shards and manifest)"
+else
+    echo -e "  ${RED}FAIL${NC} (--split-by-top-level output wrong)"
+fi
+rm -rf "$SPLIT_DIR"
+
+echo -e "${BLUE}CLI TEST: Memoized rendering${NC}"
+MEMO_INPUT="{\"pad\":[$(seq -s, 1 300)],\"a\":[1,\"x\",null],\"b\":[1,\"x\",null],\"c\":[1,\"x\",null]}"
+if [ "$(echo "$MEMO_INPUT" | $PROG -p)" = "$(echo "$MEMO_INPUT" | $PROG -p --memoize 2> /dev/null)" ] && \
+   echo "$MEMO_INPUT" | $PROG -p --memoize 2>&1 > /dev/null | grep -q '3 lookups, 2 hits'; then
+    echo -e "  ${GREEN}PASS${NC} (--memoize output unchanged, repeats served from cache)"
+else
+    echo -e "  ${RED}FAIL${NC} (--memoize output or hit count wrong)"
+fi
+
+echo -e "${BLUE}CLI TEST: S-expression to JSON${NC}"
+REVERSED=$(printf '%s' '{"a b":[1,-2.5,true,null,"q\"\\\né"],"o":{}}' | $PROG --ascii-output | $PROG --to-json)
+if [ "$REVERSED" = '{"a b":[1,-2.5,true,null,"q\"\\\n\u00e9"],"o":{}}' ] && \
+   ! echo '(json:array (preview:elided 3))' | $PROG --to-json > /dev/null 2>&1 && \
+   [ "$(echo '{"elided":3}' | $PROG | $PROG --to-json)" = '{"elided":3}' ]; then
+    echo -e "  ${GREEN}PASS${NC} (--to-json restores the JSON document)"
+else
+    echo -e "  ${RED}FAIL${NC} (--to-json output wrong)"
+fi
+
+echo -e "${BLUE}CLI TEST: Round-trip verification${NC}"
+VERIFY_FILE=$(mktemp)
+VERIFY_REJECTED=true
+for mode in "--split-by-top-level $(mktemp -u)" --check --stats-only --to-json; do
+    if $PROG --verify -o "$VERIFY_FILE" $mode tests/data/sample.json > /dev/null 2>&1; then
+        VERIFY_REJECTED=false
+    fi
+done
+VERIFY_REPORT=$(echo '{"a 1":2,"b":[{"c nil":3}]}' | $PROG --verify -o "$VERIFY_FILE" 2>&1)
+if $PROG --verify -p -o "$VERIFY_FILE" tests/data/test.json 2>&1 | grep -q 'Verified: output matches' && \
+   ! echo '[1]' | $PROG --verify > /dev/null 2>&1 && \
+   echo "$VERIFY_REPORT" | grep -q 'cannot be verified: the key "a 1"' && \
+   ! echo "$VERIFY_REPORT" | grep -q 'Verification failed' && $VERIFY_REJECTED; then
+    echo -e "  ${GREEN}PASS${NC} (--verify checks the written output)"
+else
+    echo -e "  ${RED}FAIL${NC} (--verify did not check the output)"
+fi
+rm -f "$VERIFY_FILE"
+
+echo -e "${BLUE}CLI TEST: Asynchronous output${NC}"
+if [ "$($PROG -p tests/data/test.json)" = "$($PROG -p --async-output tests/data/test.json 2> /dev/null)" ] && \
+   $PROG --async-output tests/data/test.json 2>&1 > /dev/null | grep -q 'renderer blocked on I/O'; then
+    echo -e "  ${GREEN}PASS${NC} (--async-output writes the same output and reports I/O time)"
+else
+    echo -e "  ${RED}FAIL${NC} (--async-output output or report wrong)"
+fi
+
+echo -e "${BLUE}CLI TEST: Pipelined conversion${NC}"
+if [ "$($PROG -p tests/data/test.json)" = "$($PROG -p --pipeline tests/data/test.json)" ] && \
+   [ "$(echo '[]' | $PROG --pipeline)" = "$(echo '[]' | $PROG)" ] && \
+   ! echo '[1,2,]' | $PROG --pipeline > /dev/null 2>&1; then
+    echo -e "  ${GREEN}PASS${NC} (--pipeline writes the same output and rejects invalid input)"
+else
+    echo -e "  ${RED}FAIL${NC} (--pipeline output or error handling wrong)"
+fi
+
+echo -e "${BLUE}CLI TEST: Checkpoint and resume${NC}"
+CHECKPOINT_DIR=$(mktemp -d)
+seq 1 600000 | paste -sd, - | sed 's/^/[/; s/$/]/' > "$CHECKPOINT_DIR/good.json"
+sed 's/600000]$/60000x]/' "$CHECKPOINT_DIR/good.json" > "$CHECKPOINT_DIR/in.json"
+touch -r "$CHECKPOINT_DIR/good.json" "$CHECKPOINT_DIR/in.json"
+# The damaged run stops near the end; the repaired file keeps its size and time
+if ! $PROG --checkpoint --checkpoint-interval 0 -o "$CHECKPOINT_DIR/out.lisp" "$CHECKPOINT_DIR/in.json" 2> /dev/null && \
+   [ -f "$CHECKPOINT_DIR/out.lisp.checkpoint" ] && \
+   cp "$CHECKPOINT_DIR/good.json" "$CHECKPOINT_DIR/in.json" && \
+   touch -r "$CHECKPOINT_DIR/good.json" "$CHECKPOINT_DIR/in.json" && \
+   $PROG --resume -o "$CHECKPOINT_DIR/out.lisp" "$CHECKPOINT_DIR/in.json" 2> /dev/null && \
+   [ "$(cat "$CHECKPOINT_DIR/out.lisp")" = "$($PROG "$CHECKPOINT_DIR/good.json")" ] && \
+   [ ! -f "$CHECKPOINT_DIR/out.lisp.checkpoint" ]; then
+    echo -e "  ${GREEN}PASS${NC} (--resume continues from the checkpoint with identical output)"
+else
+    echo -e "  ${RED}FAIL${NC} (--resume did not reproduce the output)"
+fi
+rm -rf "$CHECKPOINT_DIR"
+
+echo -e "${BLUE}CLI TEST: Progress reporting${NC}"
+PROGRESS_ERR=$(mktemp)
+if [ "$($PROG tests/data/sample.json)" = "$($PROG --progress tests/data/sample.json 2> "$PROGRESS_ERR")" ] && \
+   grep -q '^;; Progress: finished' "$PROGRESS_ERR" && \
+   [ "$($PROG tests/data/test.json)" = "$($PROG --progress --pipeline tests/data/test.json 2> "$PROGRESS_ERR")" ] && \
+   grep -q '^;; Progress: finished' "$PROGRESS_ERR"; then
+    echo -e "  ${GREEN}PASS${NC} (--progress reports on stderr without changing the output)"
+else
+    echo -e "  ${RED}FAIL${NC} (--progress changed the output or printed no report)"
+fi
+rm -f "$PROGRESS_ERR"
+
+echo -e "${BLUE}CLI TEST: Conversion profile${NC}"
+PROFILE_DIR=$(mktemp -d)
+if [ "$($PROG tests/data/wikipedia_example.json)" = \
+     "$($PROG --profile "$PROFILE_DIR/profile.lisp" --profile-depth 2 tests/data/wikipedia_example.json 2> /dev/null)" ] && \
+   grep -q '(json:path "\$.items\[0\]")' "$PROFILE_DIR/profile.lisp" && \
+   grep -q '^\$;\$.items;\$.items\[0\];parse [0-9]*$' "$PROFILE_DIR/profile.lisp.folded" && \
+   [ "$($PROG --profile-depth -1 tests/data/sample.json 2>&1 | grep '^Error:')" = \
+     "Error: --profile-depth requires a non-negative number" ] && \
+   [ "$($PROG --profile-depth 0 tests/data/sample.json 2>&1 | grep '^Error:')" = \
+     "Error: --profile-depth must be at least 1" ]; then
+    echo -e "  ${GREEN}PASS${NC} (--profile reports per-path costs without changing the output)"
+else
+    echo -e "  ${RED}FAIL${NC} (--profile changed the output or missed a path)"
+fi
+rm -rf "$PROFILE_DIR"
+
+echo -e "${BLUE}CLI TEST: Metrics file${NC}"
+METRICS_DIR=$(mktemp -d)
+$PROG --metrics-file "$METRICS_DIR/run.prom" tests/data/sample.json > /dev/null
+$PROG --metrics-file "$METRICS_DIR/run.prom" "$METRICS_DIR/missing.json" > /dev/null 2>&1
+# Output piped onward and split into shards is counted as it is written
+$PROG --metrics-file "$METRICS_DIR/piped.prom" tests/data/sample.json | cat > /dev/null
+$PROG --metrics-file "$METRICS_DIR/piped.prom" --processes 2 tests/data/sample.json | cat > /dev/null
+$PROG --metrics-file "$METRICS_DIR/split.prom" --split-by-top-level "$METRICS_DIR/split" tests/data/sample.json
+PIPED_BYTES=$(($($PROG tests/data/sample.json | wc -c) * 2))
+SPLIT_BYTES=$(cat "$METRICS_DIR"/split/* | wc -c)
+if grep -q '^json_to_sexpr_runs_total{result="success"} 1$' "$METRICS_DIR/run.prom" && \
+   grep -q '^json_to_sexpr_runs_total{result="failure"} 1$' "$METRICS_DIR/run.prom" && \
+   grep -q '^json_to_sexpr_parse_duration_seconds_count 1$' "$METRICS_DIR/run.prom" && \
+   grep -q '^# TYPE json_to_sexpr_run_duration_seconds histogram$' "$METRICS_DIR/run.prom" && \
+   grep -q "^json_to_sexpr_output_bytes_total $PIPED_BYTES\$" "$METRICS_DIR/piped.prom" && \
+   grep -q "^json_to_sexpr_output_bytes_total $SPLIT_BYTES\$" "$METRICS_DIR/split.prom"; then
+    echo -e "  ${GREEN}PASS${NC} (--metrics-file accumulates runs in Prometheus text format)"
+else
+    echo -e "  ${RED}FAIL${NC} (--metrics-file did not record both runs)"
+fi
+rm -rf "$METRICS_DIR"
+
+echo -e "${BLUE}CLI TEST: Position of a bad byte after a value${NC}"
+if echo '[1,2,3x]' | $PROG 2>&1 >/dev/null | grep -q "Unexpected character 'x' at line 1, column 7" && \
+   printf '{"a":1,\n "b":2 #}' | $PROG 2>&1 >/dev/null | grep -q "Unexpected character '#' at line 2, column 8"; then
+    echo -e "  ${GREEN}PASS${NC} (separator errors report line and column)"
+else
+    echo -e "  ${RED}FAIL${NC} (separator errors lost their position)"
+fi
+
+echo -e "${BLUE}CLI TEST: Nesting limit in the validation pass${NC}"
+DEEP_FILE=$(mktemp)
+python3 -c "print('[' * 10000 + ']' * 10000)" > "$DEEP_FILE"
+DEEP_CHECK=$($PROG --check "$DEEP_FILE" > /dev/null 2>&1; echo $?)$($PROG "$DEEP_FILE" > /dev/null 2>&1; echo $?)
+python3 -c "print('[' * 10001 + ']' * 10001)" > "$DEEP_FILE"
+DEEP_CHECK=$DEEP_CHECK$($PROG --check "$DEEP_FILE" > /dev/null 2>&1; echo $?)$($PROG --stats-only "$DEEP_FILE" > /dev/null 2>&1; echo $?)$($PROG "$DEEP_FILE" > /dev/null 2>&1; echo $?)
+if [ "$DEEP_CHECK" = "00111" ]; then
+    echo -e "  ${GREEN}PASS${NC} (--check and conversion agree at the nesting limit)"
+else
+    echo -e "  ${RED}FAIL${NC} (--check and conversion disagree at the nesting limit: $DEEP_CHECK)"
+fi
+rm -f "$DEEP_FILE"
+
+echo -e "${BLUE}CLI TEST: Multi-process conversion${NC}"
+if [ "$($PROG tests/data/sample.json)" = "$($PROG --processes 3 tests/data/sample.json)" ] && \
+   [ "$($PROG tests/data/test.json)" = "$($PROG --processes 2 tests/data/test.json | cat)" ]; then
+    echo -e "  ${GREEN}PASS${NC} (--processes merges the shards into the same output)"
+else
+    echo -e "  ${RED}FAIL${NC} (--processes output differs)"
+fi
+
+echo -e "${BLUE}CLI TEST: Truncated and malformed input in parallel modes${NC}"
+PARALLEL_FILE=$(mktemp)
+PARALLEL_OK=true
+for doc in '[1,2,' '[true,false,' '{"a":1,' '[' '[1,2' '[1,]' '{"a":1, }' '[1,2,3x]' "$(printf '[1,\n 2x]')" \
+           '[1,2,3]x' "$(printf '[1]\n  @')" '[1]2' '[1]true' '[1] "abc' '[1]01' '{"a":1} }'; do
+    printf '%s' "$doc" > "$PARALLEL_FILE"
+    # Diagnostics and exit status always match; the output only on success,
+    # as --pipeline has already written the entries before a failure
+    EXPECTED="$($PROG "$PARALLEL_FILE" 2>&1 > /dev/null; echo "rc=$?")"
+    EXPECTED_OUTPUT="$($PROG "$PARALLEL_FILE" 2>/dev/null)"
+    for mode in --pipeline "--processes 2"; do
+        if [ "$($PROG $mode "$PARALLEL_FILE" 2>&1 > /dev/null; echo "rc=$?")" != "$EXPECTED" ] || \
+           { [ "${EXPECTED##*rc=}" = 0 ] && [ "$($PROG $mode "$PARALLEL_FILE" 2>/dev/null)" != "$EXPECTED_OUTPUT" ]; }; then
+            PARALLEL_OK=false
+        fi
+    done
+done
+if $PARALLEL_OK; then
+    echo -e "  ${GREEN}PASS${NC} (--pipeline and --processes accept and report what the sequential path does)"
+else
+    echo -e "  ${RED}FAIL${NC} (--pipeline or --processes disagrees with the sequential path)"
+fi
+rm -f "$PARALLEL_FILE"
+
 echo -e "${BLUE}CLI TEST: Invalid option${NC}"
 if $PROG --invalid-option > /dev/null 2>&1; then
     echo -e "  ${RED}FAIL${NC} (should reject invalid option)"
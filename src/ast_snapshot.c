@@ -0,0 +1,592 @@
+/**
+ * @file ast_snapshot.c
+ * @brief Binary AST snapshots that are written out without parsing
+ *
+ * A snapshot stores the parsed document as a preorder stream of tagged
+ * nodes with no pointers. Packed array data is 8-byte aligned in the file,
+ * so a mapped snapshot is rendered in place: scalars and packed arrays are
+ * handed to the regular writer as stack views into the mapping, and only
+ * containers are walked here. Columnar records are stored row by row.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "json_to_sexpr.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Snapshot file signature, including the format version */
+static const char snapshot_magic[8] = {'J', '2', 'S', 'A', 'S', 'T', '0', '1'};
+
+/* Key length marking a keyless member (a preview elision marker) */
+#define SNAPSHOT_NO_KEY UINT64_MAX
+
+/* Node tags */
+typedef enum {
+    SNAPSHOT_OBJECT = 1,
+    SNAPSHOT_ARRAY,
+    SNAPSHOT_TYPED_ARRAY,
+    SNAPSHOT_RECORDS,
+    SNAPSHOT_STRING,
+    SNAPSHOT_NUMBER,
+    SNAPSHOT_INTEGER,           // int64 item of a record column
+    SNAPSHOT_TRUE,
+    SNAPSHOT_FALSE,
+    SNAPSHOT_NULL,
+    SNAPSHOT_ELIDED
+} snapshot_tag_t;
+
+/* Snapshot being written */
+typedef struct {
+    FILE *output;
+    uint64_t offset;            // bytes written so far
+    bool failed;
+} snapshot_output_t;
+
+/* Mapped snapshot being rendered */
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    size_t pos;
+    size_t depth;               // containers open around the cursor
+} snapshot_input_t;
+
+/**
+ * @brief Appends raw bytes to a snapshot
+ * @param snapshot The snapshot being written
+ * @param data The bytes
+ * @param length Number of bytes
+ */
+static void json_snapshot_put(snapshot_output_t *snapshot, const void *data, size_t length) {
+    if (length > 0 && fwrite(data, 1, length, snapshot->output) != length) {
+        snapshot->failed = true;
+    }
+    snapshot->offset += length;
+}
+
+/**
+ * @brief Appends a node tag
+ * @param snapshot The snapshot being written
+ * @param tag The tag
+ */
+static void json_snapshot_put_tag(snapshot_output_t *snapshot, snapshot_tag_t tag) {
+    const unsigned char byte = (unsigned char)tag;
+    json_snapshot_put(snapshot, &byte, 1);
+}
+
+/**
+ * @brief Appends a 64-bit count or length
+ * @param snapshot The snapshot being written
+ * @param value The value
+ */
+static void json_snapshot_put_u64(snapshot_output_t *snapshot, uint64_t value) {
+    json_snapshot_put(snapshot, &value, sizeof(value));
+}
+
+/**
+ * @brief Appends a length-prefixed, NUL-terminated string
+ * @param snapshot The snapshot being written
+ * @param text The string
+ */
+static void json_snapshot_put_string(snapshot_output_t *snapshot, const char *text) {
+    const size_t length = strlen(text);
+    json_snapshot_put_u64(snapshot, length);
+    json_snapshot_put(snapshot, text, length + 1);
+}
+
+/**
+ * @brief Pads the snapshot to an 8-byte boundary
+ * @param snapshot The snapshot being written
+ */
+static void json_snapshot_align(snapshot_output_t *snapshot) {
+    static const unsigned char padding[8] = {0};
+    json_snapshot_put(snapshot, padding, (8 - snapshot->offset % 8) % 8);
+}
+
+static void json_snapshot_put_value(snapshot_output_t *snapshot, const json_value_t *value);
+
+/**
+ * @brief Appends one element of a packed array or record column as a node
+ * @param snapshot The snapshot being written
+ * @param typed_array The array holding the element
+ * @param index Element position
+ */
+static void json_snapshot_put_typed_item(snapshot_output_t *snapshot,
+                                         const json_typed_array_t *typed_array, size_t index) {
+    switch (typed_array->kind) {
+        case TYPED_ARRAY_INT64:
+            json_snapshot_put_tag(snapshot, SNAPSHOT_INTEGER);
+            json_snapshot_put(snapshot, &typed_array->items.integers[index], sizeof(int64_t));
+            break;
+        case TYPED_ARRAY_DOUBLE:
+            json_snapshot_put_tag(snapshot, SNAPSHOT_NUMBER);
+            json_snapshot_put(snapshot, &typed_array->items.doubles[index], sizeof(double));
+            break;
+        case TYPED_ARRAY_BOOLEAN:
+            json_snapshot_put_tag(snapshot, json_typed_array_get_boolean(typed_array, index) ?
+                                  SNAPSHOT_TRUE : SNAPSHOT_FALSE);
+            break;
+        case TYPED_ARRAY_VALUE:
+            json_snapshot_put_value(snapshot, typed_array->items.values[index]);
+            break;
+    }
+}
+
+/**
+ * @brief Appends a value and everything below it
+ * @param snapshot The snapshot being written
+ * @param value The value
+ */
+static void json_snapshot_put_value(snapshot_output_t *snapshot, const json_value_t *value) {
+    if (value == NULL) {
+        json_snapshot_put_tag(snapshot, SNAPSHOT_NULL);
+        return;
+    }
+
+    switch (value->type) {
+        case JSON_OBJECT: {
+            uint64_t count = 0;
+            for (const json_member_t *member = value->data.object; member; member = member->next) {
+                count++;
+            }
+            json_snapshot_put_tag(snapshot, SNAPSHOT_OBJECT);
+            json_snapshot_put_u64(snapshot, count);
+            for (const json_member_t *member = value->data.object; member; member = member->next) {
+                if (member->key) {
+                    json_snapshot_put_string(snapshot, member->key);
+                } else {
+                    json_snapshot_put_u64(snapshot, SNAPSHOT_NO_KEY);
+                }
+                json_snapshot_put_value(snapshot, member->value);
+            }
+            break;
+        }
+
+        case JSON_ARRAY: {
+            uint64_t count = 0;
+            for (const json_element_t *element = value->data.array; element; element = element->next) {
+                count++;
+            }
+            json_snapshot_put_tag(snapshot, SNAPSHOT_ARRAY);
+            json_snapshot_put_u64(snapshot, count);
+            for (const json_element_t *element = value->data.array; element; element = element->next) {
+                json_snapshot_put_value(snapshot, element->value);
+            }
+            break;
+        }
+
+        case JSON_TYPED_ARRAY: {
+            const json_typed_array_t *typed_array = value->data.typed_array;
+            const unsigned char kind = (unsigned char)typed_array->kind;
+            json_snapshot_put_tag(snapshot, SNAPSHOT_TYPED_ARRAY);
+            json_snapshot_put(snapshot, &kind, 1);
+            json_snapshot_put_u64(snapshot, typed_array->count);
+            json_snapshot_align(snapshot);
+            if (typed_array->kind == TYPED_ARRAY_BOOLEAN) {
+                json_snapshot_put(snapshot, typed_array->items.bits, (typed_array->count + 7) / 8);
+            } else {
+                json_snapshot_put(snapshot, typed_array->items.integers, typed_array->count * 8);
+            }
+            break;
+        }
+
+        case JSON_RECORD_ARRAY: {
+            const json_record_array_t *record_array = value->data.record_array;
+            json_snapshot_put_tag(snapshot, SNAPSHOT_RECORDS);
+            json_snapshot_put_u64(snapshot, record_array->key_count);
+            for (size_t key_index = 0; key_index < record_array->key_count; key_index++) {
+                json_snapshot_put_string(snapshot, record_array->keys[key_index]);
+            }
+            json_snapshot_put_u64(snapshot, record_array->record_count);
+            for (size_t record_index = 0; record_index < record_array->record_count; record_index++) {
+                for (size_t key_index = 0; key_index < record_array->key_count; key_index++) {
+                    json_snapshot_put_typed_item(snapshot, record_array->columns[key_index], record_index);
+                }
+            }
+            break;
+        }
+
+        case JSON_STRING:
+            json_snapshot_put_tag(snapshot, SNAPSHOT_STRING);
+            json_snapshot_put_string(snapshot, value->data.string);
+            break;
+
+        case JSON_NUMBER:
+            json_snapshot_put_tag(snapshot, SNAPSHOT_NUMBER);
+            json_snapshot_put(snapshot, &value->data.number, sizeof(double));
+            break;
+
+        case JSON_BOOLEAN:
+            json_snapshot_put_tag(snapshot, value->data.boolean ? SNAPSHOT_TRUE : SNAPSHOT_FALSE);
+            break;
+
+        case JSON_ELIDED:
+            json_snapshot_put_tag(snapshot, SNAPSHOT_ELIDED);
+            json_snapshot_put_u64(snapshot, value->data.elided_count);
+            break;
+
+        default:
+            json_snapshot_put_tag(snapshot, SNAPSHOT_NULL);
+            break;
+    }
+}
+
+/**
+ * @brief Writes a document to a snapshot file
+ * @param value The parsed document
+ * @param filename The snapshot file
+ * @return true on success
+ */
+bool json_snapshot_save(const json_value_t *value, const char *filename) {
+    snapshot_output_t snapshot = {NULL, 0, false};
+    snapshot.output = fopen(filename, "wb");
+    if (!snapshot.output) {
+        perror("Error opening AST snapshot file");
+        return false;
+    }
+
+    // The header is rewritten with the final size once the nodes are out
+    json_snapshot_put(&snapshot, snapshot_magic, sizeof(snapshot_magic));
+    json_snapshot_put_u64(&snapshot, 0);
+    json_snapshot_put_value(&snapshot, value);
+
+    const uint64_t size = snapshot.offset;
+    if (fseek(snapshot.output, (long)sizeof(snapshot_magic), SEEK_SET) != 0 ||
+        fwrite(&size, sizeof(size), 1, snapshot.output) != 1) {
+        snapshot.failed = true;
+    }
+    if (fclose(snapshot.output) != 0 || snapshot.failed) {
+        fprintf(stderr, "Error: Failed to write AST snapshot\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads a node tag
+ * @param snapshot The mapped snapshot
+ * @param tag Receives the tag
+ * @return false if the snapshot ends early
+ */
+static bool json_snapshot_get_tag(snapshot_input_t *snapshot, snapshot_tag_t *tag) {
+    if (snapshot->pos >= snapshot->size) {
+        return false;
+    }
+    *tag = (snapshot_tag_t)snapshot->data[snapshot->pos++];
+    return true;
+}
+
+/**
+ * @brief Reads 8 bytes (a count, length, int64 or double)
+ * @param snapshot The mapped snapshot
+ * @param value Receives the bytes
+ * @return false if the snapshot ends early
+ */
+static bool json_snapshot_get_8(snapshot_input_t *snapshot, void *value) {
+    if (snapshot->size - snapshot->pos < 8) {
+        return false;
+    }
+    memcpy(value, snapshot->data + snapshot->pos, 8);
+    snapshot->pos += 8;
+    return true;
+}
+
+/**
+ * @brief Reads a length-prefixed string in place
+ * @param snapshot The mapped snapshot
+ * @param text Receives a pointer into the mapping, or NULL for no key
+ * @return false if the snapshot is damaged
+ */
+static bool json_snapshot_get_string(snapshot_input_t *snapshot, const char **text) {
+    uint64_t length;
+    if (!json_snapshot_get_8(snapshot, &length)) {
+        return false;
+    }
+    if (length == SNAPSHOT_NO_KEY) {
+        *text = NULL;
+        return true;
+    }
+    if (length >= snapshot->size - snapshot->pos || snapshot->data[snapshot->pos + length] != '\0') {
+        return false;
+    }
+    *text = (const char *)snapshot->data + snapshot->pos;
+    snapshot->pos += length + 1;
+    return true;
+}
+
+static bool json_snapshot_write_node(snapshot_input_t *snapshot, sexpr_writer_t *writer,
+                                     int indentation_level);
+
+/**
+ * @brief Renders the node at the cursor, recursing into its children
+ * @param snapshot The mapped snapshot
+ * @param writer The writer holding the output stream and options
+ * @param indentation_level Current indentation depth
+ * @return false if the snapshot is damaged
+ */
+static bool json_snapshot_write_node_contents(snapshot_input_t *snapshot, sexpr_writer_t *writer,
+                                              int indentation_level) {
+    FILE *output = writer->output;
+    snapshot_tag_t tag;
+    uint64_t count;
+    json_value_t scalar;
+    scalar.flags = 0;
+
+    if (!json_snapshot_get_tag(snapshot, &tag)) {
+        return false;
+    }
+
+    switch (tag) {
+        case SNAPSHOT_OBJECT:
+            if (!json_snapshot_get_8(snapshot, &count)) {
+                return false;
+            }
+            if (count == 0) {
+                fprintf(output, "(json:object)");
+                return true;
+            }
+            fprintf(output, "(json:object\n");
+            output_formatter_write_indentation(output, indentation_level + 1);
+            for (uint64_t index = 0; index < count; index++) {
+                const char *key;
+                if (index > 0) {
+                    fprintf(output, "\n");
+                    output_formatter_write_indentation(output, indentation_level + 1);
+                }
+                if (!json_snapshot_get_string(snapshot, &key)) {
+                    return false;
+                }
+                if (key == NULL) {
+                    if (!json_snapshot_write_node(snapshot, writer, indentation_level + 1)) {
+                        return false;
+                    }
+                    continue;
+                }
+                fprintf(output, "(json:%s ", key);
+                if (!json_snapshot_write_node(snapshot, writer, indentation_level + 2)) {
+                    return false;
+                }
+                fprintf(output, ")");
+            }
+            fprintf(output, ")");
+            return true;
+
+        case SNAPSHOT_ARRAY:
+            if (!json_snapshot_get_8(snapshot, &count)) {
+                return false;
+            }
+            if (count == 0) {
+                fprintf(output, "(json:array)");
+                return true;
+            }
+            fprintf(output, "(json:array\n");
+            output_formatter_write_indentation(output, indentation_level + 1);
+            for (uint64_t index = 0; index < count; index++) {
+                if (index > 0) {
+                    fprintf(output, "\n");
+                    output_formatter_write_indentation(output, indentation_level + 1);
+                }
+                if (!json_snapshot_write_node(snapshot, writer, indentation_level + 1)) {
+                    return false;
+                }
+            }
+            fprintf(output, ")");
+            return true;
+
+        case SNAPSHOT_TYPED_ARRAY: {
+            if (snapshot->pos >= snapshot->size) {
+                return false;
+            }
+            json_typed_array_t view;
+            view.kind = (typed_array_kind_t)snapshot->data[snapshot->pos++];
+            if ((view.kind != TYPED_ARRAY_INT64 && view.kind != TYPED_ARRAY_DOUBLE &&
+                 view.kind != TYPED_ARRAY_BOOLEAN) || !json_snapshot_get_8(snapshot, &count)) {
+                return false;
+            }
+            snapshot->pos += (8 - snapshot->pos % 8) % 8;
+            const uint64_t bytes = view.kind == TYPED_ARRAY_BOOLEAN ? (count + 7) / 8 : count * 8;
+            if (snapshot->pos > snapshot->size || count > snapshot->size ||
+                bytes > snapshot->size - snapshot->pos) {
+                return false;
+            }
+            // The packed data is used where it lies in the mapping
+            view.count = (size_t)count;
+            view.capacity = (size_t)count;
+            view.items.bits = (unsigned char *)(uintptr_t)(snapshot->data + snapshot->pos);
+            snapshot->pos += bytes;
+            scalar.type = JSON_TYPED_ARRAY;
+            scalar.data.typed_array = &view;
+            sexpr_writer_write_value(&scalar, writer, indentation_level);
+            return true;
+        }
+
+        case SNAPSHOT_RECORDS: {
+            uint64_t key_count;
+            uint64_t record_count;
+            if (!json_snapshot_get_8(snapshot, &key_count) || key_count > snapshot->size) {
+                return false;
+            }
+            const char **keys = malloc((key_count ? key_count : 1) * sizeof(char *));
+            if (!keys) {
+                fprintf(stderr, "Error: Out of memory\n");
+                return false;
+            }
+            bool intact = true;
+            for (uint64_t key_index = 0; intact && key_index < key_count; key_index++) {
+                intact = json_snapshot_get_string(snapshot, &keys[key_index]) && keys[key_index] != NULL;
+            }
+            intact = intact && json_snapshot_get_8(snapshot, &record_count);
+            // Each record is an object nested in the array
+            intact = intact && (record_count == 0 || snapshot->depth < MAX_NESTING_DEPTH);
+            snapshot->depth++;
+
+            if (intact) {
+                fprintf(output, "(json:array\n");
+                output_formatter_write_indentation(output, indentation_level + 1);
+            }
+            for (uint64_t record_index = 0; intact && record_index < record_count; record_index++) {
+                if (record_index > 0) {
+                    fprintf(output, "\n");
+                    output_formatter_write_indentation(output, indentation_level + 1);
+                }
+                fprintf(output, "(json:object\n");
+                for (uint64_t key_index = 0; intact && key_index < key_count; key_index++) {
+                    if (key_index > 0) {
+                        fprintf(output, "\n");
+                    }
+                    output_formatter_write_indentation(output, indentation_level + 2);
+                    fprintf(output, "(json:%s ", keys[key_index]);
+                    intact = json_snapshot_write_node(snapshot, writer, indentation_level + 3);
+                    fprintf(output, ")");
+                }
+                fprintf(output, ")");
+            }
+            if (intact) {
+                fprintf(output, ")");
+            }
+            snapshot->depth--;
+            free(keys);
+            return intact;
+        }
+
+        case SNAPSHOT_STRING:
+            if (!json_snapshot_get_string(snapshot, (const char **)&scalar.data.string) ||
+                scalar.data.string == NULL) {
+                return false;
+            }
+            scalar.type = JSON_STRING;
+            break;
+
+        case SNAPSHOT_NUMBER:
+            if (!json_snapshot_get_8(snapshot, &scalar.data.number)) {
+                return false;
+            }
+            scalar.type = JSON_NUMBER;
+            break;
+
+        case SNAPSHOT_INTEGER: {
+            int64_t integer_value;
+            char number_text[MAX_NUMBER_TEXT];
+            if (!json_snapshot_get_8(snapshot, &integer_value)) {
+                return false;
+            }
+            fwrite(number_text, 1, output_formatter_format_integer(integer_value, number_text), output);
+            return true;
+        }
+
+        case SNAPSHOT_TRUE:
+        case SNAPSHOT_FALSE:
+            scalar.type = JSON_BOOLEAN;
+            scalar.data.boolean = tag == SNAPSHOT_TRUE;
+            break;
+
+        case SNAPSHOT_NULL:
+            scalar.type = JSON_NULL;
+            break;
+
+        case SNAPSHOT_ELIDED:
+            if (!json_snapshot_get_8(snapshot, &count)) {
+                return false;
+            }
+            scalar.type = JSON_ELIDED;
+            scalar.data.elided_count = (size_t)count;
+            break;
+
+        default:
+            return false;
+    }
+
+    sexpr_writer_write_value(&scalar, writer, indentation_level);
+    return true;
+}
+
+/**
+ * @brief Renders the node at the cursor
+ *
+ * The parser never nests containers deeper than MAX_NESTING_DEPTH, counting
+ * them as it does, so a deeper chain can only come from a damaged file; it
+ * is rejected before the recursion can exhaust the stack.
+ *
+ * @param snapshot The mapped snapshot
+ * @param writer The writer holding the output stream and options
+ * @param indentation_level Current indentation depth
+ * @return false if the snapshot is damaged
+ */
+static bool json_snapshot_write_node(snapshot_input_t *snapshot, sexpr_writer_t *writer,
+                                     int indentation_level) {
+    const snapshot_tag_t tag = snapshot->pos < snapshot->size ? (snapshot_tag_t)snapshot->data[snapshot->pos]
+                                                              : SNAPSHOT_NULL;
+    const size_t container = tag == SNAPSHOT_OBJECT || tag == SNAPSHOT_ARRAY ||
+                             tag == SNAPSHOT_TYPED_ARRAY || tag == SNAPSHOT_RECORDS;
+    if (snapshot->depth + container > MAX_NESTING_DEPTH) {
+        return false;
+    }
+    snapshot->depth += container;
+    const bool intact = json_snapshot_write_node_contents(snapshot, writer, indentation_level);
+    snapshot->depth -= container;
+    return intact;
+}
+
+/**
+ * @brief Maps a snapshot file and writes its document as S-expressions
+ * @param filename The snapshot file
+ * @param writer The writer holding the output stream and options
+ * @return true on success
+ */
+bool json_snapshot_write(const char *filename, sexpr_writer_t *writer) {
+    const int descriptor = open(filename, O_RDONLY);
+    if (descriptor < 0) {
+        perror("Error opening AST snapshot file");
+        return false;
+    }
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || (size_t)status.st_size < sizeof(snapshot_magic) + 8) {
+        fprintf(stderr, "Error: %s is not an AST snapshot\n", filename);
+        close(descriptor);
+        return false;
+    }
+    const size_t size = (size_t)status.st_size;
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (mapping == MAP_FAILED) {
+        perror("Error mapping AST snapshot file");
+        return false;
+    }
+
+    snapshot_input_t snapshot = {mapping, size, sizeof(snapshot_magic), 0};
+    uint64_t recorded_size;
+    bool success = memcmp(mapping, snapshot_magic, sizeof(snapshot_magic)) == 0 &&
+                   json_snapshot_get_8(&snapshot, &recorded_size) && recorded_size == size;
+    if (!success) {
+        fprintf(stderr, "Error: %s is not an AST snapshot\n", filename);
+    } else if (!json_snapshot_write_node(&snapshot, writer, 0) || snapshot.pos != size) {
+        fprintf(stderr, "Error: AST snapshot %s is damaged\n", filename);
+        success = false;
+    }
+
+    munmap(mapping, size);
+    return success;
+}
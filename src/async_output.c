@@ -0,0 +1,308 @@
+/**
+ * @file async_output.c
+ * @brief Output stream whose writes happen on a dedicated I/O thread
+ *
+ * The renderer writes to an ordinary FILE; its stdio buffer drains into a
+ * bounded ring of large blocks. A full block is handed to the I/O thread,
+ * which issues the write system calls while the renderer fills the next
+ * one, so a slow device only stalls rendering once every block is queued.
+ * Time the renderer spends waiting for a free block and time the I/O
+ * thread spends in write() are both recorded.
+ *
+ * The stream is built with fopencookie; where that is not available the
+ * descriptor is wrapped with fdopen and written synchronously.
+ */
+
+#define _GNU_SOURCE
+
+#include "json_to_sexpr.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Number of blocks in the ring */
+#define ASYNC_OUTPUT_BLOCKS 4
+
+/* Size of each block */
+#define ASYNC_OUTPUT_BLOCK_SIZE (1024 * 1024)
+
+/* Ring of blocks shared by the renderer and the I/O thread */
+struct async_output {
+    int descriptor;
+    FILE *stream;
+    bool threaded;              // false when writing synchronously
+    char *blocks;               // ASYNC_OUTPUT_BLOCKS blocks in one allocation
+    size_t lengths[ASYNC_OUTPUT_BLOCKS];
+    size_t filled;              // blocks handed to the I/O thread so far
+    size_t written;             // blocks the I/O thread has finished
+    bool closing;
+    bool failed;                // a write failed; later output is dropped
+    uint64_t bytes;             // bytes accepted from the renderer (atomic: read by ftell)
+    double blocked_seconds;     // renderer waiting for a free block
+    double write_seconds;       // I/O thread inside write()
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     // signalled whenever filled or written moves
+};
+
+#ifdef __GLIBC__
+
+/**
+ * @brief Reads the monotonic clock
+ * @return Seconds since an arbitrary fixed point
+ */
+static double async_output_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Writes a whole buffer to a descriptor
+ * @param descriptor The destination
+ * @param data The bytes
+ * @param length Number of bytes
+ * @return true if every byte was written
+ */
+static bool async_output_write_all(int descriptor, const char *data, size_t length) {
+    while (length > 0) {
+        const ssize_t count = write(descriptor, data, length);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += count;
+        length -= (size_t)count;
+    }
+    return true;
+}
+
+/**
+ * @brief I/O thread: writes queued blocks in order until closed
+ * @param argument The async_output_t
+ * @return NULL
+ */
+static void *async_output_worker(void *argument) {
+    async_output_t *async = argument;
+
+    pthread_mutex_lock(&async->lock);
+    while (true) {
+        while (async->written == async->filled && !async->closing) {
+            pthread_cond_wait(&async->changed, &async->lock);
+        }
+        if (async->written == async->filled) {
+            break;
+        }
+        const size_t index = async->written % ASYNC_OUTPUT_BLOCKS;
+        const bool failed = async->failed;
+        pthread_mutex_unlock(&async->lock);
+
+        bool success = true;
+        if (!failed) {
+            const double start = async_output_now();
+            success = async_output_write_all(async->descriptor,
+                                             async->blocks + index * ASYNC_OUTPUT_BLOCK_SIZE,
+                                             async->lengths[index]);
+            async->write_seconds += async_output_now() - start;
+        }
+
+        pthread_mutex_lock(&async->lock);
+        if (!success) {
+            async->failed = true;
+        }
+        async->written++;
+        pthread_cond_signal(&async->changed);
+    }
+    pthread_mutex_unlock(&async->lock);
+    return NULL;
+}
+
+/**
+ * @brief Hands the block being filled to the I/O thread and waits for a
+ *        free one
+ * @param async The output
+ */
+static void async_output_submit(async_output_t *async) {
+    pthread_mutex_lock(&async->lock);
+    async->filled++;
+    pthread_cond_signal(&async->changed);
+    if (async->filled - async->written == ASYNC_OUTPUT_BLOCKS) {
+        const double start = async_output_now();
+        while (async->filled - async->written == ASYNC_OUTPUT_BLOCKS) {
+            pthread_cond_wait(&async->changed, &async->lock);
+        }
+        async->blocked_seconds += async_output_now() - start;
+    }
+    async->lengths[async->filled % ASYNC_OUTPUT_BLOCKS] = 0;
+    pthread_mutex_unlock(&async->lock);
+}
+
+/**
+ * @brief Stream write callback: copies stdio's buffer into the ring
+ * @param cookie The async_output_t
+ * @param data The bytes
+ * @param size Number of bytes
+ * @return size, or 0 once a write has failed
+ */
+static ssize_t async_output_cookie_write(void *cookie, const char *data, size_t size) {
+    async_output_t *async = cookie;
+    size_t remaining = size;
+
+    while (remaining > 0) {
+        const size_t index = async->filled % ASYNC_OUTPUT_BLOCKS;
+        size_t *length = &async->lengths[index];
+        size_t count = ASYNC_OUTPUT_BLOCK_SIZE - *length;
+        if (count > remaining) {
+            count = remaining;
+        }
+        memcpy(async->blocks + index * ASYNC_OUTPUT_BLOCK_SIZE + *length, data, count);
+        *length += count;
+        data += count;
+        remaining -= count;
+        if (*length == ASYNC_OUTPUT_BLOCK_SIZE) {
+            async_output_submit(async);
+        }
+    }
+
+    __atomic_add_fetch(&async->bytes, size, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&async->lock);
+    const bool failed = async->failed;
+    pthread_mutex_unlock(&async->lock);
+    return failed ? 0 : (ssize_t)size;
+}
+
+/**
+ * @brief Stream seek callback: reports the position for ftell only
+ * @param cookie The async_output_t
+ * @param offset Requested offset (only 0 relative to SEEK_CUR is allowed)
+ * @param whence Seek origin
+ * @return 0, or -1 for any real seek
+ */
+static int async_output_cookie_seek(void *cookie, off64_t *offset, int whence) {
+    async_output_t *async = cookie;
+    if (whence != SEEK_CUR || *offset != 0) {
+        errno = ESPIPE;
+        return -1;
+    }
+    *offset = (off64_t)__atomic_load_n(&async->bytes, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/**
+ * @brief Stream close callback: queues the last block and stops the thread
+ * @param cookie The async_output_t
+ * @return 0 if every block was written, -1 otherwise
+ */
+static int async_output_cookie_close(void *cookie) {
+    async_output_t *async = cookie;
+    pthread_mutex_lock(&async->lock);
+    if (async->lengths[async->filled % ASYNC_OUTPUT_BLOCKS] > 0) {
+        async->filled++;
+    }
+    async->closing = true;
+    pthread_cond_signal(&async->changed);
+    pthread_mutex_unlock(&async->lock);
+
+    pthread_join(async->thread, NULL);
+    return async->failed ? -1 : 0;
+}
+
+#endif
+
+/**
+ * @brief Opens a stream that writes to a file from an I/O thread
+ * @param filename The output file, or NULL for standard output
+ * @param stream Receives the stream to render into
+ * @return The output, or NULL on failure
+ */
+async_output_t *async_output_open(const char *filename, FILE **stream) {
+    async_output_t *async = calloc(1, sizeof(async_output_t));
+    if (!async) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return NULL;
+    }
+    fflush(stdout);
+    async->descriptor = filename ? open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666) : STDOUT_FILENO;
+    if (async->descriptor < 0) {
+        perror("Error opening output file");
+        free(async);
+        return NULL;
+    }
+
+#ifdef __GLIBC__
+    async->blocks = malloc((size_t)ASYNC_OUTPUT_BLOCKS * ASYNC_OUTPUT_BLOCK_SIZE);
+    if (async->blocks && pthread_mutex_init(&async->lock, NULL) == 0) {
+        if (pthread_cond_init(&async->changed, NULL) == 0) {
+            if (pthread_create(&async->thread, NULL, async_output_worker, async) == 0) {
+                const cookie_io_functions_t functions = {
+                    NULL, async_output_cookie_write, async_output_cookie_seek, async_output_cookie_close
+                };
+                async->stream = fopencookie(async, "w", functions);
+                if (async->stream) {
+                    async->threaded = true;
+                    *stream = async->stream;
+                    return async;
+                }
+                pthread_mutex_lock(&async->lock);
+                async->closing = true;
+                pthread_cond_signal(&async->changed);
+                pthread_mutex_unlock(&async->lock);
+                pthread_join(async->thread, NULL);
+            }
+            pthread_cond_destroy(&async->changed);
+        }
+        pthread_mutex_destroy(&async->lock);
+    }
+    free(async->blocks);
+    async->blocks = NULL;
+#endif
+
+    // Fall back to ordinary synchronous writes
+    async->stream = fdopen(dup(async->descriptor), "w");
+    if (!async->stream) {
+        perror("Error opening output stream");
+        if (async->descriptor != STDOUT_FILENO) {
+            close(async->descriptor);
+        }
+        free(async);
+        return NULL;
+    }
+    *stream = async->stream;
+    return async;
+}
+
+/**
+ * @brief Flushes and closes the stream, waits for every block to be
+ *        written, closes the file and reports how long output was blocked
+ * @param async The output
+ * @param report Stream receiving the report, or NULL for none
+ * @return true if all output was written
+ */
+bool async_output_close(async_output_t *async, FILE *report) {
+    const bool success = fclose(async->stream) == 0 && !async->failed;
+
+    if (report && async->threaded) {
+        fprintf(report, ";; Asynchronous output: %lu blocks, %lu bytes, writer thread busy %.3f s, "
+                "renderer blocked on I/O %.3f s\n",
+                (unsigned long)async->written, (unsigned long)async->bytes,
+                async->write_seconds, async->blocked_seconds);
+    } else if (report) {
+        fprintf(report, ";; Asynchronous output unavailable; output was written synchronously\n");
+    }
+
+    if (async->descriptor != STDOUT_FILENO) {
+        close(async->descriptor);
+    }
+    if (async->threaded) {
+        pthread_cond_destroy(&async->changed);
+        pthread_mutex_destroy(&async->lock);
+    }
+    free(async->blocks);
+    free(async);
+    return success;
+}
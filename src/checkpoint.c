@@ -0,0 +1,220 @@
+/**
+ * @file checkpoint.c
+ * @brief Checkpoint files for resuming an interrupted streaming conversion
+ *
+ * A checkpoint records a top-level entry boundary: the input offset where
+ * the next entry starts, the output length written up to it, the stack of
+ * open containers and the input position used for warnings. It is tied to
+ * its input by size and modification time, and to both files by a hash of
+ * the bytes just before each offset, so a resumed run only continues an
+ * output that still ends where the checkpoint says.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "json_to_sexpr.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Bytes hashed before each offset to tie the checkpoint to its files */
+#define CHECKPOINT_SAMPLE_BYTES 4096
+
+/* Checkpoint file signature, including the format version */
+static const char checkpoint_magic[8] = {'J', '2', 'S', 'C', 'K', 'P', 'T', '1'};
+
+/* Checkpoint file contents */
+typedef struct {
+    char magic[8];
+    uint64_t input_size;
+    int64_t input_mtime;
+    uint64_t input_hash;        // bytes before input_offset
+    uint64_t output_hash;       // bytes before output_offset
+    uint64_t input_offset;
+    uint64_t output_offset;
+    uint64_t line;
+    uint64_t column;
+    uint32_t unicode_mode;
+    uint32_t depth;
+    char stack[JSON_CHECKPOINT_MAX_DEPTH];
+} checkpoint_header_t;
+
+/**
+ * @brief Hashes the bytes of a file just before an offset
+ * @param filename The file
+ * @param offset End of the hashed range
+ * @param hash Receives the hash
+ * @return true on success
+ */
+static bool json_checkpoint_hash_file(const char *filename, uint64_t offset, uint64_t *hash) {
+    char sample[CHECKPOINT_SAMPLE_BYTES];
+    const size_t size = offset < sizeof(sample) ? (size_t)offset : sizeof(sample);
+    const int descriptor = open(filename, O_RDONLY);
+    if (descriptor < 0) {
+        return false;
+    }
+    const ssize_t count = pread(descriptor, sample, size, (off_t)(offset - size));
+    close(descriptor);
+    if (count < 0 || (size_t)count != size) {
+        return false;
+    }
+
+    *hash = 0xcbf29ce484222325ULL ^ offset;
+    for (size_t position = 0; position < size; position++) {
+        *hash ^= (unsigned char)sample[position];
+        *hash *= 0x100000001b3ULL;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads the size and modification time of the input file
+ * @param input_filename The input file
+ * @param size Receives the size
+ * @param mtime Receives the modification time
+ * @return true on success
+ */
+static bool json_checkpoint_input_status(const char *input_filename, uint64_t *size, int64_t *mtime) {
+    struct stat status;
+    if (stat(input_filename, &status) != 0) {
+        return false;
+    }
+    *size = (uint64_t)status.st_size;
+    *mtime = (int64_t)status.st_mtime;
+    return true;
+}
+
+/**
+ * @brief Records a checkpoint
+ *
+ * The output must have been flushed up to checkpoint->output_offset. The
+ * file is written under a temporary name and renamed into place, so an
+ * interruption never leaves a partly written checkpoint.
+ *
+ * @param checkpoint The position to record
+ * @param checkpoint_filename The checkpoint file
+ * @param input_filename The input file
+ * @param output_filename The output file
+ * @return true on success
+ */
+bool json_checkpoint_save(const json_checkpoint_t *checkpoint, const char *checkpoint_filename,
+                          const char *input_filename, const char *output_filename) {
+    checkpoint_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, checkpoint_magic, sizeof(checkpoint_magic));
+    header.input_offset = checkpoint->input_offset;
+    header.output_offset = checkpoint->output_offset;
+    header.line = checkpoint->line;
+    header.column = checkpoint->column;
+    header.unicode_mode = (uint32_t)checkpoint->unicode_mode;
+    header.depth = checkpoint->depth;
+    memcpy(header.stack, checkpoint->stack, sizeof(header.stack));
+    if (!json_checkpoint_input_status(input_filename, &header.input_size, &header.input_mtime) ||
+        !json_checkpoint_hash_file(input_filename, header.input_offset, &header.input_hash) ||
+        !json_checkpoint_hash_file(output_filename, header.output_offset, &header.output_hash)) {
+        fprintf(stderr, "Error: Failed to read back the checkpointed input or output\n");
+        return false;
+    }
+
+    const size_t name_length = strlen(checkpoint_filename);
+    char *temporary_name = malloc(name_length + 5);
+    if (!temporary_name) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return false;
+    }
+    memcpy(temporary_name, checkpoint_filename, name_length);
+    memcpy(temporary_name + name_length, ".tmp", 5);
+
+    FILE *output = fopen(temporary_name, "wb");
+    if (!output) {
+        perror("Error opening checkpoint file");
+        free(temporary_name);
+        return false;
+    }
+    bool success = fwrite(&header, sizeof(header), 1, output) == 1;
+    success = fclose(output) == 0 && success;
+    if (success && rename(temporary_name, checkpoint_filename) != 0) {
+        success = false;
+    }
+    if (!success) {
+        fprintf(stderr, "Error: Failed to write checkpoint file\n");
+        remove(temporary_name);
+    }
+    free(temporary_name);
+    return success;
+}
+
+/**
+ * @brief Reads a checkpoint and checks that it still matches its files
+ * @param checkpoint Receives the recorded position
+ * @param checkpoint_filename The checkpoint file
+ * @param input_filename The input file
+ * @param output_filename The output file
+ * @return true if the checkpoint can be resumed from
+ */
+bool json_checkpoint_load(json_checkpoint_t *checkpoint, const char *checkpoint_filename,
+                          const char *input_filename, const char *output_filename) {
+    checkpoint_header_t header;
+    FILE *input = fopen(checkpoint_filename, "rb");
+    if (!input) {
+        perror("Error opening checkpoint file");
+        return false;
+    }
+    const bool read = fread(&header, sizeof(header), 1, input) == 1;
+    fclose(input);
+    if (!read || memcmp(header.magic, checkpoint_magic, sizeof(checkpoint_magic)) != 0 ||
+        header.depth == 0 || header.depth > JSON_CHECKPOINT_MAX_DEPTH) {
+        fprintf(stderr, "Error: %s is not a checkpoint file\n", checkpoint_filename);
+        return false;
+    }
+
+    uint64_t size;
+    int64_t mtime;
+    uint64_t input_hash;
+    uint64_t output_hash;
+    if (!json_checkpoint_input_status(input_filename, &size, &mtime) || size != header.input_size ||
+        mtime != header.input_mtime || header.input_offset > size ||
+        !json_checkpoint_hash_file(input_filename, header.input_offset, &input_hash) ||
+        input_hash != header.input_hash) {
+        fprintf(stderr, "Error: The input has changed since the checkpoint was written\n");
+        return false;
+    }
+    if (!json_checkpoint_hash_file(output_filename, header.output_offset, &output_hash) ||
+        output_hash != header.output_hash) {
+        fprintf(stderr, "Error: The output no longer matches the checkpoint\n");
+        return false;
+    }
+
+    checkpoint->input_offset = header.input_offset;
+    checkpoint->output_offset = header.output_offset;
+    checkpoint->line = header.line;
+    checkpoint->column = header.column;
+    checkpoint->unicode_mode = (sexpr_unicode_mode_t)header.unicode_mode;
+    checkpoint->depth = header.depth;
+    memcpy(checkpoint->stack, header.stack, sizeof(checkpoint->stack));
+    return true;
+}
+
+/**
+ * @brief Positions the input and output of a resumed run at a checkpoint
+ *
+ * The output is truncated to the checkpoint's length, discarding whatever
+ * the interrupted run wrote after it; it is then reopened for appending.
+ *
+ * @param checkpoint The checkpoint to resume from
+ * @param input The input stream, seeked to the next entry
+ * @param output_filename The output file to truncate
+ * @return true on success
+ */
+bool json_checkpoint_seek(const json_checkpoint_t *checkpoint, FILE *input, const char *output_filename) {
+    if (fseeko(input, (off_t)checkpoint->input_offset, SEEK_SET) != 0) {
+        perror("Error seeking input file");
+        return false;
+    }
+    if (truncate(output_filename, (off_t)checkpoint->output_offset) != 0) {
+        perror("Error truncating output file");
+        return false;
+    }
+    return true;
+}
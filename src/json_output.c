@@ -0,0 +1,266 @@
+/**
+ * @file json_output.c
+ * @brief Buffered JSON text writer
+ *
+ * Writes compact JSON through a fixed buffer that is handed to the stream
+ * in large blocks. Commas are placed by the writer: every value, key and
+ * container opening is preceded by one unless it is the first entry at its
+ * level. With a digest attached, the same calls feed per-subtree hashes
+ * instead of producing text.
+ */
+
+#include "json_to_sexpr.h"
+
+/* Bytes that must be escaped inside a JSON string */
+static const unsigned char json_writer_special[256] = {
+    [0x00] = 1, [0x01] = 1, [0x02] = 1, [0x03] = 1, [0x04] = 1, [0x05] = 1, [0x06] = 1, [0x07] = 1,
+    [0x08] = 1, [0x09] = 1, [0x0A] = 1, [0x0B] = 1, [0x0C] = 1, [0x0D] = 1, [0x0E] = 1, [0x0F] = 1,
+    [0x10] = 1, [0x11] = 1, [0x12] = 1, [0x13] = 1, [0x14] = 1, [0x15] = 1, [0x16] = 1, [0x17] = 1,
+    [0x18] = 1, [0x19] = 1, [0x1A] = 1, [0x1B] = 1, [0x1C] = 1, [0x1D] = 1, [0x1E] = 1, [0x1F] = 1,
+    ['"'] = 1, ['\\'] = 1
+};
+
+/**
+ * @brief Prepares a writer for an output stream
+ * @param writer The writer to initialize
+ * @param output The file stream to write to
+ */
+void json_writer_initialize(json_writer_t *writer, FILE *output) {
+    writer->output = output;
+    writer->digest = NULL;
+    writer->need_comma = false;
+    writer->used = 0;
+}
+
+/**
+ * @brief Hands the buffered text to the stream
+ * @param writer The writer
+ * @return true if every write so far succeeded
+ */
+bool json_writer_flush(json_writer_t *writer) {
+    if (writer->output == NULL) {
+        return true;
+    }
+    if (writer->used > 0) {
+        fwrite(writer->buffer, 1, writer->used, writer->output);
+        writer->used = 0;
+    }
+    return fflush(writer->output) == 0 && !ferror(writer->output);
+}
+
+/**
+ * @brief Appends text exactly as given
+ * @param writer The writer
+ * @param text The text to append
+ * @param length Length of the text
+ */
+void json_writer_write_raw(json_writer_t *writer, const char *text, size_t length) {
+    if (writer->digest) {
+        return;
+    }
+    if (writer->used + length > JSON_WRITER_BUFFER_SIZE) {
+        fwrite(writer->buffer, 1, writer->used, writer->output);
+        writer->used = 0;
+        if (length > JSON_WRITER_BUFFER_SIZE) {
+            fwrite(text, 1, length, writer->output);
+            return;
+        }
+    }
+    memcpy(writer->buffer + writer->used, text, length);
+    writer->used += length;
+}
+
+/**
+ * @brief Appends string contents, escaping quotes, backslashes and
+ *        control characters
+ * @param writer The writer
+ * @param text The raw bytes
+ * @param length Number of bytes
+ */
+void json_writer_write_string_bytes(json_writer_t *writer, const char *text, size_t length) {
+    static const char hex_digits[] = "0123456789abcdef";
+    size_t run_start = 0;
+    if (writer->digest) {
+        json_digest_string_bytes(writer->digest, text, length);
+        return;
+    }
+
+    for (size_t position = 0; position < length; position++) {
+        const unsigned char c = (unsigned char)text[position];
+        if (!json_writer_special[c]) {
+            continue;
+        }
+        json_writer_write_raw(writer, text + run_start, position - run_start);
+        run_start = position + 1;
+
+        char escape[6] = {'\\', (char)c, 0, 0, 0, 0};
+        size_t escape_length = 2;
+        switch (c) {
+            case '"':
+            case '\\':
+                break;
+            case '\n':
+                escape[1] = 'n';
+                break;
+            case '\r':
+                escape[1] = 'r';
+                break;
+            case '\t':
+                escape[1] = 't';
+                break;
+            default:
+                escape[1] = 'u';
+                escape[2] = '0';
+                escape[3] = '0';
+                escape[4] = hex_digits[c >> 4];
+                escape[5] = hex_digits[c & 0x0F];
+                escape_length = 6;
+                break;
+        }
+        json_writer_write_raw(writer, escape, escape_length);
+    }
+    json_writer_write_raw(writer, text + run_start, length - run_start);
+}
+
+/**
+ * @brief Writes the comma that separates a new entry from the previous one
+ * @param writer The writer
+ */
+static void json_writer_separate(json_writer_t *writer) {
+    if (writer->need_comma) {
+        json_writer_write_raw(writer, ",", 1);
+    }
+}
+
+/**
+ * @brief Opens an object or array
+ * @param writer The writer
+ * @param bracket '{' or '['
+ */
+void json_writer_begin_container(json_writer_t *writer, char bracket) {
+    if (writer->digest) {
+        json_digest_begin_container(writer->digest, bracket);
+        return;
+    }
+    json_writer_separate(writer);
+    json_writer_write_raw(writer, &bracket, 1);
+    writer->need_comma = false;
+}
+
+/**
+ * @brief Closes an object or array
+ * @param writer The writer
+ * @param bracket '}' or ']'
+ */
+void json_writer_end_container(json_writer_t *writer, char bracket) {
+    if (writer->digest) {
+        json_digest_end_container(writer->digest, bracket);
+        return;
+    }
+    json_writer_write_raw(writer, &bracket, 1);
+    writer->need_comma = true;
+}
+
+/**
+ * @brief Opens a string value; contents follow as string bytes or escapes
+ * @param writer The writer
+ */
+void json_writer_begin_string(json_writer_t *writer) {
+    if (writer->digest) {
+        json_digest_begin_string(writer->digest);
+        return;
+    }
+    json_writer_separate(writer);
+    json_writer_write_raw(writer, "\"", 1);
+}
+
+/**
+ * @brief Closes a string value
+ * @param writer The writer
+ */
+void json_writer_end_string(json_writer_t *writer) {
+    if (writer->digest) {
+        json_digest_end_string(writer->digest);
+        return;
+    }
+    json_writer_write_raw(writer, "\"", 1);
+    writer->need_comma = true;
+}
+
+/**
+ * @brief Writes an object key and its colon
+ * @param writer The writer
+ * @param key The raw key bytes
+ * @param length Length of the key
+ */
+void json_writer_write_key(json_writer_t *writer, const char *key, size_t length) {
+    if (writer->digest) {
+        json_digest_key(writer->digest, key, length);
+        return;
+    }
+    json_writer_separate(writer);
+    json_writer_write_raw(writer, "\"", 1);
+    json_writer_write_string_bytes(writer, key, length);
+    json_writer_write_raw(writer, "\":", 2);
+    writer->need_comma = false;
+}
+
+/**
+ * @brief Writes a number or keyword value exactly as given
+ * @param writer The writer
+ * @param text The value text
+ * @param length Length of the text
+ */
+void json_writer_write_literal(json_writer_t *writer, const char *text, size_t length) {
+    if (writer->digest) {
+        json_digest_literal(writer->digest, text, length);
+        return;
+    }
+    json_writer_separate(writer);
+    json_writer_write_raw(writer, text, length);
+    writer->need_comma = true;
+}
+
+/**
+ * @brief Writes a code point inside a string as a \u escape (a surrogate
+ *        pair above the Basic Multilingual Plane)
+ * @param writer The writer
+ * @param code_point The code point
+ */
+void json_writer_write_code_point(json_writer_t *writer, uint32_t code_point) {
+    char text[13];
+    int length;
+    if (writer->digest) {
+        // Digests see the UTF-8 bytes the parsed document holds
+        if (code_point < 0x80) {
+            text[0] = (char)code_point;
+            length = 1;
+        } else if (code_point < 0x800) {
+            text[0] = (char)(0xC0 | (code_point >> 6));
+            text[1] = (char)(0x80 | (code_point & 0x3F));
+            length = 2;
+        } else if (code_point < 0x10000) {
+            text[0] = (char)(0xE0 | (code_point >> 12));
+            text[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+            text[2] = (char)(0x80 | (code_point & 0x3F));
+            length = 3;
+        } else {
+            text[0] = (char)(0xF0 | (code_point >> 18));
+            text[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+            text[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+            text[3] = (char)(0x80 | (code_point & 0x3F));
+            length = 4;
+        }
+        json_digest_string_bytes(writer->digest, text, (size_t)length);
+        return;
+    }
+
+    if (code_point > 0xFFFF) {
+        code_point -= 0x10000;
+        length = snprintf(text, sizeof(text), "\\u%04x\\u%04x",
+                          (unsigned)(0xD800 + (code_point >> 10)), (unsigned)(0xDC00 + (code_point & 0x3FF)));
+    } else {
+        length = snprintf(text, sizeof(text), "\\u%04x", (unsigned)code_point);
+    }
+    json_writer_write_raw(writer, text, (size_t)length);
+}
@@ -1,5 +1,33 @@
 #include "json_to_sexpr.h"
 
+/* Container depth shown by --preview unless --preview-depth is given */
+#define PREVIEW_DEFAULT_DEPTH 4
+
+/* Array elements per shard unless --chunk-size is given */
+#define SPLIT_DEFAULT_CHUNK_SIZE 1000
+
+/* Path depth profiled by --profile unless --profile-depth is given */
+#define PROFILE_DEFAULT_DEPTH 1
+
+/* Input bytes between checkpoints unless --checkpoint-interval is given */
+#define CHECKPOINT_DEFAULT_INTERVAL (64 * 1024 * 1024)
+
+/* Parse a non-negative count option value */
+static bool parse_count_option(const char *option, const char *text, size_t *count) {
+    char *end;
+    if (text == NULL || *text == '\0' || *text == '-') {
+        fprintf(stderr, "Error: %s requires a non-negative number\n", option);
+        return false;
+    }
+    unsigned long value = strtoul(text, &end, 10);
+    if (*end != '\0') {
+        fprintf(stderr, "Error: %s requires a non-negative number\n", option);
+        return false;
+    }
+    *count = (size_t)value;
+    return true;
+}
+
 /* Print usage information */
 void print_usage(const char *program_name) {
     fprintf(stderr, "Usage: %s [OPTIONS] [INPUT_FILE]\n", program_name);
@@ -7,6 +35,49 @@ void print_usage(const char *program_name) {
     fprintf(stderr, "  -h, --help     Show this help message\n");
     fprintf(stderr, "  -o OUTPUT      Write output to file (default: stdout)\n");
     fprintf(stderr, "  -p, --pretty   Enable pretty printing with indentation\n");
+    fprintf(stderr, "  --no-utf8-check  Skip UTF-8 validation of trusted input\n");
+    fprintf(stderr, "  --in-place     Unescape strings inside the input buffer (no string copies)\n");
+    fprintf(stderr, "  --ascii-output Write non-ASCII characters in strings as \\uHHHH/\\UHHHHHH escapes\n");
+    fprintf(stderr, "  --check        Only validate the input; exit status reports the result\n");
+    fprintf(stderr, "  --stats-only   Report document statistics instead of converting\n");
+    fprintf(stderr, "  --preview K    Show only the first K entries of every array and object\n");
+    fprintf(stderr, "  --preview-depth D  Elide containers nested deeper than D (default: %d)\n",
+            PREVIEW_DEFAULT_DEPTH);
+    fprintf(stderr, "  --to-json      Read converter output (S-expressions) and write it back as JSON\n");
+    fprintf(stderr, "  --verify       Re-read the written output (-o FILE) and check that it matches\n");
+    fprintf(stderr, "                 the parsed input\n");
+    fprintf(stderr, "  --async-output Write output from a separate I/O thread and report the time\n");
+    fprintf(stderr, "                 rendering was blocked on I/O\n");
+    fprintf(stderr, "  --pipeline     Read, index and convert on separate threads, streaming the\n");
+    fprintf(stderr, "                 input in blocks instead of loading it whole\n");
+    fprintf(stderr, "  --checkpoint   With --pipeline and -o FILE, record the position in\n");
+    fprintf(stderr, "                 FILE.checkpoint every so often so the run can be resumed\n");
+    fprintf(stderr, "  --checkpoint-interval N  Input bytes between checkpoints (default: %d)\n",
+            CHECKPOINT_DEFAULT_INTERVAL);
+    fprintf(stderr, "  --resume       Continue an interrupted --checkpoint run from FILE.checkpoint\n");
+    fprintf(stderr, "  --processes N  Convert byte ranges of the top-level object or array in N\n");
+    fprintf(stderr, "                 forked worker processes (0: one per CPU) and merge the shards\n");
+    fprintf(stderr, "  --progress     Report bytes converted, throughput, output size and the\n");
+    fprintf(stderr, "                 estimated time left on stderr every second\n");
+    fprintf(stderr, "  --profile FILE Time parsing and rendering of each top-level entry; write a\n");
+    fprintf(stderr, "                 sorted report to FILE and folded stacks to FILE.folded\n");
+    fprintf(stderr, "  --profile-depth N  Attribute costs to paths up to depth N (default: %d)\n",
+            PROFILE_DEFAULT_DEPTH);
+    fprintf(stderr, "  --metrics-file FILE  Add this run's counters and latency and memory\n");
+    fprintf(stderr, "                 histograms to FILE in Prometheus text format\n");
+    fprintf(stderr, "  --memoize      Reuse the rendered text of repeated subtrees and report the\n");
+    fprintf(stderr, "                 cache hit rate on stderr\n");
+    fprintf(stderr, "  --index FILE   Write the output offset of each top-level entry to FILE\n");
+    fprintf(stderr, "  --select PATH  Convert only the value at PATH ($.key, $[\"key\"], $[index])\n");
+    fprintf(stderr, "  --structure-index FILE  Reuse (or create) a structural index of the input\n");
+    fprintf(stderr, "                 in FILE so --select can jump to the subtree\n");
+    fprintf(stderr, "  --save-ast FILE  Also save the parsed document as a binary snapshot\n");
+    fprintf(stderr, "  --load-ast FILE  Convert a saved snapshot instead of parsing JSON input\n");
+    fprintf(stderr, "  --split-by-top-level DIR  Write each top-level member or array chunk to its\n");
+    fprintf(stderr, "                 own file in DIR, plus DIR/manifest.lisp\n");
+    fprintf(stderr, "  --chunk-size N Array elements per shard when splitting (default: %d)\n",
+            SPLIT_DEFAULT_CHUNK_SIZE);
+    fprintf(stderr, "  --jobs N       Worker threads when splitting (default: one per CPU)\n");
     fprintf(stderr, "\nIf INPUT_FILE is not provided, reads from stdin.\n");
     fprintf(stderr, "\nExamples:\n");
     fprintf(stderr, "  %s input.json\n", program_name);
@@ -14,6 +85,117 @@ void print_usage(const char *program_name) {
     fprintf(stderr, "  cat input.json | %s -p\n", program_name);
 }
 
+/* Count the top-level entries written for a document (progress total) */
+static size_t count_top_level_entries(const json_value_t *value) {
+    size_t count = 0;
+    switch (value->type) {
+        case JSON_OBJECT:
+            for (const json_member_t *member = value->data.object; member; member = member->next) {
+                count++;
+            }
+            break;
+        case JSON_ARRAY:
+            for (const json_element_t *element = value->data.array; element; element = element->next) {
+                count++;
+            }
+            break;
+        case JSON_TYPED_ARRAY:
+            count = value->data.typed_array->count;
+            break;
+        case JSON_RECORD_ARRAY:
+            count = value->data.record_array->record_count;
+            break;
+        default:
+            break;
+    }
+    return count;
+}
+
+/* Check the whole input and, when structure_filename is given, build and save
+ * its structural index into *structure (setting *indexed) */
+static bool index_input(const char *json_string, size_t length, const char *input_filename,
+                        const char *structure_filename, bool validate_utf8,
+                        json_structure_t *structure, bool *indexed) {
+    // Raw subtree lookups rely on the whole document being well-formed
+    size_t invalid_offset;
+    if (validate_utf8 && !utf8_validate(json_string, length, &invalid_offset)) {
+        fprintf(stderr, "Error: Invalid UTF-8 sequence at byte offset %lu\n",
+                (unsigned long)invalid_offset);
+        return false;
+    }
+    json_check_result_t check;
+    if (!json_validator_check(json_string, length, &check)) {
+        fprintf(stderr, "Error: %s at line %d, column %d (byte offset %lu)\n",
+                check.message, check.line, check.column, (unsigned long)check.error_offset);
+        return false;
+    }
+    if (structure_filename) {
+        if (!json_structure_build(structure, json_string, length)) {
+            return false;
+        }
+        *indexed = true;
+        if (!json_structure_save(structure, structure_filename, input_filename,
+                                 json_string, length)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Narrow the input to the subtree at select_path (if any), using and
+ * maintaining the structural index in structure_filename (if any) */
+static bool select_subtree(char **json_string, const char *input_filename, const char *select_path,
+                           const char *structure_filename, bool validate_utf8) {
+    const size_t length = strlen(*json_string);
+    json_structure_t structure;
+    bool indexed = false;
+    bool loaded = false;
+    
+    if (structure_filename) {
+        if (!input_filename) {
+            fprintf(stderr, "Error: --structure-index requires an input file\n");
+            return false;
+        }
+        indexed = loaded = json_structure_load(&structure, structure_filename, input_filename,
+                                               *json_string, length);
+    }
+    
+    bool success = loaded || index_input(*json_string, length, input_filename, structure_filename,
+                                         validate_utf8, &structure, &indexed);
+    if (success && select_path) {
+        size_t start;
+        size_t end;
+        bool stale;
+        success = json_structure_locate(indexed ? &structure : NULL, *json_string, length,
+                                        select_path, &start, &end, &stale);
+        if (stale) {
+            // The saved index no longer describes this input: rebuild it and look again
+            json_structure_release(&structure);
+            indexed = false;
+            success = index_input(*json_string, length, input_filename, structure_filename,
+                                  validate_utf8, &structure, &indexed) &&
+                      json_structure_locate(&structure, *json_string, length,
+                                            select_path, &start, &end, &stale) && !stale;
+        }
+        char *subtree = success ? malloc(end - start + 1) : NULL;
+        if (success && !subtree) {
+            fprintf(stderr, "Error: Out of memory\n");
+            success = false;
+        }
+        if (success) {
+            memcpy(subtree, *json_string + start, end - start);
+            subtree[end - start] = '\0';
+            free(*json_string);
+            *json_string = subtree;
+        }
+    }
+    
+    if (indexed) {
+        json_structure_release(&structure);
+    }
+    return success;
+}
+
 /* Read entire file into string */
 char *read_file_to_string(const char *filename) {
     FILE *file = fopen(filename, "r");
@@ -79,10 +261,36 @@ char *read_stdin_to_string(void) {
     return buffer;
 }
 
-int main(int argc, char *argv[]) {
+/* Run the converter with the given arguments, recording metrics */
+static int run_converter(int argc, char *argv[], json_metrics_t *metrics) {
     const char *input_filename = NULL;
     const char *output_filename = NULL;
+    const char *index_filename = NULL;
+    const char *select_path = NULL;
+    const char *structure_filename = NULL;
+    const char *save_ast_filename = NULL;
+    const char *load_ast_filename = NULL;
     bool pretty_print = false;
+    bool validate_utf8 = true;
+    bool in_place = false;
+    sexpr_unicode_mode_t unicode_mode = SEXPR_UNICODE_RAW;
+    bool check_only = false;
+    bool stats_only = false;
+    bool memoize = false;
+    bool to_json = false;
+    bool verify = false;
+    bool async = false;
+    bool pipeline = false;
+    bool multiprocess = false;
+    bool checkpoint = false;
+    bool resume = false;
+    bool progress = false;
+    bool preview = false;
+    json_preview_limits_t preview_limits = {0, PREVIEW_DEFAULT_DEPTH};
+    json_split_options_t split_options = {NULL, SPLIT_DEFAULT_CHUNK_SIZE, 0, SEXPR_UNICODE_RAW};
+    json_process_options_t process_options = {NULL, 0, true, SEXPR_UNICODE_RAW};
+    json_profile_options_t profile_options = {NULL, PROFILE_DEFAULT_DEPTH};
+    json_pipeline_options_t pipeline_options = {true, NULL, NULL, NULL, CHECKPOINT_DEFAULT_INTERVAL, NULL, NULL};
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -91,6 +299,146 @@ int main(int argc, char *argv[]) {
             return 0;
         } else if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--pretty") == 0) {
             pretty_print = true;
+        } else if (strcmp(argv[i], "--no-utf8-check") == 0) {
+            validate_utf8 = false;
+        } else if (strcmp(argv[i], "--in-place") == 0) {
+            in_place = true;
+        } else if (strcmp(argv[i], "--ascii-output") == 0) {
+            unicode_mode = SEXPR_UNICODE_ESCAPE;
+        } else if (strcmp(argv[i], "--check") == 0) {
+            check_only = true;
+        } else if (strcmp(argv[i], "--stats-only") == 0) {
+            stats_only = true;
+        } else if (strcmp(argv[i], "--to-json") == 0) {
+            to_json = true;
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verify = true;
+        } else if (strcmp(argv[i], "--async-output") == 0) {
+            async = true;
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            pipeline = true;
+        } else if (strcmp(argv[i], "--checkpoint") == 0) {
+            checkpoint = true;
+        } else if (strcmp(argv[i], "--checkpoint-interval") == 0) {
+            if (!parse_count_option(argv[i], i + 1 < argc ? argv[i + 1] : NULL,
+                                    &pipeline_options.checkpoint_interval)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--resume") == 0) {
+            resume = true;
+        } else if (strcmp(argv[i], "--processes") == 0) {
+            if (!parse_count_option(argv[i], i + 1 < argc ? argv[i + 1] : NULL,
+                                    &process_options.processes)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            multiprocess = true;
+            i++;
+        } else if (strcmp(argv[i], "--progress") == 0) {
+            progress = true;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --profile requires a report filename\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+            profile_options.report_filename = argv[++i];
+        } else if (strcmp(argv[i], "--profile-depth") == 0) {
+            if (!parse_count_option(argv[i], i + 1 < argc ? argv[i + 1] : NULL,
+                                    &profile_options.max_depth)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            if (profile_options.max_depth == 0) {
+                fprintf(stderr, "Error: --profile-depth must be at least 1\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--metrics-file") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --metrics-file requires a filename\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+            metrics->filename = argv[++i];
+        } else if (strcmp(argv[i], "--memoize") == 0) {
+            memoize = true;
+        } else if (strcmp(argv[i], "--preview") == 0) {
+            if (!parse_count_option(argv[i], i + 1 < argc ? argv[i + 1] : NULL,
+                                    &preview_limits.max_entries)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            preview = true;
+            i++;
+        } else if (strcmp(argv[i], "--preview-depth") == 0) {
+            if (!parse_count_option(argv[i], i + 1 < argc ? argv[i + 1] : NULL,
+                                    &preview_limits.max_depth)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--index") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --index requires an index filename\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+            index_filename = argv[++i];
+        } else if (strcmp(argv[i], "--select") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --select requires a path\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+            select_path = argv[++i];
+        } else if (strcmp(argv[i], "--structure-index") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --structure-index requires an index filename\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+            structure_filename = argv[++i];
+        } else if (strcmp(argv[i], "--save-ast") == 0 || strcmp(argv[i], "--load-ast") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: %s requires a snapshot filename\n", argv[i]);
+                print_usage(argv[0]);
+                return 1;
+            }
+            if (argv[i][2] == 's') {
+                save_ast_filename = argv[++i];
+            } else {
+                load_ast_filename = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--split-by-top-level") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --split-by-top-level requires an output directory\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+            split_options.directory = argv[++i];
+        } else if (strcmp(argv[i], "--chunk-size") == 0) {
+            if (!parse_count_option(argv[i], i + 1 < argc ? argv[i + 1] : NULL,
+                                    &split_options.chunk_size)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            if (split_options.chunk_size == 0) {
+                fprintf(stderr, "Error: --chunk-size must be at least 1\n");
+                print_usage(argv[0]);
+                return 1;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--jobs") == 0) {
+            if (!parse_count_option(argv[i], i + 1 < argc ? argv[i + 1] : NULL,
+                                    &split_options.workers)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            i++;
         } else if (strcmp(argv[i], "-o") == 0) {
             if (i + 1 >= argc) {
                 fprintf(stderr, "Error: -o requires an output filename\n");
@@ -112,6 +460,240 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    metrics->input_filename = input_filename;
+    metrics->output_filename = output_filename;
+    metrics->converts = !check_only && !stats_only;
+    // The offset index reads entry offsets back from a stdout written to a file
+    if (metrics->filename && !json_metrics_start_output(metrics, index_filename && !output_filename)) {
+        return 1;
+    }
+    
+    // Only a full conversion written to a file can be read back and compared
+    if (verify && (!output_filename || preview || load_ast_filename || split_options.directory ||
+                   check_only || stats_only || to_json)) {
+        fprintf(stderr, "Error: --verify needs -o FILE and cannot check --preview, --load-ast, "
+                "--split-by-top-level, --check, --stats-only or --to-json output\n");
+        return 1;
+    }
+    
+    // Checkpoints are taken at the pipeline's chunk boundaries
+    if (checkpoint || resume) {
+        if (!input_filename || !output_filename || async) {
+            fprintf(stderr, "Error: --checkpoint and --resume need an input file and -o FILE, "
+                    "and cannot be combined with --async-output\n");
+            return 1;
+        }
+        pipeline = true;
+    }
+    
+    // Only the normal parse into a tree unescapes in place
+    if (in_place && (pipeline || multiprocess || split_options.directory || profile_options.report_filename ||
+                     load_ast_filename || to_json || check_only || stats_only)) {
+        fprintf(stderr, "Error: --in-place cannot be combined with --pipeline, --processes, "
+                "--split-by-top-level, --profile, --load-ast, --to-json, --check or --stats-only\n");
+        return 1;
+    }
+    
+    // A snapshot is rendered as it was saved; nothing is read, parsed or indexed
+    if (load_ast_filename && (input_filename || index_filename || save_ast_filename || memoize || select_path ||
+                              structure_filename || preview || async)) {
+        fprintf(stderr, "Error: --load-ast cannot be combined with an input file, --index, --save-ast, "
+                "--memoize, --select, --structure-index, --preview or --async-output\n");
+        return 1;
+    }
+    
+    // The offset index and the memo cache only exist for the single rendered document
+    if ((index_filename || memoize) && (split_options.directory || to_json || check_only || stats_only)) {
+        fprintf(stderr, "Error: --index and --memoize cannot be combined with --split-by-top-level, "
+                "--to-json, --check or --stats-only\n");
+        return 1;
+    }
+    
+    if (save_ast_filename && (split_options.directory || check_only || stats_only || to_json)) {
+        fprintf(stderr, "Error: --save-ast cannot be combined with --split-by-top-level, --check, "
+                "--stats-only or --to-json, which build no tree to save\n");
+        return 1;
+    }
+    
+    if (pipeline && (preview || select_path || structure_filename || index_filename || save_ast_filename ||
+                     load_ast_filename || split_options.directory || memoize || verify || to_json ||
+                     check_only || stats_only)) {
+        fprintf(stderr, "Error: --pipeline only supports plain conversion (with --async-output, "
+                "--ascii-output or --no-utf8-check)\n");
+        return 1;
+    }
+    
+    if (profile_options.report_filename &&
+        (pipeline || multiprocess || progress || preview || index_filename || save_ast_filename ||
+         load_ast_filename || split_options.directory || memoize || verify || to_json || check_only ||
+         stats_only)) {
+        fprintf(stderr, "Error: --profile only supports plain conversion (with --select, "
+                "--async-output, --ascii-output or --no-utf8-check)\n");
+        return 1;
+    }
+    
+    if (progress && (multiprocess || load_ast_filename || split_options.directory || to_json ||
+                     check_only || stats_only)) {
+        fprintf(stderr, "Error: --progress is only available when converting JSON in this process "
+                "(with or without --pipeline)\n");
+        return 1;
+    }
+    
+    if (multiprocess && (pipeline || async || preview || select_path || structure_filename || index_filename ||
+                         save_ast_filename || load_ast_filename || split_options.directory || memoize ||
+                         verify || to_json || check_only || stats_only)) {
+        fprintf(stderr, "Error: --processes only supports plain conversion (with --ascii-output "
+                "or --no-utf8-check)\n");
+        return 1;
+    }
+    
+    // Convert byte ranges of the input in forked worker processes
+    if (multiprocess) {
+        process_options.output_filename = output_filename;
+        process_options.validate_utf8 = validate_utf8;
+        process_options.unicode_mode = unicode_mode;
+        return json_process_convert(input_filename, &process_options) ? 0 : 1;
+    }
+    
+    // Stream the input through the read, index and convert threads
+    if (pipeline) {
+        FILE *input = input_filename ? fopen(input_filename, "rb") : stdin;
+        if (!input) {
+            perror("Error opening input file");
+            return 1;
+        }
+        
+        // Continue an interrupted run after its last recorded entry
+        char *checkpoint_filename = NULL;
+        json_checkpoint_t resume_point;
+        if (checkpoint || resume) {
+            const size_t name_length = strlen(output_filename);
+            checkpoint_filename = malloc(name_length + sizeof(".checkpoint"));
+            if (!checkpoint_filename) {
+                fprintf(stderr, "Error: Out of memory\n");
+                fclose(input);
+                return 1;
+            }
+            memcpy(checkpoint_filename, output_filename, name_length);
+            memcpy(checkpoint_filename + name_length, ".checkpoint", sizeof(".checkpoint"));
+            pipeline_options.input_filename = input_filename;
+            pipeline_options.output_filename = output_filename;
+            pipeline_options.checkpoint_filename = checkpoint_filename;
+            
+            FILE *existing = fopen(checkpoint_filename, "rb");
+            if (existing) {
+                fclose(existing);
+            }
+            if (resume && existing) {
+                bool resumable = json_checkpoint_load(&resume_point, checkpoint_filename,
+                                                      input_filename, output_filename);
+                if (resumable && (resume_point.unicode_mode != unicode_mode || resume_point.depth != 1)) {
+                    fprintf(stderr, "Error: The checkpoint was written with different output options\n");
+                    resumable = false;
+                }
+                if (!resumable || !json_checkpoint_seek(&resume_point, input, output_filename)) {
+                    free(checkpoint_filename);
+                    fclose(input);
+                    return 1;
+                }
+                pipeline_options.resume = &resume_point;
+                metrics->output_resumed_at = resume_point.output_offset;
+                fprintf(stderr, ";; Resuming from checkpoint at input byte %lu, output byte %lu\n",
+                        (unsigned long)resume_point.input_offset, (unsigned long)resume_point.output_offset);
+            } else if (resume) {
+                fprintf(stderr, ";; No checkpoint found; converting from the beginning\n");
+            } else if (existing) {
+                // A checkpoint from an earlier run does not describe this output
+                remove(checkpoint_filename);
+            }
+        }
+        
+        FILE *output = stdout;
+        async_output_t *async_output = NULL;
+        if (async) {
+            async_output = async_output_open(output_filename, &output);
+        } else if (output_filename) {
+            output = fopen(output_filename, pipeline_options.resume ? "a" : "w");
+            if (!output) {
+                perror("Error opening output file");
+            }
+        }
+        if (!output || (async && !async_output)) {
+            free(checkpoint_filename);
+            if (input != stdin) {
+                fclose(input);
+            }
+            return 1;
+        }
+        
+        if (!pipeline_options.resume) {
+            fprintf(output, ";; JSON to S-expression conversion\n\n");
+        }
+        if (progress) {
+            // The input size is unknown when streaming from a pipe
+            uint64_t input_size = 0;
+            if (input_filename && fseek(input, 0, SEEK_END) == 0) {
+                const long end = ftell(input);
+                input_size = end > 0 ? (uint64_t)end : 0;
+            }
+            const uint64_t start = pipeline_options.resume ? pipeline_options.resume->input_offset : 0;
+            if (input_filename && fseek(input, (long)start, SEEK_SET) != 0) {
+                input_size = 0;
+            }
+            pipeline_options.progress = json_progress_start(stderr);
+            if (pipeline_options.progress) {
+                json_progress_phase(pipeline_options.progress, "converting", "bytes", start, input_size, output);
+            }
+        }
+        sexpr_writer_t writer;
+        sexpr_writer_initialize(&writer, output, unicode_mode);
+        pipeline_options.validate_utf8 = validate_utf8;
+        bool converted = json_pipeline_convert(input, &pipeline_options, &writer);
+        fprintf(output, "\n");
+        if (pipeline_options.progress) {
+            json_progress_finish(pipeline_options.progress);
+        }
+        
+        if (input != stdin) {
+            fclose(input);
+        }
+        if (async_output) {
+            if (!async_output_close(async_output, stderr)) {
+                fprintf(stderr, "Error: Failed to write output\n");
+                converted = false;
+            }
+        } else if (output != stdout && fclose(output) != 0) {
+            fprintf(stderr, "Error: Failed to write output\n");
+            converted = false;
+        }
+        
+        // A finished conversion has nothing left to resume
+        if (converted && checkpoint_filename) {
+            remove(checkpoint_filename);
+        }
+        free(checkpoint_filename);
+        return converted ? 0 : 1;
+    }
+    
+    // Render a saved snapshot directly; there is no JSON to read or parse
+    if (load_ast_filename) {
+        FILE *output = output_filename ? fopen(output_filename, "w") : stdout;
+        if (!output) {
+            perror("Error opening output file");
+            return 1;
+        }
+        fprintf(output, ";; JSON to S-expression conversion\n\n");
+        sexpr_writer_t writer;
+        sexpr_writer_initialize(&writer, output, unicode_mode);
+        bool loaded = json_snapshot_write(load_ast_filename, &writer);
+        fprintf(output, "\n");
+        if (output != stdout && fclose(output) != 0) {
+            fprintf(stderr, "Error: Failed to write output\n");
+            loaded = false;
+        }
+        return loaded ? 0 : 1;
+    }
+    
     // Read input
     char *json_string;
     if (input_filename) {
@@ -123,13 +705,175 @@ int main(int argc, char *argv[]) {
     if (!json_string) {
         return 1;
     }
+    if (!input_filename) {
+        metrics->input_bytes = strlen(json_string);
+    }
+    
+    // Cut the input down to the selected subtree
+    if ((select_path || structure_filename) &&
+        !select_subtree(&json_string, input_filename, select_path, structure_filename, validate_utf8)) {
+        free(json_string);
+        return 1;
+    }
+    
+    // Reject malformed UTF-8 before it can reach the output
+    size_t invalid_offset;
+    if (validate_utf8 && !utf8_validate(json_string, strlen(json_string), &invalid_offset)) {
+        fprintf(stderr, "Error: Invalid UTF-8 sequence at byte offset %lu\n",
+                (unsigned long)invalid_offset);
+        free(json_string);
+        return 1;
+    }
+    
+    // Convert S-expressions back to JSON
+    if (to_json) {
+        FILE *output = output_filename ? fopen(output_filename, "w") : stdout;
+        if (!output) {
+            perror("Error opening output file");
+            free(json_string);
+            return 1;
+        }
+        
+        json_writer_t *json_writer = malloc(sizeof(json_writer_t));
+        json_check_result_t result;
+        bool converted = false;
+        if (!json_writer) {
+            fprintf(stderr, "Error: Out of memory\n");
+        } else {
+            json_writer_initialize(json_writer, output);
+            converted = sexpr_reader_convert(json_string, strlen(json_string), json_writer, &result);
+            if (converted) {
+                json_writer_write_raw(json_writer, "\n", 1);
+            } else {
+                fprintf(stderr, "Error: %s at line %d, column %d (byte offset %lu)\n",
+                        result.message, result.line, result.column, (unsigned long)result.error_offset);
+            }
+            if (!json_writer_flush(json_writer)) {
+                fprintf(stderr, "Error: Failed to write output\n");
+                converted = false;
+            }
+        }
+        
+        free(json_writer);
+        if (output != stdout) {
+            fclose(output);
+        }
+        free(json_string);
+        return converted ? 0 : 1;
+    }
+    
+    // Validate (and measure) without converting
+    if (check_only || stats_only) {
+        json_check_result_t check;
+        json_stats_t stats;
+        json_stats_initialize(&stats);
+        if (stats_only) {
+            json_validator_collect_stats(json_string, strlen(json_string), &check, &stats);
+        } else {
+            json_validator_check(json_string, strlen(json_string), &check);
+        }
+        free(json_string);
+        
+        if (!check.valid) {
+            fprintf(stderr, "Error: %s at line %d, column %d (byte offset %lu)\n",
+                    check.message, check.line, check.column, (unsigned long)check.error_offset);
+            json_stats_release(&stats);
+            return 1;
+        }
+        
+        if (stats_only) {
+            FILE *output = output_filename ? fopen(output_filename, "w") : stdout;
+            if (!output) {
+                perror("Error opening output file");
+                json_stats_release(&stats);
+                return 1;
+            }
+            json_stats_write(&stats, output);
+            if (output != stdout) {
+                fclose(output);
+            }
+        }
+        json_stats_release(&stats);
+        return 0;
+    }
+    
+    // Render top-level entries into separate files in parallel
+    if (split_options.directory) {
+        split_options.unicode_mode = unicode_mode;
+        const bool split = json_split_document(json_string, strlen(json_string), &split_options,
+                                               &metrics->output_bytes);
+        free(json_string);
+        return split ? 0 : 1;
+    }
+    
+    // Convert subtree by subtree, timing each one
+    if (profile_options.report_filename) {
+        FILE *output = stdout;
+        async_output_t *async_output = NULL;
+        if (async) {
+            async_output = async_output_open(output_filename, &output);
+        } else if (output_filename) {
+            output = fopen(output_filename, "w");
+            if (!output) {
+                perror("Error opening output file");
+            }
+        }
+        if (!output || (async && !async_output)) {
+            free(json_string);
+            return 1;
+        }
+        
+        fprintf(output, ";; JSON to S-expression conversion\n\n");
+        sexpr_writer_t writer;
+        sexpr_writer_initialize(&writer, output, unicode_mode);
+        bool profiled = json_profile_convert(json_string, strlen(json_string), &profile_options, &writer);
+        fprintf(output, "\n");
+        
+        if (async_output) {
+            if (!async_output_close(async_output, stderr)) {
+                fprintf(stderr, "Error: Failed to write output\n");
+                profiled = false;
+            }
+        } else if (output != stdout && fclose(output) != 0) {
+            fprintf(stderr, "Error: Failed to write output\n");
+            profiled = false;
+        }
+        free(json_string);
+        return profiled ? 0 : 1;
+    }
     
     // Parse JSON
+    const double parse_start = json_metrics_now();
     parser_t parser;
-    parser_initialize(&parser, json_string);
+    if (in_place) {
+        parser_initialize_in_place(&parser, json_string);
+    } else {
+        parser_initialize(&parser, json_string);
+    }
+    json_progress_t *reporter = NULL;
+    if (progress) {
+        // Reported as the input offset reached at container boundaries
+        reporter = json_progress_start(stderr);
+        if (reporter) {
+            json_progress_phase(reporter, "parsing", "bytes", 0, parser.length, NULL);
+            parser.progress = reporter;
+        }
+    }
     
-    json_value_t *json_value = json_parser_parse_document(&parser);
+    json_value_t *json_value;
+    if (preview) {
+        // Skipped entries are passed over without building nodes
+        json_value = json_preview_parse_document(&parser, &preview_limits);
+    } else {
+        json_value = json_parser_parse_document(&parser);
+    }
+    parser_release(&parser);
+    metrics->parse_seconds = json_metrics_now() - parse_start;
+    json_metrics_sample_heap(metrics);
     if (!json_value) {
+        if (reporter) {
+            json_progress_finish(reporter);
+        }
         fprintf(stderr, "Error: Failed to parse JSON\n");
         free(json_string);
         return 1;
@@ -141,12 +885,37 @@ int main(int argc, char *argv[]) {
                 parser.line, parser.column);
     }
     
+    // Keep the parsed document for later runs
+    if (save_ast_filename && !json_snapshot_save(json_value, save_ast_filename)) {
+        if (reporter) {
+            json_progress_finish(reporter);
+        }
+        json_memory_free_value(json_value);
+        free(json_string);
+        return 1;
+    }
+    
     // Open output file
     FILE *output = stdout;
-    if (output_filename) {
+    async_output_t *async_output = NULL;
+    if (async) {
+        // Rendered blocks are written by a separate thread
+        async_output = async_output_open(output_filename, &output);
+        if (!async_output) {
+            if (reporter) {
+                json_progress_finish(reporter);
+            }
+            json_memory_free_value(json_value);
+            free(json_string);
+            return 1;
+        }
+    } else if (output_filename) {
         output = fopen(output_filename, "w");
         if (!output) {
             perror("Error opening output file");
+            if (reporter) {
+                json_progress_finish(reporter);
+            }
             json_memory_free_value(json_value);
             free(json_string);
             return 1;
@@ -154,18 +923,99 @@ int main(int argc, char *argv[]) {
     }
     
     // Print S-expression
+    const double render_start = json_metrics_now();
     fprintf(output, ";; JSON to S-expression conversion\n\n");
     
-    sexpr_writer_write_value(json_value, output, 0);
+    sexpr_writer_t writer;
+    sexpr_writer_initialize(&writer, output, unicode_mode);
+    bool written = true;
+    sexpr_memo_t memo;
+    if (memoize) {
+        // Repeated subtrees are rendered once and copied afterwards
+        if (!sexpr_memo_initialize(&memo)) {
+            written = false;
+        } else {
+            writer.memo = &memo;
+        }
+    }
+    if (reporter) {
+        // Reported per top-level entry written
+        json_progress_phase(reporter, "writing", "entries", 0, count_top_level_entries(json_value), output);
+        writer.progress = reporter;
+    }
+    if (index_filename) {
+        // Record where each top-level entry lands for random access
+        FILE *index_output = fopen(index_filename, "w");
+        if (!index_output) {
+            perror("Error opening index file");
+            written = false;
+        } else {
+            written = sexpr_index_write_document(json_value, &writer, index_output);
+            if (fclose(index_output) != 0) {
+                fprintf(stderr, "Error: Failed to write index file\n");
+                written = false;
+            }
+        }
+    } else if (reporter) {
+        sexpr_index_write_document(json_value, &writer, NULL);
+    } else {
+        sexpr_writer_write_value(json_value, &writer, 0);
+    }
     fprintf(output, "\n");
+    if (reporter) {
+        json_progress_finish(reporter);
+    }
+    
+    if (writer.memo) {
+        sexpr_memo_write_stats(writer.memo, stderr);
+        sexpr_memo_release(writer.memo);
+    }
     
     // Cleanup
-    if (output != stdout) {
-        fclose(output);
+    if (async_output) {
+        if (!async_output_close(async_output, stderr)) {
+            fprintf(stderr, "Error: Failed to write output\n");
+            written = false;
+        }
+    } else if (output != stdout && fclose(output) != 0) {
+        fprintf(stderr, "Error: Failed to write output\n");
+        written = false;
+    }
+    metrics->render_seconds = json_metrics_now() - render_start;
+    metrics->phases_measured = true;
+    json_metrics_sample_heap(metrics);
+    
+    // Read the output back and compare it with the parsed document
+    if (written && verify) {
+        size_t entries;
+        written = json_verify_output(json_value, output_filename, &entries);
+        if (written) {
+            fprintf(stderr, ";; Verified: output matches the input (%lu top-level entries)\n",
+                    (unsigned long)entries);
+        }
     }
     
     json_memory_free_value(json_value);
     free(json_string);
     
-    return 0;
+    return written ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    json_metrics_t metrics;
+    json_metrics_initialize(&metrics);
+    int status = run_converter(argc, argv, &metrics);
+    
+    // Failed runs are counted too
+    if (metrics.filename) {
+        if (!json_metrics_finish_output(&metrics)) {
+            fprintf(stderr, "Error: Failed to write output\n");
+            status = 1;
+        }
+        json_metrics_sample_heap(&metrics);
+        if (!json_metrics_write(&metrics, status == 0)) {
+            return 1;
+        }
+    }
+    return status;
 }
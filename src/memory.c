@@ -13,10 +13,21 @@
  * @param member_node The first member in the linked list to free
  */
 void json_memory_free_object_member(json_member_t *member_node) {
+    json_memory_free_member_list(member_node, true);
+}
+
+/**
+ * @brief Frees a member list whose keys may be borrowed from the input
+ * @param member_node The first member in the linked list to free
+ * @param owns_keys false if the keys point into the input buffer
+ */
+void json_memory_free_member_list(json_member_t *member_node, bool owns_keys) {
     while (member_node != NULL) {
         json_member_t *next_member = member_node->next;
         
-        free(member_node->key);
+        if (owns_keys) {
+            free(member_node->key);
+        }
         json_memory_free_value(member_node->value);
         free(member_node);
         
@@ -39,6 +50,46 @@ void json_memory_free_array_element(json_element_t *element_node) {
     }
 }
 
+/**
+ * @brief Frees a packed homogeneous array and its element storage
+ * @param typed_array The packed array to free (can be NULL)
+ */
+void json_memory_free_typed_array(json_typed_array_t *typed_array) {
+    if (typed_array == NULL) {
+        return;
+    }
+    
+    if (typed_array->kind == TYPED_ARRAY_VALUE) {
+        for (size_t index = 0; index < typed_array->count; index++) {
+            json_memory_free_value(typed_array->items.values[index]);
+        }
+    }
+    
+    free(typed_array->items.integers);
+    free(typed_array);
+}
+
+/**
+ * @brief Frees a columnar record array, its shared keys and all columns
+ * @param record_array The record array to free (can be NULL)
+ */
+void json_memory_free_record_array(json_record_array_t *record_array) {
+    if (record_array == NULL) {
+        return;
+    }
+    
+    for (size_t key_index = 0; key_index < record_array->key_count; key_index++) {
+        if (!record_array->borrowed_keys) {
+            free(record_array->keys[key_index]);
+        }
+        json_memory_free_typed_array(record_array->columns[key_index]);
+    }
+    
+    free(record_array->keys);
+    free(record_array->columns);
+    free(record_array);
+}
+
 /**
  * @brief Recursively frees a JSON value and all its contained data
  * @param json_value The JSON value to free (can be NULL)
@@ -50,20 +101,32 @@ void json_memory_free_value(json_value_t *json_value) {
     
     switch (json_value->type) {
         case JSON_OBJECT:
-            json_memory_free_object_member(json_value->data.object);
+            json_memory_free_member_list(json_value->data.object,
+                                         !(json_value->flags & JSON_VALUE_BORROWED_KEYS));
             break;
             
         case JSON_ARRAY:
             json_memory_free_array_element(json_value->data.array);
             break;
             
+        case JSON_TYPED_ARRAY:
+            json_memory_free_typed_array(json_value->data.typed_array);
+            break;
+            
+        case JSON_RECORD_ARRAY:
+            json_memory_free_record_array(json_value->data.record_array);
+            break;
+            
         case JSON_STRING:
-            free(json_value->data.string);
+            if (!(json_value->flags & JSON_VALUE_BORROWED_STRING)) {
+                free(json_value->data.string);
+            }
             break;
             
         case JSON_NUMBER:
         case JSON_BOOLEAN:
         case JSON_NULL:
+        case JSON_ELIDED:
             // These types don't allocate additional memory
             break;
     }
@@ -0,0 +1,496 @@
+/**
+ * @file metrics.c
+ * @brief Run metrics written as a Prometheus text exposition file
+ *
+ * Each run adds itself to the counters and histograms already in the
+ * metrics file: runs by result, documents converted, bytes in and out,
+ * and latency, heap and resident-memory histograms. A lock file
+ * serializes runs that finish at the same time, and the new file is
+ * renamed into place so a collector reading the text file never sees a
+ * partial write. Heap use is sampled at phase boundaries with glibc's
+ * mallinfo2 and is left out on other C libraries.
+ *
+ * Output bytes are counted as they leave the process: stdout is swapped
+ * for a pipe that a relay thread copies to the real stdout, which also
+ * catches the descriptor-level writes of --processes and --async-output.
+ * Only a regular file on stdout that --index must seek in is left in
+ * place and counts by how much it grew. The -o file counts only if this
+ * run wrote it.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "json_to_sexpr.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+#define METRICS_HAVE_MALLINFO2 1
+#endif
+
+/* Most series one run writes */
+#define METRICS_MAX_SERIES 96
+
+/* Longest series name with its labels */
+#define METRICS_MAX_NAME 128
+
+/* Longest line read back from an existing metrics file */
+#define METRICS_MAX_LINE 512
+
+/* Bytes the stdout relay moves per read */
+#define METRICS_RELAY_BUFFER 65536
+
+/* Latency histogram bucket bounds in seconds */
+static const double metrics_second_buckets[] = {0.001, 0.01, 0.1, 1, 10, 60, 600};
+
+/* Memory histogram bucket bounds in bytes */
+static const double metrics_byte_buckets[] = {1e6, 1e7, 1e8, 1e9, 1e10, 1e11};
+
+/* One sample line */
+typedef struct {
+    char name[METRICS_MAX_NAME];    // metric name with labels
+    double value;
+    bool accumulate;                // added to the value already in the file
+} metrics_series_t;
+
+/* Samples of one run, in the order they are written */
+typedef struct {
+    metrics_series_t series[METRICS_MAX_SERIES];
+    size_t count;
+    char *text;                     // HELP and TYPE lines of every family
+    size_t text_size;
+    FILE *headers;                  // memory stream building text
+    size_t header_end[METRICS_MAX_SERIES];  // text written before each series
+} metrics_set_t;
+
+/* Output accounting shared by the run and the stdout relay thread */
+typedef struct {
+    bool relaying;
+    int stdout_descriptor;      // the real stdout while relaying
+    int pipe_descriptor;        // read end of the pipe now on descriptor 1
+    pthread_t thread;
+    uint64_t bytes;             // written by the relay thread, read after joining it
+    bool failed;
+    bool stdout_is_file;        // stdout is a regular file left seekable
+    off_t stdout_start_size;    // its size when the run started
+    bool output_existed;        // the -o file existed when the run started
+    struct stat output_status;  // and its status then
+} metrics_output_t;
+
+static metrics_output_t metrics_output;
+
+/**
+ * @brief Reads the monotonic clock
+ * @return Seconds since an arbitrary fixed point
+ */
+double json_metrics_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Starts collecting metrics for a run
+ * @param metrics The metrics to reset; the run's clock starts now
+ */
+void json_metrics_initialize(json_metrics_t *metrics) {
+    memset(metrics, 0, sizeof(*metrics));
+    metrics->start = json_metrics_now();
+}
+
+/**
+ * @brief Records the heap in use if it is the largest seen so far
+ * @param metrics The run's metrics
+ */
+void json_metrics_sample_heap(json_metrics_t *metrics) {
+#ifdef METRICS_HAVE_MALLINFO2
+    const struct mallinfo2 info = mallinfo2();
+    const uint64_t in_use = (uint64_t)info.uordblks + (uint64_t)info.hblkhd;
+    if (in_use > metrics->heap_peak_bytes) {
+        metrics->heap_peak_bytes = in_use;
+    }
+#else
+    (void)metrics;
+#endif
+}
+
+/**
+ * @brief Copies the pipe on stdout to the real stdout, counting the bytes
+ * @param argument Unused
+ * @return NULL
+ */
+static void *json_metrics_relay(void *argument) {
+    (void)argument;
+    static char buffer[METRICS_RELAY_BUFFER];
+    while (true) {
+        const ssize_t count = read(metrics_output.pipe_descriptor, buffer, sizeof(buffer));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+        metrics_output.bytes += (uint64_t)count;
+
+        // After a write error the pipe is still drained so the run never blocks
+        ssize_t done = 0;
+        while (!metrics_output.failed && done < count) {
+            const ssize_t written = write(metrics_output.stdout_descriptor, buffer + done, (size_t)(count - done));
+            if (written < 0 && errno != EINTR) {
+                metrics_output.failed = true;
+            } else if (written > 0) {
+                done += written;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Starts counting the run's output
+ *
+ * Records the status of the -o file and puts a counting relay on stdout,
+ * unless stdout is a regular file that has to stay seekable.
+ *
+ * @param metrics The run's metrics (output_filename is set)
+ * @param seekable_stdout Whether offsets in stdout are read back
+ * @return true on success
+ */
+bool json_metrics_start_output(const json_metrics_t *metrics, bool seekable_stdout) {
+    metrics_output.output_existed = metrics->output_filename &&
+                                    stat(metrics->output_filename, &metrics_output.output_status) == 0;
+
+    struct stat status;
+    fflush(stdout);
+    if (seekable_stdout && fstat(STDOUT_FILENO, &status) == 0 && S_ISREG(status.st_mode)) {
+        metrics_output.stdout_is_file = true;
+        metrics_output.stdout_start_size = status.st_size;
+        return true;
+    }
+
+    int descriptors[2];
+    if (pipe(descriptors) != 0) {
+        perror("Error creating the output relay");
+        return false;
+    }
+    metrics_output.stdout_descriptor = dup(STDOUT_FILENO);
+    if (metrics_output.stdout_descriptor < 0 || dup2(descriptors[1], STDOUT_FILENO) < 0) {
+        perror("Error creating the output relay");
+        if (metrics_output.stdout_descriptor >= 0) {
+            close(metrics_output.stdout_descriptor);
+        }
+        close(descriptors[0]);
+        close(descriptors[1]);
+        return false;
+    }
+    close(descriptors[1]);
+    // Worker processes inherit only the pipe's write end
+    fcntl(descriptors[0], F_SETFD, FD_CLOEXEC);
+    fcntl(metrics_output.stdout_descriptor, F_SETFD, FD_CLOEXEC);
+    metrics_output.pipe_descriptor = descriptors[0];
+
+    if (pthread_create(&metrics_output.thread, NULL, json_metrics_relay, NULL) != 0) {
+        fprintf(stderr, "Error: Cannot start the output relay\n");
+        dup2(metrics_output.stdout_descriptor, STDOUT_FILENO);
+        close(metrics_output.stdout_descriptor);
+        close(descriptors[0]);
+        return false;
+    }
+    metrics_output.relaying = true;
+    return true;
+}
+
+/**
+ * @brief Stops counting the run's output and records the total
+ *
+ * Restores the real stdout once the relay has drained the pipe, then adds
+ * the part of the -o file this run wrote, if it wrote the file at all.
+ * A stdout left seekable counts by how much its file grew.
+ *
+ * @param metrics The run's metrics; output_bytes is increased
+ * @return false if the relay could not write to stdout
+ */
+bool json_metrics_finish_output(json_metrics_t *metrics) {
+    struct stat status;
+    fflush(stdout);
+    if (metrics_output.stdout_is_file && fstat(STDOUT_FILENO, &status) == 0 &&
+        status.st_size > metrics_output.stdout_start_size) {
+        metrics->output_bytes += (uint64_t)(status.st_size - metrics_output.stdout_start_size);
+    }
+    if (metrics_output.relaying) {
+        // Restoring descriptor 1 closes the last write end, ending the relay
+        dup2(metrics_output.stdout_descriptor, STDOUT_FILENO);
+        pthread_join(metrics_output.thread, NULL);
+        close(metrics_output.stdout_descriptor);
+        close(metrics_output.pipe_descriptor);
+        metrics_output.relaying = false;
+        metrics->output_bytes += metrics_output.bytes;
+    }
+
+    if (metrics->output_filename && stat(metrics->output_filename, &status) == 0) {
+        const struct stat *before = &metrics_output.output_status;
+        const bool written = !metrics_output.output_existed || status.st_ino != before->st_ino ||
+                             status.st_size != before->st_size ||
+                             status.st_mtim.tv_sec != before->st_mtim.tv_sec ||
+                             status.st_mtim.tv_nsec != before->st_mtim.tv_nsec;
+        if (written && (uint64_t)status.st_size > metrics->output_resumed_at) {
+            metrics->output_bytes += (uint64_t)status.st_size - metrics->output_resumed_at;
+        }
+    }
+    return !metrics_output.failed;
+}
+
+/**
+ * @brief Starts a metric family: writes its HELP and TYPE lines
+ * @param set The samples being built
+ * @param name Family name
+ * @param type "counter", "gauge" or "histogram"
+ * @param help One-line description
+ */
+static void json_metrics_family(metrics_set_t *set, const char *name, const char *type, const char *help) {
+    fprintf(set->headers, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/**
+ * @brief Adds a sample line
+ * @param set The samples being built
+ * @param accumulate Whether the value is added to the one in the file
+ * @param value The sample value
+ * @param format printf format of the name and labels
+ */
+static void json_metrics_add(metrics_set_t *set, bool accumulate, double value, const char *format, ...) {
+    if (set->count == METRICS_MAX_SERIES) {
+        return;
+    }
+    fflush(set->headers);
+    set->header_end[set->count] = (size_t)ftell(set->headers);
+    metrics_series_t *series = &set->series[set->count++];
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(series->name, sizeof(series->name), format, arguments);
+    va_end(arguments);
+    series->value = value;
+    series->accumulate = accumulate;
+}
+
+/**
+ * @brief Adds a histogram holding at most one observation from this run
+ * @param set The samples being built
+ * @param name Family name
+ * @param help One-line description
+ * @param bounds Bucket upper bounds, ascending
+ * @param bound_count Number of bounds
+ * @param observed Whether this run made an observation
+ * @param value The observation
+ */
+static void json_metrics_histogram(metrics_set_t *set, const char *name, const char *help,
+                                   const double *bounds, size_t bound_count, bool observed, double value) {
+    json_metrics_family(set, name, "histogram", help);
+    for (size_t index = 0; index < bound_count; index++) {
+        json_metrics_add(set, true, observed && value <= bounds[index] ? 1 : 0,
+                         "%s_bucket{le=\"%g\"}", name, bounds[index]);
+    }
+    json_metrics_add(set, true, observed ? 1 : 0, "%s_bucket{le=\"+Inf\"}", name);
+    json_metrics_add(set, true, observed ? value : 0, "%s_sum", name);
+    json_metrics_add(set, true, observed ? 1 : 0, "%s_count", name);
+}
+
+/**
+ * @brief Finds the size of a file
+ * @param filename The file, or NULL
+ * @param size Receives the size
+ * @return true if the file exists
+ */
+static bool json_metrics_file_size(const char *filename, uint64_t *size) {
+    struct stat status;
+    if (!filename || stat(filename, &status) != 0) {
+        return false;
+    }
+    *size = (uint64_t)status.st_size;
+    return true;
+}
+
+/**
+ * @brief Builds the samples of one run
+ * @param set Receives the samples
+ * @param metrics The run's metrics
+ * @param success Whether the run succeeded
+ */
+static void json_metrics_collect(metrics_set_t *set, const json_metrics_t *metrics, bool success) {
+    uint64_t input_bytes = metrics->input_bytes;
+    if (!json_metrics_file_size(metrics->input_filename, &input_bytes) && metrics->input_filename) {
+        input_bytes = 0;
+    }
+    struct rusage usage;
+    const bool have_usage = getrusage(RUSAGE_SELF, &usage) == 0;
+
+    json_metrics_family(set, "json_to_sexpr_runs_total", "counter", "Converter runs by result.");
+    json_metrics_add(set, true, success ? 1 : 0, "json_to_sexpr_runs_total{result=\"success\"}");
+    json_metrics_add(set, true, success ? 0 : 1, "json_to_sexpr_runs_total{result=\"failure\"}");
+    json_metrics_family(set, "json_to_sexpr_documents_converted_total", "counter",
+                        "Documents converted successfully.");
+    json_metrics_add(set, true, success && metrics->converts ? 1 : 0, "json_to_sexpr_documents_converted_total");
+    json_metrics_family(set, "json_to_sexpr_input_bytes_total", "counter", "JSON bytes read.");
+    json_metrics_add(set, true, (double)input_bytes, "json_to_sexpr_input_bytes_total");
+    json_metrics_family(set, "json_to_sexpr_output_bytes_total", "counter", "Bytes in the written output.");
+    json_metrics_add(set, true, (double)metrics->output_bytes, "json_to_sexpr_output_bytes_total");
+
+    const size_t second_buckets = sizeof(metrics_second_buckets) / sizeof(metrics_second_buckets[0]);
+    const size_t byte_buckets = sizeof(metrics_byte_buckets) / sizeof(metrics_byte_buckets[0]);
+    json_metrics_histogram(set, "json_to_sexpr_run_duration_seconds", "Wall time of a run.",
+                           metrics_second_buckets, second_buckets, true, json_metrics_now() - metrics->start);
+    json_metrics_histogram(set, "json_to_sexpr_parse_duration_seconds",
+                           "Time to parse a whole document (not observed for streaming modes).",
+                           metrics_second_buckets, second_buckets, metrics->phases_measured,
+                           metrics->parse_seconds);
+    json_metrics_histogram(set, "json_to_sexpr_render_duration_seconds",
+                           "Time to render and write a parsed document (not observed for streaming modes).",
+                           metrics_second_buckets, second_buckets, metrics->phases_measured,
+                           metrics->render_seconds);
+#ifdef METRICS_HAVE_MALLINFO2
+    json_metrics_histogram(set, "json_to_sexpr_heap_peak_bytes",
+                           "Largest heap allocation total sampled at phase boundaries.",
+                           metrics_byte_buckets, byte_buckets, true, (double)metrics->heap_peak_bytes);
+#endif
+    json_metrics_histogram(set, "json_to_sexpr_peak_resident_bytes", "Peak resident set size of a run.",
+                           metrics_byte_buckets, byte_buckets, have_usage,
+                           have_usage ? (double)usage.ru_maxrss * 1024.0 : 0);
+
+    json_metrics_family(set, "json_to_sexpr_last_run_timestamp_seconds", "gauge",
+                        "Unix time the last run finished.");
+    json_metrics_add(set, false, (double)time(NULL), "json_to_sexpr_last_run_timestamp_seconds");
+    json_metrics_family(set, "json_to_sexpr_last_run_success", "gauge", "1 if the last run succeeded.");
+    json_metrics_add(set, false, success ? 1 : 0, "json_to_sexpr_last_run_success");
+}
+
+/**
+ * @brief Adds the values of an existing metrics file to the run's samples
+ * @param set The run's samples
+ * @param filename The existing file (missing is fine)
+ */
+static void json_metrics_accumulate(metrics_set_t *set, const char *filename) {
+    FILE *input = fopen(filename, "r");
+    if (!input) {
+        return;
+    }
+    char line[METRICS_MAX_LINE];
+    while (fgets(line, sizeof(line), input)) {
+        char *separator = strrchr(line, ' ');
+        if (line[0] == '#' || !separator) {
+            continue;
+        }
+        *separator = '\0';
+        char *end;
+        const double value = strtod(separator + 1, &end);
+        if (end == separator + 1) {
+            continue;
+        }
+        for (size_t index = 0; index < set->count; index++) {
+            metrics_series_t *series = &set->series[index];
+            if (series->accumulate && strcmp(series->name, line) == 0) {
+                series->value += value;
+                break;
+            }
+        }
+    }
+    fclose(input);
+}
+
+/**
+ * @brief Writes a sample value: integers exactly, others with full precision
+ * @param output The metrics stream
+ * @param value The value
+ */
+static void json_metrics_write_value(FILE *output, double value) {
+    if (value == (double)(int64_t)value && value < 9007199254740992.0 && value > -9007199254740992.0) {
+        fprintf(output, "%.0f\n", value);
+    } else {
+        fprintf(output, "%.17g\n", value);
+    }
+}
+
+/**
+ * @brief Adds the finished run to the metrics file
+ *
+ * The counters and histograms already in the file are carried forward,
+ * so the file describes every run since it was created; the gauges
+ * describe the last run. The file is replaced atomically.
+ *
+ * @param metrics The run's metrics (metrics->filename is the file)
+ * @param success Whether the run succeeded
+ * @return true on success
+ */
+bool json_metrics_write(const json_metrics_t *metrics, bool success) {
+    metrics_set_t *set = calloc(1, sizeof(metrics_set_t));
+    if (!set) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return false;
+    }
+    set->headers = open_memstream(&set->text, &set->text_size);
+    if (!set->headers) {
+        fprintf(stderr, "Error: Out of memory\n");
+        free(set);
+        return false;
+    }
+    json_metrics_collect(set, metrics, success);
+    fclose(set->headers);
+
+    const size_t name_length = strlen(metrics->filename);
+    char *lock_name = malloc(name_length + sizeof(".lock"));
+    char *temporary_name = malloc(name_length + sizeof(".tmp"));
+    bool written = false;
+    if (!lock_name || !temporary_name) {
+        fprintf(stderr, "Error: Out of memory\n");
+    } else {
+        memcpy(lock_name, metrics->filename, name_length);
+        memcpy(lock_name + name_length, ".lock", sizeof(".lock"));
+        memcpy(temporary_name, metrics->filename, name_length);
+        memcpy(temporary_name + name_length, ".tmp", sizeof(".tmp"));
+
+        // Runs finishing together take turns reading and replacing the file
+        const int lock = open(lock_name, O_RDWR | O_CREAT, 0666);
+        struct flock range;
+        memset(&range, 0, sizeof(range));
+        range.l_type = F_WRLCK;
+        range.l_whence = SEEK_SET;
+        if (lock < 0 || fcntl(lock, F_SETLKW, &range) != 0) {
+            perror("Error locking metrics file");
+        } else {
+            json_metrics_accumulate(set, metrics->filename);
+            FILE *output = fopen(temporary_name, "w");
+            if (!output) {
+                perror("Error opening metrics file");
+            } else {
+                size_t text_written = 0;
+                for (size_t index = 0; index < set->count; index++) {
+                    fwrite(set->text + text_written, 1, set->header_end[index] - text_written, output);
+                    text_written = set->header_end[index];
+                    fprintf(output, "%s ", set->series[index].name);
+                    json_metrics_write_value(output, set->series[index].value);
+                }
+                written = fclose(output) == 0 && rename(temporary_name, metrics->filename) == 0;
+                if (!written) {
+                    fprintf(stderr, "Error: Failed to write metrics file\n");
+                    remove(temporary_name);
+                }
+            }
+        }
+        if (lock >= 0) {
+            close(lock);
+        }
+    }
+
+    free(lock_name);
+    free(temporary_name);
+    free(set->text);
+    free(set);
+    return written;
+}
@@ -0,0 +1,591 @@
+/**
+ * @file multiprocess.c
+ * @brief Multi-process conversion: forked workers render byte ranges of
+ *        the top-level container into shards that are merged in order
+ *
+ * The parent maps the input and walks its top-level entries with the raw
+ * entry skipper to cut it into one byte range per worker, split at entry
+ * boundaries. Each forked worker validates and converts its range in
+ * chunks, writing the entries at their nesting level in the whole document
+ * into an unlinked shard file. Once every worker has succeeded, the parent
+ * writes the top-level brackets around the shards, copying them into the
+ * output with copy_file_range so the text does not pass through user space.
+ *
+ * Workers share nothing but the read-only mapping, so each has its own
+ * allocator and, on multi-socket machines, its own local memory.
+ */
+
+#define _GNU_SOURCE
+
+#include "json_to_sexpr.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Smallest run of entries a worker parses at once */
+#define PROCESS_CHUNK_SIZE (1024 * 1024)
+
+/* Longest shard path template */
+#define PROCESS_MAX_PATH 4096
+
+/* Bytes copied per call when merging shards */
+#define PROCESS_COPY_SIZE (64 * 1024 * 1024)
+
+/* One worker's share of the input */
+typedef struct {
+    size_t start;               // byte range of whole top-level entries
+    size_t end;
+    size_t line;                // input position of start
+    size_t column;
+    int descriptor;             // unlinked shard file
+    pid_t pid;
+} process_shard_t;
+
+/* Work shared by the parent and (after fork) the workers */
+typedef struct {
+    const char *input;
+    size_t length;
+    bool object;
+    const json_process_options_t *options;
+    process_shard_t *shards;
+    size_t shard_count;
+} process_work_t;
+
+/**
+ * @brief Skips JSON whitespace within the mapped input
+ * @param input The input
+ * @param pos Current offset
+ * @param length Input length
+ * @return Offset of the next non-whitespace byte, or length
+ */
+static size_t json_process_skip_whitespace(const char *input, size_t pos, size_t length) {
+    while (pos < length && (input[pos] == ' ' || input[pos] == '\t' || input[pos] == '\n' ||
+                            input[pos] == '\r')) {
+        pos++;
+    }
+    return pos;
+}
+
+/**
+ * @brief Advances a line and column count through part of the input
+ * @param input The input
+ * @param from Offset the count is at
+ * @param to Offset to count up to
+ * @param line Line at from, updated to the line at to
+ * @param column Column at from, updated to the column at to
+ */
+static void json_process_advance_position(const char *input, size_t from, size_t to,
+                                          size_t *line, size_t *column) {
+    for (size_t offset = from; offset < to; offset++) {
+        if (input[offset] == '\n') {
+            (*line)++;
+            *column = 1;
+        } else {
+            (*column)++;
+        }
+    }
+}
+
+/**
+ * @brief Parses a run of entries wrapped in the top-level brackets
+ *
+ * The parser starts at the run's position in the input, so its
+ * diagnostics read as they would for the whole document.
+ *
+ * @param work The shared work description
+ * @param start Offset of the first entry
+ * @param end End of the run
+ * @param line Input line of start
+ * @param column Input column of start
+ * @param close Whether to add the closing bracket
+ * @param text_out Receives the run's text, which the container's strings
+ *        point into; the caller frees it
+ * @return The parsed container, or NULL on failure (reported)
+ */
+static json_value_t *json_process_parse_run(const process_work_t *work, size_t start, size_t end,
+                                            size_t line, size_t column, bool close, char **text_out) {
+    const size_t size = end - start;
+    char *text = malloc(size + 3);
+    *text_out = text;
+    if (!text) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return NULL;
+    }
+    text[0] = work->object ? '{' : '[';
+    memcpy(text + 1, work->input + start, size);
+    text[size + 1] = work->object ? '}' : ']';
+    text[size + (close ? 2 : 1)] = '\0';
+
+    // The opening bracket stands just before the first entry
+    parser_t parser;
+    parser_initialize_in_place(&parser, text);
+    parser.line = (int)line;
+    parser.column = (int)column - 1;
+    json_value_t *value = json_parser_parse_document(&parser);
+    parser_release(&parser);
+    if (!value || parser.current_token.type != TOKEN_EOF) {
+        fprintf(stderr, "Error: Failed to parse JSON\n");
+        json_memory_free_value(value);
+        return NULL;
+    }
+    return value;
+}
+
+/**
+ * @brief Reports a top-level entry the raw entry skipper could not cut
+ *
+ * The skipper only finds where the structure breaks, at stop; the entry
+ * is parsed up to there so the error is the parser's own, with its line
+ * and column.
+ *
+ * @param work The shared work description
+ * @param start Offset of the entry
+ * @param stop Offset just past the byte where the structure breaks
+ */
+static void json_process_report_entry(const process_work_t *work, size_t start, size_t stop) {
+    size_t line = 1;
+    size_t column = 1;
+    json_process_advance_position(work->input, 0, start, &line, &column);
+    char *text;
+    json_value_t *value = json_process_parse_run(work, start, stop < work->length ? stop : work->length,
+                                                 line, column, false, &text);
+    if (value) {
+        fprintf(stderr, "Error: Failed to parse JSON\n");
+        json_memory_free_value(value);
+    }
+    free(text);
+}
+
+/**
+ * @brief Parses one run of entries and writes them
+ * @param work The shared work description
+ * @param start Offset of the first entry
+ * @param end End of the last entry
+ * @param line Input line of start
+ * @param column Input column of start
+ * @param writer The writer for the shard
+ * @param first Whether these are the first entries of the document
+ * @return true on success
+ */
+static bool json_process_render_run(const process_work_t *work, size_t start, size_t end,
+                                    size_t line, size_t column, sexpr_writer_t *writer, bool first) {
+    char *text;
+    json_value_t *value = json_process_parse_run(work, start, end, line, column, true, &text);
+    if (!value) {
+        free(text);
+        return false;
+    }
+
+    if (!first) {
+        fprintf(writer->output, "\n");
+        output_formatter_write_indentation(writer->output, 1);
+    }
+    sexpr_writer_write_entries(value, writer, 1);
+    json_memory_free_value(value);
+    free(text);
+    return true;
+}
+
+/**
+ * @brief Worker body: converts one shard's byte range into its file
+ * @param work The shared work description
+ * @param index The shard to convert
+ * @return true on success
+ */
+static bool json_process_render_shard(const process_work_t *work, size_t index) {
+    const process_shard_t *shard = &work->shards[index];
+
+    size_t invalid_offset;
+    if (work->options->validate_utf8 &&
+        !utf8_validate(work->input + shard->start, shard->end - shard->start, &invalid_offset)) {
+        fprintf(stderr, "Error: Invalid UTF-8 sequence at byte offset %lu\n",
+                (unsigned long)(shard->start + invalid_offset));
+        return false;
+    }
+
+    FILE *output = fdopen(dup(shard->descriptor), "w");
+    if (!output) {
+        perror("Error opening shard file");
+        return false;
+    }
+    sexpr_writer_t writer;
+    sexpr_writer_initialize(&writer, output, work->options->unicode_mode);
+
+    // Runs of entries are parsed one at a time to keep the tree small
+    bool success = true;
+    size_t run_start = shard->start;
+    size_t line = shard->line;
+    size_t column = shard->column;
+    size_t pos = shard->start;
+    while (success && pos < shard->end) {
+        if (!json_validator_skip_entry(work->input, shard->end + 1, &pos)) {
+            pos = shard->end;
+        }
+        if (pos >= shard->end || pos - run_start >= PROCESS_CHUNK_SIZE) {
+            success = json_process_render_run(work, run_start, pos, line, column, &writer,
+                                              index == 0 && run_start == shard->start);
+            json_process_advance_position(work->input, run_start, pos + 1, &line, &column);
+            run_start = ++pos;
+        } else {
+            pos++;
+        }
+    }
+
+    if (fclose(output) != 0 && success) {
+        fprintf(stderr, "Error: Failed to write shard %lu\n", (unsigned long)index);
+        success = false;
+    }
+    return success;
+}
+
+/**
+ * @brief Cuts the top-level container into one byte range per worker
+ * @param work Work description; shards and shard_count are filled in
+ * @param pos Offset just after the top-level opening bracket
+ * @param workers Number of ranges wanted
+ * @param root_end Receives the offset just after the closing bracket
+ * @return true on success
+ */
+static bool json_process_find_shards(process_work_t *work, size_t pos, size_t workers, size_t *root_end) {
+    const char *input = work->input;
+    const char close = work->object ? '}' : ']';
+    const size_t share = work->length / workers + 1;
+
+    work->shards = calloc(workers, sizeof(process_shard_t));
+    if (!work->shards) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return false;
+    }
+
+    pos = json_process_skip_whitespace(input, pos, work->length);
+    if (pos < work->length && input[pos] == close) {
+        *root_end = pos + 1;
+        return true;
+    }
+
+    process_shard_t *shard = NULL;
+    size_t counted = 0;         // input offset the line count has reached
+    size_t line = 1;
+    size_t column = 1;
+    while (true) {
+        const size_t start = json_process_skip_whitespace(input, pos, work->length);
+        size_t end = start;
+        if (start >= work->length) {
+            // Input that ends where an entry could start closes the container, as in the parser
+            *root_end = work->length;
+            return true;
+        }
+        if (input[start] == ',' || input[start] == '}' || input[start] == ']') {
+            // After an entry, the comma before it is part of the error
+            json_process_report_entry(work, shard ? pos - 1 : start, start + 1);
+            return false;
+        }
+        if (!json_validator_skip_entry(input, work->length, &end)) {
+            json_process_report_entry(work, start, work->length);
+            return false;
+        }
+
+        // A new range starts once the current one has its share of bytes
+        if (shard == NULL || (end > (work->shard_count * share) && work->shard_count < workers)) {
+            json_process_advance_position(input, counted, start, &line, &column);
+            counted = start;
+            shard = &work->shards[work->shard_count++];
+            shard->start = start;
+            shard->line = line;
+            shard->column = column;
+            shard->descriptor = -1;
+        }
+        shard->end = end;
+
+        if (input[end] != ',') {
+            if (input[end] != close) {
+                json_process_report_entry(work, start, end + 1);
+                return false;
+            }
+            *root_end = end + 1;
+            return true;
+        }
+        pos = end + 1;
+    }
+}
+
+/**
+ * @brief Reports content after the top-level container
+ * @param work The work description
+ * @param pos Offset just after the container
+ * @return false if the trailing content is not valid UTF-8 or on allocation failure
+ */
+static bool json_process_check_trailing(const process_work_t *work, size_t pos) {
+    const size_t trailing = json_process_skip_whitespace(work->input, pos, work->length);
+    if (trailing == work->length) {
+        return true;
+    }
+
+    size_t invalid_offset;
+    if (work->options->validate_utf8 &&
+        !utf8_validate(work->input + trailing, work->length - trailing, &invalid_offset)) {
+        fprintf(stderr, "Error: Invalid UTF-8 sequence at byte offset %lu\n",
+                (unsigned long)(trailing + invalid_offset));
+        return false;
+    }
+
+    int line = 1;
+    int column = 1;
+    for (size_t offset = 0; offset < trailing; offset++) {
+        if (work->input[offset] == '\n') {
+            line++;
+            column = 1;
+        } else {
+            column++;
+        }
+    }
+
+    // The input is not NUL-terminated, so the first token is copied out
+    const size_t extent = tokenizer_token_extent(work->input + trailing, work->length - trailing);
+    char *token = malloc(extent + 1);
+    if (!token) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return false;
+    }
+    memcpy(token, work->input + trailing, extent);
+    token[extent] = '\0';
+    tokenizer_report_trailing(token, line, column);
+    free(token);
+    return true;
+}
+
+/**
+ * @brief Creates an unlinked shard file next to the output
+ * @param output_filename The output file, or NULL for standard output
+ * @return The descriptor, or -1 on failure
+ */
+static int json_process_create_shard(const char *output_filename) {
+    char path[PROCESS_MAX_PATH];
+    const char *directory = getenv("TMPDIR");
+    const int written = output_filename
+                            ? snprintf(path, sizeof(path), "%s.shard-XXXXXX", output_filename)
+                            : snprintf(path, sizeof(path), "%s/json_to_sexpr-XXXXXX",
+                                       directory ? directory : "/tmp");
+    if (written <= 0 || written >= (int)sizeof(path)) {
+        fprintf(stderr, "Error: Output path too long\n");
+        return -1;
+    }
+
+    const int descriptor = mkstemp(path);
+    if (descriptor < 0) {
+        perror("Error creating shard file");
+        return -1;
+    }
+    unlink(path);
+    return descriptor;
+}
+
+/**
+ * @brief Appends a shard file to the output
+ *
+ * copy_file_range moves the bytes inside the kernel (or shares extents on
+ * file systems that support it); where it is unavailable, as for a pipe,
+ * the shard is copied with read and write.
+ *
+ * @param descriptor The shard file
+ * @param output The output descriptor, positioned at the end
+ * @return true on success
+ */
+static bool json_process_append_shard(int descriptor, int output) {
+    struct stat status;
+    if (fstat(descriptor, &status) != 0) {
+        return false;
+    }
+    off_t offset = 0;
+    const off_t size = status.st_size;
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 27)
+    while (offset < size) {
+        const size_t request = size - offset < PROCESS_COPY_SIZE ? (size_t)(size - offset) : PROCESS_COPY_SIZE;
+        const ssize_t copied = copy_file_range(descriptor, &offset, output, NULL, request, 0);
+        if (copied <= 0) {
+            if (copied < 0 && errno == EINTR) {
+                continue;
+            }
+            if (offset == 0 && copied < 0 &&
+                (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP ||
+                 errno == EBADF)) {
+                break;
+            }
+            return false;
+        }
+    }
+#endif
+
+    char buffer[64 * 1024];
+    while (offset < size) {
+        const ssize_t count = pread(descriptor, buffer, sizeof(buffer), offset);
+        if (count <= 0) {
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        for (ssize_t done = 0; done < count;) {
+            const ssize_t written = write(output, buffer + done, (size_t)(count - done));
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            done += written;
+        }
+        offset += count;
+    }
+    return true;
+}
+
+/**
+ * @brief Forks the workers and waits for all of them
+ * @param work The work description with its shards found
+ * @return true if every worker succeeded
+ */
+static bool json_process_run_workers(process_work_t *work) {
+    bool success = true;
+
+    // Nothing buffered may be written twice by the children
+    fflush(NULL);
+    for (size_t index = 0; index < work->shard_count && success; index++) {
+        process_shard_t *shard = &work->shards[index];
+        shard->descriptor = json_process_create_shard(work->options->output_filename);
+        if (shard->descriptor < 0) {
+            success = false;
+            break;
+        }
+        shard->pid = fork();
+        if (shard->pid == 0) {
+            const bool rendered = json_process_render_shard(work, index);
+            fflush(stderr);
+            _exit(rendered ? 0 : 1);
+        }
+        if (shard->pid < 0) {
+            perror("Error starting worker process");
+            success = false;
+        }
+    }
+
+    for (size_t index = 0; index < work->shard_count; index++) {
+        int status;
+        if (work->shards[index].pid <= 0) {
+            continue;
+        }
+        while (waitpid(work->shards[index].pid, &status, 0) < 0) {
+            if (errno != EINTR) {
+                status = 1;
+                break;
+            }
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            success = false;
+        }
+    }
+    return success;
+}
+
+/**
+ * @brief Converts an object or array document with forked worker
+ *        processes, one per byte range of top-level entries
+ *
+ * The output is identical to the single-process conversion. It is only
+ * written once every worker has succeeded.
+ *
+ * @param input_filename The input file, or NULL for standard input (which
+ *        must then be a regular file)
+ * @param options Output file, worker count (0 for one per online
+ *        processor), validation and encoding
+ * @return true on success
+ */
+bool json_process_convert(const char *input_filename, const json_process_options_t *options) {
+    const int input_descriptor = input_filename ? open(input_filename, O_RDONLY) : STDIN_FILENO;
+    if (input_descriptor < 0) {
+        perror("Error opening input file");
+        return false;
+    }
+
+    struct stat status;
+    void *mapping = MAP_FAILED;
+    if (fstat(input_descriptor, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0) {
+        mapping = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, input_descriptor, 0);
+    }
+    if (input_descriptor != STDIN_FILENO) {
+        close(input_descriptor);
+    }
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Error: --processes needs a non-empty regular input file\n");
+        return false;
+    }
+    posix_madvise(mapping, (size_t)status.st_size, POSIX_MADV_SEQUENTIAL);
+
+    process_work_t work;
+    memset(&work, 0, sizeof(work));
+    work.input = mapping;
+    work.length = (size_t)status.st_size;
+    work.options = options;
+
+    size_t workers = options->processes;
+    if (workers == 0) {
+        const long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = processors > 0 ? (size_t)processors : 1;
+    }
+
+    bool success = true;
+    const size_t pos = json_process_skip_whitespace(work.input, 0, work.length);
+    size_t root_end = 0;
+    if (pos >= work.length || (work.input[pos] != '{' && work.input[pos] != '[')) {
+        fprintf(stderr, "Error: --processes needs an object or array at the top level\n");
+        success = false;
+    } else {
+        work.object = work.input[pos] == '{';
+        success = json_process_find_shards(&work, pos + 1, workers, &root_end) &&
+                  json_process_check_trailing(&work, root_end) &&
+                  json_process_run_workers(&work);
+    }
+
+    // Merge the shards between the top-level brackets
+    if (success) {
+        FILE *output = options->output_filename ? fopen(options->output_filename, "w") : stdout;
+        if (!output) {
+            perror("Error opening output file");
+            success = false;
+        } else {
+            fprintf(output, ";; JSON to S-expression conversion\n\n");
+            if (work.shard_count == 0) {
+                fprintf(output, work.object ? "(json:object)\n" : "(json:array)\n");
+            } else {
+                fprintf(output, work.object ? "(json:object\n" : "(json:array\n");
+                output_formatter_write_indentation(output, 1);
+                success = fflush(output) == 0;
+                for (size_t index = 0; success && index < work.shard_count; index++) {
+                    success = json_process_append_shard(work.shards[index].descriptor, fileno(output));
+                }
+                fprintf(output, ")\n");
+            }
+            if (fflush(output) != 0 || (output != stdout && fclose(output) != 0)) {
+                success = false;
+            }
+            if (!success) {
+                fprintf(stderr, "Error: Failed to write output\n");
+            }
+        }
+    }
+
+    for (size_t index = 0; index < work.shard_count; index++) {
+        if (work.shards[index].descriptor >= 0) {
+            close(work.shards[index].descriptor);
+        }
+    }
+    free(work.shards);
+    munmap(mapping, work.length);
+    return success;
+}
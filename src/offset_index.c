@@ -0,0 +1,214 @@
+/**
+ * @file offset_index.c
+ * @brief Sidecar index of where each top-level entry lands in the output
+ *
+ * The top-level container is written here entry by entry, byte for byte
+ * as sexpr_writer_write_value would write it, and the output position is
+ * read before and after every entry. Each entry gets one line in the
+ * index, so tools can seek straight to the form they need.
+ */
+
+#include "json_to_sexpr.h"
+
+/* Room for "[" plus the largest index and "]" */
+#define INDEX_MAX_ELEMENT_SUFFIX 32
+
+/**
+ * @brief Builds the JSON path of a member or element below a parent path
+ *
+ * Identifier-like keys use dot notation; any other key is written as a
+ * quoted JSON string in brackets. Elements use their index in brackets.
+ *
+ * @param parent Path of the containing value ("$" for the document)
+ * @param key The member key, or NULL for an array element
+ * @param element_index Element position when key is NULL
+ * @return Newly allocated path, or NULL on allocation failure
+ */
+char *sexpr_index_child_path(const char *parent, const char *key, size_t element_index) {
+    const size_t parent_length = strlen(parent);
+    if (!key) {
+        char *path = malloc(parent_length + INDEX_MAX_ELEMENT_SUFFIX);
+        if (path) {
+            memcpy(path, parent, parent_length);
+            snprintf(path + parent_length, INDEX_MAX_ELEMENT_SUFFIX, "[%lu]", (unsigned long)element_index);
+        }
+        return path;
+    }
+
+    const size_t key_length = strlen(key);
+    bool identifier = key_length > 0 && (isalpha((unsigned char)key[0]) || key[0] == '_');
+    for (size_t position = 1; identifier && position < key_length; position++) {
+        identifier = isalnum((unsigned char)key[position]) || key[position] == '_';
+    }
+
+    // Worst case: every byte becomes a six-character \u00XX escape
+    char *path = malloc(parent_length + key_length * 6 + 6);
+    if (!path) {
+        return NULL;
+    }
+
+    size_t length = parent_length;
+    memcpy(path, parent, parent_length);
+    if (identifier) {
+        path[length++] = '.';
+        memcpy(path + length, key, key_length);
+        length += key_length;
+    } else {
+        path[length++] = '[';
+        path[length++] = '"';
+        for (size_t position = 0; position < key_length; position++) {
+            const unsigned char c = (unsigned char)key[position];
+            if (c == '"' || c == '\\') {
+                path[length++] = '\\';
+                path[length++] = (char)c;
+            } else if (c < 0x20) {
+                length += (size_t)sprintf(path + length, "\\u%04x", c);
+            } else {
+                path[length++] = (char)c;
+            }
+        }
+        path[length++] = '"';
+        path[length++] = ']';
+    }
+    path[length] = '\0';
+    return path;
+}
+
+/**
+ * @brief Writes one index line
+ * @param writer The writer (for the string escaping mode)
+ * @param index_output The index stream
+ * @param key Member key, or NULL for an array element
+ * @param element_index Element position when key is NULL
+ * @param start Output offset where the entry's form begins
+ * @param end Output offset just past the entry's form
+ * @return true on success, false on allocation failure
+ */
+static bool sexpr_index_write_entry(sexpr_writer_t *writer, FILE *index_output, const char *key,
+                                    size_t element_index, long start, long end) {
+    char *path = sexpr_index_child_path("$", key, element_index);
+    char *escaped_path = path ? string_utils_escape_for_lisp(path, writer->unicode_mode) : NULL;
+    char *escaped_key = key ? string_utils_escape_for_lisp(key, writer->unicode_mode) : NULL;
+
+    const bool success = escaped_path != NULL && (key == NULL || escaped_key != NULL);
+    if (success) {
+        if (key) {
+            fprintf(index_output, "\n  (json:entry (json:key %s)", escaped_key);
+        } else {
+            fprintf(index_output, "\n  (json:entry (json:index %lu)", (unsigned long)element_index);
+        }
+        fprintf(index_output, " (json:path %s) (json:offset %ld) (json:length %ld))",
+                escaped_path, start, end - start);
+    } else {
+        fprintf(stderr, "Error: Out of memory\n");
+    }
+
+    free(escaped_key);
+    free(escaped_path);
+    free(path);
+    return success;
+}
+
+/**
+ * @brief Writes the document and an index of its top-level entries
+ *
+ * The output stream must be seekable (a regular file) so entry offsets can
+ * be read from it; offsets count from the start of the file. Scalar and
+ * empty documents produce an index without entries, and preview elision
+ * markers are not indexed. Without an index stream the document is still
+ * written entry by entry, which lets the writer's progress reporter count
+ * the top-level entries written.
+ *
+ * @param value The document to write
+ * @param writer The writer holding the output stream and options
+ * @param index_output Stream receiving the index, or NULL for none
+ * @return true on success
+ */
+bool sexpr_index_write_document(json_value_t *value, sexpr_writer_t *writer, FILE *index_output) {
+    FILE *output = writer->output;
+    long start = index_output ? ftell(output) : 0;
+    if (start < 0) {
+        fprintf(stderr, "Error: The offset index needs the output written to a file\n");
+        return false;
+    }
+
+    if (index_output) {
+        fprintf(index_output, ";; JSON to S-expression offset index\n\n(json:index");
+    }
+
+    const bool object = value->type == JSON_OBJECT && value->data.object != NULL;
+    const bool array = (value->type == JSON_ARRAY && value->data.array != NULL) ||
+                       value->type == JSON_TYPED_ARRAY || value->type == JSON_RECORD_ARRAY;
+    if (!object && !array) {
+        sexpr_writer_write_value(value, writer, 0);
+        if (index_output) {
+            fprintf(index_output, ")\n");
+        }
+        return true;
+    }
+
+    fprintf(output, object ? "(json:object\n" : "(json:array\n");
+    output_formatter_write_indentation(output, 1);
+
+    json_member_t *member = object ? value->data.object : NULL;
+    json_element_t *element = value->type == JSON_ARRAY ? value->data.array : NULL;
+    size_t count = 0;
+    switch (value->type) {
+        case JSON_TYPED_ARRAY:
+            count = value->data.typed_array->count;
+            break;
+        case JSON_RECORD_ARRAY:
+            count = value->data.record_array->record_count;
+            break;
+        default:
+            break;
+    }
+
+    bool success = true;
+    for (size_t position = 0; success; position++) {
+        if (object ? member == NULL : (element == NULL && position >= count)) {
+            break;
+        }
+        if (position > 0) {
+            fprintf(output, "\n");
+            output_formatter_write_indentation(output, 1);
+        }
+
+        start = index_output ? ftell(output) : 0;
+        const char *key = NULL;
+        bool indexed = true;
+        if (object) {
+            key = member->key;
+            indexed = key != NULL;
+            if (indexed) {
+                fprintf(output, "(json:%s ", key);
+                sexpr_writer_write_value(member->value, writer, 2);
+                fprintf(output, ")");
+            } else {
+                sexpr_writer_write_value(member->value, writer, 1);
+            }
+            member = member->next;
+        } else if (element) {
+            indexed = element->value == NULL || element->value->type != JSON_ELIDED;
+            sexpr_writer_write_value(element->value, writer, 1);
+            element = element->next;
+        } else if (value->type == JSON_TYPED_ARRAY) {
+            sexpr_writer_write_typed_item(value->data.typed_array, position, writer, 1);
+        } else {
+            sexpr_writer_write_record(value->data.record_array, position, writer, 1);
+        }
+
+        if (indexed && index_output) {
+            success = sexpr_index_write_entry(writer, index_output, key, position, start, ftell(output));
+        }
+        if (writer->progress) {
+            json_progress_update(writer->progress, position + 1);
+        }
+    }
+
+    fprintf(output, ")");
+    if (index_output) {
+        fprintf(index_output, ")\n");
+    }
+    return success;
+}
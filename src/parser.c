@@ -2,8 +2,8 @@
  * @file parser.c
  * @brief JSON lexical analysis and parsing implementation
  * 
- * This module provides a complete JSON parser with tokenization,
- * recursive descent parsing, and AST construction.
+ * This module provides a complete JSON parser with tokenization and a
+ * fused state machine that builds the AST straight from the input bytes.
  */
 
 #include "json_to_sexpr.h"
@@ -15,11 +15,50 @@
  */
 void parser_initialize(parser_t *parser, const char *input) {
     parser->input = input;
+    parser->mutable_input = NULL;
     parser->pos = 0;
     parser->length = strlen(input);
     parser->line = 1;
     parser->column = 1;
-    parser->current_token = tokenizer_get_next_token(parser);
+    parser->string_buffer = NULL;
+    parser->string_capacity = 0;
+    parser->progress = NULL;
+    parser->preview = NULL;
+    parser->current_token.type = TOKEN_EOF;
+}
+
+/**
+ * @brief Initializes the parser to unescape strings inside the input buffer
+ * 
+ * Decoded strings are written over their escaped form (never longer) and
+ * parsed string values and keys point into the buffer instead of being
+ * copied, so the buffer must outlive the parsed document.
+ * 
+ * @param parser The parser context to initialize
+ * @param input The JSON input string to parse (modified while parsing)
+ */
+void parser_initialize_in_place(parser_t *parser, char *input) {
+    parser->input = input;
+    parser->mutable_input = input;
+    parser->pos = 0;
+    parser->length = strlen(input);
+    parser->line = 1;
+    parser->column = 1;
+    parser->string_buffer = NULL;
+    parser->string_capacity = 0;
+    parser->progress = NULL;
+    parser->preview = NULL;
+    parser->current_token.type = TOKEN_EOF;
+}
+
+/**
+ * @brief Frees the parser's scratch storage
+ * @param parser The parser context
+ */
+void parser_release(parser_t *parser) {
+    free(parser->string_buffer);
+    parser->string_buffer = NULL;
+    parser->string_capacity = 0;
 }
 
 /**
@@ -44,19 +83,197 @@ void tokenizer_skip_whitespace(parser_t *parser) {
 }
 
 /**
- * @brief Parses a JSON string literal token with escape sequence handling
+ * @brief Measures the run of bytes before the next '"' or '\\'
+ * @param text Bytes to scan
+ * @param available Number of bytes available
+ * @return Length of the run that needs no escape processing
+ */
+static size_t tokenizer_scan_plain_run(const char *text, size_t available) {
+    size_t run_length = 0;
+    
+    // Test eight bytes per step for a quote or backslash, then locate it
+    while (run_length + 8 <= available) {
+        uint64_t word;
+        memcpy(&word, text + run_length, sizeof(word));
+        const uint64_t quotes = word ^ 0x2222222222222222ULL;
+        const uint64_t backslashes = word ^ 0x5C5C5C5C5C5C5C5CULL;
+        const uint64_t hits = (((quotes - 0x0101010101010101ULL) & ~quotes) |
+                               ((backslashes - 0x0101010101010101ULL) & ~backslashes)) &
+                              0x8080808080808080ULL;
+        if (hits != 0) {
+            break;
+        }
+        run_length += 8;
+    }
+    
+    while (run_length < available && text[run_length] != '"' && text[run_length] != '\\') {
+        run_length++;
+    }
+    return run_length;
+}
+
+/**
+ * @brief Makes room in the scratch buffer for decoded string bytes
  * @param parser The parser context
- * @return A token containing the parsed string value
+ * @param required Total number of bytes needed
+ * @return true on success, false on allocation failure
  */
-token_t tokenizer_parse_string_literal(parser_t *parser) {
-    token_t token = {TOKEN_STRING, "", 0.0};
+static bool tokenizer_reserve_string_buffer(parser_t *parser, size_t required) {
+    if (required <= parser->string_capacity) {
+        return true;
+    }
+    
+    size_t new_capacity = parser->string_capacity ? parser->string_capacity : MAX_TOKEN_SIZE;
+    while (new_capacity < required) {
+        new_capacity *= 2;
+    }
+    
+    char *new_buffer = realloc(parser->string_buffer, new_capacity);
+    if (!new_buffer) {
+        return false;
+    }
+    parser->string_buffer = new_buffer;
+    parser->string_capacity = new_capacity;
+    return true;
+}
+
+/* Hex digit values plus one, so zero marks a non-hex character */
+static const unsigned char tokenizer_hex_values[256] = {
+    ['0'] = 1,  ['1'] = 2,  ['2'] = 3,  ['3'] = 4,  ['4'] = 5,
+    ['5'] = 6,  ['6'] = 7,  ['7'] = 8,  ['8'] = 9,  ['9'] = 10,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16
+};
+
+/**
+ * @brief Reads the four hex digits of a \\u escape
+ * @param text Points at the first hex digit
+ * @return The code unit, or -1 if any digit is not hex
+ */
+static long tokenizer_read_hex_quad(const char *text) {
+    const unsigned char digit0 = tokenizer_hex_values[(unsigned char)text[0]];
+    const unsigned char digit1 = tokenizer_hex_values[(unsigned char)text[1]];
+    const unsigned char digit2 = tokenizer_hex_values[(unsigned char)text[2]];
+    const unsigned char digit3 = tokenizer_hex_values[(unsigned char)text[3]];
+    
+    if (!digit0 || !digit1 || !digit2 || !digit3) {
+        return -1;
+    }
+    return ((long)(digit0 - 1) << 12) | ((digit1 - 1) << 8) | ((digit2 - 1) << 4) | (digit3 - 1);
+}
+
+/**
+ * @brief Decodes a \\uXXXX escape (and a following low surrogate) to UTF-8
+ * 
+ * Unpaired surrogates become U+FFFD. U+0000 cannot live in a C string and
+ * is kept as the literal text \\u0000. The output is never longer than the
+ * escape it replaces, so this is safe for in-place decoding.
+ * 
+ * @param parser The parser context, positioned on the 'u'; on success left on
+ *        the last consumed hex digit
+ * @param destination Where the UTF-8 bytes are written
+ * @return Number of bytes written, or -1 for a malformed escape
+ */
+static int tokenizer_decode_unicode_escape(parser_t *parser, char *destination) {
+    if (parser->pos + 4 >= parser->length) {
+        return -1;
+    }
+    
+    long code_point = tokenizer_read_hex_quad(parser->input + parser->pos + 1);
+    if (code_point < 0) {
+        return -1;
+    }
+    size_t consumed = 4;
+    
+    if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+        const char *next = parser->input + parser->pos + 5;
+        long low_surrogate = -1;
+        if (parser->pos + 10 < parser->length && next[0] == '\\' && next[1] == 'u') {
+            low_surrogate = tokenizer_read_hex_quad(next + 2);
+        }
+        if (low_surrogate >= 0xDC00 && low_surrogate <= 0xDFFF) {
+            code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low_surrogate - 0xDC00);
+            consumed = 10;
+        } else {
+            code_point = 0xFFFD;
+        }
+    } else if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+        code_point = 0xFFFD;
+    }
+    
+    int written;
+    if (code_point == 0) {
+        memmove(destination, "\\u0000", 6);
+        written = 6;
+    } else if (code_point < 0x80) {
+        destination[0] = (char)code_point;
+        written = 1;
+    } else if (code_point < 0x800) {
+        destination[0] = (char)(0xC0 | (code_point >> 6));
+        destination[1] = (char)(0x80 | (code_point & 0x3F));
+        written = 2;
+    } else if (code_point < 0x10000) {
+        destination[0] = (char)(0xE0 | (code_point >> 12));
+        destination[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        destination[2] = (char)(0x80 | (code_point & 0x3F));
+        written = 3;
+    } else {
+        destination[0] = (char)(0xF0 | (code_point >> 18));
+        destination[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+        destination[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        destination[3] = (char)(0x80 | (code_point & 0x3F));
+        written = 4;
+    }
+    
+    parser->pos += consumed;
+    parser->column += (int)consumed;
+    return written;
+}
+
+/**
+ * @brief Scans a JSON string literal with escape sequence handling
+ * 
+ * The decoded text goes to the parser's scratch buffer, or over the escaped
+ * text itself when the parser was initialized in place. Scratch text is only
+ * valid until the next string is scanned.
+ * 
+ * @param parser The parser context, positioned on the opening quote
+ * @param text Receives the NUL-terminated decoded text
+ * @param length Receives the decoded length in bytes
+ * @return true on success, false on error (already reported)
+ */
+bool tokenizer_scan_string(parser_t *parser, const char **text, size_t *length) {
     size_t value_pos = 0;
     bool found_closing_quote = false;
     
     parser->pos++; // Skip opening quote
     parser->column++;
     
-    while (parser->pos < parser->length && value_pos < MAX_TOKEN_SIZE - 1) {
+    const bool in_place = parser->mutable_input != NULL;
+    char *destination = in_place ? parser->mutable_input + parser->pos : NULL;
+    
+    while (parser->pos < parser->length) {
+        const size_t run_length = tokenizer_scan_plain_run(parser->input + parser->pos,
+                                                           parser->length - parser->pos);
+        if (!in_place) {
+            // Room for the run, the longest escape expansion and the terminator
+            if (!tokenizer_reserve_string_buffer(parser, value_pos + run_length + 7)) {
+                fprintf(stderr, "Error: Out of memory\n");
+                return false;
+            }
+            destination = parser->string_buffer;
+            memcpy(destination + value_pos, parser->input + parser->pos, run_length);
+        } else if (destination + value_pos != parser->mutable_input + parser->pos) {
+            memmove(destination + value_pos, parser->input + parser->pos, run_length);
+        }
+        value_pos += run_length;
+        parser->pos += run_length;
+        parser->column += (int)run_length;
+        
+        if (parser->pos >= parser->length) {
+            break;
+        }
+        
         char c = parser->input[parser->pos];
         
         if (c == '"') {
@@ -64,30 +281,39 @@ token_t tokenizer_parse_string_literal(parser_t *parser) {
             parser->column++;
             found_closing_quote = true;
             break;
-        } else if (c == '\\' && parser->pos + 1 < parser->length) {
+        } else if (parser->pos + 1 < parser->length) {
             parser->pos++;
             parser->column++;
             char escaped = parser->input[parser->pos];
             switch (escaped) {
-                case '"': token.value[value_pos++] = '"'; break;
-                case '\\': token.value[value_pos++] = '\\'; break;
-                case '/': token.value[value_pos++] = '/'; break;
-                case 'b': token.value[value_pos++] = '\b'; break;
-                case 'f': token.value[value_pos++] = '\f'; break;
-                case 'n': token.value[value_pos++] = '\n'; break;
-                case 'r': token.value[value_pos++] = '\r'; break;
-                case 't': token.value[value_pos++] = '\t'; break;
-                default: 
-                    token.value[value_pos++] = '\\';
-                    if (value_pos < MAX_TOKEN_SIZE - 1) {
-                        token.value[value_pos++] = escaped;
+                case '"': destination[value_pos++] = '"'; break;
+                case '\\': destination[value_pos++] = '\\'; break;
+                case '/': destination[value_pos++] = '/'; break;
+                case 'b': destination[value_pos++] = '\b'; break;
+                case 'f': destination[value_pos++] = '\f'; break;
+                case 'n': destination[value_pos++] = '\n'; break;
+                case 'r': destination[value_pos++] = '\r'; break;
+                case 't': destination[value_pos++] = '\t'; break;
+                case 'u': {
+                    const int written = tokenizer_decode_unicode_escape(parser, destination + value_pos);
+                    if (written < 0) {
+                        fprintf(stderr, "Invalid \\u escape at line %d, column %d\n",
+                                parser->line, parser->column);
+                        return false;
                     }
+                    value_pos += (size_t)written;
+                    break;
+                }
+                default: 
+                    destination[value_pos++] = '\\';
+                    destination[value_pos++] = escaped;
                     break;
             }
             parser->pos++;
             parser->column++;
         } else {
-            token.value[value_pos++] = c;
+            // Lone backslash at the very end of the input
+            destination[value_pos++] = c;
             parser->pos++;
             parser->column++;
         }
@@ -97,29 +323,49 @@ token_t tokenizer_parse_string_literal(parser_t *parser) {
     if (!found_closing_quote) {
         fprintf(stderr, "Unterminated string at line %d, column %d\n", 
                 parser->line, parser->column);
-        token.type = TOKEN_ERROR;
-        return token;
+        return false;
     }
     
-    token.value[value_pos] = '\0';
+    destination[value_pos] = '\0';
+    *text = destination;
+    *length = value_pos;
+    return true;
+}
+
+/**
+ * @brief Parses a JSON string literal token with escape sequence handling
+ * @param parser The parser context
+ * @return A token whose string field holds the decoded value
+ */
+token_t tokenizer_parse_string_literal(parser_t *parser) {
+    token_t token = {TOKEN_STRING, "", 0.0, NULL, 0};
+    
+    if (!tokenizer_scan_string(parser, &token.string, &token.string_length)) {
+        token.type = TOKEN_ERROR;
+    }
     return token;
 }
 
-/* Parse a JSON number token */
-token_t tokenizer_parse_numeric_literal(parser_t *parser) {
-    token_t token = {TOKEN_NUMBER, "", 0.0};
+/**
+ * @brief Scans a JSON number literal
+ * @param parser The parser context, positioned on the first character
+ * @param text Buffer of MAX_TOKEN_SIZE bytes receiving the literal text
+ * @param number Receives the numeric value
+ * @return true on success, false on error (already reported)
+ */
+bool tokenizer_scan_number(parser_t *parser, char *text, double *number) {
     size_t value_pos = 0;
     
     // Handle negative numbers
     if (parser->input[parser->pos] == '-') {
-        token.value[value_pos++] = '-';
+        text[value_pos++] = '-';
         parser->pos++;
         parser->column++;
     }
     
     // Check for invalid leading zero pattern (like "01", "02", etc.)
     if (parser->pos < parser->length && parser->input[parser->pos] == '0') {
-        token.value[value_pos++] = '0';
+        text[value_pos++] = '0';
         parser->pos++;
         parser->column++;
         
@@ -127,14 +373,13 @@ token_t tokenizer_parse_numeric_literal(parser_t *parser) {
         if (parser->pos < parser->length && isdigit(parser->input[parser->pos])) {
             fprintf(stderr, "Invalid number with leading zero at line %d, column %d\n", 
                     parser->line, parser->column);
-            token.type = TOKEN_ERROR;
-            return token;
+            return false;
         }
     } else {
         // Parse integer part (non-zero start)
         while (parser->pos < parser->length && isdigit(parser->input[parser->pos])) {
             if (value_pos < MAX_TOKEN_SIZE - 1) {
-                token.value[value_pos++] = parser->input[parser->pos];
+                text[value_pos++] = parser->input[parser->pos];
             }
             parser->pos++;
             parser->column++;
@@ -144,14 +389,14 @@ token_t tokenizer_parse_numeric_literal(parser_t *parser) {
     // Parse fractional part
     if (parser->pos < parser->length && parser->input[parser->pos] == '.') {
         if (value_pos < MAX_TOKEN_SIZE - 1) {
-            token.value[value_pos++] = '.';
+            text[value_pos++] = '.';
         }
         parser->pos++;
         parser->column++;
         
         while (parser->pos < parser->length && isdigit(parser->input[parser->pos])) {
             if (value_pos < MAX_TOKEN_SIZE - 1) {
-                token.value[value_pos++] = parser->input[parser->pos];
+                text[value_pos++] = parser->input[parser->pos];
             }
             parser->pos++;
             parser->column++;
@@ -162,7 +407,7 @@ token_t tokenizer_parse_numeric_literal(parser_t *parser) {
     if (parser->pos < parser->length && 
         (parser->input[parser->pos] == 'e' || parser->input[parser->pos] == 'E')) {
         if (value_pos < MAX_TOKEN_SIZE - 1) {
-            token.value[value_pos++] = parser->input[parser->pos];
+            text[value_pos++] = parser->input[parser->pos];
         }
         parser->pos++;
         parser->column++;
@@ -170,7 +415,7 @@ token_t tokenizer_parse_numeric_literal(parser_t *parser) {
         if (parser->pos < parser->length && 
             (parser->input[parser->pos] == '+' || parser->input[parser->pos] == '-')) {
             if (value_pos < MAX_TOKEN_SIZE - 1) {
-                token.value[value_pos++] = parser->input[parser->pos];
+                text[value_pos++] = parser->input[parser->pos];
             }
             parser->pos++;
             parser->column++;
@@ -178,21 +423,31 @@ token_t tokenizer_parse_numeric_literal(parser_t *parser) {
         
         while (parser->pos < parser->length && isdigit(parser->input[parser->pos])) {
             if (value_pos < MAX_TOKEN_SIZE - 1) {
-                token.value[value_pos++] = parser->input[parser->pos];
+                text[value_pos++] = parser->input[parser->pos];
             }
             parser->pos++;
             parser->column++;
         }
     }
     
-    token.value[value_pos] = '\0';
-    token.number_value = atof(token.value);
+    text[value_pos] = '\0';
+    *number = atof(text);
+    return true;
+}
+
+/* Parse a JSON number token */
+token_t tokenizer_parse_numeric_literal(parser_t *parser) {
+    token_t token = {TOKEN_NUMBER, "", 0.0, NULL, 0};
+    
+    if (!tokenizer_scan_number(parser, token.value, &token.number_value)) {
+        token.type = TOKEN_ERROR;
+    }
     return token;
 }
 
 /* Parse JSON keywords (true, false, null) */
 token_t tokenizer_parse_keyword_literal(parser_t *parser) {
-    token_t token = {TOKEN_ERROR, "", 0.0};
+    token_t token = {TOKEN_ERROR, "", 0.0, NULL, 0};
     
     if (strncmp(parser->input + parser->pos, "true", 4) == 0) {
         token.type = TOKEN_TRUE;
@@ -219,12 +474,12 @@ token_t tokenizer_get_next_token(parser_t *parser) {
     tokenizer_skip_whitespace(parser);
     
     if (parser->pos >= parser->length) {
-        token_t token = {TOKEN_EOF, "", 0.0};
+        token_t token = {TOKEN_EOF, "", 0.0, NULL, 0};
         return token;
     }
     
     char c = parser->input[parser->pos];
-    token_t token = {TOKEN_ERROR, "", 0.0};
+    token_t token = {TOKEN_ERROR, "", 0.0, NULL, 0};
     
     switch (c) {
         case '{':
@@ -289,193 +544,1115 @@ token_t tokenizer_get_next_token(parser_t *parser) {
     return token;
 }
 
-/* Parse JSON value */
-json_value_t *json_parser_parse_value(parser_t *parser) {
-    json_value_t *value = malloc(sizeof(json_value_t));
-    if (!value) return NULL;
+/**
+ * @brief Measures the first token of some text, as far as the tokenizer reads it
+ * 
+ * Lets callers that see the input in pieces gather just enough of it to
+ * tokenize the same way as with the whole input at hand.
+ * 
+ * @param text The text, starting on a non-whitespace byte
+ * @param length Number of bytes available
+ * @return Bytes the token spans, or length if it may go on past them
+ */
+size_t tokenizer_token_extent(const char *text, size_t length) {
+    if (length == 0) {
+        return 0;
+    }
     
-    switch (parser->current_token.type) {
-        case TOKEN_LBRACE:
-            free(value);
-            return json_parser_parse_object(parser);
-        case TOKEN_LBRACKET:
-            free(value);
-            return json_parser_parse_array(parser);
-        case TOKEN_STRING:
-            value->type = JSON_STRING;
-            value->data.string = malloc(strlen(parser->current_token.value) + 1);
-            if (value->data.string) {
-                strcpy(value->data.string, parser->current_token.value);
-            }
-            parser->current_token = tokenizer_get_next_token(parser);
-            break;
-        case TOKEN_NUMBER:
-            value->type = JSON_NUMBER;
-            value->data.number = parser->current_token.number_value;
-            parser->current_token = tokenizer_get_next_token(parser);
-            break;
-        case TOKEN_TRUE:
-            value->type = JSON_BOOLEAN;
-            value->data.boolean = true;
-            parser->current_token = tokenizer_get_next_token(parser);
+    size_t extent = 1;
+    switch (text[0]) {
+        case '"':
+            extent = json_validator_skip_string(text, length, 1) + 1;
             break;
-        case TOKEN_FALSE:
-            value->type = JSON_BOOLEAN;
-            value->data.boolean = false;
-            parser->current_token = tokenizer_get_next_token(parser);
+        case '-':
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            while (extent < length && strchr("0123456789.eE+-", text[extent]) && text[extent] != '\0') {
+                extent++;
+            }
+            if (extent == length) {
+                extent++;   // the run may go on
+            }
             break;
-        case TOKEN_NULL:
-            value->type = JSON_NULL;
-            parser->current_token = tokenizer_get_next_token(parser);
+        case 't': case 'f': case 'n':
+            extent = 5;
             break;
-        case TOKEN_ERROR:
-            fprintf(stderr, "Parse error: Invalid token encountered\n");
-            free(value);
-            return NULL;
-        default:
-            fprintf(stderr, "Parse error: Unexpected token type\n");
-            free(value);
-            return NULL;
     }
-    
-    return value;
+    return extent < length ? extent : length;
+}
+
+/**
+ * @brief Reports content after the document, as the sequential converter does
+ * 
+ * The first trailing token is read with the tokenizer, so that anything it
+ * has to say about the token comes before the warning, which gives the
+ * position just past the token.
+ * 
+ * @param text NUL-terminated trailing content, from its first non-whitespace
+ *        byte through at least its first token (see tokenizer_token_extent)
+ * @param line Input line of text[0]
+ * @param column Input column of text[0]
+ */
+void tokenizer_report_trailing(const char *text, int line, int column) {
+    parser_t parser;
+    parser_initialize(&parser, text);
+    parser.line = line;
+    parser.column = column;
+    tokenizer_get_next_token(&parser);
+    fprintf(stderr, "Warning: Extra content after JSON at line %d, column %d\n", parser.line, parser.column);
+    parser_release(&parser);
 }
 
-/* Parse JSON object */
-json_value_t *json_parser_parse_object(parser_t *parser) {
-    json_value_t *object = malloc(sizeof(json_value_t));
-    if (!object) return NULL;
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || \
+    defined(_M_X64) || defined(_M_IX86)
+#define PARSER_SWAR_DIGITS 1
+#endif
+
+/* Longest digit run converted exactly in a uint64_t (10^19 - 1 fits) */
+#define INTEGER_RUN_MAX_DIGITS 19
+
+#ifdef PARSER_SWAR_DIGITS
+/**
+ * @brief Counts the leading ASCII digits in an 8-byte little-endian word
+ * @param word Eight input bytes, first byte in the low-order position
+ * @return Number of leading digit bytes (0-8)
+ */
+static unsigned swar_count_leading_digits(uint64_t word) {
+    // Digit bytes become 0x00-0x09; anything else gets its high bit set
+    const uint64_t shifted = word ^ 0x3030303030303030ULL;
+    const uint64_t non_digits = (((shifted & 0x7F7F7F7F7F7F7F7FULL) + 0x7676767676767676ULL) |
+                                 shifted) & 0x8080808080808080ULL;
+    if (non_digits == 0) {
+        return 8;
+    }
+#if defined(__GNUC__)
+    return (unsigned)__builtin_ctzll(non_digits) / 8;
+#else
+    unsigned count = 0;
+    while (!(non_digits & (0x80ULL << (count * 8)))) {
+        count++;
+    }
+    return count;
+#endif
+}
+
+/**
+ * @brief Converts up to eight leading ASCII digits of a word in parallel
+ * @param word Eight input bytes, first byte in the low-order position
+ * @param digit_count Number of leading digit bytes to convert (1-8)
+ * @return The decimal value of those digits
+ */
+static uint64_t swar_parse_digits(uint64_t word, unsigned digit_count) {
+    // Shift the digits into the high bytes so the vacated bytes read as zeros
+    if (digit_count < 8) {
+        word <<= 8 * (8 - digit_count);
+    }
+    word = ((word & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+    word = ((word & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+    return ((word & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32;
+}
+#endif
+
+/**
+ * @brief Scans a plain integer literal (no fraction or exponent) at a position
+ * @param input The input text
+ * @param length Total input length
+ * @param pos Start of the literal; advanced past its digits on success
+ * @param number Receives the value as the tokenizer would produce it
+ * @return true if a plain integer was recognized, false to defer to the tokenizer
+ */
+static bool parser_scan_plain_integer(const char *input, size_t length, size_t *pos, double *number) {
+    size_t cursor = *pos;
+    const bool negative = cursor < length && input[cursor] == '-';
+    if (negative) {
+        cursor++;
+    }
     
-    object->type = JSON_OBJECT;
-    object->data.object = NULL;
+    const size_t digits_start = cursor;
+    uint64_t magnitude = 0;
     
-    parser->current_token = tokenizer_get_next_token(parser); // Skip '{'
+#ifdef PARSER_SWAR_DIGITS
+    // Convert 8 digits per step, up to two steps for a 16-digit value
+    while (cursor + 8 <= length && cursor - digits_start <= 8) {
+        uint64_t word;
+        memcpy(&word, input + cursor, sizeof(word));
+        const unsigned digit_count = swar_count_leading_digits(word);
+        if (digit_count == 0) {
+            break;
+        }
+        
+        static const uint64_t powers_of_ten[9] = {
+            1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000
+        };
+        magnitude = magnitude * powers_of_ten[digit_count] + swar_parse_digits(word, digit_count);
+        cursor += digit_count;
+        if (digit_count < 8) {
+            break;
+        }
+    }
+#endif
     
-    if (parser->current_token.type == TOKEN_RBRACE) {
-        parser->current_token = tokenizer_get_next_token(parser); // Skip '}'
-        return object;
+    while (cursor < length && input[cursor] >= '0' && input[cursor] <= '9' &&
+           cursor - digits_start < INTEGER_RUN_MAX_DIGITS) {
+        magnitude = magnitude * 10 + (uint64_t)(input[cursor] - '0');
+        cursor++;
     }
     
-    json_member_t *last_member = NULL;
+    const size_t digit_count = cursor - digits_start;
+    if (digit_count == 0 || (digit_count > 1 && input[digits_start] == '0')) {
+        return false;
+    }
     
-    while (parser->current_token.type != TOKEN_EOF) {
-        if (parser->current_token.type != TOKEN_STRING) {
-            fprintf(stderr, "Expected string key in object\n");
-            json_memory_free_value(object);
-            return NULL;
+    // Fractions, exponents and over-long runs go through the tokenizer
+    if (cursor < length) {
+        const char next = input[cursor];
+        if (next == '.' || next == 'e' || next == 'E' || (next >= '0' && next <= '9')) {
+            return false;
         }
+    }
+    
+    *number = negative ? -(double)magnitude : (double)magnitude;
+    *pos = cursor;
+    return true;
+}
+
+/**
+ * @brief Appends a run of `, integer` elements without producing tokens
+ * 
+ * Works directly on the input bytes after the current numeric token. Each
+ * element is consumed only if it is a plain integer; otherwise the position
+ * is left just after the last consumed element so the regular tokenizer
+ * picks up from there.
+ * 
+ * @param parser The parser context, positioned after a numeric element
+ * @param typed_array The numeric packed array being filled
+ * @return true on success, false on allocation failure
+ */
+bool json_parser_scan_integer_run(parser_t *parser, json_typed_array_t *typed_array) {
+    const char *input = parser->input;
+    const size_t length = parser->length;
+    
+    while (true) {
+        size_t cursor = parser->pos;
+        int line = parser->line;
+        int column = parser->column;
         
-        json_member_t *member = malloc(sizeof(json_member_t));
-        if (!member) {
-            json_memory_free_value(object);
-            return NULL;
+        bool seen_comma = false;
+        while (cursor < length) {
+            const char c = input[cursor];
+            if (c == ' ' || c == '\t' || c == '\r') {
+                column++;
+            } else if (c == '\n') {
+                line++;
+                column = 1;
+            } else if (c == ',' && !seen_comma) {
+                seen_comma = true;
+                column++;
+            } else {
+                break;
+            }
+            cursor++;
         }
-        
-        member->key = malloc(strlen(parser->current_token.value) + 1);
-        if (member->key) {
-            strcpy(member->key, parser->current_token.value);
+        if (!seen_comma) {
+            return true;
         }
-        member->value = NULL;
-        member->next = NULL;
         
-        parser->current_token = tokenizer_get_next_token(parser); // Skip key
+        const size_t element_start = cursor;
+        double number;
+        if (!parser_scan_plain_integer(input, length, &cursor, &number)) {
+            return true;
+        }
         
-        if (parser->current_token.type != TOKEN_COLON) {
-            fprintf(stderr, "Expected ':' after object key\n");
-            free(member->key);
-            free(member);
-            json_memory_free_value(object);
-            return NULL;
+        if (!json_typed_array_append_number(typed_array, number)) {
+            return false;
         }
         
-        parser->current_token = tokenizer_get_next_token(parser); // Skip ':'
+        parser->pos = cursor;
+        parser->line = line;
+        parser->column = column + (int)(cursor - element_start);
+    }
+}
+
+/**
+ * @brief Gets storage for a decoded string value or key
+ * @param parser The parser context
+ * @param text Decoded text from tokenizer_scan_string
+ * @param length Decoded length in bytes
+ * @return The text itself in in-place mode, otherwise a newly allocated
+ *         copy (NULL on allocation failure)
+ */
+static char *json_parser_store_string(parser_t *parser, const char *text, size_t length) {
+    if (parser->mutable_input) {
+        return (char *)text;
+    }
+    
+    char *copy = malloc(length + 1);
+    if (copy) {
+        memcpy(copy, text, length + 1);
+    }
+    return copy;
+}
+
+/**
+ * @brief Returns the next significant input byte without consuming it
+ * @param parser The parser context
+ * @return The byte after any whitespace, or '\0' at the end of input
+ */
+static unsigned char json_parser_peek_byte(parser_t *parser) {
+    unsigned char c = (unsigned char)parser->input[parser->pos];
+    
+    if (c <= ' ' && c != '\0') {
+        tokenizer_skip_whitespace(parser);
+        c = (unsigned char)parser->input[parser->pos];
+    }
+    return c;
+}
+
+/**
+ * @brief Reports a byte that cannot start any token, as the tokenizer does
+ * 
+ * Used where a separator, colon or key is expected, before the caller's own
+ * message; a misplaced byte that starts some other token is left to that
+ * message alone.
+ * 
+ * @param parser The parser context, positioned on the byte
+ */
+static void json_parser_report_unexpected(const parser_t *parser) {
+    const unsigned char c = (unsigned char)parser->input[parser->pos];
+    if (parser->pos < parser->length && (c == '\0' || !strchr("{}[]:,\"-0123456789tfn", c))) {
+        fprintf(stderr, "Unexpected character '%c' at line %d, column %d\n",
+                c, parser->line, parser->column);
+    }
+}
+
+/**
+ * @brief Consumes a single-byte structural character
+ * @param parser The parser context
+ */
+static void json_parser_consume_byte(parser_t *parser) {
+    parser->pos++;
+    parser->column++;
+}
+
+/**
+ * @brief Scans a number, trying the plain integer fast path first
+ * @param parser The parser context, positioned on the first character
+ * @param text Buffer of MAX_TOKEN_SIZE bytes for the general scanner
+ * @param number Receives the numeric value
+ * @return true on success, false on error (already reported)
+ */
+static bool json_parser_scan_number(parser_t *parser, char *text, double *number) {
+    const size_t start = parser->pos;
+    
+    if (parser_scan_plain_integer(parser->input, parser->length, &parser->pos, number)) {
+        parser->column += (int)(parser->pos - start);
+        return true;
+    }
+    return tokenizer_scan_number(parser, text, number);
+}
+
+/**
+ * @brief Determines whether an element can be stored in a packed array
+ * @param text The element's first input bytes
+ * @param kind Receives TYPED_ARRAY_INT64 for numbers, TYPED_ARRAY_BOOLEAN
+ *        for booleans
+ * @return true if the element is a number or boolean
+ */
+static bool json_parser_packed_kind(const char *text, typed_array_kind_t *kind) {
+    if (*text == '-' || (*text >= '0' && *text <= '9')) {
+        *kind = TYPED_ARRAY_INT64;
+        return true;
+    }
+    if (strncmp(text, "true", 4) == 0 || strncmp(text, "false", 5) == 0) {
+        *kind = TYPED_ARRAY_BOOLEAN;
+        return true;
+    }
+    return false;
+}
+
+/* How a run of packed array elements ended */
+typedef enum {
+    TYPED_RUN_ERROR,        // malformed input, already reported
+    TYPED_RUN_CLOSED,       // consumed the closing ']'
+    TYPED_RUN_MISMATCH      // consumed a ',' before an element of another kind
+} typed_run_stop_t;
+
+/**
+ * @brief Parses a run of homogeneous numeric or boolean array elements
+ * 
+ * Appends elements straight from the input bytes while they share the
+ * packed array's kind.
+ * 
+ * @param parser The parser context, positioned on the first element
+ * @param typed_array The packed array being filled
+ * @param number_text Buffer of MAX_TOKEN_SIZE bytes for number scanning
+ * @return How the run ended
+ */
+static typed_run_stop_t json_parser_parse_typed_run(parser_t *parser, json_typed_array_t *typed_array,
+                                                    char *number_text) {
+    while (true) {
+        bool appended;
+        if (typed_array->kind == TYPED_ARRAY_BOOLEAN) {
+            const bool boolean = parser->input[parser->pos] == 't';
+            const int width = boolean ? 4 : 5;
+            parser->pos += (size_t)width;
+            parser->column += width;
+            appended = json_typed_array_append_boolean(typed_array, boolean);
+        } else {
+            double number;
+            if (!json_parser_scan_number(parser, number_text, &number)) {
+                fprintf(stderr, "Parse error: Invalid token encountered\n");
+                return TYPED_RUN_ERROR;
+            }
+            // Consume following plain integers without leaving this loop
+            appended = json_typed_array_append_number(typed_array, number) &&
+                       json_parser_scan_integer_run(parser, typed_array);
+        }
+        if (!appended) {
+            return TYPED_RUN_ERROR;
+        }
         
-        member->value = json_parser_parse_value(parser);
-        if (!member->value) {
-            free(member->key);
-            free(member);
-            json_memory_free_value(object);
-            return NULL;
+        unsigned char c = json_parser_peek_byte(parser);
+        if (c == ']') {
+            json_parser_consume_byte(parser);
+            return TYPED_RUN_CLOSED;
+        }
+        if (c != ',') {
+            json_parser_report_unexpected(parser);
+            fprintf(stderr, "Expected ',' or ']' in array\n");
+            return TYPED_RUN_ERROR;
         }
+        json_parser_consume_byte(parser);
         
-        if (object->data.object == NULL) {
-            object->data.object = member;
-        } else {
-            last_member->next = member;
+        c = json_parser_peek_byte(parser);
+        if (c == ']') {
+            fprintf(stderr, "Parse error: Unexpected token type\n");
+            return TYPED_RUN_ERROR;
         }
-        last_member = member;
         
-        if (parser->current_token.type == TOKEN_COMMA) {
-            parser->current_token = tokenizer_get_next_token(parser); // Skip ','
-        } else if (parser->current_token.type == TOKEN_RBRACE) {
-            parser->current_token = tokenizer_get_next_token(parser); // Skip '}'
-            break;
-        } else {
-            fprintf(stderr, "Expected ',' or '}' in object\n");
-            json_memory_free_value(object);
-            return NULL;
+        typed_array_kind_t next_kind;
+        if (!json_parser_packed_kind(parser->input + parser->pos, &next_kind) ||
+            (next_kind == TYPED_ARRAY_BOOLEAN) != (typed_array->kind == TYPED_ARRAY_BOOLEAN)) {
+            return TYPED_RUN_MISMATCH;
+        }
+    }
+}
+
+/* Containers the state machine can be filling */
+typedef enum {
+    PARSE_FRAME_OBJECT,
+    PARSE_FRAME_ARRAY,
+    PARSE_FRAME_RECORDS,        // columnar record array, between rows
+    PARSE_FRAME_RECORD_ROW,     // columnar record array, inside a row
+    PARSE_FRAME_KIND_COUNT
+} parse_frame_kind_t;
+
+/* An open container on the state machine's stack */
+typedef struct {
+    parse_frame_kind_t kind;
+    json_value_t *container;        // not yet attached to its parent
+    json_member_t *last_member;     // OBJECT: tail of the member list
+    json_element_t *last_element;   // ARRAY: tail of the element list
+    size_t record_member;           // RECORD_ROW: members of the row stored so far
+    size_t shown;                   // OBJECT, ARRAY: entries kept so far in a preview
+} parse_frame_t;
+
+/* Stack of open containers, innermost last */
+typedef struct {
+    parse_frame_t *frames;
+    size_t depth;
+    size_t capacity;
+} parse_stack_t;
+
+/**
+ * @brief Opens a container on the parse stack
+ * @param stack The parse stack
+ * @param kind Frame kind
+ * @param container The container value (owned by the stack until closed)
+ * @return true on success, false on allocation failure (container not taken)
+ */
+static bool parse_stack_push(parse_stack_t *stack, parse_frame_kind_t kind, json_value_t *container) {
+    if (stack->depth == stack->capacity) {
+        const size_t new_capacity = stack->capacity ? stack->capacity * 2 : MAX_DEPTH;
+        parse_frame_t *new_frames = realloc(stack->frames, new_capacity * sizeof(parse_frame_t));
+        if (!new_frames) {
+            return false;
+        }
+        stack->frames = new_frames;
+        stack->capacity = new_capacity;
+    }
+    
+    parse_frame_t *frame = &stack->frames[stack->depth++];
+    frame->kind = kind;
+    frame->container = container;
+    frame->last_member = NULL;
+    frame->last_element = NULL;
+    frame->record_member = 0;
+    frame->shown = 0;
+    return true;
+}
+
+/**
+ * @brief Checks that a container may open at the current position
+ * 
+ * Every container counts as a level, including empty and packed arrays,
+ * which never take a frame, and a record row, whose members are stored in
+ * its record array's frame. The validator counts levels the same way.
+ * 
+ * @param stack The parse stack
+ * @return true if the container is within MAX_NESTING_DEPTH levels
+ */
+static bool parse_stack_has_room(const parse_stack_t *stack) {
+    const bool in_row = stack->depth > 0 && stack->frames[stack->depth - 1].kind == PARSE_FRAME_RECORD_ROW;
+    if (stack->depth + (in_row ? 1 : 0) < MAX_NESTING_DEPTH) {
+        return true;
+    }
+    fprintf(stderr, "Parse error: Containers nested deeper than %d levels\n", MAX_NESTING_DEPTH);
+    return false;
+}
+
+/**
+ * @brief Frees every open container and the stack itself
+ * @param stack The parse stack
+ */
+static void parse_stack_free(parse_stack_t *stack) {
+    while (stack->depth > 0) {
+        json_memory_free_value(stack->frames[--stack->depth].container);
+    }
+    free(stack->frames);
+    stack->frames = NULL;
+    stack->capacity = 0;
+}
+
+/**
+ * @brief Creates a value node of the given type
+ * @param type The value type
+ * @return The node, or NULL on allocation failure
+ */
+static json_value_t *json_parser_create_value(json_type_t type) {
+    json_value_t *value = malloc(sizeof(json_value_t));
+    if (value) {
+        value->type = type;
+        value->flags = 0;
+    }
+    return value;
+}
+
+/**
+ * @brief Adds a completed value to the innermost open container
+ * 
+ * A non-empty object arriving as the first element of an array turns the
+ * array into a columnar record array unless records are not packed.
+ * 
+ * @param frame The innermost frame
+ * @param value The completed value (freed on failure)
+ * @param pack_records Whether arrays of objects may be stored column-wise
+ * @return true on success, false on allocation failure
+ */
+static bool json_parser_attach_value(parse_frame_t *frame, json_value_t *value, bool pack_records) {
+    if (frame->kind == PARSE_FRAME_OBJECT) {
+        frame->last_member->value = value;
+        return true;
+    }
+    
+    if (frame->kind == PARSE_FRAME_RECORD_ROW) {
+        json_record_array_t *record_array = frame->container->data.record_array;
+        if (!json_typed_array_append_value(record_array->columns[frame->record_member], value)) {
+            json_memory_free_value(value);
+            return false;
+        }
+        frame->record_member++;
+        return true;
+    }
+    
+    json_value_t *array = frame->container;
+    const bool first_element = array->data.array == NULL;
+    
+    if (pack_records && first_element && value->type == JSON_OBJECT && value->data.object != NULL) {
+        // Arrays of same-shaped objects are stored column-wise
+        json_record_array_t *record_array = json_record_array_create_from_object(value);
+        if (!record_array) {
+            json_memory_free_value(value);
+            return false;
         }
+        array->type = JSON_RECORD_ARRAY;
+        array->data.record_array = record_array;
+        frame->kind = PARSE_FRAME_RECORDS;
+        return true;
+    }
+    
+    json_element_t *element = malloc(sizeof(json_element_t));
+    if (!element) {
+        json_memory_free_value(value);
+        return false;
+    }
+    element->value = value;
+    element->next = NULL;
+    
+    if (first_element) {
+        array->data.array = element;
+    } else {
+        frame->last_element->next = element;
+    }
+    frame->last_element = element;
+    return true;
+}
+
+/**
+ * @brief Turns a record array frame back into a regular array frame
+ * 
+ * The complete rows are expanded into an element list.
+ * 
+ * @param frame A RECORDS or RECORD_ROW frame whose partial row was popped
+ * @return true on success, false on allocation failure
+ */
+static bool json_parser_expand_records(parse_frame_t *frame) {
+    json_record_array_t *record_array = frame->container->data.record_array;
+    json_element_t *last_element;
+    json_element_t *elements = json_record_array_expand_elements(record_array, &last_element);
+    if (!elements) {
+        return false;
     }
     
-    return object;
+    json_memory_free_record_array(record_array);
+    frame->container->type = JSON_ARRAY;
+    frame->container->data.array = elements;
+    frame->kind = PARSE_FRAME_ARRAY;
+    frame->last_element = last_element;
+    return true;
 }
 
-/* Parse JSON array */
-json_value_t *json_parser_parse_array(parser_t *parser) {
-    json_value_t *array = malloc(sizeof(json_value_t));
-    if (!array) return NULL;
+/**
+ * @brief Continues a record that broke the shared key sequence as an object
+ * 
+ * The members stored so far are pulled back out of the columns into a new
+ * object, the record array becomes a regular array, and the object is
+ * opened on top of it to receive the rest of the record.
+ * 
+ * @param stack The parse stack, with a RECORD_ROW frame on top
+ * @return true on success, false on allocation failure
+ */
+static bool json_parser_split_record_row(parse_stack_t *stack) {
+    parse_frame_t *frame = &stack->frames[stack->depth - 1];
+    json_record_array_t *record_array = frame->container->data.record_array;
+    
+    json_value_t *object = json_parser_create_value(JSON_OBJECT);
+    if (!object) return false;
+    
+    json_member_t *last_member = NULL;
+    object->flags = record_array->borrowed_keys ? JSON_VALUE_BORROWED_KEYS : 0;
+    object->data.object = json_record_array_pop_partial_record(record_array, frame->record_member,
+                                                               &last_member);
+    if (frame->record_member > 0 && !object->data.object) {
+        free(object);
+        return false;
+    }
+    
+    if (!json_parser_expand_records(frame) ||
+        !parse_stack_push(stack, PARSE_FRAME_OBJECT, object)) {
+        json_memory_free_value(object);
+        return false;
+    }
+    stack->frames[stack->depth - 1].last_member = last_member;
+    return true;
+}
+
+/* Byte classes driving value dispatch */
+typedef enum {
+    PARSER_CLASS_INVALID,
+    PARSER_CLASS_END,
+    PARSER_CLASS_STRUCTURAL,        // '}', ']', ':' or ',' where a value belongs
+    PARSER_CLASS_LBRACE,
+    PARSER_CLASS_LBRACKET,
+    PARSER_CLASS_QUOTE,
+    PARSER_CLASS_NUMBER,
+    PARSER_CLASS_TRUE,
+    PARSER_CLASS_FALSE,
+    PARSER_CLASS_NULL,
+    PARSER_CLASS_COUNT
+} parser_byte_class_t;
+
+static const unsigned char parser_byte_classes[256] = {
+    ['\0'] = PARSER_CLASS_END,
+    ['}'] = PARSER_CLASS_STRUCTURAL, [']'] = PARSER_CLASS_STRUCTURAL,
+    [':'] = PARSER_CLASS_STRUCTURAL, [','] = PARSER_CLASS_STRUCTURAL,
+    ['{'] = PARSER_CLASS_LBRACE,
+    ['['] = PARSER_CLASS_LBRACKET,
+    ['"'] = PARSER_CLASS_QUOTE,
+    ['-'] = PARSER_CLASS_NUMBER,
+    ['0'] = PARSER_CLASS_NUMBER, ['1'] = PARSER_CLASS_NUMBER, ['2'] = PARSER_CLASS_NUMBER,
+    ['3'] = PARSER_CLASS_NUMBER, ['4'] = PARSER_CLASS_NUMBER, ['5'] = PARSER_CLASS_NUMBER,
+    ['6'] = PARSER_CLASS_NUMBER, ['7'] = PARSER_CLASS_NUMBER, ['8'] = PARSER_CLASS_NUMBER,
+    ['9'] = PARSER_CLASS_NUMBER,
+    ['t'] = PARSER_CLASS_TRUE,
+    ['f'] = PARSER_CLASS_FALSE,
+    ['n'] = PARSER_CLASS_NULL
+};
+
+/*
+ * State dispatch uses GCC's labels-as-values where available, so each state
+ * jumps straight to the next through a table; other compilers go through a
+ * switch on the equivalent state number.
+ */
+#if defined(__GNUC__) && !defined(PARSER_NO_COMPUTED_GOTO)
+#define PARSER_COMPUTED_GOTO 1
+#endif
+
+#ifdef PARSER_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+typedef const void *parser_target_t;
+#define PARSER_TARGET(label) &&label
+#define PARSER_DISPATCH(targets, index) goto *(targets)[index]
+#else
+typedef enum {
+    PARSER_TARGET_value_invalid,
+    PARSER_TARGET_value_unexpected,
+    PARSER_TARGET_value_object,
+    PARSER_TARGET_value_array,
+    PARSER_TARGET_value_string,
+    PARSER_TARGET_value_number,
+    PARSER_TARGET_value_true,
+    PARSER_TARGET_value_false,
+    PARSER_TARGET_value_null,
+    PARSER_TARGET_object_separator,
+    PARSER_TARGET_array_separator,
+    PARSER_TARGET_records_separator,
+    PARSER_TARGET_row_separator
+} parser_target_t;
+#define PARSER_TARGET(label) PARSER_TARGET_##label
+#define PARSER_DISPATCH(targets, index) do { target = (targets)[index]; goto dispatch; } while (0)
+#endif
+
+/**
+ * @brief Parses a JSON document with a fused byte-level state machine
+ * 
+ * Bytes are classified once and drive tree construction directly: there is
+ * no intermediate token, and nesting is tracked on an explicit stack rather
+ * than the C call stack. Afterwards the parser's current token holds
+ * whatever follows the document (TOKEN_EOF if nothing).
+ * 
+ * @param parser The parser context
+ * @return The parsed document, or NULL on error
+ */
+json_value_t *json_parser_parse_document(parser_t *parser) {
+    static const parser_target_t value_targets[PARSER_CLASS_COUNT] = {
+        [PARSER_CLASS_INVALID] = PARSER_TARGET(value_invalid),
+        [PARSER_CLASS_END] = PARSER_TARGET(value_unexpected),
+        [PARSER_CLASS_STRUCTURAL] = PARSER_TARGET(value_unexpected),
+        [PARSER_CLASS_LBRACE] = PARSER_TARGET(value_object),
+        [PARSER_CLASS_LBRACKET] = PARSER_TARGET(value_array),
+        [PARSER_CLASS_QUOTE] = PARSER_TARGET(value_string),
+        [PARSER_CLASS_NUMBER] = PARSER_TARGET(value_number),
+        [PARSER_CLASS_TRUE] = PARSER_TARGET(value_true),
+        [PARSER_CLASS_FALSE] = PARSER_TARGET(value_false),
+        [PARSER_CLASS_NULL] = PARSER_TARGET(value_null)
+    };
+    static const parser_target_t separator_targets[PARSE_FRAME_KIND_COUNT] = {
+        [PARSE_FRAME_OBJECT] = PARSER_TARGET(object_separator),
+        [PARSE_FRAME_ARRAY] = PARSER_TARGET(array_separator),
+        [PARSE_FRAME_RECORDS] = PARSER_TARGET(records_separator),
+        [PARSE_FRAME_RECORD_ROW] = PARSER_TARGET(row_separator)
+    };
+#ifndef PARSER_COMPUTED_GOTO
+    parser_target_t target;
+#endif
     
-    array->type = JSON_ARRAY;
-    array->data.array = NULL;
+    parse_stack_t stack = {NULL, 0, 0};
+    parse_frame_t *frame;
+    json_value_t *value = NULL;
+    json_typed_array_t *typed_array;
+    typed_array_kind_t packed_kind;
+    const char *text;
+    size_t text_length;
+    double number;
+    char number_text[MAX_TOKEN_SIZE];
+    unsigned char c;
     
-    parser->current_token = tokenizer_get_next_token(parser); // Skip '['
+    // A value is expected
+    c = json_parser_peek_byte(parser);
+    PARSER_DISPATCH(value_targets, parser_byte_classes[c]);
     
-    if (parser->current_token.type == TOKEN_RBRACKET) {
-        parser->current_token = tokenizer_get_next_token(parser); // Skip ']'
-        return array;
+value_object:
+    if (!parse_stack_has_room(&stack)) goto fail;
+    json_parser_consume_byte(parser);
+    value = json_parser_create_value(JSON_OBJECT);
+    if (!value) goto fail;
+    value->flags = parser->mutable_input ? JSON_VALUE_BORROWED_KEYS : 0;
+    value->data.object = NULL;
+    if (parser->preview && (stack.depth >= parser->preview->max_depth || parser->preview->max_entries == 0)) {
+        goto elide_container;
+    }
+    if (!parse_stack_push(&stack, PARSE_FRAME_OBJECT, value)) {
+        json_memory_free_value(value);
+        goto fail;
     }
     
-    json_element_t *last_element = NULL;
+    if (json_parser_peek_byte(parser) == '}') {
+        json_parser_consume_byte(parser);
+        goto close_container;
+    }
+    // Fall through to the first member
     
-    while (parser->current_token.type != TOKEN_EOF) {
-        json_element_t *element = malloc(sizeof(json_element_t));
-        if (!element) {
-            json_memory_free_value(array);
-            return NULL;
+object_member:
+    c = json_parser_peek_byte(parser);
+    if (c == '"') {
+        if (!tokenizer_scan_string(parser, &text, &text_length)) {
+            fprintf(stderr, "Expected string key in object\n");
+            goto fail;
         }
-        
-        element->value = json_parser_parse_value(parser);
-        element->next = NULL;
-        
-        if (!element->value) {
-            free(element);
-            json_memory_free_value(array);
-            return NULL;
+        goto object_key;
+    }
+    if (parser->pos >= parser->length) {
+        goto close_container;   // a truncated object is accepted
+    }
+    json_parser_report_unexpected(parser);
+    fprintf(stderr, "Expected string key in object\n");
+    goto fail;
+    
+object_key: {
+        frame = &stack.frames[stack.depth - 1];
+        json_member_t *member = malloc(sizeof(json_member_t));
+        if (!member) goto fail;
+        member->key = json_parser_store_string(parser, text, text_length);
+        if (!member->key) {
+            free(member);
+            goto fail;
         }
+        member->value = NULL;
+        member->next = NULL;
         
-        if (array->data.array == NULL) {
-            array->data.array = element;
+        if (frame->last_member) {
+            frame->last_member->next = member;
         } else {
-            last_element->next = element;
+            frame->container->data.object = member;
+        }
+        frame->last_member = member;
+    }
+    
+member_colon:
+    if (json_parser_peek_byte(parser) != ':') {
+        json_parser_report_unexpected(parser);
+        fprintf(stderr, "Expected ':' after object key\n");
+        goto fail;
+    }
+    json_parser_consume_byte(parser);
+    c = json_parser_peek_byte(parser);
+    PARSER_DISPATCH(value_targets, parser_byte_classes[c]);
+    
+value_array:
+    if (!parse_stack_has_room(&stack)) goto fail;
+    json_parser_consume_byte(parser);
+    value = json_parser_create_value(JSON_ARRAY);
+    if (!value) goto fail;
+    value->data.array = NULL;
+    if (parser->preview && (stack.depth >= parser->preview->max_depth || parser->preview->max_entries == 0)) {
+        goto elide_container;
+    }
+    
+    c = json_parser_peek_byte(parser);
+    if (c == ']') {
+        json_parser_consume_byte(parser);
+        goto complete_value;
+    }
+    if (parser->pos >= parser->length) {
+        goto complete_value;    // a truncated array is accepted
+    }
+    
+    if (!parser->preview && json_parser_packed_kind(parser->input + parser->pos, &packed_kind)) {
+        // Numeric and boolean runs are packed until the first mismatching element
+        typed_array = json_typed_array_create(packed_kind);
+        if (!typed_array) {
+            free(value);
+            goto fail;
         }
-        last_element = element;
         
-        if (parser->current_token.type == TOKEN_COMMA) {
-            parser->current_token = tokenizer_get_next_token(parser); // Skip ','
-        } else if (parser->current_token.type == TOKEN_RBRACKET) {
-            parser->current_token = tokenizer_get_next_token(parser); // Skip ']'
-            break;
-        } else {
-            fprintf(stderr, "Expected ',' or ']' in array\n");
-            json_memory_free_value(array);
-            return NULL;
+        switch (json_parser_parse_typed_run(parser, typed_array, number_text)) {
+            case TYPED_RUN_CLOSED:
+                value->type = JSON_TYPED_ARRAY;
+                value->data.typed_array = typed_array;
+                goto complete_value;
+            case TYPED_RUN_MISMATCH:
+                break;
+            default:
+                json_memory_free_typed_array(typed_array);
+                free(value);
+                goto fail;
+        }
+        
+        json_element_t *last_element;
+        value->data.array = json_typed_array_expand_elements(typed_array, &last_element);
+        json_memory_free_typed_array(typed_array);
+        if (!value->data.array || !parse_stack_push(&stack, PARSE_FRAME_ARRAY, value)) {
+            json_memory_free_value(value);
+            goto fail;
+        }
+        stack.frames[stack.depth - 1].last_element = last_element;
+        goto array_element;
+    }
+    
+    if (!parse_stack_push(&stack, PARSE_FRAME_ARRAY, value)) {
+        json_memory_free_value(value);
+        goto fail;
+    }
+    PARSER_DISPATCH(value_targets, parser_byte_classes[c]);
+    
+array_element:
+    c = json_parser_peek_byte(parser);
+    if (parser->pos >= parser->length) {
+        goto close_container;   // a truncated array is accepted
+    }
+    PARSER_DISPATCH(value_targets, parser_byte_classes[c]);
+    
+value_string:
+    if (!tokenizer_scan_string(parser, &text, &text_length)) {
+        goto value_bad_token;
+    }
+    value = json_parser_create_value(JSON_STRING);
+    if (!value) goto fail;
+    value->data.string = json_parser_store_string(parser, text, text_length);
+    if (!value->data.string) {
+        free(value);
+        goto fail;
+    }
+    if (parser->mutable_input) {
+        value->flags = JSON_VALUE_BORROWED_STRING;
+    }
+    goto complete_value;
+    
+value_number:
+    if (!json_parser_scan_number(parser, number_text, &number)) {
+        goto value_bad_token;
+    }
+    value = json_parser_create_value(JSON_NUMBER);
+    if (!value) goto fail;
+    value->data.number = number;
+    goto complete_value;
+    
+value_true:
+    if (strncmp(parser->input + parser->pos, "true", 4) != 0) {
+        goto value_bad_token;
+    }
+    parser->pos += 4;
+    parser->column += 4;
+    value = json_parser_create_value(JSON_BOOLEAN);
+    if (!value) goto fail;
+    value->data.boolean = true;
+    goto complete_value;
+    
+value_false:
+    if (strncmp(parser->input + parser->pos, "false", 5) != 0) {
+        goto value_bad_token;
+    }
+    parser->pos += 5;
+    parser->column += 5;
+    value = json_parser_create_value(JSON_BOOLEAN);
+    if (!value) goto fail;
+    value->data.boolean = false;
+    goto complete_value;
+    
+value_null:
+    if (strncmp(parser->input + parser->pos, "null", 4) != 0) {
+        goto value_bad_token;
+    }
+    parser->pos += 4;
+    parser->column += 4;
+    value = json_parser_create_value(JSON_NULL);
+    if (!value) goto fail;
+    goto complete_value;
+    
+value_invalid:
+    fprintf(stderr, "Unexpected character '%c' at line %d, column %d\n",
+            parser->input[parser->pos], parser->line, parser->column);
+value_bad_token:
+    fprintf(stderr, "Parse error: Invalid token encountered\n");
+    goto fail;
+    
+value_unexpected:
+    fprintf(stderr, "Parse error: Unexpected token type\n");
+    goto fail;
+    
+close_container:
+    value = stack.frames[--stack.depth].container;
+    if (parser->progress) {
+        json_progress_update(parser->progress, parser->pos);
+    }
+    // Fall through to hand the finished container to its parent
+    
+complete_value:
+    if (stack.depth == 0) {
+        goto finished;
+    }
+    // Previews keep plain lists so that elision markers can follow the entries
+    if (!json_parser_attach_value(&stack.frames[stack.depth - 1], value, !parser->preview)) {
+        value = NULL;
+        goto fail;
+    }
+    value = NULL;
+    PARSER_DISPATCH(separator_targets, stack.frames[stack.depth - 1].kind);
+    
+object_separator:
+    c = json_parser_peek_byte(parser);
+    if (c == ',') {
+        json_parser_consume_byte(parser);
+        if (parser->preview && ++stack.frames[stack.depth - 1].shown == parser->preview->max_entries) {
+            goto elide_rest;
+        }
+        goto object_member;
+    }
+    if (c == '}') {
+        json_parser_consume_byte(parser);
+        goto close_container;
+    }
+    json_parser_report_unexpected(parser);
+    fprintf(stderr, "Expected ',' or '}' in object\n");
+    goto fail;
+    
+array_separator:
+    c = json_parser_peek_byte(parser);
+    if (c == ',') {
+        json_parser_consume_byte(parser);
+        if (parser->preview && ++stack.frames[stack.depth - 1].shown == parser->preview->max_entries) {
+            goto elide_rest;
+        }
+        goto array_element;
+    }
+    if (c == ']') {
+        json_parser_consume_byte(parser);
+        goto close_container;
+    }
+    json_parser_report_unexpected(parser);
+    fprintf(stderr, "Expected ',' or ']' in array\n");
+    goto fail;
+    
+elide_container:
+    // Too deep for the preview: only the entries are counted
+    if (!json_preview_elide_rest(parser, value, NULL, NULL)) {
+        json_memory_free_value(value);
+        goto fail;
+    }
+    goto complete_value;
+    
+elide_rest:
+    // The preview has shown enough entries: the rest are counted, not parsed
+    frame = &stack.frames[stack.depth - 1];
+    if (!json_preview_elide_rest(parser, frame->container, frame->last_member, frame->last_element)) {
+        goto fail;
+    }
+    goto close_container;
+    
+records_separator:
+    c = json_parser_peek_byte(parser);
+    if (c == ']') {
+        json_parser_consume_byte(parser);
+        goto close_container;
+    }
+    if (c != ',') {
+        json_parser_report_unexpected(parser);
+        fprintf(stderr, "Expected ',' or ']' in array\n");
+        goto fail;
+    }
+    json_parser_consume_byte(parser);
+    if (parser->progress) {
+        json_progress_update(parser->progress, parser->pos);
+    }
+    
+    frame = &stack.frames[stack.depth - 1];
+    c = json_parser_peek_byte(parser);
+    if (c == '{') {
+        json_parser_consume_byte(parser);
+        frame->kind = PARSE_FRAME_RECORD_ROW;
+        frame->record_member = 0;
+        goto record_key;
+    }
+    
+    // Any other element ends the run of records
+    if (!json_parser_expand_records(frame)) goto fail;
+    if (parser->pos >= parser->length) {
+        goto close_container;
+    }
+    PARSER_DISPATCH(value_targets, parser_byte_classes[c]);
+    
+record_key:
+    frame = &stack.frames[stack.depth - 1];
+    c = json_parser_peek_byte(parser);
+    if (c == '}' && frame->record_member == 0) {
+        json_parser_consume_byte(parser);
+        if (!json_parser_split_record_row(&stack)) goto fail;
+        goto close_container;
+    }
+    if (c != '"') {
+        // Malformed or truncated records are finished by the object states
+        if (!json_parser_split_record_row(&stack)) goto fail;
+        goto object_member;
+    }
+    
+    if (!tokenizer_scan_string(parser, &text, &text_length)) {
+        fprintf(stderr, "Expected string key in object\n");
+        goto fail;
+    }
+    if (!json_record_array_key_matches(frame->container->data.record_array,
+                                       frame->record_member, text)) {
+        if (!json_parser_split_record_row(&stack)) goto fail;
+        goto object_key;
+    }
+    goto member_colon;
+    
+row_separator:
+    frame = &stack.frames[stack.depth - 1];
+    c = json_parser_peek_byte(parser);
+    if (c == ',') {
+        json_parser_consume_byte(parser);
+        if (frame->record_member < frame->container->data.record_array->key_count) {
+            goto record_key;
         }
+        if (!json_parser_split_record_row(&stack)) goto fail;
+        goto object_member;
+    }
+    if (c != '}') {
+        json_parser_report_unexpected(parser);
+        fprintf(stderr, "Expected ',' or '}' in object\n");
+        goto fail;
+    }
+    json_parser_consume_byte(parser);
+    
+    if (frame->record_member == frame->container->data.record_array->key_count) {
+        frame->container->data.record_array->record_count++;
+        frame->kind = PARSE_FRAME_RECORDS;
+        goto records_separator;
     }
+    if (!json_parser_split_record_row(&stack)) goto fail;
+    goto close_container;
     
-    return array;
+#ifndef PARSER_COMPUTED_GOTO
+dispatch:
+    switch (target) {
+        case PARSER_TARGET_value_invalid: goto value_invalid;
+        case PARSER_TARGET_value_unexpected: goto value_unexpected;
+        case PARSER_TARGET_value_object: goto value_object;
+        case PARSER_TARGET_value_array: goto value_array;
+        case PARSER_TARGET_value_string: goto value_string;
+        case PARSER_TARGET_value_number: goto value_number;
+        case PARSER_TARGET_value_true: goto value_true;
+        case PARSER_TARGET_value_false: goto value_false;
+        case PARSER_TARGET_value_null: goto value_null;
+        case PARSER_TARGET_object_separator: goto object_separator;
+        case PARSER_TARGET_array_separator: goto array_separator;
+        case PARSER_TARGET_records_separator: goto records_separator;
+        case PARSER_TARGET_row_separator: goto row_separator;
+    }
+#endif
+    
+fail:
+    parse_stack_free(&stack);
+    return NULL;
+    
+finished:
+    free(stack.frames);
+    parser->current_token = tokenizer_get_next_token(parser); // Look past the document
+    return value;
 }
 
-/* Parse JSON from string */
-json_value_t *json_parser_parse_document(parser_t *parser) {
-    return json_parser_parse_value(parser);
-}
+#ifdef PARSER_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,758 @@
+/**
+ * @file pipeline.c
+ * @brief Three-stage pipelined conversion: read, index, parse and emit
+ *
+ * Each stage runs on its own thread and hands large blocks to the next
+ * through a bounded queue:
+ *
+ *  1. The reader fills fixed-size input blocks taken from a small pool.
+ *  2. The indexer validates UTF-8 and scans each block for the top-level
+ *     entry boundaries, copying the entries into chunks of at least
+ *     PIPELINE_CHUNK_SIZE bytes wrapped in the top-level brackets, then
+ *     returns the block to the pool.
+ *  3. The calling thread parses each chunk in place and writes its entries
+ *     at the nesting level they have in the whole document.
+ *
+ * Rendering entry by entry gives the same text as rendering the whole
+ * document, so the output is identical to the sequential path, while the
+ * input and the tree are never held in full. A document whose top level is
+ * not an object or array is passed through as a single chunk.
+ *
+ * Every chunk boundary is a top-level entry boundary. With checkpoints
+ * enabled, the output is flushed at such a boundary every so many input
+ * bytes and the position is recorded, so an interrupted run can truncate
+ * the output there and continue from the next entry.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "json_to_sexpr.h"
+
+#include <pthread.h>
+
+/* Size of each input block */
+#define PIPELINE_BLOCK_SIZE (4 * 1024 * 1024)
+
+/* Input blocks in circulation between the reader and the indexer */
+#define PIPELINE_BLOCKS 4
+
+/* Smallest chunk of top-level entries handed to the parser */
+#define PIPELINE_CHUNK_SIZE (1024 * 1024)
+
+/* Entries each queue can hold */
+#define PIPELINE_QUEUE_CAPACITY 4
+
+/* A bounded blocking queue between two stages */
+typedef struct {
+    void *items[PIPELINE_QUEUE_CAPACITY];
+    size_t head;
+    size_t count;
+    bool closed;                // the producer is finished
+    bool *aborted;              // shared flag set when any stage fails
+    pthread_mutex_t *lock;      // shared by all queues
+    pthread_cond_t changed;
+} pipeline_queue_t;
+
+/* An input block */
+typedef struct {
+    size_t length;
+    char data[PIPELINE_BLOCK_SIZE];
+} pipeline_block_t;
+
+/* A run of top-level entries, wrapped in the top-level brackets */
+typedef struct {
+    char *text;                 // NUL-terminated
+    size_t length;
+    size_t capacity;
+    bool scalar;                // the whole document, not a run of entries
+    size_t first_line;          // input position of text[0]
+    size_t first_column;
+    size_t next_offset;         // input offset of the next entry, 0 for the last chunk
+    size_t line;                // input position of next_offset
+    size_t column;
+} pipeline_chunk_t;
+
+/* State shared by the three stages */
+typedef struct {
+    FILE *input;
+    const json_pipeline_options_t *options;
+    pthread_mutex_t lock;
+    bool aborted;
+    pipeline_queue_t free_blocks;   // indexer -> reader
+    pipeline_queue_t full_blocks;   // reader -> indexer
+    pipeline_queue_t chunks;        // indexer -> parser
+    pipeline_block_t *blocks;
+
+    // Indexer state, carried from one block to the next
+    enum { SCAN_BEFORE_ROOT, SCAN_IN_ROOT, SCAN_AFTER_ROOT, SCAN_SCALAR } scan_state;
+    char root_open;
+    size_t depth;
+    bool in_string;
+    bool escape_pending;
+    size_t offset;              // input offset of the current block
+    size_t trailing_offset;     // first byte after the document, or SIZE_MAX
+    pipeline_chunk_t trailing;  // content from trailing_offset through its first token
+    size_t counted;             // input offset line counting has reached
+    size_t line;                // input position at counted
+    size_t column;
+    pipeline_chunk_t *chunk;    // chunk being filled
+    size_t chunks_sent;
+    const char *error;          // first failure, reported by the caller
+} pipeline_t;
+
+/**
+ * @brief Prepares a queue
+ * @param queue The queue
+ * @param pipeline The pipeline whose lock and abort flag it shares
+ * @return true on success
+ */
+static bool pipeline_queue_initialize(pipeline_queue_t *queue, pipeline_t *pipeline) {
+    memset(queue, 0, sizeof(*queue));
+    queue->lock = &pipeline->lock;
+    queue->aborted = &pipeline->aborted;
+    return pthread_cond_init(&queue->changed, NULL) == 0;
+}
+
+/**
+ * @brief Adds an item, waiting while the queue is full
+ * @param queue The queue
+ * @param item The item
+ * @return false if the pipeline was aborted
+ */
+static bool pipeline_queue_push(pipeline_queue_t *queue, void *item) {
+    pthread_mutex_lock(queue->lock);
+    while (queue->count == PIPELINE_QUEUE_CAPACITY && !*queue->aborted) {
+        pthread_cond_wait(&queue->changed, queue->lock);
+    }
+    const bool accepted = !*queue->aborted;
+    if (accepted) {
+        queue->items[(queue->head + queue->count++) % PIPELINE_QUEUE_CAPACITY] = item;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(queue->lock);
+    return accepted;
+}
+
+/**
+ * @brief Takes the oldest item, waiting while the queue is empty
+ * @param queue The queue
+ * @return The item, or NULL once the queue is closed and drained or the
+ *         pipeline was aborted
+ */
+static void *pipeline_queue_pop(pipeline_queue_t *queue) {
+    pthread_mutex_lock(queue->lock);
+    while (queue->count == 0 && !queue->closed && !*queue->aborted) {
+        pthread_cond_wait(&queue->changed, queue->lock);
+    }
+    void *item = NULL;
+    if (queue->count > 0 && !*queue->aborted) {
+        item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % PIPELINE_QUEUE_CAPACITY;
+        queue->count--;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(queue->lock);
+    return item;
+}
+
+/**
+ * @brief Marks a queue's producer as finished
+ * @param queue The queue
+ */
+static void pipeline_queue_close(pipeline_queue_t *queue) {
+    pthread_mutex_lock(queue->lock);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(queue->lock);
+}
+
+/**
+ * @brief Stops every stage after a failure
+ * @param pipeline The pipeline
+ * @param error Message reported for the failure (the first one wins)
+ */
+static void pipeline_abort(pipeline_t *pipeline, const char *error) {
+    pthread_mutex_lock(&pipeline->lock);
+    if (!pipeline->aborted) {
+        pipeline->aborted = true;
+        pipeline->error = error;
+    }
+    pthread_cond_broadcast(&pipeline->free_blocks.changed);
+    pthread_cond_broadcast(&pipeline->full_blocks.changed);
+    pthread_cond_broadcast(&pipeline->chunks.changed);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+/**
+ * @brief Frees a chunk
+ * @param chunk The chunk, or NULL
+ */
+static void pipeline_chunk_free(pipeline_chunk_t *chunk) {
+    if (chunk) {
+        free(chunk->text);
+        free(chunk);
+    }
+}
+
+/**
+ * @brief Appends bytes to a chunk
+ * @param chunk The chunk
+ * @param data The bytes
+ * @param length Number of bytes
+ * @return true on success, false on allocation failure
+ */
+static bool pipeline_chunk_append(pipeline_chunk_t *chunk, const char *data, size_t length) {
+    // Room is kept for the closing bracket and the terminator
+    if (chunk->length + length + 2 > chunk->capacity) {
+        size_t capacity = chunk->capacity ? chunk->capacity : PIPELINE_CHUNK_SIZE + PIPELINE_CHUNK_SIZE / 4;
+        while (capacity < chunk->length + length + 2) {
+            capacity *= 2;
+        }
+        char *text = realloc(chunk->text, capacity);
+        if (!text) {
+            return false;
+        }
+        chunk->text = text;
+        chunk->capacity = capacity;
+    }
+    memcpy(chunk->text + chunk->length, data, length);
+    chunk->length += length;
+    return true;
+}
+
+/**
+ * @brief Starts a new chunk holding the top-level opening bracket
+ *
+ * The bracket stands where the document's own bracket is, or where the
+ * comma the previous chunk was cut at is.
+ *
+ * @param pipeline The pipeline, with its line count at the start of the
+ *        document or just past the comma
+ * @param after_comma Whether the chunk follows a cut comma
+ * @return true on success
+ */
+static bool pipeline_start_chunk(pipeline_t *pipeline, bool after_comma) {
+    pipeline->chunk = calloc(1, sizeof(pipeline_chunk_t));
+    if (!pipeline->chunk) {
+        return false;
+    }
+    pipeline->chunk->first_line = pipeline->line;
+    pipeline->chunk->first_column = pipeline->column - (after_comma ? 1 : 0);
+    return pipeline->scan_state == SCAN_SCALAR ||
+           pipeline_chunk_append(pipeline->chunk, &pipeline->root_open, 1);
+}
+
+/**
+ * @brief Closes the current chunk and hands it to the parser
+ *
+ * A chunk cut at a top-level comma gets a closing bracket. The last chunk
+ * already ends with the document's closing bracket, or with none when the
+ * input ended inside the top-level container, so the parser accepts and
+ * rejects exactly what it would in the whole document. A chunk holding
+ * only whitespace is an empty container or an input that ended after a
+ * comma, and is dropped, unless a comma follows it or it is a later
+ * chunk's closed end; the comma it follows is then put back so the
+ * parser rejects it as it would the whole document.
+ *
+ * @param pipeline The pipeline
+ * @param split Whether the chunk was cut at a top-level comma
+ * @return true on success
+ */
+static bool pipeline_send_chunk(pipeline_t *pipeline, bool split) {
+    pipeline_chunk_t *chunk = pipeline->chunk;
+    pipeline->chunk = NULL;
+
+    if (!chunk->scalar) {
+        const char close = pipeline->root_open == '{' ? '}' : ']';
+        const bool closed = !split && pipeline->scan_state == SCAN_AFTER_ROOT;
+        const bool mismatched = closed && chunk->text[chunk->length - 1] != close;
+        bool blank = true;
+        for (size_t position = 1; blank && position < chunk->length - (closed ? 1 : 0); position++) {
+            const char c = chunk->text[position];
+            blank = c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+        if (blank && !split && (!closed || (pipeline->chunks_sent == 0 && !mismatched))) {
+            pipeline_chunk_free(chunk);
+            return true;
+        }
+        if (blank && (split || pipeline->chunks_sent > 0)) {
+            if (!pipeline_chunk_append(chunk, ",", 1)) {
+                pipeline_chunk_free(chunk);
+                pipeline_abort(pipeline, "Out of memory");
+                return false;
+            }
+            memmove(chunk->text + 2, chunk->text + 1, chunk->length - 2);
+            chunk->text[1] = ',';
+        }
+        if (split) {
+            chunk->text[chunk->length++] = close;
+        }
+    }
+    chunk->text[chunk->length] = '\0';
+
+    pipeline->chunks_sent++;
+    if (!pipeline_queue_push(&pipeline->chunks, chunk)) {
+        pipeline_chunk_free(chunk);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Skips whitespace within a block
+ * @param data The block
+ * @param pos Current offset
+ * @param length Block length
+ * @return Offset of the next non-whitespace byte, or length
+ */
+static size_t pipeline_skip_whitespace(const char *data, size_t pos, size_t length) {
+    while (pos < length && (data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\n' ||
+                            data[pos] == '\r')) {
+        pos++;
+    }
+    return pos;
+}
+
+/**
+ * @brief Advances the line and column count through the current block
+ * @param pipeline The pipeline
+ * @param data The current block
+ * @param end Input offset to count up to (within the block)
+ */
+static void pipeline_count_lines(pipeline_t *pipeline, const char *data, size_t end) {
+    if (end <= pipeline->counted) {
+        return;
+    }
+    for (size_t pos = pipeline->counted - pipeline->offset; pos < end - pipeline->offset; pos++) {
+        if (data[pos] == '\n') {
+            pipeline->line++;
+            pipeline->column = 1;
+        } else {
+            pipeline->column++;
+        }
+    }
+    pipeline->counted = end;
+}
+
+/**
+ * @brief Scans one block for top-level entry boundaries and copies its
+ *        entries into chunks
+ * @param pipeline The pipeline
+ * @param data The block
+ * @param length Block length
+ * @return false on failure (the pipeline has been aborted)
+ */
+static bool pipeline_scan_block(pipeline_t *pipeline, const char *data, size_t length) {
+    size_t pos = 0;
+    size_t segment = 0;         // start of the bytes not yet copied
+
+    if (pipeline->escape_pending) {
+        pipeline->escape_pending = false;
+        pos = 1;
+    }
+
+    while (pos < length) {
+        if (pipeline->scan_state == SCAN_BEFORE_ROOT) {
+            pos = pipeline_skip_whitespace(data, pos, length);
+            if (pos == length) {
+                break;
+            }
+            pipeline_count_lines(pipeline, data, pipeline->offset + pos);
+            if (data[pos] == '{' || data[pos] == '[') {
+                pipeline->root_open = data[pos];
+                pipeline->scan_state = SCAN_IN_ROOT;
+                pipeline->depth = 1;
+                segment = ++pos;
+            } else {
+                pipeline->scan_state = SCAN_SCALAR;
+                segment = pos;
+            }
+            if (!pipeline_start_chunk(pipeline, false)) {
+                pipeline_abort(pipeline, "Out of memory");
+                return false;
+            }
+            pipeline->chunk->scalar = pipeline->scan_state == SCAN_SCALAR;
+            continue;
+        }
+
+        if (pipeline->scan_state == SCAN_SCALAR) {
+            pos = length;
+            break;
+        }
+
+        if (pipeline->scan_state == SCAN_AFTER_ROOT) {
+            // Only the first trailing token is kept, for the extra-content warning
+            pipeline_chunk_t *trailing = &pipeline->trailing;
+            if (pipeline->trailing_offset == SIZE_MAX) {
+                pos = pipeline_skip_whitespace(data, pos, length);
+                if (pos == length) {
+                    return true;
+                }
+                pipeline->trailing_offset = pipeline->offset + pos;
+            } else if (tokenizer_token_extent(trailing->text, trailing->length) < trailing->length) {
+                return true;
+            }
+            if (!pipeline_chunk_append(trailing, data + pos, length - pos)) {
+                pipeline_abort(pipeline, "Out of memory");
+                return false;
+            }
+            trailing->text[trailing->length] = '\0';
+            return true;
+        }
+
+        if (pipeline->in_string) {
+            pos = json_validator_find_string_special(data, pos, length);
+            if (pos == length) {
+                break;
+            }
+            if (data[pos] == '\\') {
+                pipeline->escape_pending = pos + 1 == length;
+                pos += 2;
+            } else {
+                pipeline->in_string = false;
+                pos++;
+            }
+            continue;
+        }
+
+        pos = json_validator_find_structural(data, pos, length);
+        if (pos == length) {
+            break;
+        }
+        const char c = data[pos];
+        if (c == '"') {
+            pipeline->in_string = true;
+        } else if (c == '{' || c == '[') {
+            pipeline->depth++;
+        } else if (c == '}' || c == ']') {
+            if (--pipeline->depth == 0) {
+                // The document ends here; the parser checks that its brackets match
+                if (!pipeline_chunk_append(pipeline->chunk, data + segment, pos + 1 - segment)) {
+                    pipeline_abort(pipeline, "Out of memory");
+                    return false;
+                }
+                pipeline->scan_state = SCAN_AFTER_ROOT;
+                if (!pipeline_send_chunk(pipeline, false)) {
+                    return false;
+                }
+                segment = length;
+            }
+        } else if (c == ',' && pipeline->depth == 1 &&
+                   pipeline->chunk->length + (pos - segment) >= PIPELINE_CHUNK_SIZE) {
+            // Enough entries for a chunk; the comma between chunks is dropped
+            if (!pipeline_chunk_append(pipeline->chunk, data + segment, pos - segment)) {
+                pipeline_abort(pipeline, "Out of memory");
+                return false;
+            }
+            pipeline_count_lines(pipeline, data, pipeline->offset + pos + 1);
+            pipeline->chunk->next_offset = pipeline->offset + pos + 1;
+            pipeline->chunk->line = pipeline->line;
+            pipeline->chunk->column = pipeline->column;
+            if (!pipeline_send_chunk(pipeline, true) || !pipeline_start_chunk(pipeline, true)) {
+                if (!pipeline->aborted) {
+                    pipeline_abort(pipeline, "Out of memory");
+                }
+                return false;
+            }
+            segment = pos + 1;
+        }
+        pos++;
+    }
+
+    if ((pipeline->scan_state == SCAN_IN_ROOT || pipeline->scan_state == SCAN_SCALAR) &&
+        segment < length && !pipeline_chunk_append(pipeline->chunk, data + segment, length - segment)) {
+        pipeline_abort(pipeline, "Out of memory");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Stage 1: reads input blocks until end of input
+ * @param argument The pipeline_t
+ * @return NULL
+ */
+static void *pipeline_reader(void *argument) {
+    pipeline_t *pipeline = argument;
+    pipeline_block_t *block;
+
+    while ((block = pipeline_queue_pop(&pipeline->free_blocks)) != NULL) {
+        block->length = fread(block->data, 1, PIPELINE_BLOCK_SIZE, pipeline->input);
+        if (block->length == 0) {
+            if (ferror(pipeline->input)) {
+                pipeline_abort(pipeline, "Failed to read input");
+            }
+            break;
+        }
+        if (!pipeline_queue_push(&pipeline->full_blocks, block)) {
+            break;
+        }
+    }
+    pipeline_queue_close(&pipeline->full_blocks);
+    return NULL;
+}
+
+/**
+ * @brief Stage 2: validates and cuts the input into chunks of entries
+ * @param argument The pipeline_t
+ * @return NULL
+ */
+static void *pipeline_indexer(void *argument) {
+    pipeline_t *pipeline = argument;
+    utf8_validator_t utf8;
+    pipeline_block_t *block;
+    bool success = true;
+
+    utf8_validator_init(&utf8);
+    utf8.offset = pipeline->offset;
+    while (success && (block = pipeline_queue_pop(&pipeline->full_blocks)) != NULL) {
+        if (pipeline->options->validate_utf8 && !utf8_validator_feed(&utf8, block->data, block->length)) {
+            pipeline_abort(pipeline, "Invalid UTF-8 sequence");
+            pipeline->trailing_offset = utf8.error_offset;
+            success = false;
+            break;
+        }
+
+        // Line counting for the extra-content warning stops at its offset
+        success = pipeline_scan_block(pipeline, block->data, block->length);
+        const size_t end = pipeline->offset + block->length;
+        pipeline_count_lines(pipeline, block->data, pipeline->trailing_offset < end ? pipeline->trailing_offset : end);
+
+        pipeline->offset += block->length;
+        success = pipeline_queue_push(&pipeline->free_blocks, block) && success;
+    }
+
+    if (success && !pipeline->aborted) {
+        if (pipeline->options->validate_utf8 && !utf8_validator_finish(&utf8)) {
+            pipeline_abort(pipeline, "Invalid UTF-8 sequence");
+            pipeline->trailing_offset = utf8.error_offset;
+        } else if (pipeline->scan_state == SCAN_BEFORE_ROOT) {
+            // An empty document goes to the parser to be reported
+            pipeline->scan_state = SCAN_SCALAR;
+            if (!pipeline_start_chunk(pipeline, false) || !pipeline_chunk_append(pipeline->chunk, "", 0)) {
+                pipeline_abort(pipeline, "Out of memory");
+            } else {
+                pipeline->chunk->scalar = true;
+                pipeline_send_chunk(pipeline, false);
+            }
+        } else if (pipeline->scan_state != SCAN_AFTER_ROOT) {
+            // The input ended inside the document; the parser decides
+            pipeline_send_chunk(pipeline, false);
+        }
+    }
+    pipeline_queue_close(&pipeline->chunks);
+    return NULL;
+}
+
+/**
+ * @brief Stage 3: parses one chunk and writes its entries
+ * @param pipeline The pipeline
+ * @param chunk The chunk
+ * @param writer The writer holding the output stream and options
+ * @param first Whether this is the first chunk of the document
+ * @return true on success
+ */
+static bool pipeline_emit_chunk(pipeline_t *pipeline, pipeline_chunk_t *chunk, sexpr_writer_t *writer,
+                                bool first) {
+    FILE *output = writer->output;
+    parser_t parser;
+    parser_initialize_in_place(&parser, chunk->text);
+    parser.line = (int)chunk->first_line;
+    parser.column = (int)chunk->first_column;
+    json_value_t *value = json_parser_parse_document(&parser);
+    parser_release(&parser);
+    if (!value) {
+        return false;
+    }
+
+    if (chunk->scalar) {
+        if (parser.current_token.type != TOKEN_EOF) {
+            fprintf(stderr, "Warning: Extra content after JSON at line %d, column %d\n",
+                    parser.line, parser.column);
+        }
+        sexpr_writer_write_value(value, writer, 0);
+        json_memory_free_value(value);
+        return true;
+    }
+
+    if (parser.current_token.type != TOKEN_EOF) {
+        json_memory_free_value(value);
+        return false;
+    }
+
+    if (first) {
+        fprintf(output, pipeline->root_open == '{' ? "(json:object\n" : "(json:array\n");
+    } else {
+        fprintf(output, "\n");
+    }
+    output_formatter_write_indentation(output, 1);
+
+    sexpr_writer_write_entries(value, writer, 1);
+    json_memory_free_value(value);
+    return true;
+}
+
+/**
+ * @brief Records the boundary after a chunk as a checkpoint
+ * @param pipeline The pipeline
+ * @param chunk The chunk just written
+ * @param writer The writer holding the output stream and options
+ * @return true on success
+ */
+static bool pipeline_save_checkpoint(pipeline_t *pipeline, const pipeline_chunk_t *chunk,
+                                     sexpr_writer_t *writer) {
+    json_checkpoint_t checkpoint;
+    memset(&checkpoint, 0, sizeof(checkpoint));
+    if (fflush(writer->output) != 0) {
+        fprintf(stderr, "Error: Failed to write output\n");
+        return false;
+    }
+    const long output_offset = ftell(writer->output);
+    if (output_offset < 0) {
+        perror("Error reading output position");
+        return false;
+    }
+    checkpoint.input_offset = chunk->next_offset;
+    checkpoint.output_offset = (uint64_t)output_offset;
+    checkpoint.line = chunk->line;
+    checkpoint.column = chunk->column;
+    checkpoint.unicode_mode = writer->unicode_mode;
+    checkpoint.depth = 1;
+    checkpoint.stack[0] = pipeline->root_open;
+    return json_checkpoint_save(&checkpoint, pipeline->options->checkpoint_filename,
+                                pipeline->options->input_filename, pipeline->options->output_filename);
+}
+
+/**
+ * @brief Converts a document with reading, indexing and parsing on
+ *        separate threads
+ *
+ * The output is identical to parsing the whole document and writing it
+ * with sexpr_writer_write_value, but entries are written as their chunk is
+ * parsed, so after a failure the output holds the entries before it.
+ * When resuming, input must be positioned at the checkpoint's input offset
+ * and the output must already hold the text written before it.
+ *
+ * @param input Stream to read the JSON document from
+ * @param options Validation, checkpoint and resume settings
+ * @param writer The writer holding the output stream and options
+ * @return true on success
+ */
+bool json_pipeline_convert(FILE *input, const json_pipeline_options_t *options, sexpr_writer_t *writer) {
+    pipeline_t *pipeline = calloc(1, sizeof(pipeline_t));
+    if (!pipeline) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return false;
+    }
+    pipeline->input = input;
+    pipeline->options = options;
+    pipeline->trailing_offset = SIZE_MAX;
+    pipeline->line = 1;
+    pipeline->column = 1;
+    pipeline->blocks = malloc(PIPELINE_BLOCKS * sizeof(pipeline_block_t));
+
+    // A resumed run starts inside the top-level container, after an entry
+    size_t emitted = 0;
+    if (options->resume) {
+        pipeline->scan_state = SCAN_IN_ROOT;
+        pipeline->root_open = options->resume->stack[0];
+        pipeline->depth = 1;
+        pipeline->offset = (size_t)options->resume->input_offset;
+        pipeline->counted = pipeline->offset;
+        pipeline->line = (size_t)options->resume->line;
+        pipeline->column = (size_t)options->resume->column;
+        pipeline->chunks_sent = 1;
+        emitted = 1;
+    }
+
+    bool success = pipeline->blocks != NULL && pthread_mutex_init(&pipeline->lock, NULL) == 0 &&
+                   (!options->resume || pipeline_start_chunk(pipeline, true));
+    if (success) {
+        success = pipeline_queue_initialize(&pipeline->free_blocks, pipeline) &&
+                  pipeline_queue_initialize(&pipeline->full_blocks, pipeline) &&
+                  pipeline_queue_initialize(&pipeline->chunks, pipeline);
+    }
+    for (size_t index = 0; success && index < PIPELINE_BLOCKS; index++) {
+        pipeline_queue_push(&pipeline->free_blocks, &pipeline->blocks[index]);
+    }
+
+    pthread_t reader;
+    pthread_t indexer;
+    const bool reader_started = success && pthread_create(&reader, NULL, pipeline_reader, pipeline) == 0;
+    const bool indexer_started = reader_started &&
+                                 pthread_create(&indexer, NULL, pipeline_indexer, pipeline) == 0;
+    if (!indexer_started) {
+        fprintf(stderr, "Error: Out of memory\n");
+        if (reader_started) {
+            pipeline_abort(pipeline, "Out of memory");
+            pthread_join(reader, NULL);
+        }
+        pipeline_chunk_free(pipeline->chunk);
+        free(pipeline->trailing.text);
+        free(pipeline->blocks);
+        free(pipeline);
+        return false;
+    }
+
+    // Stage 3 runs on the calling thread
+    pipeline_chunk_t *chunk;
+    bool scalar = false;
+    size_t checkpointed = pipeline->offset;
+    while ((chunk = pipeline_queue_pop(&pipeline->chunks)) != NULL) {
+        scalar = chunk->scalar;
+        bool emitted_chunk = pipeline_emit_chunk(pipeline, chunk, writer, emitted == 0);
+        if (options->progress && chunk->next_offset > 0) {
+            json_progress_update(options->progress, chunk->next_offset);
+        }
+        if (emitted_chunk && options->checkpoint_filename && chunk->next_offset > 0 &&
+            chunk->next_offset - checkpointed >= options->checkpoint_interval) {
+            checkpointed = chunk->next_offset;
+            if (!pipeline_save_checkpoint(pipeline, chunk, writer)) {
+                pipeline_abort(pipeline, "Failed to record checkpoint");
+                pipeline_chunk_free(chunk);
+                break;
+            }
+        }
+        pipeline_chunk_free(chunk);
+        if (!emitted_chunk) {
+            pipeline_abort(pipeline, "Failed to parse JSON");
+            break;
+        }
+        emitted++;
+    }
+
+    pthread_join(reader, NULL);
+    pthread_join(indexer, NULL);
+    pipeline_chunk_free(pipeline->chunk);
+    while ((chunk = pipeline_queue_pop(&pipeline->chunks)) != NULL) {
+        pipeline_chunk_free(chunk);
+    }
+
+    success = !pipeline->aborted;
+    if (success && !scalar) {
+        if (emitted == 0) {
+            fprintf(writer->output, pipeline->root_open == '{' ? "(json:object)" : "(json:array)");
+        } else {
+            fprintf(writer->output, ")");
+        }
+        if (pipeline->trailing_offset != SIZE_MAX) {
+            tokenizer_report_trailing(pipeline->trailing.text, (int)pipeline->line, (int)pipeline->column);
+        }
+    } else if (!success) {
+        if (strcmp(pipeline->error, "Invalid UTF-8 sequence") == 0) {
+            fprintf(stderr, "Error: Invalid UTF-8 sequence at byte offset %lu\n",
+                    (unsigned long)pipeline->trailing_offset);
+        } else {
+            fprintf(stderr, "Error: %s\n", pipeline->error);
+        }
+    }
+
+    pthread_cond_destroy(&pipeline->free_blocks.changed);
+    pthread_cond_destroy(&pipeline->full_blocks.changed);
+    pthread_cond_destroy(&pipeline->chunks.changed);
+    pthread_mutex_destroy(&pipeline->lock);
+    free(pipeline->trailing.text);
+    free(pipeline->blocks);
+    free(pipeline);
+    return success;
+}
@@ -0,0 +1,130 @@
+/**
+ * @file preview.c
+ * @brief Bounded preview of large JSON documents
+ *
+ * A preview is an ordinary parse whose state machine keeps only the first
+ * few entries of every container and containers down to a maximum depth.
+ * Everything else is passed over with the raw container skipper, without
+ * tokenizing it or allocating nodes, and is represented by an elision
+ * marker carrying the number of entries left out.
+ */
+
+#include "json_to_sexpr.h"
+
+/**
+ * @brief Skips the rest of the current container at raw scanning speed
+ *
+ * The line and column are brought up to date by counting the newlines in
+ * the skipped range.
+ *
+ * @param parser The parser context, positioned just after '{', '[' or ','
+ * @param entries Receives the number of entries skipped
+ * @return true on success, false if the container is not closed
+ */
+static bool json_preview_skip_rest(parser_t *parser, size_t *entries) {
+    const size_t start = parser->pos;
+    if (!json_validator_skip_container(parser->input, parser->length, &parser->pos, entries)) {
+        fprintf(stderr, "Unterminated container starting at line %d, column %d\n",
+                parser->line, parser->column);
+        return false;
+    }
+
+    const char *cursor = parser->input + start;
+    const char *end = parser->input + parser->pos;
+    const char *line_start = NULL;
+    const char *newline;
+    while ((newline = memchr(cursor, '\n', (size_t)(end - cursor))) != NULL) {
+        parser->line++;
+        line_start = newline + 1;
+        cursor = line_start;
+    }
+    if (line_start) {
+        parser->column = (int)(end - line_start) + 1;
+    } else {
+        parser->column += (int)(end - (parser->input + start));
+    }
+    return true;
+}
+
+/**
+ * @brief Skips the rest of a container and appends its elision marker
+ *
+ * Called by the parser's state machine when a container is deeper than
+ * the preview depth or has shown its quota of entries. The marker goes
+ * after the entries kept so far, as a keyless member in an object.
+ *
+ * @param parser The parser context, positioned just after '{', '[' or ','
+ * @param container The object or array being filled
+ * @param last_member Tail of the object's member list, or NULL if empty
+ * @param last_element Tail of the array's element list, or NULL if empty
+ * @return true on success, false if the container is not closed or on allocation failure
+ */
+bool json_preview_elide_rest(parser_t *parser, json_value_t *container, json_member_t *last_member,
+                             json_element_t *last_element) {
+    size_t entries;
+    if (!json_preview_skip_rest(parser, &entries)) {
+        return false;
+    }
+    if (entries == 0) {
+        return true;
+    }
+
+    json_value_t *marker = malloc(sizeof(json_value_t));
+    if (!marker) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return false;
+    }
+    marker->type = JSON_ELIDED;
+    marker->flags = 0;
+    marker->data.elided_count = entries;
+
+    if (container->type == JSON_OBJECT) {
+        json_member_t *member = malloc(sizeof(json_member_t));
+        if (!member) {
+            fprintf(stderr, "Error: Out of memory\n");
+            free(marker);
+            return false;
+        }
+        member->key = NULL;
+        member->value = marker;
+        member->next = NULL;
+        if (last_member) {
+            last_member->next = member;
+        } else {
+            container->data.object = member;
+        }
+        return true;
+    }
+
+    json_element_t *element = malloc(sizeof(json_element_t));
+    if (!element) {
+        fprintf(stderr, "Error: Out of memory\n");
+        free(marker);
+        return false;
+    }
+    element->value = marker;
+    element->next = NULL;
+    if (last_element) {
+        last_element->next = element;
+    } else {
+        container->data.array = element;
+    }
+    return true;
+}
+
+/**
+ * @brief Parses a bounded preview of a JSON document
+ *
+ * On return the current token is whatever follows the document (TOKEN_EOF
+ * if nothing), as after json_parser_parse_document.
+ *
+ * @param parser The initialized parser context
+ * @param limits Entries kept per container and maximum container depth
+ * @return The preview AST, or NULL on error
+ */
+json_value_t *json_preview_parse_document(parser_t *parser, const json_preview_limits_t *limits) {
+    parser->preview = limits;
+    json_value_t *document = json_parser_parse_document(parser);
+    parser->preview = NULL;
+    return document;
+}
@@ -0,0 +1,616 @@
+/**
+ * @file profile.c
+ * @brief Conversion profile: cost attributed to each subtree by JSON path
+ *
+ * The document is validated once and walked with the raw entry skipper
+ * down to the profiling depth. Every subtree at that depth (or shallower,
+ * when it is a scalar or an empty container) is parsed on its own, wrapped
+ * in its parent's brackets, and rendered straight into the output, so the
+ * output is the same as a normal conversion and only one subtree is held
+ * in memory at a time. Parse and render times, input and output bytes and
+ * node counts are recorded per path and summed into the enclosing paths.
+ * The result is a report sorted by total time and a folded-stack file with
+ * one frame per path, which flame graph tools read directly.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "json_to_sexpr.h"
+
+#include <time.h>
+
+/* No parent: the document node */
+#define PROFILE_NO_PARENT ((size_t)-1)
+
+/* Costs of one path */
+typedef struct {
+    char *path;
+    size_t parent;              // index of the enclosing path's node
+    size_t depth;               // 0 for the document
+    double parse_seconds;       // including everything below the path
+    double render_seconds;
+    double self_parse_seconds;  // spent on this path alone (leaves and keys)
+    double self_render_seconds;
+    uint64_t input_bytes;       // the path's whole text and form
+    uint64_t output_bytes;
+    uint64_t nodes;             // values at and below the path
+} profile_node_t;
+
+/* State of a profiled conversion */
+typedef struct {
+    const char *input;
+    size_t length;
+    const json_profile_options_t *options;
+    sexpr_writer_t *writer;
+    bool seekable;              // output offsets can be read with ftell
+    profile_node_t *nodes;
+    size_t node_count;
+    size_t node_capacity;
+} profile_t;
+
+/**
+ * @brief Reads the monotonic clock
+ * @return Seconds since an arbitrary fixed point
+ */
+static double json_profile_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Counts the values in a parsed subtree
+ * @param value The subtree
+ * @return Number of values, containers included
+ */
+static uint64_t json_profile_count_nodes(const json_value_t *value) {
+    if (!value) {
+        return 1;
+    }
+    uint64_t count = 1;
+    switch (value->type) {
+        case JSON_OBJECT:
+            for (const json_member_t *member = value->data.object; member; member = member->next) {
+                count += json_profile_count_nodes(member->value);
+            }
+            break;
+        case JSON_ARRAY:
+            for (const json_element_t *element = value->data.array; element; element = element->next) {
+                count += json_profile_count_nodes(element->value);
+            }
+            break;
+        case JSON_TYPED_ARRAY:
+            count += value->data.typed_array->count;
+            break;
+        case JSON_RECORD_ARRAY: {
+            const json_record_array_t *records = value->data.record_array;
+            count += records->record_count;
+            for (size_t key_index = 0; key_index < records->key_count; key_index++) {
+                const json_typed_array_t *column = records->columns[key_index];
+                for (size_t index = 0; index < column->count; index++) {
+                    count += column->kind == TYPED_ARRAY_VALUE ?
+                             json_profile_count_nodes(column->items.values[index]) : 1;
+                }
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return count;
+}
+
+/**
+ * @brief Adds a path to the profile
+ * @param profile The profile
+ * @param path Newly allocated path, owned by the profile on success
+ * @param parent Index of the enclosing path's node
+ * @param depth Depth of the path
+ * @return Index of the new node, or PROFILE_NO_PARENT on allocation failure
+ */
+static size_t json_profile_add_node(profile_t *profile, char *path, size_t parent, size_t depth) {
+    if (!path) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return PROFILE_NO_PARENT;
+    }
+    if (profile->node_count == profile->node_capacity) {
+        const size_t new_capacity = profile->node_capacity ? profile->node_capacity * 2 : 64;
+        profile_node_t *grown = realloc(profile->nodes, new_capacity * sizeof(profile_node_t));
+        if (!grown) {
+            fprintf(stderr, "Error: Out of memory\n");
+            free(path);
+            return PROFILE_NO_PARENT;
+        }
+        profile->nodes = grown;
+        profile->node_capacity = new_capacity;
+    }
+    profile_node_t *node = &profile->nodes[profile->node_count];
+    memset(node, 0, sizeof(*node));
+    node->path = path;
+    node->parent = parent;
+    node->depth = depth;
+    return profile->node_count++;
+}
+
+/**
+ * @brief Adds a finished node's totals to its enclosing path
+ * @param profile The profile
+ * @param index The finished node
+ */
+static void json_profile_close_node(profile_t *profile, size_t index) {
+    const profile_node_t *node = &profile->nodes[index];
+    if (node->parent == PROFILE_NO_PARENT) {
+        return;
+    }
+    profile_node_t *parent = &profile->nodes[node->parent];
+    parent->parse_seconds += node->parse_seconds;
+    parent->render_seconds += node->render_seconds;
+    parent->nodes += node->nodes;
+}
+
+/**
+ * @brief Parses a byte range on its own, timing the parse
+ * @param profile The profile
+ * @param start Start of the range
+ * @param end End of the range
+ * @param open Bracket written before the range, or 0 for none
+ * @param close Text written after the range
+ * @param seconds Receives the parse time
+ * @return The parsed value (the wrapping container, if any), or NULL on
+ *         failure
+ */
+static json_value_t *json_profile_parse_range(profile_t *profile, size_t start, size_t end, char open,
+                                              const char *close, double *seconds) {
+    const size_t size = end - start;
+    const size_t close_length = strlen(close);
+    char *text = malloc(size + close_length + 2);
+    if (!text) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return NULL;
+    }
+    size_t length = 0;
+    if (open) {
+        text[length++] = open;
+    }
+    memcpy(text + length, profile->input + start, size);
+    length += size;
+    memcpy(text + length, close, close_length + 1);
+
+    const double parse_start = json_profile_now();
+    parser_t parser;
+    parser_initialize(&parser, text);
+    json_value_t *value = json_parser_parse_document(&parser);
+    parser_release(&parser);
+    *seconds = json_profile_now() - parse_start;
+
+    free(text);
+    if (!value) {
+        fprintf(stderr, "Error: Failed to parse the subtree at byte offset %lu\n", (unsigned long)start);
+    }
+    return value;
+}
+
+/**
+ * @brief Reads the output offset for byte counts
+ * @param profile The profile
+ * @return The offset, or 0 when the output is not seekable
+ */
+static uint64_t json_profile_output_offset(const profile_t *profile) {
+    if (!profile->seekable) {
+        return 0;
+    }
+    const long offset = ftell(profile->writer->output);
+    return offset > 0 ? (uint64_t)offset : 0;
+}
+
+static bool json_profile_write_container(profile_t *profile, size_t node, size_t open, int indentation_level);
+
+/**
+ * @brief Finds whether a value is a non-empty container
+ * @param input The input text
+ * @param pos Offset of the value
+ * @return true for an object or array with at least one entry
+ */
+static bool json_profile_has_entries(const char *input, size_t pos) {
+    if (input[pos] != '{' && input[pos] != '[') {
+        return false;
+    }
+    const size_t inside = json_validator_skip_whitespace(input, pos + 1);
+    return input[inside] != '}' && input[inside] != ']';
+}
+
+/**
+ * @brief Writes one member or element and records its costs
+ *
+ * Above the profiling depth, a non-empty container is walked entry by
+ * entry; anything else is parsed and rendered whole.
+ *
+ * @param profile The profile
+ * @param parent Node of the enclosing container
+ * @param object Whether the entry is an object member
+ * @param start Offset of the entry (a member's key)
+ * @param end Offset of the comma or bracket ending the entry
+ * @param element_index Position of the entry in its container
+ * @param indentation_level Indentation depth of the container's entries
+ * @return true on success
+ */
+static bool json_profile_write_entry(profile_t *profile, size_t parent, bool object, size_t start, size_t end,
+                                     size_t element_index, int indentation_level) {
+    const size_t depth = profile->nodes[parent].depth + 1;
+    size_t key_end = start;
+    size_t value_start = start;
+    if (object) {
+        key_end = json_validator_skip_string(profile->input, profile->length, start + 1) + 1;
+        value_start = json_validator_skip_whitespace(profile->input, key_end);
+        value_start = json_validator_skip_whitespace(profile->input, value_start + 1);
+    }
+    const bool walk = depth < profile->options->max_depth &&
+                      json_profile_has_entries(profile->input, value_start);
+
+    // A leaf is parsed with its key so the member is written as usual; a
+    // walked member only has its key decoded
+    double parse_seconds = 0;
+    json_value_t *wrapper = NULL;
+    if (!walk) {
+        wrapper = json_profile_parse_range(profile, start, end, object ? '{' : '[', object ? "}" : "]",
+                                           &parse_seconds);
+    } else if (object) {
+        wrapper = json_profile_parse_range(profile, start, key_end, '{', ":0}", &parse_seconds);
+    }
+    if (!wrapper && (object || !walk)) {
+        return false;
+    }
+    char *key = NULL;
+    if (object) {
+        key = wrapper->data.object->key;
+    }
+    const size_t node = json_profile_add_node(profile, sexpr_index_child_path(profile->nodes[parent].path, key,
+                                                                             element_index),
+                                              parent, depth);
+    if (node == PROFILE_NO_PARENT) {
+        json_memory_free_value(wrapper);
+        return false;
+    }
+    profile->nodes[node].parse_seconds = parse_seconds;
+    profile->nodes[node].self_parse_seconds = parse_seconds;
+    profile->nodes[node].input_bytes = end - start;
+    if (!walk) {
+        profile->nodes[node].nodes = json_profile_count_nodes(wrapper) - 1;
+    }
+
+    FILE *output = profile->writer->output;
+    bool success = true;
+    const uint64_t output_start = json_profile_output_offset(profile);
+    if (walk) {
+        // Only the key was parsed; the value's entries get their own nodes
+        const double render_start = json_profile_now();
+        if (object) {
+            fprintf(output, "(json:%s ", key);
+        }
+        profile->nodes[node].self_render_seconds = json_profile_now() - render_start;
+        profile->nodes[node].render_seconds = profile->nodes[node].self_render_seconds;
+        profile->nodes[node].nodes = 1;
+        success = json_profile_write_container(profile, node, value_start,
+                                               object ? indentation_level + 1 : indentation_level);
+        if (object) {
+            fprintf(output, ")");
+        }
+        json_memory_free_value(wrapper);
+    } else {
+        const double render_start = json_profile_now();
+        if (object) {
+            sexpr_writer_write_object_members(wrapper->data.object, profile->writer, indentation_level);
+        } else {
+            sexpr_writer_write_entries(wrapper, profile->writer, indentation_level);
+        }
+        profile->nodes[node].render_seconds = json_profile_now() - render_start;
+        profile->nodes[node].self_render_seconds = profile->nodes[node].render_seconds;
+        json_memory_free_value(wrapper);
+    }
+
+    profile->nodes[node].output_bytes = json_profile_output_offset(profile) - output_start;
+    json_profile_close_node(profile, node);
+    return success;
+}
+
+/**
+ * @brief Writes a non-empty container entry by entry
+ * @param profile The profile
+ * @param node Node of the container
+ * @param open Offset of the opening bracket
+ * @param indentation_level Indentation depth the container is written at
+ * @return true on success
+ */
+static bool json_profile_write_container(profile_t *profile, size_t node, size_t open, int indentation_level) {
+    const char *input = profile->input;
+    const bool object = input[open] == '{';
+    FILE *output = profile->writer->output;
+
+    fprintf(output, object ? "(json:object\n" : "(json:array\n");
+    output_formatter_write_indentation(output, indentation_level + 1);
+
+    size_t pos = open + 1;
+    for (size_t element_index = 0; ; element_index++) {
+        const size_t start = json_validator_skip_whitespace(input, pos);
+        size_t end = start;
+        if (!json_validator_skip_entry(input, profile->length, &end)) {
+            fprintf(stderr, "Error: Unterminated container at byte offset %lu\n", (unsigned long)open);
+            return false;
+        }
+        if (element_index > 0) {
+            fprintf(output, "\n");
+            output_formatter_write_indentation(output, indentation_level + 1);
+        }
+        if (!json_profile_write_entry(profile, node, object, start, end, element_index, indentation_level + 1)) {
+            return false;
+        }
+        if (input[end] != ',') {
+            break;
+        }
+        pos = end + 1;
+    }
+
+    fprintf(output, ")");
+    return true;
+}
+
+/**
+ * @brief Orders nodes by total time, longest first, then by position
+ * @param left First node
+ * @param right Second node
+ * @return Comparison result for qsort
+ */
+static int json_profile_compare_nodes(const void *left, const void *right) {
+    const profile_node_t *a = *(profile_node_t *const *)left;
+    const profile_node_t *b = *(profile_node_t *const *)right;
+    const double a_total = a->parse_seconds + a->render_seconds;
+    const double b_total = b->parse_seconds + b->render_seconds;
+    if (a_total != b_total) {
+        return a_total > b_total ? -1 : 1;
+    }
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+/**
+ * @brief Writes the report, every path sorted by total time
+ * @param profile The finished profile
+ * @param output The report stream
+ * @return true on success
+ */
+static bool json_profile_write_report(const profile_t *profile, FILE *output) {
+    profile_node_t **sorted = malloc(profile->node_count * sizeof(profile_node_t *));
+    if (!sorted) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return false;
+    }
+    for (size_t index = 0; index < profile->node_count; index++) {
+        sorted[index] = &profile->nodes[index];
+    }
+    qsort(sorted, profile->node_count, sizeof(profile_node_t *), json_profile_compare_nodes);
+
+    const profile_node_t *document = &profile->nodes[0];
+    fprintf(output, ";; JSON to S-expression conversion profile\n\n");
+    fprintf(output, "(json:profile\n  (json:depth %lu)\n  (json:parse-seconds %.6f)\n"
+            "  (json:render-seconds %.6f)", (unsigned long)profile->options->max_depth,
+            document->parse_seconds, document->render_seconds);
+
+    bool success = true;
+    for (size_t index = 0; index < profile->node_count && success; index++) {
+        const profile_node_t *node = sorted[index];
+        char *path = string_utils_escape_for_lisp(node->path, profile->writer->unicode_mode);
+        if (!path) {
+            fprintf(stderr, "Error: Out of memory\n");
+            success = false;
+            break;
+        }
+        fprintf(output, "\n  (json:entry (json:path %s) (json:depth %lu) (json:parse-ms %.3f) "
+                "(json:render-ms %.3f) (json:input-bytes %lu)", path, (unsigned long)node->depth,
+                node->parse_seconds * 1e3, node->render_seconds * 1e3, (unsigned long)node->input_bytes);
+        if (profile->seekable) {
+            fprintf(output, " (json:output-bytes %lu)", (unsigned long)node->output_bytes);
+        }
+        fprintf(output, " (json:nodes %lu))", (unsigned long)node->nodes);
+        free(path);
+    }
+    fprintf(output, ")\n");
+    free(sorted);
+    return success;
+}
+
+/**
+ * @brief Writes a frame of a folded stack
+ *
+ * Semicolons separate frames, so any inside a quoted key are written as
+ * the equivalent ; escape.
+ *
+ * @param output The folded-stack stream
+ * @param path The frame's path
+ */
+static void json_profile_write_frame(FILE *output, const char *path) {
+    for (const char *c = path; *c; c++) {
+        if (*c == ';') {
+            fputs("\\u003b", output);
+        } else {
+            fputc(*c, output);
+        }
+    }
+}
+
+/**
+ * @brief Writes the folded stack of a path and one of its costs
+ * @param profile The profile
+ * @param index The path's node
+ * @param phase "parse" or "render"
+ * @param seconds The cost, written in whole microseconds (at least one)
+ * @param output The folded-stack stream
+ */
+static void json_profile_write_stack(const profile_t *profile, size_t index, const char *phase, double seconds,
+                                     FILE *output) {
+    if (seconds <= 0) {
+        return;
+    }
+    // Anything measured shows up, however short
+    unsigned long microseconds = (unsigned long)(seconds * 1e6 + 0.5);
+    if (microseconds == 0) {
+        microseconds = 1;
+    }
+    size_t frames[64];
+    size_t depth = 0;
+    for (size_t node = index; node != PROFILE_NO_PARENT && depth < 64; node = profile->nodes[node].parent) {
+        frames[depth++] = node;
+    }
+    while (depth > 0) {
+        json_profile_write_frame(output, profile->nodes[frames[--depth]].path);
+        fputc(';', output);
+    }
+    fprintf(output, "%s %lu\n", phase, microseconds);
+}
+
+/**
+ * @brief Writes the folded stacks: each path's own parse and render time
+ * @param profile The finished profile
+ * @param output The folded-stack stream
+ */
+static void json_profile_write_folded(const profile_t *profile, FILE *output) {
+    for (size_t index = 0; index < profile->node_count; index++) {
+        const profile_node_t *node = &profile->nodes[index];
+        json_profile_write_stack(profile, index, "parse", node->self_parse_seconds, output);
+        json_profile_write_stack(profile, index, "render", node->self_render_seconds, output);
+    }
+}
+
+/**
+ * @brief Writes the report file and the folded-stack file next to it
+ * @param profile The finished profile
+ * @return true on success
+ */
+static bool json_profile_write_files(const profile_t *profile) {
+    const char *report_filename = profile->options->report_filename;
+    FILE *report = fopen(report_filename, "w");
+    if (!report) {
+        perror("Error opening profile file");
+        return false;
+    }
+    bool success = json_profile_write_report(profile, report);
+    if (fclose(report) != 0) {
+        success = false;
+    }
+
+    const size_t name_length = strlen(report_filename);
+    char *folded_filename = malloc(name_length + sizeof(".folded"));
+    if (!folded_filename) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return false;
+    }
+    memcpy(folded_filename, report_filename, name_length);
+    memcpy(folded_filename + name_length, ".folded", sizeof(".folded"));
+    FILE *folded = fopen(folded_filename, "w");
+    free(folded_filename);
+    if (!folded) {
+        perror("Error opening folded-stack file");
+        return false;
+    }
+    json_profile_write_folded(profile, folded);
+    if (fclose(folded) != 0) {
+        success = false;
+    }
+    if (!success) {
+        fprintf(stderr, "Error: Failed to write profile\n");
+    }
+    return success;
+}
+
+/**
+ * @brief Converts a document subtree by subtree and profiles each subtree
+ *
+ * The output matches a normal conversion. Costs are attributed to every
+ * path down to options->max_depth; the report goes to
+ * options->report_filename, the folded stacks to the same name with
+ * ".folded" appended, and a summary to stderr. The document must be
+ * NUL-terminated and valid UTF-8.
+ *
+ * @param input NUL-terminated JSON text
+ * @param length Input length in bytes
+ * @param options Report file and profiling depth
+ * @param writer The writer holding the output stream and options
+ * @return true if the document was converted and the profile written
+ */
+bool json_profile_convert(const char *input, size_t length, const json_profile_options_t *options,
+                          sexpr_writer_t *writer) {
+    json_check_result_t check;
+    if (!json_validator_check(input, length, &check)) {
+        fprintf(stderr, "Error: %s at line %d, column %d (byte offset %lu)\n",
+                check.message, check.line, check.column, (unsigned long)check.error_offset);
+        return false;
+    }
+
+    profile_t profile;
+    memset(&profile, 0, sizeof(profile));
+    profile.input = input;
+    profile.length = length;
+    profile.options = options;
+    profile.writer = writer;
+    profile.seekable = ftell(writer->output) >= 0;
+
+    char *document_path = malloc(2);
+    if (document_path) {
+        memcpy(document_path, "$", 2);
+    }
+    bool success = json_profile_add_node(&profile, document_path, PROFILE_NO_PARENT, 0) == 0;
+    if (success) {
+        const size_t start = json_validator_skip_whitespace(input, 0);
+        const uint64_t output_start = json_profile_output_offset(&profile);
+        profile.nodes[0].input_bytes = length;
+        if (options->max_depth > 0 && json_profile_has_entries(input, start)) {
+            profile.nodes[0].nodes = 1;
+            success = json_profile_write_container(&profile, 0, start, 0);
+        } else {
+            // Scalars and empty containers are profiled as a whole
+            double parse_seconds;
+            json_value_t *value = json_profile_parse_range(&profile, 0, length, 0, "", &parse_seconds);
+            success = value != NULL;
+            if (success) {
+                const double render_start = json_profile_now();
+                sexpr_writer_write_value(value, writer, 0);
+                profile.nodes[0].self_render_seconds = json_profile_now() - render_start;
+                profile.nodes[0].render_seconds += profile.nodes[0].self_render_seconds;
+                profile.nodes[0].self_parse_seconds = parse_seconds;
+                profile.nodes[0].parse_seconds += parse_seconds;
+                profile.nodes[0].nodes = json_profile_count_nodes(value);
+                json_memory_free_value(value);
+            }
+        }
+        profile.nodes[0].output_bytes = json_profile_output_offset(&profile) - output_start;
+    }
+
+    if (success) {
+        success = json_profile_write_files(&profile);
+    }
+    if (success) {
+        // The slowest path below the document, if any
+        const profile_node_t *document = &profile.nodes[0];
+        const profile_node_t *slowest = NULL;
+        for (size_t index = 1; index < profile.node_count; index++) {
+            const profile_node_t *node = &profile.nodes[index];
+            if (!slowest || node->parse_seconds + node->render_seconds >
+                            slowest->parse_seconds + slowest->render_seconds) {
+                slowest = node;
+            }
+        }
+        const double total = document->parse_seconds + document->render_seconds;
+        fprintf(stderr, ";; Profile: %lu paths to depth %lu, parse %.3f s, render %.3f s",
+                (unsigned long)profile.node_count, (unsigned long)options->max_depth,
+                document->parse_seconds, document->render_seconds);
+        if (slowest && total > 0) {
+            fprintf(stderr, "; slowest %s (%.1f%%)", slowest->path,
+                    100.0 * (slowest->parse_seconds + slowest->render_seconds) / total);
+        }
+        fprintf(stderr, "\n");
+    }
+
+    for (size_t index = 0; index < profile.node_count; index++) {
+        free(profile.nodes[index].path);
+    }
+    free(profile.nodes);
+    return success;
+}
@@ -0,0 +1,250 @@
+/**
+ * @file progress.c
+ * @brief Periodic progress reports on stderr for long conversions
+ *
+ * A conversion runs through phases (parsing, writing, or the pipeline's
+ * single converting phase), each measured in its own unit against a known
+ * or unknown total. The converting code only stores its position with a
+ * relaxed atomic write at cheap points such as container boundaries. A
+ * reporter thread wakes once per interval, samples the position and the
+ * output stream's offset, and prints the rate and an estimate of the time
+ * left in the phase. On a terminal the report overwrites one line.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "json_to_sexpr.h"
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Time between reports */
+#define PROGRESS_INTERVAL_MS 1000
+
+/* Reporter state shared with the converting thread */
+struct json_progress {
+    FILE *report;
+    FILE *output;               // sampled with ftell during the phase, or NULL
+    bool terminal;              // overwrite one line instead of appending
+    uint64_t done;              // position in the phase, written atomically
+    const char *phase;          // guarded by lock, like the fields below
+    const char *unit;           // "bytes" or "entries"
+    uint64_t total;             // 0 when unknown
+    uint64_t phase_done;        // position when the phase started
+    double phase_start;
+    double start;
+    bool stopping;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+/**
+ * @brief Reads the monotonic clock
+ * @return Seconds since an arbitrary fixed point
+ */
+static double json_progress_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Formats a byte count with a binary unit
+ * @param text Buffer of at least 32 bytes
+ * @param bytes The count
+ */
+static void json_progress_format_bytes(char *text, uint64_t bytes) {
+    static const char *const units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    double value = (double)bytes;
+    size_t unit = 0;
+    while (value >= 1024.0 && unit + 1 < sizeof(units) / sizeof(units[0])) {
+        value /= 1024.0;
+        unit++;
+    }
+    snprintf(text, 32, unit == 0 ? "%.0f %s" : "%.1f %s", value, units[unit]);
+}
+
+/**
+ * @brief Formats a phase position, its total and percentage
+ * @param text Buffer of at least 96 bytes
+ * @param unit The phase's unit
+ * @param done Position in the phase
+ * @param total Phase total, 0 when unknown
+ */
+static void json_progress_format_position(char *text, const char *unit, uint64_t done, uint64_t total) {
+    char done_text[32];
+    char total_text[32];
+    if (strcmp(unit, "bytes") == 0) {
+        json_progress_format_bytes(done_text, done);
+        json_progress_format_bytes(total_text, total);
+    } else {
+        snprintf(done_text, sizeof(done_text), "%lu %s", (unsigned long)done, unit);
+        snprintf(total_text, sizeof(total_text), "%lu", (unsigned long)total);
+    }
+    if (total > 0) {
+        snprintf(text, 96, "%s of %s (%.1f%%)", done_text, total_text, 100.0 * (double)done / (double)total);
+    } else {
+        snprintf(text, 96, "%s", done_text);
+    }
+}
+
+/**
+ * @brief Prints one report
+ * @param progress The reporter (lock held)
+ */
+static void json_progress_print(json_progress_t *progress) {
+    const double now = json_progress_now();
+    const uint64_t done = __atomic_load_n(&progress->done, __ATOMIC_RELAXED);
+    const double elapsed = now - progress->phase_start;
+    const double rate = elapsed > 0 ? (double)(done - progress->phase_done) / elapsed : 0;
+
+    char position[96];
+    char rate_text[48];
+    char output_text[48] = "";
+    char eta_text[32] = "";
+    json_progress_format_position(position, progress->unit, done, progress->total);
+    if (strcmp(progress->unit, "bytes") == 0) {
+        char bytes[32];
+        json_progress_format_bytes(bytes, (uint64_t)rate);
+        snprintf(rate_text, sizeof(rate_text), "%s/s", bytes);
+    } else {
+        snprintf(rate_text, sizeof(rate_text), "%.0f %s/s", rate, progress->unit);
+    }
+    const long written = progress->output ? ftell(progress->output) : -1;
+    if (written >= 0) {
+        char bytes[32];
+        json_progress_format_bytes(bytes, (uint64_t)written);
+        snprintf(output_text, sizeof(output_text), ", output %s", bytes);
+    }
+    if (progress->total > done && rate > 0) {
+        const unsigned long seconds = (unsigned long)((double)(progress->total - done) / rate + 0.5);
+        snprintf(eta_text, sizeof(eta_text), ", ETA %lu:%02lu", seconds / 60, seconds % 60);
+    }
+
+    fprintf(progress->report, "%s;; Progress: %s %s, %s%s%s%s", progress->terminal ? "\r\033[K" : "",
+            progress->phase, position, rate_text, output_text, eta_text, progress->terminal ? "" : "\n");
+    fflush(progress->report);
+}
+
+/**
+ * @brief Reporter thread: prints a report every interval until stopped
+ * @param argument The json_progress_t
+ * @return NULL
+ */
+static void *json_progress_reporter(void *argument) {
+    json_progress_t *progress = argument;
+
+    pthread_mutex_lock(&progress->lock);
+    while (!progress->stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += PROGRESS_INTERVAL_MS / 1000;
+        deadline.tv_nsec += (long)(PROGRESS_INTERVAL_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (!progress->stopping &&
+               pthread_cond_timedwait(&progress->changed, &progress->lock, &deadline) == 0) {
+            // Woken by a phase change; keep waiting for the deadline
+        }
+        if (!progress->stopping && progress->phase) {
+            json_progress_print(progress);
+        }
+    }
+    pthread_mutex_unlock(&progress->lock);
+    return NULL;
+}
+
+/**
+ * @brief Starts reporting progress
+ * @param report Stream receiving the reports (normally stderr)
+ * @return The reporter, or NULL if it could not be started
+ */
+json_progress_t *json_progress_start(FILE *report) {
+    json_progress_t *progress = calloc(1, sizeof(json_progress_t));
+    if (!progress) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return NULL;
+    }
+    progress->report = report;
+    progress->terminal = isatty(fileno(report));
+    progress->start = json_progress_now();
+
+    if (pthread_mutex_init(&progress->lock, NULL) == 0) {
+        if (pthread_cond_init(&progress->changed, NULL) == 0) {
+            if (pthread_create(&progress->thread, NULL, json_progress_reporter, progress) == 0) {
+                return progress;
+            }
+            pthread_cond_destroy(&progress->changed);
+        }
+        pthread_mutex_destroy(&progress->lock);
+    }
+    fprintf(stderr, "Error: Could not start the progress reporter\n");
+    free(progress);
+    return NULL;
+}
+
+/**
+ * @brief Begins a new phase
+ * @param progress The reporter
+ * @param phase Name shown in reports (a string literal)
+ * @param unit "bytes" or a plural noun for the positions
+ * @param done Starting position
+ * @param total Final position, or 0 when unknown
+ * @param output The output stream being written in this phase, sampled for
+ *        its offset, or NULL
+ */
+void json_progress_phase(json_progress_t *progress, const char *phase, const char *unit,
+                         uint64_t done, uint64_t total, FILE *output) {
+    pthread_mutex_lock(&progress->lock);
+    progress->phase = phase;
+    progress->output = output;
+    progress->unit = unit;
+    progress->total = total;
+    progress->phase_done = done;
+    progress->phase_start = json_progress_now();
+    __atomic_store_n(&progress->done, done, __ATOMIC_RELAXED);
+    pthread_cond_signal(&progress->changed);
+    pthread_mutex_unlock(&progress->lock);
+}
+
+/**
+ * @brief Records the position in the current phase
+ * @param progress The reporter
+ * @param done The position
+ */
+void json_progress_update(json_progress_t *progress, uint64_t done) {
+    __atomic_store_n(&progress->done, done, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Stops reporting and prints the total time
+ *
+ * The current phase's output stream must still be open.
+ *
+ * @param progress The reporter
+ */
+void json_progress_finish(json_progress_t *progress) {
+    pthread_mutex_lock(&progress->lock);
+    progress->stopping = true;
+    pthread_cond_signal(&progress->changed);
+    pthread_mutex_unlock(&progress->lock);
+    pthread_join(progress->thread, NULL);
+
+    char output_text[48] = "";
+    const long written = progress->output ? ftell(progress->output) : -1;
+    if (written >= 0) {
+        char bytes[32];
+        json_progress_format_bytes(bytes, (uint64_t)written);
+        snprintf(output_text, sizeof(output_text), ", output %s", bytes);
+    }
+    fprintf(progress->report, "%s;; Progress: finished in %.1f s%s\n", progress->terminal ? "\r\033[K" : "",
+            json_progress_now() - progress->start, output_text);
+
+    pthread_cond_destroy(&progress->changed);
+    pthread_mutex_destroy(&progress->lock);
+    free(progress);
+}
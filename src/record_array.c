@@ -0,0 +1,233 @@
+/**
+ * @file record_array.c
+ * @brief Column-wise storage for arrays of objects with a shared key sequence
+ * 
+ * Records are kept as one value vector per key plus a single key list, so
+ * each record costs no member nodes or key copies. Numeric and boolean
+ * columns stay packed through the typed array machinery.
+ */
+
+#include "json_to_sexpr.h"
+
+/**
+ * @brief Picks the initial column kind for a first-record value
+ * @param value The value found in the first record
+ * @return Packed kind for numbers/booleans, generic pointers otherwise
+ */
+static typed_array_kind_t json_record_array_column_kind(const json_value_t *value) {
+    switch (value->type) {
+        case JSON_NUMBER:
+            return TYPED_ARRAY_INT64;
+        case JSON_BOOLEAN:
+            return TYPED_ARRAY_BOOLEAN;
+        default:
+            return TYPED_ARRAY_VALUE;
+    }
+}
+
+/**
+ * @brief Turns a parsed non-empty object into the first record of a new array
+ * 
+ * The object's keys become the shared key list and its values the first
+ * row of the columns. On success the object node and its members are freed.
+ * 
+ * @param object A JSON_OBJECT with at least one member
+ * @return The new record array, or NULL on allocation failure (object untouched)
+ */
+json_record_array_t *json_record_array_create_from_object(json_value_t *object) {
+    size_t key_count = 0;
+    for (json_member_t *member = object->data.object; member != NULL; member = member->next) {
+        key_count++;
+    }
+    
+    json_record_array_t *record_array = malloc(sizeof(json_record_array_t));
+    char **keys = malloc(key_count * sizeof(char *));
+    json_typed_array_t **columns = calloc(key_count, sizeof(json_typed_array_t *));
+    if (!record_array || !keys || !columns) {
+        free(record_array);
+        free(keys);
+        free(columns);
+        return NULL;
+    }
+    
+    record_array->key_count = key_count;
+    record_array->keys = keys;
+    record_array->columns = columns;
+    record_array->record_count = 0;
+    record_array->borrowed_keys = (object->flags & JSON_VALUE_BORROWED_KEYS) != 0;
+    
+    size_t key_index = 0;
+    for (json_member_t *member = object->data.object; member != NULL; member = member->next) {
+        columns[key_index] = json_typed_array_create(json_record_array_column_kind(member->value));
+        if (!columns[key_index] || !json_typed_array_reserve(columns[key_index])) {
+            json_memory_free_typed_array(columns[key_index]);
+            while (key_index > 0) {
+                json_memory_free_typed_array(columns[--key_index]);
+            }
+            free(keys);
+            free(columns);
+            free(record_array);
+            return NULL;
+        }
+        key_index++;
+    }
+    
+    // Every column has room reserved, so moving the first row cannot fail
+    key_index = 0;
+    json_member_t *member = object->data.object;
+    while (member != NULL) {
+        json_member_t *next_member = member->next;
+        keys[key_index] = member->key;
+        json_typed_array_append_value(columns[key_index], member->value);
+        free(member);
+        member = next_member;
+        key_index++;
+    }
+    free(object);
+    
+    record_array->record_count = 1;
+    return record_array;
+}
+
+/**
+ * @brief Produces the key for a rebuilt member, sharing borrowed keys
+ * @param record_array The record array
+ * @param key_index Position of the key
+ * @return The key to store in the member, or NULL on allocation failure
+ */
+static char *json_record_array_member_key(const json_record_array_t *record_array, size_t key_index) {
+    if (record_array->borrowed_keys) {
+        return record_array->keys[key_index];
+    }
+    
+    char *key = malloc(strlen(record_array->keys[key_index]) + 1);
+    if (key) {
+        strcpy(key, record_array->keys[key_index]);
+    }
+    return key;
+}
+
+/**
+ * @brief Checks a record key against the shared key sequence
+ * @param record_array The record array
+ * @param key_index Position of the key within the record
+ * @param key The key found in the input
+ * @return true if the key is expected at this position
+ */
+bool json_record_array_key_matches(const json_record_array_t *record_array, size_t key_index,
+                                   const char *key) {
+    return key_index < record_array->key_count &&
+           strcmp(record_array->keys[key_index], key) == 0;
+}
+
+/**
+ * @brief Pulls the members of a partially read record back out of the columns
+ * 
+ * Used when a record stops matching the key sequence after some members
+ * were already stored column-wise.
+ * 
+ * @param record_array The record array holding the partial row
+ * @param member_count Number of leading columns holding an extra value
+ * @param last_member Receives the tail of the rebuilt member list
+ * @return Head of the member list (NULL when empty or on allocation failure)
+ */
+json_member_t *json_record_array_pop_partial_record(json_record_array_t *record_array,
+                                                    size_t member_count, json_member_t **last_member) {
+    json_member_t *head = NULL;
+    *last_member = NULL;
+    
+    // Pop from the last column backwards so the list comes out in order
+    for (size_t key_index = member_count; key_index > 0; key_index--) {
+        json_member_t *member = malloc(sizeof(json_member_t));
+        char *key = member ? json_record_array_member_key(record_array, key_index - 1) : NULL;
+        json_value_t *value = key ? json_typed_array_pop_value(record_array->columns[key_index - 1]) : NULL;
+        if (!value) {
+            if (!record_array->borrowed_keys) {
+                free(key);
+            }
+            free(member);
+            json_memory_free_member_list(head, !record_array->borrowed_keys);
+            *last_member = NULL;
+            return NULL;
+        }
+        
+        member->key = key;
+        member->value = value;
+        member->next = head;
+        if (head == NULL) {
+            *last_member = member;
+        }
+        head = member;
+    }
+    
+    return head;
+}
+
+/**
+ * @brief Rebuilds one regular object per record as an element list
+ * 
+ * Used when a later element breaks the uniform shape. Values are moved or
+ * unpacked out of the columns; the caller still frees the record array.
+ * 
+ * @param record_array The record array to expand
+ * @param last_element Receives the tail of the new list
+ * @return Head of the new element list, or NULL on allocation failure
+ */
+json_element_t *json_record_array_expand_elements(json_record_array_t *record_array,
+                                                  json_element_t **last_element) {
+    json_element_t *head = NULL;
+    json_element_t *tail = NULL;
+    
+    for (size_t record_index = 0; record_index < record_array->record_count; record_index++) {
+        json_element_t *element = malloc(sizeof(json_element_t));
+        json_value_t *object = malloc(sizeof(json_value_t));
+        if (!element || !object) {
+            free(element);
+            free(object);
+            json_memory_free_array_element(head);
+            return NULL;
+        }
+        
+        object->type = JSON_OBJECT;
+        object->flags = record_array->borrowed_keys ? JSON_VALUE_BORROWED_KEYS : 0;
+        object->data.object = NULL;
+        element->value = object;
+        element->next = NULL;
+        if (tail) {
+            tail->next = element;
+        } else {
+            head = element;
+        }
+        tail = element;
+        
+        json_member_t *last_member = NULL;
+        for (size_t key_index = 0; key_index < record_array->key_count; key_index++) {
+            json_member_t *member = malloc(sizeof(json_member_t));
+            char *key = member ? json_record_array_member_key(record_array, key_index) : NULL;
+            json_value_t *value = key ? json_typed_array_take_value(record_array->columns[key_index],
+                                                                    record_index)
+                                      : NULL;
+            if (!value) {
+                if (!record_array->borrowed_keys) {
+                    free(key);
+                }
+                free(member);
+                json_memory_free_array_element(head);
+                return NULL;
+            }
+            
+            member->key = key;
+            member->value = value;
+            member->next = NULL;
+            if (last_member) {
+                last_member->next = member;
+            } else {
+                object->data.object = member;
+            }
+            last_member = member;
+        }
+    }
+    
+    *last_element = tail;
+    return head;
+}
@@ -0,0 +1,398 @@
+/**
+ * @file sexpr_memo.c
+ * @brief Memoized rendering of repeated subtrees
+ *
+ * Containers of a few to a few hundred nodes are hashed before they are
+ * written. A direct-mapped cache keyed by hash and indentation level keeps
+ * the text each one rendered to, and a later subtree that compares equal
+ * is written by copying that text. Equality is checked node by node against
+ * the subtree the text came from, so the output never changes.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "json_to_sexpr.h"
+
+/* Number of cache slots (a power of two) */
+#define SEXPR_MEMO_SLOTS 4096
+
+/* Subtrees smaller than this render faster than they can be looked up */
+#define SEXPR_MEMO_MIN_NODES 4
+
+/* Subtrees larger than this are not hashed as a whole */
+#define SEXPR_MEMO_MAX_NODES 256
+
+/* Longest rendered text kept in the cache */
+#define SEXPR_MEMO_MAX_BYTES 16384
+
+/* Scratch stream size at which it is reopened empty */
+#define SEXPR_MEMO_SCRATCH_LIMIT (1024 * 1024)
+
+/**
+ * @brief Prepares an empty cache
+ * @param memo The cache to initialize
+ * @return true on success, false on allocation failure
+ */
+bool sexpr_memo_initialize(sexpr_memo_t *memo) {
+    memset(memo, 0, sizeof(*memo));
+    memo->entries = calloc(SEXPR_MEMO_SLOTS, sizeof(sexpr_memo_entry_t));
+    if (!memo->entries) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Frees the cache and its scratch stream
+ * @param memo The cache to release
+ */
+void sexpr_memo_release(sexpr_memo_t *memo) {
+    if (memo->entries) {
+        for (size_t slot = 0; slot < SEXPR_MEMO_SLOTS; slot++) {
+            free(memo->entries[slot].text);
+        }
+        free(memo->entries);
+    }
+    if (memo->scratch) {
+        fclose(memo->scratch);
+    }
+    free(memo->scratch_buffer);
+    memset(memo, 0, sizeof(*memo));
+}
+
+/**
+ * @brief Mixes a 64-bit word into a hash
+ * @param hash The hash so far
+ * @param word The word to add
+ * @return The updated hash
+ */
+static uint64_t sexpr_memo_mix(uint64_t hash, uint64_t word) {
+    hash = ((hash << 27) | (hash >> 37)) ^ word;
+    return hash * 0x9e3779b97f4a7c15ULL;
+}
+
+/**
+ * @brief Mixes a string into a hash
+ * @param hash The hash so far
+ * @param text The string
+ * @return The updated hash
+ */
+static uint64_t sexpr_memo_mix_string(uint64_t hash, const char *text) {
+    size_t length = 0;
+    for (; text[length] != '\0'; length++) {
+        hash = (hash ^ (unsigned char)text[length]) * 0x100000001b3ULL;
+    }
+    return sexpr_memo_mix(hash, length);
+}
+
+static bool sexpr_memo_hash_value(const json_value_t *value, uint64_t *hash, size_t *nodes);
+
+/**
+ * @brief Hashes one element of a packed array or record column
+ * @param typed_array The array holding the element
+ * @param index Element position
+ * @param hash The hash to update
+ * @param nodes Node count, checked against SEXPR_MEMO_MAX_NODES
+ * @return false once the subtree is too large
+ */
+static bool sexpr_memo_hash_item(const json_typed_array_t *typed_array, size_t index,
+                                 uint64_t *hash, size_t *nodes) {
+    uint64_t bits;
+    switch (typed_array->kind) {
+        case TYPED_ARRAY_INT64:
+            *hash = sexpr_memo_mix(*hash, (uint64_t)typed_array->items.integers[index]);
+            break;
+        case TYPED_ARRAY_DOUBLE:
+            memcpy(&bits, &typed_array->items.doubles[index], sizeof(bits));
+            *hash = sexpr_memo_mix(*hash, bits);
+            break;
+        case TYPED_ARRAY_BOOLEAN:
+            *hash = sexpr_memo_mix(*hash, json_typed_array_get_boolean(typed_array, index));
+            break;
+        case TYPED_ARRAY_VALUE:
+            return sexpr_memo_hash_value(typed_array->items.values[index], hash, nodes);
+    }
+    return ++*nodes <= SEXPR_MEMO_MAX_NODES;
+}
+
+/**
+ * @brief Hashes a subtree, giving up once it exceeds SEXPR_MEMO_MAX_NODES
+ * @param value The subtree
+ * @param hash The hash to update
+ * @param nodes Running node count
+ * @return false if the subtree is too large to memoize
+ */
+static bool sexpr_memo_hash_value(const json_value_t *value, uint64_t *hash, size_t *nodes) {
+    if (++*nodes > SEXPR_MEMO_MAX_NODES) {
+        return false;
+    }
+    if (value == NULL) {
+        *hash = sexpr_memo_mix(*hash, 0xff);
+        return true;
+    }
+
+    *hash = sexpr_memo_mix(*hash, (uint64_t)value->type + 1);
+    uint64_t bits;
+    switch (value->type) {
+        case JSON_OBJECT:
+            for (const json_member_t *member = value->data.object; member; member = member->next) {
+                *hash = member->key ? sexpr_memo_mix_string(*hash, member->key) : sexpr_memo_mix(*hash, 0);
+                if (!sexpr_memo_hash_value(member->value, hash, nodes)) {
+                    return false;
+                }
+            }
+            break;
+        case JSON_ARRAY:
+            for (const json_element_t *element = value->data.array; element; element = element->next) {
+                if (!sexpr_memo_hash_value(element->value, hash, nodes)) {
+                    return false;
+                }
+            }
+            break;
+        case JSON_TYPED_ARRAY: {
+            const json_typed_array_t *typed_array = value->data.typed_array;
+            *hash = sexpr_memo_mix(*hash, typed_array->kind);
+            for (size_t index = 0; index < typed_array->count; index++) {
+                if (!sexpr_memo_hash_item(typed_array, index, hash, nodes)) {
+                    return false;
+                }
+            }
+            break;
+        }
+        case JSON_RECORD_ARRAY: {
+            const json_record_array_t *record_array = value->data.record_array;
+            for (size_t key_index = 0; key_index < record_array->key_count; key_index++) {
+                *hash = sexpr_memo_mix_string(*hash, record_array->keys[key_index]);
+            }
+            for (size_t record_index = 0; record_index < record_array->record_count; record_index++) {
+                for (size_t key_index = 0; key_index < record_array->key_count; key_index++) {
+                    if (!sexpr_memo_hash_item(record_array->columns[key_index], record_index, hash, nodes)) {
+                        return false;
+                    }
+                }
+            }
+            break;
+        }
+        case JSON_STRING:
+            *hash = sexpr_memo_mix_string(*hash, value->data.string);
+            break;
+        case JSON_NUMBER:
+            memcpy(&bits, &value->data.number, sizeof(bits));
+            *hash = sexpr_memo_mix(*hash, bits);
+            break;
+        case JSON_BOOLEAN:
+            *hash = sexpr_memo_mix(*hash, value->data.boolean);
+            break;
+        case JSON_ELIDED:
+            *hash = sexpr_memo_mix(*hash, value->data.elided_count);
+            break;
+        default:
+            break;
+    }
+    return true;
+}
+
+static bool sexpr_memo_equal(const json_value_t *left, const json_value_t *right);
+
+/**
+ * @brief Compares two elements of packed arrays or record columns
+ * @param left Array holding the first element
+ * @param left_index Its position
+ * @param right Array holding the second element
+ * @param right_index Its position
+ * @return true if both render identically
+ */
+static bool sexpr_memo_items_equal(const json_typed_array_t *left, size_t left_index,
+                                   const json_typed_array_t *right, size_t right_index) {
+    if (left->kind != right->kind) {
+        return false;
+    }
+    switch (left->kind) {
+        case TYPED_ARRAY_INT64:
+            return left->items.integers[left_index] == right->items.integers[right_index];
+        case TYPED_ARRAY_DOUBLE:
+            return memcmp(&left->items.doubles[left_index], &right->items.doubles[right_index],
+                          sizeof(double)) == 0;
+        case TYPED_ARRAY_BOOLEAN:
+            return json_typed_array_get_boolean(left, left_index) ==
+                   json_typed_array_get_boolean(right, right_index);
+        case TYPED_ARRAY_VALUE:
+            return sexpr_memo_equal(left->items.values[left_index], right->items.values[right_index]);
+    }
+    return false;
+}
+
+/**
+ * @brief Compares two subtrees node by node
+ * @param left The first subtree
+ * @param right The second subtree
+ * @return true if both render identically
+ */
+static bool sexpr_memo_equal(const json_value_t *left, const json_value_t *right) {
+    if (left == right) {
+        return true;
+    }
+    if (left == NULL || right == NULL || left->type != right->type) {
+        return false;
+    }
+
+    switch (left->type) {
+        case JSON_OBJECT: {
+            const json_member_t *left_member = left->data.object;
+            const json_member_t *right_member = right->data.object;
+            for (; left_member && right_member;
+                 left_member = left_member->next, right_member = right_member->next) {
+                if ((left_member->key == NULL) != (right_member->key == NULL) ||
+                    (left_member->key && strcmp(left_member->key, right_member->key) != 0) ||
+                    !sexpr_memo_equal(left_member->value, right_member->value)) {
+                    return false;
+                }
+            }
+            return left_member == NULL && right_member == NULL;
+        }
+        case JSON_ARRAY: {
+            const json_element_t *left_element = left->data.array;
+            const json_element_t *right_element = right->data.array;
+            for (; left_element && right_element;
+                 left_element = left_element->next, right_element = right_element->next) {
+                if (!sexpr_memo_equal(left_element->value, right_element->value)) {
+                    return false;
+                }
+            }
+            return left_element == NULL && right_element == NULL;
+        }
+        case JSON_TYPED_ARRAY: {
+            const json_typed_array_t *left_array = left->data.typed_array;
+            const json_typed_array_t *right_array = right->data.typed_array;
+            if (left_array->count != right_array->count) {
+                return false;
+            }
+            for (size_t index = 0; index < left_array->count; index++) {
+                if (!sexpr_memo_items_equal(left_array, index, right_array, index)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case JSON_RECORD_ARRAY: {
+            const json_record_array_t *left_records = left->data.record_array;
+            const json_record_array_t *right_records = right->data.record_array;
+            if (left_records->key_count != right_records->key_count ||
+                left_records->record_count != right_records->record_count) {
+                return false;
+            }
+            for (size_t key_index = 0; key_index < left_records->key_count; key_index++) {
+                if (strcmp(left_records->keys[key_index], right_records->keys[key_index]) != 0) {
+                    return false;
+                }
+                for (size_t index = 0; index < left_records->record_count; index++) {
+                    if (!sexpr_memo_items_equal(left_records->columns[key_index], index,
+                                                right_records->columns[key_index], index)) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+        case JSON_STRING:
+            return strcmp(left->data.string, right->data.string) == 0;
+        case JSON_NUMBER:
+            return memcmp(&left->data.number, &right->data.number, sizeof(double)) == 0;
+        case JSON_BOOLEAN:
+            return left->data.boolean == right->data.boolean;
+        case JSON_ELIDED:
+            return left->data.elided_count == right->data.elided_count;
+        default:
+            return true;
+    }
+}
+
+/**
+ * @brief Writes a container through the cache
+ *
+ * Containers outside the memoized size range are left to the caller. On a
+ * miss the subtree is rendered into a memory stream, with memoization off
+ * for its descendants, then copied to the output and into the cache.
+ *
+ * @param memo The cache
+ * @param value The container to write
+ * @param writer The writer holding the output stream and options
+ * @param indentation_level Current indentation depth
+ * @return true if the container was written, false if the caller must
+ *         write it
+ */
+bool sexpr_memo_write_value(sexpr_memo_t *memo, json_value_t *value, sexpr_writer_t *writer,
+                            int indentation_level) {
+    uint64_t hash = 0x84222325cbf29ce4ULL;
+    size_t nodes = 0;
+    if (!sexpr_memo_hash_value(value, &hash, &nodes) || nodes < SEXPR_MEMO_MIN_NODES) {
+        return false;
+    }
+    hash = sexpr_memo_mix(hash, (uint64_t)indentation_level);
+
+    memo->lookups++;
+    sexpr_memo_entry_t *entry = &memo->entries[(hash >> 32 ^ hash >> 52) & (SEXPR_MEMO_SLOTS - 1)];
+    if (entry->text && entry->hash == hash && entry->indentation_level == indentation_level &&
+        sexpr_memo_equal(entry->value, value)) {
+        memo->hits++;
+        fwrite(entry->text, 1, entry->length, writer->output);
+        return true;
+    }
+
+    if (!memo->scratch) {
+        free(memo->scratch_buffer);
+        memo->scratch_buffer = NULL;
+        memo->scratch = open_memstream(&memo->scratch_buffer, &memo->scratch_size);
+        if (!memo->scratch) {
+            return false;
+        }
+    }
+
+    // Render into the scratch stream; descendants are not memoized
+    fflush(memo->scratch);
+    const size_t start = memo->scratch_size;
+    FILE *output = writer->output;
+    writer->output = memo->scratch;
+    writer->memo = NULL;
+    sexpr_writer_write_value(value, writer, indentation_level);
+    writer->output = output;
+    writer->memo = memo;
+    if (fflush(memo->scratch) != 0) {
+        return false;
+    }
+
+    const char *text = memo->scratch_buffer + start;
+    const size_t length = memo->scratch_size - start;
+    fwrite(text, 1, length, output);
+
+    if (length <= SEXPR_MEMO_MAX_BYTES) {
+        char *copy = malloc(length);
+        if (copy) {
+            memcpy(copy, text, length);
+            free(entry->text);
+            entry->hash = hash;
+            entry->indentation_level = indentation_level;
+            entry->value = value;
+            entry->text = copy;
+            entry->length = length;
+        }
+    }
+
+    if (memo->scratch_size > SEXPR_MEMO_SCRATCH_LIMIT) {
+        fclose(memo->scratch);
+        memo->scratch = NULL;
+    }
+    return true;
+}
+
+/**
+ * @brief Reports how often the cache was used
+ * @param memo The cache
+ * @param output Stream receiving the report
+ */
+void sexpr_memo_write_stats(const sexpr_memo_t *memo, FILE *output) {
+    const double rate = memo->lookups ? 100.0 * (double)memo->hits / (double)memo->lookups : 0.0;
+    fprintf(output, ";; Memoized subtrees: %lu lookups, %lu hits (%.1f%% hit rate)\n",
+            (unsigned long)memo->lookups, (unsigned long)memo->hits, rate);
+}
@@ -8,20 +8,89 @@
 
 #include "json_to_sexpr.h"
 
+/**
+ * @brief Prepares a writer for an output stream
+ * @param writer The writer to initialize
+ * @param output The file stream to write to
+ * @param unicode_mode How non-ASCII characters are written in strings
+ */
+void sexpr_writer_initialize(sexpr_writer_t *writer, FILE *output, sexpr_unicode_mode_t unicode_mode) {
+    writer->output = output;
+    writer->unicode_mode = unicode_mode;
+    writer->memo = NULL;
+    writer->progress = NULL;
+}
+
+/**
+ * @brief Writes one non-ASCII UTF-8 sequence as a Guile-style escape
+ * @param input The string being escaped
+ * @param input_length Length of the string
+ * @param input_position Position of the lead byte; advanced past the sequence
+ * @param output Destination buffer
+ * @return Number of characters written
+ */
+static size_t string_utils_escape_code_point(const unsigned char *input, size_t input_length,
+                                             size_t *input_position, char *output) {
+    static const char hex_digits[] = "0123456789abcdef";
+    const unsigned char lead = input[*input_position];
+    size_t sequence_length = 0;
+    uint32_t code_point = 0;
+    
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        sequence_length = 2;
+        code_point = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        sequence_length = 3;
+        code_point = lead & 0x0F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        sequence_length = 4;
+        code_point = lead & 0x07;
+    }
+    
+    bool complete = sequence_length > 0 && *input_position + sequence_length <= input_length;
+    for (size_t offset = 1; complete && offset < sequence_length; offset++) {
+        const unsigned char continuation = input[*input_position + offset];
+        complete = (continuation & 0xC0) == 0x80;
+        code_point = (code_point << 6) | (continuation & 0x3F);
+    }
+    
+    // Bytes that do not decode (unvalidated input) are written as \xHH
+    if (!complete) {
+        output[0] = '\\';
+        output[1] = 'x';
+        output[2] = hex_digits[lead >> 4];
+        output[3] = hex_digits[lead & 0x0F];
+        *input_position += 1;
+        return 4;
+    }
+    
+    *input_position += sequence_length;
+    const int digit_count = code_point > 0xFFFF ? 6 : 4;
+    output[0] = '\\';
+    output[1] = code_point > 0xFFFF ? 'U' : 'u';
+    for (int digit = 0; digit < digit_count; digit++) {
+        output[2 + digit] = hex_digits[(code_point >> (4 * (digit_count - 1 - digit))) & 0x0F];
+    }
+    return 2 + (size_t)digit_count;
+}
+
 /**
  * @brief Escapes a string for safe output in S-expression format
  * @param input_string The string to escape
+ * @param unicode_mode Whether non-ASCII characters are kept or escaped
  * @return Newly allocated escaped string with quotes, or NULL on failure
  * @note Caller is responsible for freeing the returned string
  */
-char *string_utils_escape_for_lisp(const char *input_string) {
+char *string_utils_escape_for_lisp(const char *input_string, sexpr_unicode_mode_t unicode_mode) {
     if (!input_string) {
         return NULL;
     }
     
     const size_t input_length = strlen(input_string);
     // Worst case: every character needs escaping plus surrounding quotes
-    char *escaped_string = malloc(input_length * 2 + 3);
+    // (a stray byte becomes the four characters \xHH in escape mode)
+    const size_t expansion = unicode_mode == SEXPR_UNICODE_ESCAPE ? 4 : 2;
+    char *escaped_string = malloc(input_length * expansion + 3);
     if (!escaped_string) {
         return NULL;
     }
@@ -29,9 +98,17 @@ char *string_utils_escape_for_lisp(const char *input_string) {
     size_t output_position = 0;
     escaped_string[output_position++] = '"';
     
-    for (size_t input_position = 0; input_position < input_length; input_position++) {
+    size_t input_position = 0;
+    while (input_position < input_length) {
         const char current_char = input_string[input_position];
         
+        if ((unsigned char)current_char >= 0x80 && unicode_mode == SEXPR_UNICODE_ESCAPE) {
+            output_position += string_utils_escape_code_point((const unsigned char *)input_string,
+                                                              input_length, &input_position,
+                                                              escaped_string + output_position);
+            continue;
+        }
+        
         switch (current_char) {
             case '"':
                 escaped_string[output_position++] = '\\';
@@ -57,6 +134,7 @@ char *string_utils_escape_for_lisp(const char *input_string) {
                 escaped_string[output_position++] = current_char;
                 break;
         }
+        input_position++;
     }
     
     escaped_string[output_position++] = '"';
@@ -79,13 +157,62 @@ void output_formatter_write_indentation(FILE *output, int indentation_level) {
     }
 }
 
+/**
+ * @brief Formats a signed 64-bit integer in decimal
+ * @param integer_value The integer to format
+ * @param buffer Destination with room for MAX_NUMBER_TEXT bytes
+ * @return Number of characters written (not counting the terminator)
+ */
+size_t output_formatter_format_integer(int64_t integer_value, char *buffer) {
+    char digits[MAX_NUMBER_TEXT];
+    size_t digit_count = 0;
+    size_t length = 0;
+    
+    // Work on the magnitude as unsigned so INT64_MIN does not overflow
+    uint64_t magnitude = (uint64_t)integer_value;
+    if (integer_value < 0) {
+        buffer[length++] = '-';
+        magnitude = 0 - magnitude;
+    }
+    
+    do {
+        digits[digit_count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    
+    while (digit_count > 0) {
+        buffer[length++] = digits[--digit_count];
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+/**
+ * @brief Formats a JSON number, printing integral values without a fraction
+ * @param number_value The number to format
+ * @param buffer Destination with room for MAX_NUMBER_TEXT bytes
+ * @return Number of characters written (not counting the terminator)
+ */
+size_t output_formatter_format_number(double number_value, char *buffer) {
+    // Check if the number is effectively an integer within long long range
+    if (number_value >= -9223372036854775808.0 && number_value < 9223372036854775808.0) {
+        const long long integer_value = (long long)number_value;
+        if (number_value == (double)integer_value) {
+            return output_formatter_format_integer(integer_value, buffer);
+        }
+    }
+    
+    return (size_t)snprintf(buffer, MAX_NUMBER_TEXT, "%.15g", number_value);
+}
+
 /**
  * @brief Writes JSON object members as S-expression format
  * @param member_node The first member in the linked list
- * @param output The file stream to write to
+ * @param writer The writer holding the output stream and options
  * @param indentation_level Current indentation depth
  */
-void sexpr_writer_write_object_members(json_member_t *member_node, FILE *output, int indentation_level) {
+void sexpr_writer_write_object_members(json_member_t *member_node, sexpr_writer_t *writer, int indentation_level) {
+    FILE *output = writer->output;
     bool is_first_member = true;
     
     while (member_node != NULL) {
@@ -95,9 +222,14 @@ void sexpr_writer_write_object_members(json_member_t *member_node, FILE *output,
         }
         is_first_member = false;
         
-        fprintf(output, "(json:%s ", member_node->key);
-        sexpr_writer_write_value(member_node->value, output, indentation_level + 1);
-        fprintf(output, ")");
+        if (member_node->key == NULL) {
+            // Preview elision markers stand alone among the members
+            sexpr_writer_write_value(member_node->value, writer, indentation_level);
+        } else {
+            fprintf(output, "(json:%s ", member_node->key);
+            sexpr_writer_write_value(member_node->value, writer, indentation_level + 1);
+            fprintf(output, ")");
+        }
         
         member_node = member_node->next;
     }
@@ -106,10 +238,11 @@ void sexpr_writer_write_object_members(json_member_t *member_node, FILE *output,
 /**
  * @brief Writes JSON array elements as S-expression format
  * @param element_node The first element in the linked list
- * @param output The file stream to write to
+ * @param writer The writer holding the output stream and options
  * @param indentation_level Current indentation depth
  */
-void sexpr_writer_write_array_elements(json_element_t *element_node, FILE *output, int indentation_level) {
+void sexpr_writer_write_array_elements(json_element_t *element_node, sexpr_writer_t *writer, int indentation_level) {
+    FILE *output = writer->output;
     bool is_first_element = true;
     
     while (element_node != NULL) {
@@ -119,30 +252,198 @@ void sexpr_writer_write_array_elements(json_element_t *element_node, FILE *outpu
         }
         is_first_element = false;
         
-        sexpr_writer_write_value(element_node->value, output, indentation_level);
+        sexpr_writer_write_value(element_node->value, writer, indentation_level);
         
         element_node = element_node->next;
     }
 }
 
+/**
+ * @brief Writes packed array elements using a batched formatter
+ * 
+ * Elements are formatted into a local buffer and flushed with a single
+ * fwrite per batch instead of one formatted print per element.
+ * 
+ * @param typed_array The packed array to write (must not be empty)
+ * @param writer The writer holding the output stream and options
+ * @param indentation_level Current indentation depth
+ */
+void sexpr_writer_write_typed_array_elements(json_typed_array_t *typed_array, sexpr_writer_t *writer, int indentation_level) {
+    FILE *output = writer->output;
+    const size_t separator_length = 1 + (size_t)indentation_level * 2;
+    char *separator = malloc(separator_length);
+    if (!separator) {
+        return;
+    }
+    separator[0] = '\n';
+    memset(separator + 1, ' ', separator_length - 1);
+    
+    char batch[8192];
+    size_t batch_used = 0;
+    
+    for (size_t index = 0; index < typed_array->count; index++) {
+        if (batch_used + separator_length + MAX_NUMBER_TEXT > sizeof(batch)) {
+            fwrite(batch, 1, batch_used, output);
+            batch_used = 0;
+        }
+        
+        if (index > 0) {
+            if (separator_length + MAX_NUMBER_TEXT > sizeof(batch)) {
+                fwrite(separator, 1, separator_length, output);
+            } else {
+                memcpy(batch + batch_used, separator, separator_length);
+                batch_used += separator_length;
+            }
+        }
+        
+        switch (typed_array->kind) {
+            case TYPED_ARRAY_INT64:
+                batch_used += output_formatter_format_integer(typed_array->items.integers[index],
+                                                              batch + batch_used);
+                break;
+            case TYPED_ARRAY_DOUBLE:
+                batch_used += output_formatter_format_number(typed_array->items.doubles[index],
+                                                             batch + batch_used);
+                break;
+            case TYPED_ARRAY_BOOLEAN:
+                batch[batch_used++] = '#';
+                batch[batch_used++] = json_typed_array_get_boolean(typed_array, index) ? 't' : 'f';
+                break;
+            case TYPED_ARRAY_VALUE:
+                // Packed arrays never hold generic values
+                break;
+        }
+    }
+    
+    fwrite(batch, 1, batch_used, output);
+    free(separator);
+}
+
+/**
+ * @brief Writes one element of a packed array or record column
+ * @param typed_array The array holding the element
+ * @param index Element position
+ * @param writer The writer holding the output stream and options
+ * @param indentation_level Indentation depth used for generic values
+ */
+void sexpr_writer_write_typed_item(json_typed_array_t *typed_array, size_t index,
+                                   sexpr_writer_t *writer, int indentation_level) {
+    FILE *output = writer->output;
+    char number_text[MAX_NUMBER_TEXT];
+    size_t length;
+    
+    switch (typed_array->kind) {
+        case TYPED_ARRAY_INT64:
+            length = output_formatter_format_integer(typed_array->items.integers[index], number_text);
+            fwrite(number_text, 1, length, output);
+            break;
+        case TYPED_ARRAY_DOUBLE:
+            length = output_formatter_format_number(typed_array->items.doubles[index], number_text);
+            fwrite(number_text, 1, length, output);
+            break;
+        case TYPED_ARRAY_BOOLEAN:
+            fprintf(output, "%s", json_typed_array_get_boolean(typed_array, index) ? "#t" : "#f");
+            break;
+        case TYPED_ARRAY_VALUE:
+            sexpr_writer_write_value(typed_array->items.values[index], writer, indentation_level);
+            break;
+    }
+}
+
+/**
+ * @brief Writes one columnar record as the equivalent object
+ * @param record_array The record array holding the record
+ * @param record_index Record position
+ * @param writer The writer holding the output stream and options
+ * @param indentation_level Current indentation depth
+ */
+void sexpr_writer_write_record(json_record_array_t *record_array, size_t record_index,
+                               sexpr_writer_t *writer, int indentation_level) {
+    FILE *output = writer->output;
+    fprintf(output, "(json:object\n");
+    for (size_t key_index = 0; key_index < record_array->key_count; key_index++) {
+        if (key_index > 0) {
+            fprintf(output, "\n");
+        }
+        output_formatter_write_indentation(output, indentation_level + 1);
+        fprintf(output, "(json:%s ", record_array->keys[key_index]);
+        sexpr_writer_write_typed_item(record_array->columns[key_index], record_index,
+                                      writer, indentation_level + 2);
+        fprintf(output, ")");
+    }
+    fprintf(output, ")");
+}
+
+/**
+ * @brief Writes columnar records as the equivalent sequence of objects
+ * @param record_array The record array to write (at least one record)
+ * @param writer The writer holding the output stream and options
+ * @param indentation_level Current indentation depth
+ */
+void sexpr_writer_write_record_array_elements(json_record_array_t *record_array, sexpr_writer_t *writer, int indentation_level) {
+    FILE *output = writer->output;
+    for (size_t record_index = 0; record_index < record_array->record_count; record_index++) {
+        if (record_index > 0) {
+            fprintf(output, "\n");
+            output_formatter_write_indentation(output, indentation_level);
+        }
+        sexpr_writer_write_record(record_array, record_index, writer, indentation_level);
+    }
+}
+
+/**
+ * @brief Writes the entries of a non-empty container without its brackets,
+ *        separated as they are inside it
+ * @param container The object or array whose entries to write
+ * @param writer The writer holding the output stream and options
+ * @param indentation_level Indentation depth of the entries
+ */
+void sexpr_writer_write_entries(json_value_t *container, sexpr_writer_t *writer, int indentation_level) {
+    switch (container->type) {
+        case JSON_OBJECT:
+            sexpr_writer_write_object_members(container->data.object, writer, indentation_level);
+            break;
+        case JSON_ARRAY:
+            sexpr_writer_write_array_elements(container->data.array, writer, indentation_level);
+            break;
+        case JSON_TYPED_ARRAY:
+            sexpr_writer_write_typed_array_elements(container->data.typed_array, writer, indentation_level);
+            break;
+        case JSON_RECORD_ARRAY:
+            sexpr_writer_write_record_array_elements(container->data.record_array, writer, indentation_level);
+            break;
+        default:
+            break;
+    }
+}
+
 /**
  * @brief Converts a JSON value to S-expression format and writes to output
  * @param json_value The JSON value to convert
- * @param output The file stream to write to
+ * @param writer The writer holding the output stream and options
  * @param indentation_level Current indentation depth for pretty printing
  */
-void sexpr_writer_write_value(json_value_t *json_value, FILE *output, int indentation_level) {
+void sexpr_writer_write_value(json_value_t *json_value, sexpr_writer_t *writer, int indentation_level) {
+    FILE *output = writer->output;
     if (json_value == NULL) {
         fprintf(output, "nil");
         return;
     }
     
+    // Small repeated subtrees are copied from the cache when memoizing
+    if (writer->memo != NULL &&
+        (json_value->type == JSON_OBJECT || json_value->type == JSON_ARRAY ||
+         json_value->type == JSON_TYPED_ARRAY || json_value->type == JSON_RECORD_ARRAY) &&
+        sexpr_memo_write_value(writer->memo, json_value, writer, indentation_level)) {
+        return;
+    }
+    
     switch (json_value->type) {
         case JSON_OBJECT:
             if (json_value->data.object != NULL) {
                 fprintf(output, "(json:object\n");
                 output_formatter_write_indentation(output, indentation_level + 1);
-                sexpr_writer_write_object_members(json_value->data.object, output, indentation_level + 1);
+                sexpr_writer_write_object_members(json_value->data.object, writer, indentation_level + 1);
                 fprintf(output, ")");
             } else {
                 fprintf(output, "(json:object)");
@@ -153,15 +454,29 @@ void sexpr_writer_write_value(json_value_t *json_value, FILE *output, int indent
             if (json_value->data.array != NULL) {
                 fprintf(output, "(json:array\n");
                 output_formatter_write_indentation(output, indentation_level + 1);
-                sexpr_writer_write_array_elements(json_value->data.array, output, indentation_level + 1);
+                sexpr_writer_write_array_elements(json_value->data.array, writer, indentation_level + 1);
                 fprintf(output, ")");
             } else {
                 fprintf(output, "(json:array)");
             }
             break;
             
+        case JSON_TYPED_ARRAY:
+            fprintf(output, "(json:array\n");
+            output_formatter_write_indentation(output, indentation_level + 1);
+            sexpr_writer_write_typed_array_elements(json_value->data.typed_array, writer, indentation_level + 1);
+            fprintf(output, ")");
+            break;
+            
+        case JSON_RECORD_ARRAY:
+            fprintf(output, "(json:array\n");
+            output_formatter_write_indentation(output, indentation_level + 1);
+            sexpr_writer_write_record_array_elements(json_value->data.record_array, writer, indentation_level + 1);
+            fprintf(output, ")");
+            break;
+            
         case JSON_STRING: {
-            char *escaped_string = string_utils_escape_for_lisp(json_value->data.string);
+            char *escaped_string = string_utils_escape_for_lisp(json_value->data.string, writer->unicode_mode);
             if (escaped_string != NULL) {
                 fprintf(output, "%s", escaped_string);
                 free(escaped_string);
@@ -172,15 +487,9 @@ void sexpr_writer_write_value(json_value_t *json_value, FILE *output, int indent
         }
         
         case JSON_NUMBER: {
-            const double number_value = json_value->data.number;
-            const long long integer_value = (long long)number_value;
-            
-            // Check if the number is effectively an integer
-            if (number_value == (double)integer_value) {
-                fprintf(output, "%lld", integer_value);
-            } else {
-                fprintf(output, "%.15g", number_value);
-            }
+            char number_text[MAX_NUMBER_TEXT];
+            const size_t length = output_formatter_format_number(json_value->data.number, number_text);
+            fwrite(number_text, 1, length, output);
             break;
         }
         
@@ -192,6 +501,10 @@ void sexpr_writer_write_value(json_value_t *json_value, FILE *output, int indent
             fprintf(output, "nil");
             break;
             
+        case JSON_ELIDED:
+            fprintf(output, "(preview:elided %lu)", (unsigned long)json_value->data.elided_count);
+            break;
+            
         default:
             fprintf(output, "nil"); // Fallback for unknown types
             break;
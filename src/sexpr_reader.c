@@ -0,0 +1,493 @@
+/**
+ * @file sexpr_reader.c
+ * @brief Reverse conversion of the converter's S-expressions back to JSON
+ *
+ * Reads exactly the dialect sexpr_writer_write_value produces, in one pass
+ * and without building a tree: each form is passed to the JSON writer as
+ * soon as it is recognized, string contents are copied in runs found with
+ * the validator's string scanner, and numbers are copied verbatim. Open
+ * forms are tracked on a byte stack, so nesting depth is not limited.
+ *
+ * Member keys are written unquoted by the converter, so a key is read up
+ * to the first space that is followed by the start of a value; a key that
+ * itself contains such a space (like "a 1") is split at the wrong place;
+ * sexpr_reader_key_is_readable tells such keys apart beforehand.
+ * Preview elision markers have no JSON equivalent and are rejected.
+ */
+
+#include "json_to_sexpr.h"
+
+/* Open forms on the reader's stack */
+typedef enum {
+    READER_FRAME_OBJECT,
+    READER_FRAME_ARRAY,
+    READER_FRAME_MEMBER,        // (json:key ... waiting for its value
+    READER_FRAME_MEMBER_DONE    // (json:key value ... waiting for ')'
+} reader_frame_t;
+
+/* Reader state for one conversion */
+typedef struct {
+    const char *input;
+    size_t length;
+    json_writer_t *writer;
+    json_check_result_t *result;
+    unsigned char *frames;
+    size_t depth;
+    size_t capacity;
+} sexpr_reader_t;
+
+/**
+ * @brief Records the first error and where it happened
+ * @param reader The reader
+ * @param offset Byte offset of the offending input
+ * @param message Description of the error
+ * @return false, for use in return statements
+ */
+static bool sexpr_reader_fail(sexpr_reader_t *reader, size_t offset, const char *message) {
+    reader->result->valid = false;
+    reader->result->error_offset = offset;
+    reader->result->message = message;
+    return false;
+}
+
+/**
+ * @brief Skips whitespace and ';' comments
+ * @param reader The reader
+ * @param pos Current offset
+ * @return Offset of the next byte that starts a form, or length
+ */
+static size_t sexpr_reader_skip_space(const sexpr_reader_t *reader, size_t pos) {
+    while (true) {
+        while (pos < reader->length && (reader->input[pos] == ' ' || reader->input[pos] == '\n' ||
+                                        reader->input[pos] == '\t' || reader->input[pos] == '\r')) {
+            pos++;
+        }
+        if (pos >= reader->length || reader->input[pos] != ';') {
+            return pos;
+        }
+        const char *newline = memchr(reader->input + pos, '\n', reader->length - pos);
+        pos = newline ? (size_t)(newline - reader->input) + 1 : reader->length;
+    }
+}
+
+/**
+ * @brief Pushes an open form
+ * @param reader The reader
+ * @param frame The kind of form
+ * @return true on success, false on allocation failure
+ */
+static bool sexpr_reader_push(sexpr_reader_t *reader, reader_frame_t frame) {
+    if (reader->depth == reader->capacity) {
+        const size_t capacity = reader->capacity ? reader->capacity * 2 : MAX_DEPTH;
+        unsigned char *frames = realloc(reader->frames, capacity);
+        if (!frames) {
+            return sexpr_reader_fail(reader, 0, "Out of memory");
+        }
+        reader->frames = frames;
+        reader->capacity = capacity;
+    }
+    reader->frames[reader->depth++] = (unsigned char)frame;
+    return true;
+}
+
+/**
+ * @brief Notes that a complete value was written
+ * @param reader The reader
+ * @return true if the document is finished
+ */
+static bool sexpr_reader_complete_value(sexpr_reader_t *reader) {
+    if (reader->depth == 0) {
+        return true;
+    }
+    if (reader->frames[reader->depth - 1] == READER_FRAME_MEMBER) {
+        reader->frames[reader->depth - 1] = READER_FRAME_MEMBER_DONE;
+    }
+    return false;
+}
+
+/**
+ * @brief Parses a run of hex digits
+ * @param text The digits
+ * @param count Number of digits
+ * @param value Receives the value
+ * @return true if all count characters are hex digits
+ */
+static bool sexpr_reader_parse_hex(const char *text, size_t count, uint32_t *value) {
+    *value = 0;
+    for (size_t index = 0; index < count; index++) {
+        const char c = text[index];
+        uint32_t digit;
+        if (c >= '0' && c <= '9') {
+            digit = (uint32_t)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            digit = (uint32_t)(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            digit = (uint32_t)(c - 'A' + 10);
+        } else {
+            return false;
+        }
+        *value = (*value << 4) | digit;
+    }
+    return true;
+}
+
+/**
+ * @brief Converts a string literal
+ * @param reader The reader
+ * @param pos Offset of the opening quote; advanced past the closing quote
+ * @return true on success
+ */
+static bool sexpr_reader_read_string(sexpr_reader_t *reader, size_t *pos) {
+    const char *input = reader->input;
+    json_writer_t *writer = reader->writer;
+    size_t cursor = *pos + 1;
+
+    json_writer_begin_string(writer);
+    while (true) {
+        const size_t special = json_validator_find_string_special(input, cursor, reader->length);
+        if (special >= reader->length) {
+            return sexpr_reader_fail(reader, *pos, "Unterminated string");
+        }
+        json_writer_write_string_bytes(writer, input + cursor, special - cursor);
+        if (input[special] == '"') {
+            cursor = special + 1;
+            break;
+        }
+
+        uint32_t value;
+        cursor = special + 2;
+        switch (special + 1 < reader->length ? input[special + 1] : '\0') {
+            case '"':
+                json_writer_write_string_bytes(writer, "\"", 1);
+                break;
+            case '\\':
+                json_writer_write_string_bytes(writer, "\\", 1);
+                break;
+            case 'n':
+                json_writer_write_string_bytes(writer, "\n", 1);
+                break;
+            case 'r':
+                json_writer_write_string_bytes(writer, "\r", 1);
+                break;
+            case 't':
+                json_writer_write_string_bytes(writer, "\t", 1);
+                break;
+            case 'u':
+                if (cursor + 4 > reader->length || !sexpr_reader_parse_hex(input + cursor, 4, &value)) {
+                    return sexpr_reader_fail(reader, special, "Invalid \\u escape");
+                }
+                json_writer_write_code_point(writer, value);
+                cursor += 4;
+                break;
+            case 'U':
+                if (cursor + 6 > reader->length || !sexpr_reader_parse_hex(input + cursor, 6, &value) ||
+                    value > 0x10FFFF) {
+                    return sexpr_reader_fail(reader, special, "Invalid \\U escape");
+                }
+                json_writer_write_code_point(writer, value);
+                cursor += 6;
+                break;
+            case 'x': {
+                // A byte that was not valid UTF-8 in the original input
+                if (cursor + 2 > reader->length || !sexpr_reader_parse_hex(input + cursor, 2, &value)) {
+                    return sexpr_reader_fail(reader, special, "Invalid \\x escape");
+                }
+                const char byte = (char)value;
+                json_writer_write_string_bytes(writer, &byte, 1);
+                cursor += 2;
+                break;
+            }
+            default:
+                return sexpr_reader_fail(reader, special, "Unknown escape sequence");
+        }
+    }
+
+    json_writer_end_string(writer);
+    *pos = cursor;
+    return true;
+}
+
+/**
+ * @brief Checks that text is a JSON number
+ * @param text The candidate
+ * @param length Its length
+ * @return true if text follows the JSON number grammar
+ */
+static bool sexpr_reader_is_number(const char *text, size_t length) {
+    size_t pos = 0;
+    if (pos < length && text[pos] == '-') {
+        pos++;
+    }
+    if (pos >= length || !isdigit((unsigned char)text[pos])) {
+        return false;
+    }
+    if (text[pos] == '0') {
+        pos++;
+    } else {
+        while (pos < length && isdigit((unsigned char)text[pos])) {
+            pos++;
+        }
+    }
+    if (pos < length && text[pos] == '.') {
+        pos++;
+        if (pos >= length || !isdigit((unsigned char)text[pos])) {
+            return false;
+        }
+        while (pos < length && isdigit((unsigned char)text[pos])) {
+            pos++;
+        }
+    }
+    if (pos < length && (text[pos] == 'e' || text[pos] == 'E')) {
+        pos++;
+        if (pos < length && (text[pos] == '+' || text[pos] == '-')) {
+            pos++;
+        }
+        if (pos >= length || !isdigit((unsigned char)text[pos])) {
+            return false;
+        }
+        while (pos < length && isdigit((unsigned char)text[pos])) {
+            pos++;
+        }
+    }
+    return pos == length;
+}
+
+/**
+ * @brief Converts an atom: nil, #t, #f or a number
+ * @param reader The reader
+ * @param pos Offset of the atom; advanced past it
+ * @return true on success
+ */
+static bool sexpr_reader_read_atom(sexpr_reader_t *reader, size_t *pos) {
+    const char *input = reader->input;
+    size_t end = *pos;
+    while (end < reader->length) {
+        const char c = input[end];
+        if (c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '(' || c == ')' ||
+            c == '"' || c == ';') {
+            break;
+        }
+        end++;
+    }
+
+    const char *atom = input + *pos;
+    const size_t length = end - *pos;
+    if (length == 3 && memcmp(atom, "nil", 3) == 0) {
+        json_writer_write_literal(reader->writer, "null", 4);
+    } else if (length == 2 && memcmp(atom, "#t", 2) == 0) {
+        json_writer_write_literal(reader->writer, "true", 4);
+    } else if (length == 2 && memcmp(atom, "#f", 2) == 0) {
+        json_writer_write_literal(reader->writer, "false", 5);
+    } else if (sexpr_reader_is_number(atom, length)) {
+        json_writer_write_literal(reader->writer, atom, length);
+    } else {
+        return sexpr_reader_fail(reader, *pos, "Unexpected atom");
+    }
+    *pos = end;
+    return true;
+}
+
+/**
+ * @brief Checks whether a value could start a piece of text
+ * @param text The text
+ * @param remaining Bytes left in the text
+ * @return true if it starts a string, form, number or keyword
+ */
+static bool sexpr_reader_text_starts_value(const char *text, size_t remaining) {
+    size_t keyword = 0;
+    if (remaining >= 3 && memcmp(text, "nil", 3) == 0) {
+        keyword = 3;
+    } else if (remaining >= 2 && (memcmp(text, "#t", 2) == 0 || memcmp(text, "#f", 2) == 0)) {
+        keyword = 2;
+    }
+    if (keyword > 0) {
+        return keyword == remaining || text[keyword] == ')' || isspace((unsigned char)text[keyword]);
+    }
+    return remaining > 0 && (text[0] == '"' || text[0] == '-' || isdigit((unsigned char)text[0]) ||
+                             (remaining >= 6 && memcmp(text, "(json:", 6) == 0));
+}
+
+/**
+ * @brief Checks whether a value could start at an offset
+ * @param reader The reader
+ * @param pos Offset to check
+ * @return true if the text there starts a string, form, number or keyword
+ */
+static bool sexpr_reader_starts_value(const sexpr_reader_t *reader, size_t pos) {
+    return sexpr_reader_text_starts_value(reader->input + pos, reader->length - pos);
+}
+
+/**
+ * @brief Checks whether a member key reads back as it was written
+ *
+ * A key is read up to its first space followed by the start of a value,
+ * so a key holding such a space comes back split.
+ *
+ * @param key The key
+ * @param length Key length
+ * @return true if the reader would recover the whole key
+ */
+bool sexpr_reader_key_is_readable(const char *key, size_t length) {
+    for (const char *space = memchr(key, ' ', length); space;
+         space = memchr(space + 1, ' ', (size_t)(key + length - space) - 1)) {
+        if (sexpr_reader_text_starts_value(space + 1, (size_t)(key + length - space) - 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Converts the opening of a (json:...) form
+ *
+ * Inside an object the form is a member and the text up to the space before
+ * its value is the key; elsewhere it must open an object or array.
+ *
+ * @param reader The reader
+ * @param pos Offset of the '('; advanced past the form's head
+ * @return true on success
+ */
+static bool sexpr_reader_read_form(sexpr_reader_t *reader, size_t *pos) {
+    const char *input = reader->input;
+    const size_t start = *pos;
+    const size_t name = start + 6;
+    if (start + 9 <= reader->length && memcmp(input + start, "(preview:", 9) == 0) {
+        return sexpr_reader_fail(reader, start, "Preview elision markers have no JSON equivalent");
+    }
+    if (name > reader->length || memcmp(input + start, "(json:", 6) != 0) {
+        return sexpr_reader_fail(reader, start, "Expected a (json:...) form");
+    }
+
+    if (reader->depth > 0 && reader->frames[reader->depth - 1] == READER_FRAME_OBJECT) {
+        const char *space = memchr(input + name, ' ', reader->length - name);
+        while (space && !sexpr_reader_starts_value(reader, (size_t)(space - input) + 1)) {
+            space = memchr(space + 1, ' ', (size_t)(input + reader->length - space) - 1);
+        }
+        if (!space) {
+            return sexpr_reader_fail(reader, start, "Member without a value");
+        }
+        json_writer_write_key(reader->writer, input + name, (size_t)(space - input) - name);
+        *pos = (size_t)(space - input) + 1;
+        return sexpr_reader_push(reader, READER_FRAME_MEMBER);
+    }
+
+    size_t end = name;
+    while (end < reader->length && isalpha((unsigned char)input[end])) {
+        end++;
+    }
+    const size_t name_length = end - name;
+    if (end < reader->length && input[end] != ')' && !isspace((unsigned char)input[end])) {
+        return sexpr_reader_fail(reader, start, "Unknown form");
+    }
+
+    *pos = end;
+    if (name_length == 6 && memcmp(input + name, "object", 6) == 0) {
+        json_writer_begin_container(reader->writer, '{');
+        return sexpr_reader_push(reader, READER_FRAME_OBJECT);
+    }
+    if (name_length == 5 && memcmp(input + name, "array", 5) == 0) {
+        json_writer_begin_container(reader->writer, '[');
+        return sexpr_reader_push(reader, READER_FRAME_ARRAY);
+    }
+    return sexpr_reader_fail(reader, start, "Unknown form");
+}
+
+/**
+ * @brief Converts the closing ')' of the innermost open form
+ * @param reader The reader
+ * @param pos Offset of the ')'
+ * @return true on success
+ */
+static bool sexpr_reader_close_form(sexpr_reader_t *reader, size_t pos) {
+    if (reader->depth == 0) {
+        return sexpr_reader_fail(reader, pos, "Unexpected ')'");
+    }
+    switch (reader->frames[--reader->depth]) {
+        case READER_FRAME_OBJECT:
+            json_writer_end_container(reader->writer, '}');
+            return true;
+        case READER_FRAME_ARRAY:
+            json_writer_end_container(reader->writer, ']');
+            return true;
+        case READER_FRAME_MEMBER_DONE:
+            return true;
+        default:
+            return sexpr_reader_fail(reader, pos, "Member without a value");
+    }
+}
+
+/**
+ * @brief Converts converter output back to JSON
+ *
+ * The input holds one S-expression, optionally preceded by ';' comment
+ * lines such as the converter's header. On failure the JSON written so far
+ * is incomplete and result describes the first error.
+ *
+ * @param input The S-expression text (need not be NUL-terminated)
+ * @param length Input length in bytes
+ * @param writer Receives the compact JSON document
+ * @param result Receives the outcome and the position of any error
+ * @return true if the whole document was converted
+ */
+bool sexpr_reader_convert(const char *input, size_t length, json_writer_t *writer,
+                          json_check_result_t *result) {
+    sexpr_reader_t reader = {input, length, writer, result, NULL, 0, 0};
+    result->valid = true;
+    result->error_offset = 0;
+    result->line = 0;
+    result->column = 0;
+    result->message = NULL;
+
+    size_t pos = 0;
+    bool finished = false;
+    bool success = true;
+    while (success && !finished) {
+        pos = sexpr_reader_skip_space(&reader, pos);
+        if (pos >= length) {
+            success = sexpr_reader_fail(&reader, pos, "Unexpected end of input");
+            break;
+        }
+
+        const char c = input[pos];
+        const reader_frame_t top = reader.depth > 0 ? reader.frames[reader.depth - 1] : READER_FRAME_ARRAY;
+        if (c == ')') {
+            success = sexpr_reader_close_form(&reader, pos++);
+            if (success && top != READER_FRAME_MEMBER_DONE) {
+                finished = sexpr_reader_complete_value(&reader);
+            }
+        } else if (top == READER_FRAME_MEMBER_DONE) {
+            success = sexpr_reader_fail(&reader, pos, "Expected ')' after the member value");
+        } else if (c == '(') {
+            success = sexpr_reader_read_form(&reader, &pos);
+        } else if (top == READER_FRAME_OBJECT) {
+            success = sexpr_reader_fail(&reader, pos, "Expected a (json:key value) member");
+        } else if (c == '"') {
+            success = sexpr_reader_read_string(&reader, &pos);
+            finished = success && sexpr_reader_complete_value(&reader);
+        } else {
+            success = sexpr_reader_read_atom(&reader, &pos);
+            finished = success && sexpr_reader_complete_value(&reader);
+        }
+    }
+
+    if (success && sexpr_reader_skip_space(&reader, pos) < length) {
+        success = sexpr_reader_fail(&reader, sexpr_reader_skip_space(&reader, pos),
+                                    "Unexpected content after the document");
+    }
+
+    if (!success) {
+        result->line = 1;
+        result->column = 1;
+        for (size_t offset = 0; offset < result->error_offset; offset++) {
+            if (input[offset] == '\n') {
+                result->line++;
+                result->column = 1;
+            } else {
+                result->column++;
+            }
+        }
+    }
+
+    free(reader.frames);
+    return success;
+}
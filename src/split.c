@@ -0,0 +1,377 @@
+/**
+ * @file split.c
+ * @brief Sharded output: one file per top-level member or array chunk
+ *
+ * The document is validated once, then cut at its top-level commas with the
+ * raw entry skipper. Each shard is a self-contained byte range that a pool
+ * of worker threads parses and renders into its own file; the main thread
+ * writes a manifest listing the shards in document order.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "json_to_sexpr.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/* Longest shard path written (directory, separator and file name) */
+#define SPLIT_MAX_PATH 4096
+
+/* One shard: a run of consecutive top-level entries */
+typedef struct {
+    size_t start;               // byte range of the entries in the input
+    size_t end;
+    size_t first_index;         // index of the first entry in the document
+    size_t count;
+    char *key;                  // member key, filled in by the worker
+    uint64_t bytes;             // size of the written shard file
+    bool failed;
+} split_shard_t;
+
+/* Work shared by the worker threads */
+typedef struct {
+    const char *input;
+    const json_split_options_t *options;
+    bool object;
+    split_shard_t *shards;
+    size_t shard_count;
+    size_t next_shard;          // next shard to hand out, guarded by lock
+    pthread_mutex_t lock;
+} split_work_t;
+
+/**
+ * @brief Skips JSON whitespace
+ * @param input NUL-terminated input
+ * @param pos Current offset
+ * @return Offset of the next non-whitespace byte
+ */
+static size_t json_split_skip_whitespace(const char *input, size_t pos) {
+    while (input[pos] == ' ' || input[pos] == '\t' || input[pos] == '\n' || input[pos] == '\r') {
+        pos++;
+    }
+    return pos;
+}
+
+/**
+ * @brief Builds the file name of a shard
+ * @param path Buffer of SPLIT_MAX_PATH bytes
+ * @param directory The output directory
+ * @param index The shard number
+ * @return true if the path fits
+ */
+static bool json_split_shard_path(char *path, const char *directory, size_t index) {
+    const int written = snprintf(path, SPLIT_MAX_PATH, "%s/part-%05lu.lisp",
+                                 directory, (unsigned long)index);
+    return written > 0 && written < SPLIT_MAX_PATH;
+}
+
+/**
+ * @brief Appends a shard to the shard list
+ * @param shards The list (reallocated as needed)
+ * @param count Number of shards in the list
+ * @param capacity Allocated list size
+ * @return The new shard, or NULL on allocation failure
+ */
+static split_shard_t *json_split_add_shard(split_shard_t **shards, size_t *count, size_t *capacity) {
+    if (*count == *capacity) {
+        const size_t new_capacity = *capacity ? *capacity * 2 : 64;
+        split_shard_t *grown = realloc(*shards, new_capacity * sizeof(split_shard_t));
+        if (!grown) {
+            fprintf(stderr, "Error: Out of memory\n");
+            return NULL;
+        }
+        *shards = grown;
+        *capacity = new_capacity;
+    }
+    split_shard_t *shard = &(*shards)[(*count)++];
+    memset(shard, 0, sizeof(*shard));
+    return shard;
+}
+
+/**
+ * @brief Parses and writes one shard
+ *
+ * The shard's byte range is wrapped in the brackets of the top-level
+ * container so the regular parser handles it unchanged.
+ *
+ * @param work The shared work description
+ * @param index The shard to render
+ * @return true on success
+ */
+static bool json_split_render_shard(split_work_t *work, size_t index) {
+    split_shard_t *shard = &work->shards[index];
+    const size_t size = shard->end - shard->start;
+    char path[SPLIT_MAX_PATH];
+
+    if (!json_split_shard_path(path, work->options->directory, index)) {
+        fprintf(stderr, "Error: Output path too long\n");
+        return false;
+    }
+
+    char *text = malloc(size + 3);
+    if (!text) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return false;
+    }
+    text[0] = work->object ? '{' : '[';
+    memcpy(text + 1, work->input + shard->start, size);
+    text[size + 1] = work->object ? '}' : ']';
+    text[size + 2] = '\0';
+
+    parser_t parser;
+    parser_initialize(&parser, text);
+    json_value_t *value = json_parser_parse_document(&parser);
+    parser_release(&parser);
+    if (!value) {
+        fprintf(stderr, "Error: Failed to parse shard %lu\n", (unsigned long)index);
+        free(text);
+        return false;
+    }
+
+    bool success = false;
+    FILE *output = fopen(path, "w");
+    if (!output) {
+        perror("Error opening shard file");
+    } else {
+        fprintf(output, ";; JSON to S-expression conversion\n\n");
+        sexpr_writer_t writer;
+        sexpr_writer_initialize(&writer, output, work->options->unicode_mode);
+        if (work->object) {
+            // A member shard holds the bare (json:key value) form
+            json_member_t *member = value->data.object;
+            const size_t key_length = strlen(member->key);
+            shard->key = malloc(key_length + 1);
+            if (shard->key) {
+                memcpy(shard->key, member->key, key_length + 1);
+            }
+            sexpr_writer_write_object_members(member, &writer, 0);
+        } else {
+            sexpr_writer_write_value(value, &writer, 0);
+        }
+        fprintf(output, "\n");
+        const long size = ftell(output);
+        shard->bytes = size > 0 ? (uint64_t)size : 0;
+        success = fclose(output) == 0 && (!work->object || shard->key != NULL);
+        if (!success) {
+            fprintf(stderr, "Error: Failed to write shard %lu\n", (unsigned long)index);
+        }
+    }
+
+    json_memory_free_value(value);
+    free(text);
+    return success;
+}
+
+/**
+ * @brief Worker thread: renders shards until none are left
+ * @param argument The shared split_work_t
+ * @return NULL
+ */
+static void *json_split_worker(void *argument) {
+    split_work_t *work = argument;
+
+    while (true) {
+        pthread_mutex_lock(&work->lock);
+        const size_t index = work->next_shard;
+        if (index < work->shard_count) {
+            work->next_shard++;
+        }
+        pthread_mutex_unlock(&work->lock);
+
+        if (index >= work->shard_count) {
+            return NULL;
+        }
+        work->shards[index].failed = !json_split_render_shard(work, index);
+    }
+}
+
+/**
+ * @brief Writes manifest.lisp listing the shards in document order
+ * @param work The completed work
+ * @param entries Number of top-level entries in the document
+ * @param bytes_written Increased by the size of the manifest
+ * @return true on success
+ */
+static bool json_split_write_manifest(const split_work_t *work, size_t entries, uint64_t *bytes_written) {
+    char path[SPLIT_MAX_PATH];
+    const int written = snprintf(path, sizeof(path), "%s/manifest.lisp", work->options->directory);
+    if (written <= 0 || written >= (int)sizeof(path)) {
+        fprintf(stderr, "Error: Output path too long\n");
+        return false;
+    }
+
+    FILE *output = fopen(path, "w");
+    if (!output) {
+        perror("Error opening manifest file");
+        return false;
+    }
+
+    fprintf(output, ";; JSON to S-expression shard manifest\n\n");
+    fprintf(output, "(json:manifest\n  (json:type %s)\n  (json:entries %lu)\n  (json:shards",
+            work->object ? "object" : "array", (unsigned long)entries);
+    for (size_t index = 0; index < work->shard_count; index++) {
+        const split_shard_t *shard = &work->shards[index];
+        fprintf(output, "\n    (json:shard \"part-%05lu.lisp\" ", (unsigned long)index);
+        if (work->object) {
+            char *key = string_utils_escape_for_lisp(shard->key, work->options->unicode_mode);
+            fprintf(output, "(json:key %s))", key ? key : "\"\"");
+            free(key);
+        } else {
+            fprintf(output, "(json:first %lu) (json:count %lu))",
+                    (unsigned long)shard->first_index, (unsigned long)shard->count);
+        }
+    }
+    fprintf(output, "))\n");
+
+    const long size = ftell(output);
+    *bytes_written += size > 0 ? (uint64_t)size : 0;
+    if (fclose(output) != 0) {
+        fprintf(stderr, "Error: Failed to write manifest\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Cuts the top-level container into shards
+ * @param work Work description; shards and shard_count are filled in
+ * @param length Total input length
+ * @param pos Offset just after the top-level opening bracket
+ * @param entries Receives the number of top-level entries
+ * @return true on success
+ */
+static bool json_split_find_shards(split_work_t *work, size_t length, size_t pos, size_t *entries) {
+    const char *input = work->input;
+    const size_t chunk_size = work->object ? 1 : work->options->chunk_size;
+    size_t capacity = 0;
+    split_shard_t *shard = NULL;
+
+    *entries = 0;
+    pos = json_split_skip_whitespace(input, pos);
+    if (input[pos] == '}' || input[pos] == ']') {
+        return true;
+    }
+
+    while (true) {
+        const size_t start = json_split_skip_whitespace(input, pos);
+        size_t end = start;
+        if (!json_validator_skip_entry(input, length, &end)) {
+            fprintf(stderr, "Error: Unterminated top-level container\n");
+            return false;
+        }
+
+        if (shard == NULL || shard->count == chunk_size) {
+            shard = json_split_add_shard(&work->shards, &work->shard_count, &capacity);
+            if (!shard) {
+                return false;
+            }
+            shard->start = start;
+            shard->first_index = *entries;
+        }
+        shard->end = end;
+        shard->count++;
+        (*entries)++;
+
+        if (input[end] != ',') {
+            return true;
+        }
+        pos = end + 1;
+    }
+}
+
+/**
+ * @brief Writes a document as one shard file per top-level entry
+ *
+ * Object documents get one shard per member holding its (json:key value)
+ * form; array documents get one (json:array ...) shard per chunk of
+ * chunk_size elements. The document must be complete, well-formed JSON.
+ *
+ * @param input NUL-terminated JSON text
+ * @param length Input length in bytes
+ * @param options Output directory, chunk size, worker count (0 for one
+ *        per online processor) and encoding
+ * @param bytes_written Increased by the size of every shard and the manifest
+ * @return true if every shard and the manifest were written
+ */
+bool json_split_document(const char *input, size_t length, const json_split_options_t *options,
+                         uint64_t *bytes_written) {
+    json_check_result_t check;
+    if (!json_validator_check(input, length, &check)) {
+        fprintf(stderr, "Error: %s at line %d, column %d (byte offset %lu)\n",
+                check.message, check.line, check.column, (unsigned long)check.error_offset);
+        return false;
+    }
+
+    const size_t pos = json_split_skip_whitespace(input, 0);
+    if (input[pos] != '{' && input[pos] != '[') {
+        fprintf(stderr, "Error: Splitting needs an object or array at the top level\n");
+        return false;
+    }
+
+    if (mkdir(options->directory, 0777) != 0 && errno != EEXIST) {
+        perror("Error creating output directory");
+        return false;
+    }
+
+    split_work_t work;
+    memset(&work, 0, sizeof(work));
+    work.input = input;
+    work.options = options;
+    work.object = input[pos] == '{';
+
+    size_t entries;
+    bool success = json_split_find_shards(&work, length, pos + 1, &entries);
+
+    if (success && work.shard_count > 0) {
+        size_t worker_count = options->workers;
+        if (worker_count == 0) {
+            const long processors = sysconf(_SC_NPROCESSORS_ONLN);
+            worker_count = processors > 0 ? (size_t)processors : 1;
+        }
+        if (worker_count > work.shard_count) {
+            worker_count = work.shard_count;
+        }
+
+        pthread_t *threads = malloc(worker_count * sizeof(pthread_t));
+        if (!threads || pthread_mutex_init(&work.lock, NULL) != 0) {
+            fprintf(stderr, "Error: Out of memory\n");
+            free(threads);
+            free(work.shards);
+            return false;
+        }
+
+        // The calling thread works too when a thread cannot be started
+        size_t started = 0;
+        while (started < worker_count &&
+               pthread_create(&threads[started], NULL, json_split_worker, &work) == 0) {
+            started++;
+        }
+        if (started == 0) {
+            json_split_worker(&work);
+        }
+        for (size_t index = 0; index < started; index++) {
+            pthread_join(threads[index], NULL);
+        }
+        pthread_mutex_destroy(&work.lock);
+        free(threads);
+
+        for (size_t index = 0; index < work.shard_count; index++) {
+            success = success && !work.shards[index].failed;
+            *bytes_written += work.shards[index].bytes;
+        }
+    }
+
+    if (success) {
+        success = json_split_write_manifest(&work, entries, bytes_written);
+    }
+
+    for (size_t index = 0; index < work.shard_count; index++) {
+        free(work.shards[index].key);
+    }
+    free(work.shards);
+    return success;
+}
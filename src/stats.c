@@ -0,0 +1,141 @@
+/**
+ * @file stats.c
+ * @brief Document statistics gathered without building an AST
+ * 
+ * The counters are filled in by the validation pass; this module owns the
+ * bounded key set used for the distinct key count and writes the report.
+ */
+
+#include "json_to_sexpr.h"
+
+/* Initial number of slots in the key hash set */
+#define STATS_INITIAL_KEY_SLOTS 256
+
+/**
+ * @brief Resets all statistics to zero
+ * @param stats The statistics to initialize
+ */
+void json_stats_initialize(json_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+/**
+ * @brief Frees the key hash set
+ * @param stats The statistics to release
+ */
+void json_stats_release(json_stats_t *stats) {
+    free(stats->key_hashes);
+    stats->key_hashes = NULL;
+    stats->key_hash_capacity = 0;
+}
+
+/**
+ * @brief Hashes key bytes (FNV-1a followed by a 64-bit finalizer)
+ * @param key Key bytes as written in the input
+ * @param length Number of bytes
+ * @return A non-zero hash
+ */
+static uint64_t json_stats_hash_key(const char *key, size_t length) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t index = 0; index < length; index++) {
+        hash ^= (unsigned char)key[index];
+        hash *= 0x100000001B3ULL;
+    }
+    
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    return hash ? hash : 1;
+}
+
+/**
+ * @brief Inserts a hash into the open-addressing key set
+ * @param slots The set's slots (capacity is a power of two)
+ * @param capacity Number of slots
+ * @param hash The hash to insert
+ * @return true if the hash was not present yet
+ */
+static bool json_stats_insert_hash(uint64_t *slots, size_t capacity, uint64_t hash) {
+    size_t index = (size_t)hash & (capacity - 1);
+    while (slots[index] != 0) {
+        if (slots[index] == hash) {
+            return false;
+        }
+        index = (index + 1) & (capacity - 1);
+    }
+    slots[index] = hash;
+    return true;
+}
+
+/**
+ * @brief Counts an object member and its key
+ * 
+ * Keys are compared by their bytes as written, so differently escaped
+ * spellings of one key count separately. Once JSON_STATS_MAX_DISTINCT_KEYS
+ * keys are known the set stops growing and the count becomes a lower bound.
+ * 
+ * @param stats The statistics being gathered
+ * @param key Key bytes between the quotes
+ * @param length Number of key bytes
+ * @return true on success, false on allocation failure
+ */
+bool json_stats_add_key(json_stats_t *stats, const char *key, size_t length) {
+    stats->members++;
+    stats->key_bytes += length;
+    
+    if (stats->distinct_keys >= JSON_STATS_MAX_DISTINCT_KEYS) {
+        return true;
+    }
+    
+    // Keep the set at most half full
+    if ((stats->distinct_keys + 1) * 2 > stats->key_hash_capacity) {
+        const size_t new_capacity = stats->key_hash_capacity ? stats->key_hash_capacity * 2
+                                                             : STATS_INITIAL_KEY_SLOTS;
+        uint64_t *new_slots = calloc(new_capacity, sizeof(uint64_t));
+        if (!new_slots) {
+            return false;
+        }
+        for (size_t index = 0; index < stats->key_hash_capacity; index++) {
+            if (stats->key_hashes[index] != 0) {
+                json_stats_insert_hash(new_slots, new_capacity, stats->key_hashes[index]);
+            }
+        }
+        free(stats->key_hashes);
+        stats->key_hashes = new_slots;
+        stats->key_hash_capacity = new_capacity;
+    }
+    
+    if (json_stats_insert_hash(stats->key_hashes, stats->key_hash_capacity,
+                               json_stats_hash_key(key, length))) {
+        stats->distinct_keys++;
+    }
+    return true;
+}
+
+/**
+ * @brief Writes the statistics as an S-expression report
+ * @param stats The gathered statistics
+ * @param output The output stream
+ */
+void json_stats_write(const json_stats_t *stats, FILE *output) {
+    fprintf(output, ";; JSON document statistics\n\n");
+    fprintf(output, "(json:stats\n");
+    fprintf(output, "  (objects %lu)\n", (unsigned long)stats->objects);
+    fprintf(output, "  (arrays %lu)\n", (unsigned long)stats->arrays);
+    fprintf(output, "  (strings %lu)\n", (unsigned long)stats->strings);
+    fprintf(output, "  (integers %lu)\n", (unsigned long)stats->integers);
+    fprintf(output, "  (floats %lu)\n", (unsigned long)stats->floats);
+    fprintf(output, "  (booleans %lu)\n", (unsigned long)stats->booleans);
+    fprintf(output, "  (nulls %lu)\n", (unsigned long)stats->nulls);
+    fprintf(output, "  (members %lu)\n", (unsigned long)stats->members);
+    fprintf(output, "  (max-depth %lu)\n", (unsigned long)stats->max_depth);
+    fprintf(output, "  (largest-array %lu)\n", (unsigned long)stats->largest_array);
+    fprintf(output, "  (largest-object %lu)\n", (unsigned long)stats->largest_object);
+    fprintf(output, "  (string-bytes %lu)\n", (unsigned long)stats->string_bytes);
+    fprintf(output, "  (key-bytes %lu)\n", (unsigned long)stats->key_bytes);
+    if (stats->distinct_keys >= JSON_STATS_MAX_DISTINCT_KEYS) {
+        fprintf(output, "  (distinct-keys-at-least %lu))\n", (unsigned long)stats->distinct_keys);
+    } else {
+        fprintf(output, "  (distinct-keys %lu))\n", (unsigned long)stats->distinct_keys);
+    }
+}
@@ -0,0 +1,871 @@
+/**
+ * @file structure_index.c
+ * @brief Persistent structural index for selecting subtrees by path
+ *
+ * The index records every container of at least a few kilobytes: its byte
+ * range, the position and key hash of each member, and the start of every
+ * 64th element. Smaller containers are cheap to scan, so they are left out
+ * to keep the index compact. The file is a flat header plus two arrays of
+ * fixed-size records with no pointers, so a later run maps it and uses it
+ * directly. It is tied to its input by size, inode, modification and
+ * status change times to the nanosecond, and a hash of the first and last
+ * 64 KiB. An edit that slips past all of these is still caught when a
+ * lookup reads something other than what the index recorded; the caller
+ * then rebuilds the index.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "json_to_sexpr.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Containers smaller than this are scanned instead of indexed */
+#define STRUCTURE_MIN_CONTAINER_BYTES 4096
+
+/* One array element start is kept per this many elements */
+#define STRUCTURE_ELEMENT_STRIDE 64
+
+/* Bytes hashed at each end of the input to identify it */
+#define STRUCTURE_SAMPLE_BYTES 65536
+
+/* Index file signature, including the format version */
+static const char structure_magic[8] = {'J', '2', 'S', 'S', 'T', 'R', 'U', '2'};
+
+/* Index file header, followed by the container and child records */
+typedef struct {
+    char magic[8];
+    uint64_t input_size;
+    uint64_t input_inode;
+    int64_t input_mtime;
+    int64_t input_mtime_nanoseconds;
+    int64_t input_ctime;
+    int64_t input_ctime_nanoseconds;
+    uint64_t input_hash;
+    uint64_t container_count;
+    uint64_t child_count;
+} structure_header_t;
+
+/* Container still open while building */
+typedef struct {
+    size_t start;
+    size_t entries;
+    size_t child_base;          // first pending child record
+    bool is_object;
+    bool expecting_key;
+} structure_frame_t;
+
+/* Growable record arrays used while building */
+typedef struct {
+    structure_frame_t *frames;
+    size_t frame_count;
+    size_t frame_capacity;
+    json_structure_child_t *pending;    // children of the open containers
+    size_t pending_count;
+    size_t pending_capacity;
+    json_structure_container_t *containers;
+    size_t container_count;
+    size_t container_capacity;
+    json_structure_child_t *children;
+    size_t child_count;
+    size_t child_capacity;
+} structure_builder_t;
+
+/**
+ * @brief Hashes bytes with 64-bit FNV-1a
+ * @param hash Starting hash
+ * @param data The bytes
+ * @param length Number of bytes
+ * @return The updated hash
+ */
+static uint64_t json_structure_hash_bytes(uint64_t hash, const char *data, size_t length) {
+    for (size_t position = 0; position < length; position++) {
+        hash ^= (unsigned char)data[position];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Hashes a key; never returns 0, which marks escaped keys
+ * @param key The key bytes
+ * @param length Key length
+ * @return The key hash
+ */
+static uint64_t json_structure_hash_key(const char *key, size_t length) {
+    const uint64_t hash = json_structure_hash_bytes(0xcbf29ce484222325ULL, key, length);
+    return hash ? hash : 1;
+}
+
+/**
+ * @brief Hashes the input's length and the bytes at both of its ends
+ * @param input The input text
+ * @param length Input length
+ * @return The identifying hash
+ */
+static uint64_t json_structure_hash_input(const char *input, size_t length) {
+    const size_t sample = length < STRUCTURE_SAMPLE_BYTES ? length : STRUCTURE_SAMPLE_BYTES;
+    uint64_t hash = 0xcbf29ce484222325ULL ^ (uint64_t)length;
+    hash = json_structure_hash_bytes(hash, input, sample);
+    return json_structure_hash_bytes(hash, input + length - sample, sample);
+}
+
+/**
+ * @brief Makes room for one more record in a growable array
+ * @param items The array (reallocated as needed)
+ * @param count Records in use
+ * @param capacity Records allocated
+ * @param item_size Size of one record
+ * @return true on success, false on allocation failure
+ */
+static bool json_structure_reserve(void **items, size_t count, size_t *capacity, size_t item_size) {
+    if (count < *capacity) {
+        return true;
+    }
+    const size_t new_capacity = *capacity ? *capacity * 2 : MAX_DEPTH;
+    void *grown = realloc(*items, new_capacity * item_size);
+    if (!grown) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return false;
+    }
+    *items = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+/**
+ * @brief Records a child of the innermost open container
+ * @param builder The builder
+ * @param offset Key or element start
+ * @param key_hash Key hash, or 0
+ * @return true on success, false on allocation failure
+ */
+static bool json_structure_add_child(structure_builder_t *builder, size_t offset, uint64_t key_hash) {
+    if (!json_structure_reserve((void **)&builder->pending, builder->pending_count,
+                                &builder->pending_capacity, sizeof(json_structure_child_t))) {
+        return false;
+    }
+    builder->pending[builder->pending_count].offset = offset;
+    builder->pending[builder->pending_count].key_hash = key_hash;
+    builder->pending_count++;
+    return true;
+}
+
+/**
+ * @brief Closes the innermost container, keeping it if it is large enough
+ * @param builder The builder
+ * @param end Offset just past the closing bracket
+ * @return true on success, false on allocation failure
+ */
+static bool json_structure_close(structure_builder_t *builder, size_t end) {
+    const structure_frame_t *frame = &builder->frames[--builder->frame_count];
+    const size_t stored = builder->pending_count - frame->child_base;
+
+    if (end - frame->start >= STRUCTURE_MIN_CONTAINER_BYTES && stored <= UINT32_MAX) {
+        if (!json_structure_reserve((void **)&builder->containers, builder->container_count,
+                                    &builder->container_capacity, sizeof(json_structure_container_t))) {
+            return false;
+        }
+        while (builder->child_count + stored > builder->child_capacity) {
+            if (!json_structure_reserve((void **)&builder->children, builder->child_capacity,
+                                        &builder->child_capacity, sizeof(json_structure_child_t))) {
+                return false;
+            }
+        }
+
+        json_structure_container_t *container = &builder->containers[builder->container_count++];
+        container->start = frame->start;
+        container->end = end;
+        container->first_child = builder->child_count;
+        container->entries = frame->entries;
+        container->child_count = (uint32_t)stored;
+        container->is_object = frame->is_object;
+        memcpy(builder->children + builder->child_count, builder->pending + frame->child_base,
+               stored * sizeof(json_structure_child_t));
+        builder->child_count += stored;
+    }
+
+    builder->pending_count = frame->child_base;
+    return true;
+}
+
+/**
+ * @brief Orders containers by start offset for binary search
+ * @param left First container
+ * @param right Second container
+ * @return Negative, zero or positive as for qsort
+ */
+static int json_structure_compare_containers(const void *left, const void *right) {
+    const uint64_t left_start = ((const json_structure_container_t *)left)->start;
+    const uint64_t right_start = ((const json_structure_container_t *)right)->start;
+    return (left_start > right_start) - (left_start < right_start);
+}
+
+/**
+ * @brief Runs the structural scan that fills a builder
+ * @param builder An empty builder
+ * @param input Well-formed JSON text
+ * @param length Input length
+ * @return true on success
+ */
+static bool json_structure_scan(structure_builder_t *builder, const char *input, size_t length) {
+    size_t pos = 0;
+
+    while ((pos = json_validator_find_structural(input, pos, length)) < length) {
+        structure_frame_t *frame = builder->frame_count ? &builder->frames[builder->frame_count - 1] : NULL;
+        const char c = input[pos];
+
+        if (c == '"') {
+            const size_t close = json_validator_skip_string(input, length, pos + 1);
+            if (close >= length) {
+                return false;
+            }
+            if (frame && frame->is_object && frame->expecting_key) {
+                const char *key = input + pos + 1;
+                const size_t key_length = close - pos - 1;
+                const uint64_t key_hash = memchr(key, '\\', key_length) ? 0 :
+                                          json_structure_hash_key(key, key_length);
+                if (!json_structure_add_child(builder, pos, key_hash)) {
+                    return false;
+                }
+                frame->entries++;
+                frame->expecting_key = false;
+            }
+            pos = close + 1;
+            continue;
+        }
+
+        if (c == '{' || c == '[') {
+            if (!json_structure_reserve((void **)&builder->frames, builder->frame_count,
+                                        &builder->frame_capacity, sizeof(structure_frame_t))) {
+                return false;
+            }
+            frame = &builder->frames[builder->frame_count++];
+            frame->start = pos;
+            frame->entries = 0;
+            frame->child_base = builder->pending_count;
+            frame->is_object = c == '{';
+            frame->expecting_key = true;
+            if (c == '[') {
+                const size_t element = json_validator_skip_whitespace(input, pos + 1);
+                if (input[element] != ']') {
+                    frame->entries = 1;
+                    if (!json_structure_add_child(builder, element, 0)) {
+                        return false;
+                    }
+                }
+            }
+        } else if (c == ',') {
+            if (!frame) {
+                return false;
+            }
+            if (frame->is_object) {
+                frame->expecting_key = true;
+            } else if (frame->entries++ % STRUCTURE_ELEMENT_STRIDE == 0) {
+                if (!json_structure_add_child(builder, json_validator_skip_whitespace(input, pos + 1), 0)) {
+                    return false;
+                }
+            }
+        } else {
+            if (!frame || !json_structure_close(builder, pos + 1)) {
+                return false;
+            }
+        }
+        pos++;
+    }
+
+    return builder->frame_count == 0;
+}
+
+/**
+ * @brief Builds the structural index of a document
+ * @param structure Receives the index
+ * @param input Well-formed JSON text (validate it first)
+ * @param length Input length
+ * @return true on success
+ */
+bool json_structure_build(json_structure_t *structure, const char *input, size_t length) {
+    structure_builder_t builder;
+    memset(&builder, 0, sizeof(builder));
+    memset(structure, 0, sizeof(*structure));
+
+    const bool success = json_structure_scan(&builder, input, length);
+    free(builder.frames);
+    free(builder.pending);
+    if (!success) {
+        fprintf(stderr, "Error: Failed to build the structural index\n");
+        free(builder.containers);
+        free(builder.children);
+        return false;
+    }
+
+    // Containers were recorded as they closed; lookups need them by start
+    qsort(builder.containers, builder.container_count, sizeof(json_structure_container_t),
+          json_structure_compare_containers);
+
+    structure->containers = builder.containers;
+    structure->container_count = builder.container_count;
+    structure->children = builder.children;
+    structure->child_count = builder.child_count;
+    return true;
+}
+
+/**
+ * @brief Records the identity of the input file in an index header
+ * @param input_filename The input file
+ * @param header Receives the inode and the modification and status change
+ *        times
+ * @return true on success
+ */
+static bool json_structure_input_status(const char *input_filename, structure_header_t *header) {
+    struct stat status;
+    if (stat(input_filename, &status) != 0) {
+        return false;
+    }
+    header->input_inode = (uint64_t)status.st_ino;
+    header->input_mtime = (int64_t)status.st_mtim.tv_sec;
+    header->input_mtime_nanoseconds = (int64_t)status.st_mtim.tv_nsec;
+    header->input_ctime = (int64_t)status.st_ctim.tv_sec;
+    header->input_ctime_nanoseconds = (int64_t)status.st_ctim.tv_nsec;
+    return true;
+}
+
+/**
+ * @brief Maps an index file if it was built for this exact input
+ * @param structure Receives the mapped index
+ * @param index_filename The index file
+ * @param input_filename The input file the index must belong to
+ * @param input The input text
+ * @param length Input length
+ * @return true if a matching index was mapped; false if it is missing,
+ *         stale or damaged (the caller rebuilds it)
+ */
+bool json_structure_load(json_structure_t *structure, const char *index_filename,
+                         const char *input_filename, const char *input, size_t length) {
+    memset(structure, 0, sizeof(*structure));
+
+    structure_header_t input_status;
+    if (!json_structure_input_status(input_filename, &input_status)) {
+        return false;
+    }
+
+    const int descriptor = open(index_filename, O_RDONLY);
+    if (descriptor < 0) {
+        return false;
+    }
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || (size_t)status.st_size < sizeof(structure_header_t)) {
+        close(descriptor);
+        return false;
+    }
+    const size_t size = (size_t)status.st_size;
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    const structure_header_t *header = mapping;
+    const size_t records = size - sizeof(structure_header_t);
+    bool valid = memcmp(header->magic, structure_magic, sizeof(structure_magic)) == 0 &&
+                 header->input_size == length && header->input_inode == input_status.input_inode &&
+                 header->input_mtime == input_status.input_mtime &&
+                 header->input_mtime_nanoseconds == input_status.input_mtime_nanoseconds &&
+                 header->input_ctime == input_status.input_ctime &&
+                 header->input_ctime_nanoseconds == input_status.input_ctime_nanoseconds &&
+                 header->container_count <= records / sizeof(json_structure_container_t) &&
+                 header->child_count <= records / sizeof(json_structure_child_t) &&
+                 header->container_count * sizeof(json_structure_container_t) +
+                 header->child_count * sizeof(json_structure_child_t) == records &&
+                 header->input_hash == json_structure_hash_input(input, length);
+
+    const json_structure_container_t *containers = (const void *)(header + 1);
+    const json_structure_child_t *children = (const void *)(containers + (valid ? header->container_count : 0));
+    for (size_t index = 0; valid && index < header->container_count; index++) {
+        const json_structure_container_t *container = &containers[index];
+        valid = container->start < container->end && container->end <= length &&
+                container->first_child <= header->child_count &&
+                container->child_count <= header->child_count - container->first_child &&
+                (index == 0 || containers[index - 1].start < container->start);
+    }
+    for (size_t index = 0; valid && index < header->child_count; index++) {
+        valid = children[index].offset < length;
+    }
+
+    if (!valid) {
+        munmap(mapping, size);
+        return false;
+    }
+
+    structure->containers = containers;
+    structure->container_count = header->container_count;
+    structure->children = children;
+    structure->child_count = header->child_count;
+    structure->mapping = mapping;
+    structure->mapping_size = size;
+    return true;
+}
+
+/**
+ * @brief Writes an index file for the input
+ *
+ * The file is written under a temporary name and renamed into place, so
+ * readers never map a partly written index.
+ *
+ * @param structure The index to save
+ * @param index_filename The index file
+ * @param input_filename The input file the index belongs to
+ * @param input The input text
+ * @param length Input length
+ * @return true on success
+ */
+bool json_structure_save(const json_structure_t *structure, const char *index_filename,
+                         const char *input_filename, const char *input, size_t length) {
+    structure_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, structure_magic, sizeof(structure_magic));
+    header.input_size = length;
+    header.input_hash = json_structure_hash_input(input, length);
+    header.container_count = structure->container_count;
+    header.child_count = structure->child_count;
+    if (!json_structure_input_status(input_filename, &header)) {
+        perror("Error reading input file status");
+        return false;
+    }
+
+    const size_t name_length = strlen(index_filename);
+    char *temporary_name = malloc(name_length + 5);
+    if (!temporary_name) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return false;
+    }
+    memcpy(temporary_name, index_filename, name_length);
+    memcpy(temporary_name + name_length, ".tmp", 5);
+
+    FILE *output = fopen(temporary_name, "wb");
+    if (!output) {
+        perror("Error opening structural index file");
+        free(temporary_name);
+        return false;
+    }
+    bool success = fwrite(&header, sizeof(header), 1, output) == 1 &&
+                   fwrite(structure->containers, sizeof(json_structure_container_t),
+                          structure->container_count, output) == structure->container_count &&
+                   fwrite(structure->children, sizeof(json_structure_child_t),
+                          structure->child_count, output) == structure->child_count;
+    success = fclose(output) == 0 && success;
+    if (success && rename(temporary_name, index_filename) != 0) {
+        success = false;
+    }
+    if (!success) {
+        fprintf(stderr, "Error: Failed to write structural index file\n");
+        remove(temporary_name);
+    }
+    free(temporary_name);
+    return success;
+}
+
+/**
+ * @brief Frees or unmaps an index
+ * @param structure The index to release
+ */
+void json_structure_release(json_structure_t *structure) {
+    if (structure->mapping) {
+        munmap(structure->mapping, structure->mapping_size);
+    } else {
+        free((void *)structure->containers);
+        free((void *)structure->children);
+    }
+    memset(structure, 0, sizeof(*structure));
+}
+
+/**
+ * @brief Finds the indexed container starting at an offset
+ * @param structure The index, or NULL
+ * @param start Offset of the container's opening bracket
+ * @return The container, or NULL if it was not indexed
+ */
+static const json_structure_container_t *json_structure_find(const json_structure_t *structure,
+                                                             size_t start) {
+    if (!structure) {
+        return NULL;
+    }
+    size_t low = 0;
+    size_t high = structure->container_count;
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if (structure->containers[middle].start < start) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low < structure->container_count && structure->containers[low].start == start) {
+        return &structure->containers[low];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Checks whether the key at an offset decodes to the wanted key
+ * @param key_parser Parser over the input, used to decode the key
+ * @param offset Offset of the key's opening quote
+ * @param key The wanted key (decoded)
+ * @param key_length Its length
+ * @return true if the keys are equal
+ */
+static bool json_structure_key_matches(parser_t *key_parser, size_t offset,
+                                       const char *key, size_t key_length) {
+    const char *text;
+    size_t text_length;
+    key_parser->pos = offset;
+    return tokenizer_scan_string(key_parser, &text, &text_length) &&
+           text_length == key_length && memcmp(text, key, key_length) == 0;
+}
+
+/**
+ * @brief Finds the value of a member given the offset of its key
+ * @param input The input text
+ * @param length Input length
+ * @param offset Offset of the key's opening quote
+ * @return Offset of the value, or length if the member is malformed
+ */
+static size_t json_structure_member_value(const char *input, size_t length, size_t offset) {
+    const size_t close = json_validator_skip_string(input, length, offset + 1);
+    if (close >= length) {
+        return length;
+    }
+    const size_t colon = json_validator_skip_whitespace(input, close + 1);
+    if (input[colon] != ':') {
+        return length;
+    }
+    return json_validator_skip_whitespace(input, colon + 1);
+}
+
+/**
+ * @brief Checks that an indexed container still lies where it was recorded
+ * @param input The input text
+ * @param container The container's index record
+ * @return true if its brackets are at the recorded offsets
+ */
+static bool json_structure_container_intact(const char *input, const json_structure_container_t *container) {
+    return input[container->start] == (container->is_object ? '{' : '[') &&
+           input[container->end - 1] == (container->is_object ? '}' : ']');
+}
+
+/**
+ * @brief Checks that an indexed key still reads as recorded
+ * @param input The input text
+ * @param length Input length
+ * @param child The key's index record
+ * @return true if a key with the recorded hash starts at the offset
+ */
+static bool json_structure_key_intact(const char *input, size_t length, const json_structure_child_t *child) {
+    if (input[child->offset] != '"') {
+        return false;
+    }
+    const size_t close = json_validator_skip_string(input, length, child->offset + 1);
+    if (close >= length) {
+        return false;
+    }
+    const char *key = input + child->offset + 1;
+    const size_t key_length = close - child->offset - 1;
+    return memchr(key, '\\', key_length) ? child->key_hash == 0
+                                          : child->key_hash == json_structure_hash_key(key, key_length);
+}
+
+/**
+ * @brief Finds a member's value by scanning the object starting at pos
+ * @param key_parser Parser over the input, used to decode keys
+ * @param pos Offset of the object's opening brace
+ * @param key The wanted key (decoded)
+ * @param key_length Its length
+ * @return Offset of the member's value, or the input length if absent
+ */
+static size_t json_structure_scan_member(parser_t *key_parser, size_t pos, const char *key, size_t key_length) {
+    const char *input = key_parser->input;
+    const size_t length = key_parser->length;
+    size_t cursor = json_validator_skip_whitespace(input, pos + 1);
+    while (input[cursor] == '"') {
+        const size_t value = json_structure_member_value(input, length, cursor);
+        if (value >= length) {
+            return length;
+        }
+        if (json_structure_key_matches(key_parser, cursor, key, key_length)) {
+            return value;
+        }
+        size_t next = value;
+        if (!json_validator_skip_entry(input, length, &next) || input[next] != ',') {
+            return length;
+        }
+        cursor = json_validator_skip_whitespace(input, next + 1);
+    }
+    return length;
+}
+
+/**
+ * @brief Finds a member's value inside the object starting at pos
+ *
+ * An indexed object is searched through its key hashes. A key found there
+ * is checked against the input, and a miss is confirmed by scanning the
+ * object, so an index that no longer matches the input is noticed instead
+ * of reporting a wrong or missing value.
+ *
+ * @param structure The index, or NULL to scan
+ * @param key_parser Parser over the input, used to decode keys
+ * @param pos Offset of the object's opening brace
+ * @param key The wanted key (decoded)
+ * @param key_length Its length
+ * @param stale Set when the index disagrees with the input
+ * @return Offset of the member's value, or the input length if absent
+ */
+static size_t json_structure_find_member(const json_structure_t *structure, parser_t *key_parser,
+                                         size_t pos, const char *key, size_t key_length, bool *stale) {
+    const char *input = key_parser->input;
+    const size_t length = key_parser->length;
+    const json_structure_container_t *container = json_structure_find(structure, pos);
+
+    if (!container) {
+        return json_structure_scan_member(key_parser, pos, key, key_length);
+    }
+    if (!json_structure_container_intact(input, container)) {
+        *stale = true;
+        return length;
+    }
+
+    const uint64_t key_hash = json_structure_hash_key(key, key_length);
+    const json_structure_child_t *children = structure->children + container->first_child;
+    for (uint32_t index = 0; index < container->child_count; index++) {
+        if (children[index].key_hash != key_hash && children[index].key_hash != 0) {
+            continue;
+        }
+        if (!json_structure_key_intact(input, length, &children[index])) {
+            *stale = true;
+            return length;
+        }
+        if (json_structure_key_matches(key_parser, children[index].offset, key, key_length)) {
+            return json_structure_member_value(input, length, children[index].offset);
+        }
+    }
+    if (json_structure_scan_member(key_parser, pos, key, key_length) < length) {
+        *stale = true;
+    }
+    return length;
+}
+
+/**
+ * @brief Finds an element by scanning the array from a known element
+ * @param input The input text
+ * @param length Input length
+ * @param cursor Offset of an element
+ * @param remaining Elements to skip past it
+ * @return Offset of the element, or length if the array is shorter
+ */
+static size_t json_structure_scan_element(const char *input, size_t length, size_t cursor, size_t remaining) {
+    while (remaining-- > 0) {
+        size_t next = cursor;
+        if (!json_validator_skip_entry(input, length, &next) || input[next] != ',') {
+            return length;
+        }
+        cursor = json_validator_skip_whitespace(input, next + 1);
+    }
+    return cursor;
+}
+
+/**
+ * @brief Finds an element inside the array starting at pos
+ *
+ * An indexed array is entered at the nearest recorded element, which must
+ * still follow a '[' or ','; a miss is confirmed by scanning the array.
+ *
+ * @param structure The index, or NULL to scan
+ * @param input The input text
+ * @param length Input length
+ * @param pos Offset of the array's opening bracket
+ * @param element_index The wanted element
+ * @param stale Set when the index disagrees with the input
+ * @return Offset of the element, or length if the array is shorter
+ */
+static size_t json_structure_find_element(const json_structure_t *structure, const char *input,
+                                          size_t length, size_t pos, size_t element_index, bool *stale) {
+    const json_structure_container_t *container = json_structure_find(structure, pos);
+    const size_t first = json_validator_skip_whitespace(input, pos + 1);
+
+    if (!container) {
+        return input[first] == ']' ? length : json_structure_scan_element(input, length, first, element_index);
+    }
+    if (!json_structure_container_intact(input, container)) {
+        *stale = true;
+        return length;
+    }
+
+    if (element_index >= container->entries) {
+        if (input[first] != ']' && json_structure_scan_element(input, length, first, element_index) < length) {
+            *stale = true;
+        }
+        return length;
+    }
+    // Start from the nearest recorded element at or before the target
+    const size_t cursor = structure->children[container->first_child + element_index / STRUCTURE_ELEMENT_STRIDE].offset;
+    size_t before = cursor;
+    while (before > container->start && isspace((unsigned char)input[before - 1])) {
+        before--;
+    }
+    if (cursor >= container->end || before <= container->start ||
+        (input[before - 1] != ',' && input[before - 1] != '[')) {
+        *stale = true;
+        return length;
+    }
+    return json_structure_scan_element(input, length, cursor, element_index % STRUCTURE_ELEMENT_STRIDE);
+}
+
+/**
+ * @brief Reads one step of a path into a key or an element index
+ * @param path_parser Parser over the path text, positioned on the step
+ * @param key Receives the key (in the parser's scratch space or the path)
+ * @param key_length Receives the key length
+ * @param element_index Receives the element index when key is NULL
+ * @return true if the step is well-formed
+ */
+static bool json_structure_read_step(parser_t *path_parser, const char **key, size_t *key_length,
+                                     size_t *element_index) {
+    const char *path = path_parser->input;
+    size_t pos = path_parser->pos;
+
+    *key = NULL;
+    if (path[pos] == '.') {
+        const size_t start = ++pos;
+        while (path[pos] != '\0' && path[pos] != '.' && path[pos] != '[') {
+            pos++;
+        }
+        *key = path + start;
+        *key_length = pos - start;
+        path_parser->pos = pos;
+        return pos > start;
+    }
+    if (path[pos] != '[') {
+        return false;
+    }
+    pos++;
+
+    if (path[pos] == '"') {
+        path_parser->pos = pos;
+        if (!tokenizer_scan_string(path_parser, key, key_length)) {
+            return false;
+        }
+        pos = path_parser->pos;
+    } else {
+        if (!isdigit((unsigned char)path[pos])) {
+            return false;
+        }
+        *element_index = 0;
+        while (isdigit((unsigned char)path[pos])) {
+            *element_index = *element_index * 10 + (size_t)(path[pos++] - '0');
+        }
+    }
+
+    if (path[pos] != ']') {
+        return false;
+    }
+    path_parser->pos = pos + 1;
+    return true;
+}
+
+/**
+ * @brief Locates the value at a JSON path
+ *
+ * Paths use the notation of the offset index: `$`, then `.name`,
+ * `["any key"]` or `[index]` steps. Indexed containers are entered through
+ * the index; anything else is scanned raw, so the input must be
+ * well-formed.
+ *
+ * @param structure The structural index, or NULL to scan from the start
+ * @param input The input text
+ * @param length Input length
+ * @param path The path to look up
+ * @param start Receives the offset where the value begins
+ * @param end Receives the offset just past the value
+ * @param stale Set, with nothing reported, if the index turned out not to
+ *        match the input; the caller rebuilds it and looks again
+ * @return true if the path names a value (other errors are reported)
+ */
+bool json_structure_locate(const json_structure_t *structure, const char *input, size_t length,
+                           const char *path, size_t *start, size_t *end, bool *stale) {
+    if (path[0] != '$') {
+        fprintf(stderr, "Error: Path must start with '$': %s\n", path);
+        return false;
+    }
+
+    parser_t path_parser;
+    parser_initialize(&path_parser, path);
+    path_parser.pos = 1;
+
+    // Keys in the input are decoded on demand, so the parser needs no strlen
+    parser_t key_parser;
+    memset(&key_parser, 0, sizeof(key_parser));
+    key_parser.input = input;
+    key_parser.length = length;
+    key_parser.line = 1;
+    key_parser.column = 1;
+
+    size_t pos = json_validator_skip_whitespace(input, 0);
+    bool found = pos < length;
+    bool valid = true;
+    *stale = false;
+
+    while (found && !*stale && path[path_parser.pos] != '\0') {
+        const char *key;
+        size_t key_length;
+        size_t element_index = 0;
+        if (!json_structure_read_step(&path_parser, &key, &key_length, &element_index)) {
+            valid = false;
+            break;
+        }
+
+        if (key) {
+            found = input[pos] == '{' &&
+                    (pos = json_structure_find_member(structure, &key_parser, pos, key, key_length,
+                                                      stale)) < length;
+        } else {
+            found = input[pos] == '[' &&
+                    (pos = json_structure_find_element(structure, input, length, pos, element_index,
+                                                       stale)) < length;
+        }
+    }
+    parser_release(&path_parser);
+    parser_release(&key_parser);
+
+    if (*stale) {
+        return false;
+    }
+
+    if (!valid) {
+        fprintf(stderr, "Error: Invalid path: %s\n", path);
+        return false;
+    }
+    if (!found) {
+        fprintf(stderr, "Error: No value at path %s\n", path);
+        return false;
+    }
+
+    size_t next = pos;
+    if (input[pos] == '{' || input[pos] == '[') {
+        size_t entries;
+        next = pos + 1;
+        if (!json_validator_skip_container(input, length, &next, &entries)) {
+            next = length;
+        }
+    } else if (!json_validator_skip_entry(input, length, &next)) {
+        next = length;      // a scalar document runs to the end of input
+    }
+    while (next > pos && isspace((unsigned char)input[next - 1])) {
+        next--;
+    }
+
+    *start = pos;
+    *end = next;
+    return true;
+}
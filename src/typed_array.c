@@ -0,0 +1,297 @@
+/**
+ * @file typed_array.c
+ * @brief Packed storage for homogeneous numeric and boolean arrays
+ * 
+ * Arrays made only of numbers or only of booleans are kept as a single
+ * node holding a packed int64/double/bit vector instead of one element
+ * and one value node per item. Record columns reuse the same vectors and
+ * fall back to generic value pointers when their values are mixed.
+ */
+
+#include "json_to_sexpr.h"
+
+#define TYPED_ARRAY_INITIAL_CAPACITY 8
+
+/* Largest magnitude (exclusive) that an int64 element can hold exactly */
+#define TYPED_ARRAY_INT64_LIMIT 9223372036854775808.0
+
+/**
+ * @brief Allocates an empty packed array of the given kind
+ * @param kind The element kind to store
+ * @return Newly allocated typed array, or NULL on allocation failure
+ */
+json_typed_array_t *json_typed_array_create(typed_array_kind_t kind) {
+    json_typed_array_t *typed_array = malloc(sizeof(json_typed_array_t));
+    if (!typed_array) {
+        return NULL;
+    }
+    
+    typed_array->kind = kind;
+    typed_array->count = 0;
+    typed_array->capacity = 0;
+    typed_array->items.integers = NULL;
+    return typed_array;
+}
+
+/**
+ * @brief Ensures room for one more element, growing geometrically
+ * @param typed_array The packed array to grow
+ * @return true on success, false on allocation failure
+ */
+bool json_typed_array_reserve(json_typed_array_t *typed_array) {
+    if (typed_array->count < typed_array->capacity) {
+        return true;
+    }
+    
+    size_t new_capacity = typed_array->capacity ? typed_array->capacity * 2
+                                                : TYPED_ARRAY_INITIAL_CAPACITY;
+    size_t new_size;
+    switch (typed_array->kind) {
+        case TYPED_ARRAY_BOOLEAN:
+            new_size = (new_capacity + 7) / 8;
+            break;
+        case TYPED_ARRAY_VALUE:
+            new_size = new_capacity * sizeof(json_value_t *);
+            break;
+        default:
+            new_size = new_capacity * sizeof(int64_t);
+            break;
+    }
+    
+    void *new_items = realloc(typed_array->items.integers, new_size);
+    if (!new_items) {
+        return false;
+    }
+    
+    typed_array->items.integers = new_items;
+    typed_array->capacity = new_capacity;
+    return true;
+}
+
+/**
+ * @brief Checks whether a number can be stored exactly as an int64 element
+ * @param number The parsed number
+ * @return true if the number is integral and within int64 range
+ */
+static bool json_typed_array_is_integral(double number) {
+    return number >= -TYPED_ARRAY_INT64_LIMIT && number < TYPED_ARRAY_INT64_LIMIT &&
+           number == (double)(int64_t)number;
+}
+
+/**
+ * @brief Appends a number, promoting int64 storage to double when needed
+ * @param typed_array A numeric packed array
+ * @param number The value to append
+ * @return true on success, false on allocation failure
+ */
+bool json_typed_array_append_number(json_typed_array_t *typed_array, double number) {
+    if (typed_array->kind == TYPED_ARRAY_INT64 && !json_typed_array_is_integral(number)) {
+        // Both element types are 8 bytes wide, so promote in place
+        for (size_t index = 0; index < typed_array->count; index++) {
+            const double promoted = (double)typed_array->items.integers[index];
+            typed_array->items.doubles[index] = promoted;
+        }
+        typed_array->kind = TYPED_ARRAY_DOUBLE;
+    }
+    
+    if (!json_typed_array_reserve(typed_array)) {
+        return false;
+    }
+    
+    if (typed_array->kind == TYPED_ARRAY_INT64) {
+        typed_array->items.integers[typed_array->count++] = (int64_t)number;
+    } else {
+        typed_array->items.doubles[typed_array->count++] = number;
+    }
+    return true;
+}
+
+/**
+ * @brief Appends a boolean as a single bit
+ * @param typed_array A boolean packed array
+ * @param boolean The value to append
+ * @return true on success, false on allocation failure
+ */
+bool json_typed_array_append_boolean(json_typed_array_t *typed_array, bool boolean) {
+    if (!json_typed_array_reserve(typed_array)) {
+        return false;
+    }
+    
+    const size_t index = typed_array->count++;
+    const unsigned char mask = (unsigned char)(1u << (index % 8));
+    if (boolean) {
+        typed_array->items.bits[index / 8] |= mask;
+    } else {
+        typed_array->items.bits[index / 8] &= (unsigned char)~mask;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads one element of a boolean packed array
+ * @param typed_array A boolean packed array
+ * @param index Element position
+ * @return The stored boolean
+ */
+bool json_typed_array_get_boolean(const json_typed_array_t *typed_array, size_t index) {
+    return (typed_array->items.bits[index / 8] >> (index % 8)) & 1u;
+}
+
+/**
+ * @brief Converts every packed element into generic value pointers
+ * @param typed_array The packed array to demote
+ * @return true on success, false on allocation failure (array unchanged)
+ */
+static bool json_typed_array_demote_to_values(json_typed_array_t *typed_array) {
+    const size_t capacity = typed_array->count ? typed_array->count : TYPED_ARRAY_INITIAL_CAPACITY;
+    json_value_t **values = malloc(capacity * sizeof(json_value_t *));
+    if (!values) {
+        return false;
+    }
+    
+    for (size_t index = 0; index < typed_array->count; index++) {
+        values[index] = json_typed_array_take_value(typed_array, index);
+        if (!values[index]) {
+            while (index > 0) {
+                free(values[--index]);
+            }
+            free(values);
+            return false;
+        }
+    }
+    
+    free(typed_array->items.integers);
+    typed_array->kind = TYPED_ARRAY_VALUE;
+    typed_array->items.values = values;
+    typed_array->capacity = capacity;
+    return true;
+}
+
+/**
+ * @brief Appends an arbitrary value, keeping packed storage when it fits
+ * 
+ * Numbers and booleans matching the array kind are stored unboxed and their
+ * node is freed; anything else demotes the array to value pointers.
+ * 
+ * @param typed_array The array to append to (takes ownership of value)
+ * @param value The parsed value
+ * @return true on success, false on allocation failure (value not taken)
+ */
+bool json_typed_array_append_value(json_typed_array_t *typed_array, json_value_t *value) {
+    bool appended;
+    
+    if (typed_array->kind != TYPED_ARRAY_VALUE) {
+        const bool numeric = typed_array->kind != TYPED_ARRAY_BOOLEAN;
+        if (numeric && value->type == JSON_NUMBER) {
+            appended = json_typed_array_append_number(typed_array, value->data.number);
+        } else if (!numeric && value->type == JSON_BOOLEAN) {
+            appended = json_typed_array_append_boolean(typed_array, value->data.boolean);
+        } else if (!json_typed_array_demote_to_values(typed_array)) {
+            return false;
+        } else {
+            return json_typed_array_append_value(typed_array, value);
+        }
+        
+        if (appended) {
+            free(value);
+        }
+        return appended;
+    }
+    
+    if (!json_typed_array_reserve(typed_array)) {
+        return false;
+    }
+    typed_array->items.values[typed_array->count++] = value;
+    return true;
+}
+
+/**
+ * @brief Produces a standalone value node for one element
+ * 
+ * Packed elements get a freshly allocated node; generic elements are handed
+ * over and their slot is cleared so the array no longer owns them.
+ * 
+ * @param typed_array The array holding the element
+ * @param index Element position
+ * @return The value node, or NULL on allocation failure
+ */
+json_value_t *json_typed_array_take_value(json_typed_array_t *typed_array, size_t index) {
+    if (typed_array->kind == TYPED_ARRAY_VALUE) {
+        json_value_t *value = typed_array->items.values[index];
+        typed_array->items.values[index] = NULL;
+        return value;
+    }
+    
+    json_value_t *value = malloc(sizeof(json_value_t));
+    if (!value) {
+        return NULL;
+    }
+    value->flags = 0;
+    
+    switch (typed_array->kind) {
+        case TYPED_ARRAY_INT64:
+            value->type = JSON_NUMBER;
+            value->data.number = (double)typed_array->items.integers[index];
+            break;
+        case TYPED_ARRAY_DOUBLE:
+            value->type = JSON_NUMBER;
+            value->data.number = typed_array->items.doubles[index];
+            break;
+        default:
+            value->type = JSON_BOOLEAN;
+            value->data.boolean = json_typed_array_get_boolean(typed_array, index);
+            break;
+    }
+    return value;
+}
+
+/**
+ * @brief Removes the last element and returns it as a value node
+ * @param typed_array A non-empty array
+ * @return The value node, or NULL on allocation failure (array unchanged)
+ */
+json_value_t *json_typed_array_pop_value(json_typed_array_t *typed_array) {
+    json_value_t *value = json_typed_array_take_value(typed_array, typed_array->count - 1);
+    if (value) {
+        typed_array->count--;
+    }
+    return value;
+}
+
+/**
+ * @brief Converts packed elements back into a regular element list
+ * 
+ * Used when an array turns out to be heterogeneous after a packed prefix.
+ * Generic elements are moved into the list; packed ones are copied.
+ * 
+ * @param typed_array The prefix to expand (caller still frees it)
+ * @param last_element Receives the tail of the new list
+ * @return Head of the new element list, or NULL on allocation failure
+ */
+json_element_t *json_typed_array_expand_elements(json_typed_array_t *typed_array,
+                                                 json_element_t **last_element) {
+    json_element_t *head = NULL;
+    json_element_t *tail = NULL;
+    
+    for (size_t index = 0; index < typed_array->count; index++) {
+        json_element_t *element = malloc(sizeof(json_element_t));
+        json_value_t *value = element ? json_typed_array_take_value(typed_array, index) : NULL;
+        if (!element || !value) {
+            free(element);
+            json_memory_free_array_element(head);
+            return NULL;
+        }
+        
+        element->value = value;
+        element->next = NULL;
+        if (tail) {
+            tail->next = element;
+        } else {
+            head = element;
+        }
+        tail = element;
+    }
+    
+    *last_element = tail;
+    return head;
+}
@@ -0,0 +1,201 @@
+/**
+ * @file utf8.c
+ * @brief UTF-8 validation of the raw input with an ASCII fast path
+ * 
+ * Input is checked before tokenizing so malformed byte sequences are
+ * reported with their offset instead of reaching the S-expression output.
+ * Runs of ASCII are skipped 16 bytes at a time (SSE2 where available,
+ * 64-bit word tests otherwise); multi-byte sequences go through a small
+ * table-driven state machine that also works across buffer boundaries.
+ */
+
+#include "json_to_sexpr.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Decoding rules for a lead byte: continuation count and second-byte range */
+typedef struct {
+    unsigned char continuation_count;
+    unsigned char second_min;
+    unsigned char second_max;
+} utf8_lead_rule_t;
+
+#define UTF8_RULE_INVALID {0, 0, 0}
+#define UTF8_RULE_TWO {1, 0x80, 0xBF}
+#define UTF8_RULE_THREE {2, 0x80, 0xBF}
+#define UTF8_RULE_FOUR {3, 0x80, 0xBF}
+
+/* Rules for lead bytes 0xC0-0xFF (RFC 3629, Table 3-7 of Unicode); an
+ * invalid lead has continuation_count 0 */
+static const utf8_lead_rule_t utf8_lead_rules[64] = {
+    // 0xC0-0xC1 would be overlong encodings of ASCII
+    UTF8_RULE_INVALID, UTF8_RULE_INVALID, UTF8_RULE_TWO, UTF8_RULE_TWO,
+    UTF8_RULE_TWO, UTF8_RULE_TWO, UTF8_RULE_TWO, UTF8_RULE_TWO,
+    UTF8_RULE_TWO, UTF8_RULE_TWO, UTF8_RULE_TWO, UTF8_RULE_TWO,
+    UTF8_RULE_TWO, UTF8_RULE_TWO, UTF8_RULE_TWO, UTF8_RULE_TWO,
+    UTF8_RULE_TWO, UTF8_RULE_TWO, UTF8_RULE_TWO, UTF8_RULE_TWO,
+    UTF8_RULE_TWO, UTF8_RULE_TWO, UTF8_RULE_TWO, UTF8_RULE_TWO,
+    UTF8_RULE_TWO, UTF8_RULE_TWO, UTF8_RULE_TWO, UTF8_RULE_TWO,
+    UTF8_RULE_TWO, UTF8_RULE_TWO, UTF8_RULE_TWO, UTF8_RULE_TWO,
+    // 0xE0 excludes overlong forms, 0xED the UTF-16 surrogate code points
+    {2, 0xA0, 0xBF}, UTF8_RULE_THREE, UTF8_RULE_THREE, UTF8_RULE_THREE,
+    UTF8_RULE_THREE, UTF8_RULE_THREE, UTF8_RULE_THREE, UTF8_RULE_THREE,
+    UTF8_RULE_THREE, UTF8_RULE_THREE, UTF8_RULE_THREE, UTF8_RULE_THREE,
+    UTF8_RULE_THREE, {2, 0x80, 0x9F}, UTF8_RULE_THREE, UTF8_RULE_THREE,
+    // 0xF0 excludes overlong forms, 0xF4 caps code points at U+10FFFF
+    {3, 0x90, 0xBF}, UTF8_RULE_FOUR, UTF8_RULE_FOUR, UTF8_RULE_FOUR,
+    {3, 0x80, 0x8F}, UTF8_RULE_INVALID, UTF8_RULE_INVALID, UTF8_RULE_INVALID,
+    UTF8_RULE_INVALID, UTF8_RULE_INVALID, UTF8_RULE_INVALID, UTF8_RULE_INVALID,
+    UTF8_RULE_INVALID, UTF8_RULE_INVALID, UTF8_RULE_INVALID, UTF8_RULE_INVALID
+};
+
+/**
+ * @brief Returns the length of the leading pure-ASCII run, in 16-byte steps
+ * @param data Bytes to scan
+ * @param length Number of bytes available
+ * @return Number of bytes known to be ASCII (multiple of 16, may be 0)
+ */
+static size_t utf8_skip_ascii_blocks(const unsigned char *data, size_t length) {
+    size_t position = 0;
+    
+#ifdef __SSE2__
+    while (position + 32 <= length) {
+        const __m128i first = _mm_loadu_si128((const __m128i *)(const void *)(data + position));
+        const __m128i second = _mm_loadu_si128((const __m128i *)(const void *)(data + position + 16));
+        if (_mm_movemask_epi8(_mm_or_si128(first, second)) != 0) {
+            break;
+        }
+        position += 32;
+    }
+    while (position + 16 <= length) {
+        const __m128i block = _mm_loadu_si128((const __m128i *)(const void *)(data + position));
+        if (_mm_movemask_epi8(block) != 0) {
+            break;
+        }
+        position += 16;
+    }
+#else
+    while (position + 16 <= length) {
+        uint64_t low_word;
+        uint64_t high_word;
+        memcpy(&low_word, data + position, sizeof(low_word));
+        memcpy(&high_word, data + position + 8, sizeof(high_word));
+        if ((low_word | high_word) & 0x8080808080808080ULL) {
+            break;
+        }
+        position += 16;
+    }
+#endif
+    
+    return position;
+}
+
+/**
+ * @brief Resets a validator to the start of a new input
+ * @param validator The validator state
+ */
+void utf8_validator_init(utf8_validator_t *validator) {
+    validator->offset = 0;
+    validator->sequence_start = 0;
+    validator->remaining = 0;
+    validator->next_min = 0x80;
+    validator->next_max = 0xBF;
+    validator->error_offset = 0;
+    validator->failed = false;
+}
+
+/**
+ * @brief Validates the next chunk of input
+ * 
+ * Chunks may split multi-byte sequences; the partial sequence carries over
+ * to the next call.
+ * 
+ * @param validator The validator state
+ * @param data Next bytes of the input
+ * @param length Number of bytes in this chunk
+ * @return true if the input so far is valid, false once an error is found
+ */
+bool utf8_validator_feed(utf8_validator_t *validator, const char *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    size_t position = 0;
+    
+    if (validator->failed) {
+        return false;
+    }
+    
+    while (position < length) {
+        if (validator->remaining == 0) {
+            position += utf8_skip_ascii_blocks(bytes + position, length - position);
+            if (position >= length) {
+                break;
+            }
+            
+            const unsigned char lead = bytes[position];
+            if (lead < 0x80) {
+                position++;
+                continue;
+            }
+            
+            // Bytes 0x80-0xBF cannot start a sequence
+            if (lead < 0xC0 || utf8_lead_rules[lead - 0xC0].continuation_count == 0) {
+                validator->failed = true;
+                validator->error_offset = validator->offset + position;
+                return false;
+            }
+            const utf8_lead_rule_t *rule = &utf8_lead_rules[lead - 0xC0];
+            validator->sequence_start = validator->offset + position;
+            validator->remaining = rule->continuation_count;
+            validator->next_min = rule->second_min;
+            validator->next_max = rule->second_max;
+            position++;
+        } else {
+            const unsigned char continuation = bytes[position];
+            if (continuation < validator->next_min || continuation > validator->next_max) {
+                validator->failed = true;
+                validator->error_offset = validator->sequence_start;
+                return false;
+            }
+            validator->remaining--;
+            validator->next_min = 0x80;
+            validator->next_max = 0xBF;
+            position++;
+        }
+    }
+    
+    validator->offset += length;
+    return true;
+}
+
+/**
+ * @brief Checks that the input did not end inside a multi-byte sequence
+ * @param validator The validator state after the last chunk
+ * @return true if the whole input was valid UTF-8
+ */
+bool utf8_validator_finish(utf8_validator_t *validator) {
+    if (!validator->failed && validator->remaining != 0) {
+        validator->failed = true;
+        validator->error_offset = validator->sequence_start;
+    }
+    return !validator->failed;
+}
+
+/**
+ * @brief Validates a complete buffer as UTF-8
+ * @param data The bytes to check
+ * @param length Number of bytes
+ * @param error_offset Receives the offset of the first invalid sequence
+ * @return true if the buffer is valid UTF-8
+ */
+bool utf8_validate(const char *data, size_t length, size_t *error_offset) {
+    utf8_validator_t validator;
+    utf8_validator_init(&validator);
+    utf8_validator_feed(&validator, data, length);
+    
+    if (!utf8_validator_finish(&validator)) {
+        *error_offset = validator.error_offset;
+        return false;
+    }
+    return true;
+}
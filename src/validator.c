@@ -0,0 +1,645 @@
+/**
+ * @file validator.c
+ * @brief Validation-only pass over JSON input without building an AST
+ *
+ * Accepts the same tokens as the converting parser (unknown escapes are
+ * kept, numbers follow the tokenizer's rules) but is strict about document
+ * structure: truncated containers and content after the document are
+ * errors, so input that passes the check always converts. Nothing is
+ * decoded or allocated apart from a small container stack entry per nesting
+ * level; line and column are only worked out for the error position. The
+ * same pass can gather document statistics along the way.
+ */
+
+#include "json_to_sexpr.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define VALIDATOR_QUOTE(text) #text
+#define VALIDATOR_NUMBER(value) VALIDATOR_QUOTE(value)
+
+/* Kinds of value recognized at a value position */
+typedef enum {
+    VALIDATOR_VALUE_OBJECT,
+    VALIDATOR_VALUE_ARRAY,
+    VALIDATOR_VALUE_STRING,
+    VALIDATOR_VALUE_INTEGER,
+    VALIDATOR_VALUE_FLOAT,
+    VALIDATOR_VALUE_BOOLEAN,
+    VALIDATOR_VALUE_NULL
+} validator_value_t;
+
+/* An open container: its kind and how many entries it has so far */
+typedef struct {
+    validator_value_t container;
+    size_t entries;
+} validator_level_t;
+
+/* Bytes that may appear between tokens */
+static const unsigned char validator_whitespace[256] = {
+    [' '] = 1, ['\t'] = 1, ['\r'] = 1, ['\n'] = 1
+};
+
+/**
+ * @brief Skips whitespace between tokens
+ * @param input NUL-terminated input
+ * @param pos Current offset
+ * @return Offset of the next non-whitespace byte
+ */
+size_t json_validator_skip_whitespace(const char *input, size_t pos) {
+    while (validator_whitespace[(unsigned char)input[pos]]) {
+        pos++;
+    }
+    return pos;
+}
+
+/**
+ * @brief Finds the next '"' or '\\' in string content
+ * @param input The input text
+ * @param pos Offset inside the string
+ * @param length Total input length
+ * @return Offset of the next quote or backslash, or length if there is none
+ */
+size_t json_validator_find_string_special(const char *input, size_t pos, size_t length) {
+#ifdef __SSE2__
+    const __m128i quotes = _mm_set1_epi8('"');
+    const __m128i backslashes = _mm_set1_epi8('\\');
+    while (pos + 16 <= length) {
+        const __m128i block = _mm_loadu_si128((const __m128i *)(input + pos));
+        const int hits = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, quotes),
+                                                        _mm_cmpeq_epi8(block, backslashes)));
+        if (hits != 0) {
+            return pos + (size_t)__builtin_ctz((unsigned)hits);
+        }
+        pos += 16;
+    }
+#else
+    while (pos + 8 <= length) {
+        uint64_t word;
+        memcpy(&word, input + pos, sizeof(word));
+        const uint64_t quotes = word ^ 0x2222222222222222ULL;
+        const uint64_t backslashes = word ^ 0x5C5C5C5C5C5C5C5CULL;
+        const uint64_t hits = (((quotes - 0x0101010101010101ULL) & ~quotes) |
+                               ((backslashes - 0x0101010101010101ULL) & ~backslashes)) &
+                              0x8080808080808080ULL;
+        if (hits != 0) {
+            break;
+        }
+        pos += 8;
+    }
+#endif
+
+    while (pos < length && input[pos] != '"' && input[pos] != '\\') {
+        pos++;
+    }
+    return pos;
+}
+
+/**
+ * @brief Finds the next byte that matters when skipping raw content
+ * @param input The input text
+ * @param pos Offset to start from
+ * @param length Total input length
+ * @return Offset of the next quote, bracket, brace or comma, or length
+ */
+size_t json_validator_find_structural(const char *input, size_t pos, size_t length) {
+#ifdef __SSE2__
+    while (pos + 16 <= length) {
+        const __m128i block = _mm_loadu_si128((const __m128i *)(input + pos));
+        const __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('"')),
+                         _mm_cmpeq_epi8(block, _mm_set1_epi8(','))),
+            _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('[')),
+                             _mm_cmpeq_epi8(block, _mm_set1_epi8(']'))),
+                _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('{')),
+                             _mm_cmpeq_epi8(block, _mm_set1_epi8('}')))));
+        const int mask = _mm_movemask_epi8(hits);
+        if (mask != 0) {
+            return pos + (size_t)__builtin_ctz((unsigned)mask);
+        }
+        pos += 16;
+    }
+#endif
+
+    while (pos < length) {
+        const char c = input[pos];
+        if (c == '"' || c == ',' || c == '[' || c == ']' || c == '{' || c == '}') {
+            break;
+        }
+        pos++;
+    }
+    return pos;
+}
+
+/**
+ * @brief Records the first error and where it happened
+ * @param result The result to fill
+ * @param offset Byte offset of the offending input
+ * @param message Description of the error
+ * @return false, for use in return statements
+ */
+static bool json_validator_fail(json_check_result_t *result, size_t offset, const char *message) {
+    result->valid = false;
+    result->error_offset = offset;
+    result->message = message;
+    return false;
+}
+
+/**
+ * @brief Checks a string literal, including its escapes
+ * @param input The input text
+ * @param length Total input length
+ * @param pos Offset of the opening quote; advanced past the closing quote
+ * @param result Receives the error, if any
+ * @return true if the string is well-formed
+ */
+static bool json_validator_check_string(const char *input, size_t length, size_t *pos,
+                                        json_check_result_t *result) {
+    const size_t start = *pos;
+    size_t cursor = start + 1;
+
+    while (true) {
+        cursor = json_validator_find_string_special(input, cursor, length);
+        if (cursor >= length) {
+            return json_validator_fail(result, start, "Unterminated string");
+        }
+        if (input[cursor] == '"') {
+            *pos = cursor + 1;
+            return true;
+        }
+
+        // Backslash: other escape letters are kept verbatim by the converter
+        if (cursor + 1 >= length) {
+            return json_validator_fail(result, start, "Unterminated string");
+        }
+        if (input[cursor + 1] == 'u') {
+            if (cursor + 5 >= length) {
+                return json_validator_fail(result, cursor, "Invalid \\u escape");
+            }
+            for (size_t digit = 2; digit < 6; digit++) {
+                if (!isxdigit((unsigned char)input[cursor + digit])) {
+                    return json_validator_fail(result, cursor, "Invalid \\u escape");
+                }
+            }
+            cursor += 6;
+        } else {
+            cursor += 2;
+        }
+    }
+}
+
+/**
+ * @brief Checks a number literal with the tokenizer's rules
+ * @param input NUL-terminated input
+ * @param pos Offset of the '-' or first digit; advanced past the literal
+ * @param kind Receives VALIDATOR_VALUE_FLOAT if there is a fraction or
+ *        exponent, VALIDATOR_VALUE_INTEGER otherwise
+ * @param result Receives the error, if any
+ * @return true if the number is acceptable
+ */
+static bool json_validator_check_number(const char *input, size_t *pos, validator_value_t *kind,
+                                        json_check_result_t *result) {
+    size_t cursor = *pos;
+    *kind = VALIDATOR_VALUE_INTEGER;
+
+    if (input[cursor] == '-') {
+        cursor++;
+    }
+    if (input[cursor] == '0') {
+        cursor++;
+        if (isdigit((unsigned char)input[cursor])) {
+            return json_validator_fail(result, *pos, "Invalid number with leading zero");
+        }
+    } else {
+        while (isdigit((unsigned char)input[cursor])) {
+            cursor++;
+        }
+    }
+
+    if (input[cursor] == '.') {
+        *kind = VALIDATOR_VALUE_FLOAT;
+        cursor++;
+        while (isdigit((unsigned char)input[cursor])) {
+            cursor++;
+        }
+    }
+    if (input[cursor] == 'e' || input[cursor] == 'E') {
+        *kind = VALIDATOR_VALUE_FLOAT;
+        cursor++;
+        if (input[cursor] == '+' || input[cursor] == '-') {
+            cursor++;
+        }
+        while (isdigit((unsigned char)input[cursor])) {
+            cursor++;
+        }
+    }
+
+    *pos = cursor;
+    return true;
+}
+
+/**
+ * @brief Fills in the line and column of the recorded error offset
+ * @param input The input text
+ * @param result A failed result
+ */
+static void json_validator_locate_error(const char *input, json_check_result_t *result) {
+    result->line = 1;
+    result->column = 1;
+
+    for (size_t pos = 0; pos < result->error_offset; pos++) {
+        if (input[pos] == '\n') {
+            result->line++;
+            result->column = 1;
+        } else {
+            result->column++;
+        }
+    }
+}
+
+/**
+ * @brief Checks one scalar or opens a container at a value position
+ * @param input NUL-terminated input
+ * @param length Total input length
+ * @param pos Offset of the value; advanced past a scalar or opening bracket
+ * @param kind Receives the kind of value found
+ * @param result Receives the error, if any
+ * @return true if the value (or its opening bracket) is acceptable
+ */
+static bool json_validator_check_value(const char *input, size_t length, size_t *pos,
+                                       validator_value_t *kind, json_check_result_t *result) {
+    switch (input[*pos]) {
+        case '{':
+            *kind = VALIDATOR_VALUE_OBJECT;
+            (*pos)++;
+            return true;
+        case '[':
+            *kind = VALIDATOR_VALUE_ARRAY;
+            (*pos)++;
+            return true;
+        case '"':
+            *kind = VALIDATOR_VALUE_STRING;
+            return json_validator_check_string(input, length, pos, result);
+        case '-':
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            return json_validator_check_number(input, pos, kind, result);
+        case 't':
+            if (strncmp(input + *pos, "true", 4) != 0) break;
+            *kind = VALIDATOR_VALUE_BOOLEAN;
+            *pos += 4;
+            return true;
+        case 'f':
+            if (strncmp(input + *pos, "false", 5) != 0) break;
+            *kind = VALIDATOR_VALUE_BOOLEAN;
+            *pos += 5;
+            return true;
+        case 'n':
+            if (strncmp(input + *pos, "null", 4) != 0) break;
+            *kind = VALIDATOR_VALUE_NULL;
+            *pos += 4;
+            return true;
+        case '\0':
+            if (*pos >= length) {
+                return json_validator_fail(result, *pos, "Unexpected end of input");
+            }
+            break;
+        default:
+            break;
+    }
+    return json_validator_fail(result, *pos, "Unexpected character where a value belongs");
+}
+
+/**
+ * @brief Counts a scalar value in the statistics
+ * @param stats The statistics being gathered
+ * @param kind The scalar's kind
+ * @param size Bytes the scalar occupies in the input
+ */
+static void json_validator_count_scalar(json_stats_t *stats, validator_value_t kind, size_t size) {
+    switch (kind) {
+        case VALIDATOR_VALUE_STRING:
+            stats->strings++;
+            stats->string_bytes += size - 2;
+            break;
+        case VALIDATOR_VALUE_INTEGER: stats->integers++; break;
+        case VALIDATOR_VALUE_FLOAT: stats->floats++; break;
+        case VALIDATOR_VALUE_BOOLEAN: stats->booleans++; break;
+        default: stats->nulls++; break;
+    }
+}
+
+/**
+ * @brief Records a closed container in the statistics
+ * @param stats The statistics being gathered
+ * @param level The container's stack entry
+ */
+static void json_validator_count_container(json_stats_t *stats, const validator_level_t *level) {
+    if (level->container == VALIDATOR_VALUE_OBJECT) {
+        stats->objects++;
+        if (level->entries > stats->largest_object) {
+            stats->largest_object = level->entries;
+        }
+    } else {
+        stats->arrays++;
+        if (level->entries > stats->largest_array) {
+            stats->largest_array = level->entries;
+        }
+    }
+}
+
+/**
+ * @brief Runs the validation pass, optionally gathering statistics
+ * @param input The input text, NUL-terminated at input[length]
+ * @param length Input length in bytes
+ * @param result Receives validity and, on failure, the first error position
+ * @param stats Statistics to update, or NULL to only validate
+ * @return true if the input is one well-formed document
+ */
+static bool json_validator_scan(const char *input, size_t length, json_check_result_t *result,
+                                json_stats_t *stats) {
+    validator_level_t local_stack[MAX_DEPTH];
+    validator_level_t *stack = local_stack;
+    size_t stack_capacity = MAX_DEPTH;
+    size_t depth = 0;
+    size_t pos = 0;
+    validator_value_t kind;
+
+    result->valid = true;
+    result->error_offset = 0;
+    result->line = 0;
+    result->column = 0;
+    result->message = NULL;
+
+    pos = json_validator_skip_whitespace(input, pos);
+
+    while (true) {
+        // A value is expected at pos
+        const size_t value_start = pos;
+        if (!json_validator_check_value(input, length, &pos, &kind, result)) {
+            break;
+        }
+        if (depth > 0 && stack[depth - 1].container == VALIDATOR_VALUE_ARRAY) {
+            stack[depth - 1].entries++;
+        }
+
+        if (kind == VALIDATOR_VALUE_OBJECT || kind == VALIDATOR_VALUE_ARRAY) {
+            // Deeper input is rejected by the parser, so it fails the check too
+            if (depth == MAX_NESTING_DEPTH) {
+                json_validator_fail(result, value_start, "Containers nested deeper than "
+                                    VALIDATOR_NUMBER(MAX_NESTING_DEPTH) " levels");
+                break;
+            }
+            if (depth == stack_capacity) {
+                validator_level_t *grown = malloc(stack_capacity * 2 * sizeof(validator_level_t));
+                if (!grown) {
+                    json_validator_fail(result, pos, "Out of memory");
+                    break;
+                }
+                memcpy(grown, stack, depth * sizeof(validator_level_t));
+                if (stack != local_stack) {
+                    free(stack);
+                }
+                stack = grown;
+                stack_capacity *= 2;
+            }
+            stack[depth].container = kind;
+            stack[depth].entries = 0;
+            depth++;
+            if (stats && depth > stats->max_depth) {
+                stats->max_depth = depth;
+            }
+
+            pos = json_validator_skip_whitespace(input, pos);
+            const char close = kind == VALIDATOR_VALUE_OBJECT ? '}' : ']';
+            if (input[pos] == close) {
+                pos++;
+                if (stats) {
+                    json_validator_count_container(stats, &stack[depth - 1]);
+                }
+                depth--;
+            } else if (kind == VALIDATOR_VALUE_OBJECT) {
+                goto object_key;
+            } else {
+                continue;
+            }
+        } else if (stats) {
+            json_validator_count_scalar(stats, kind, pos - value_start);
+        }
+
+        // After a value: separators and closing brackets until the next value
+        while (true) {
+            pos = json_validator_skip_whitespace(input, pos);
+
+            if (depth == 0) {
+                if (pos < length) {
+                    json_validator_fail(result, pos, "Extra content after JSON");
+                }
+                goto done;
+            }
+
+            const validator_value_t container = stack[depth - 1].container;
+            const char c = input[pos];
+            if (c == ',') {
+                pos = json_validator_skip_whitespace(input, pos + 1);
+                if (container == VALIDATOR_VALUE_OBJECT) {
+                    goto object_key;
+                }
+                break;
+            }
+            if (c == (container == VALIDATOR_VALUE_OBJECT ? '}' : ']')) {
+                pos++;
+                if (stats) {
+                    json_validator_count_container(stats, &stack[depth - 1]);
+                }
+                depth--;
+                continue;
+            }
+
+            if (pos >= length) {
+                json_validator_fail(result, pos, "Unexpected end of input");
+            } else if (container == VALIDATOR_VALUE_OBJECT) {
+                json_validator_fail(result, pos, "Expected ',' or '}' in object");
+            } else {
+                json_validator_fail(result, pos, "Expected ',' or ']' in array");
+            }
+            goto done;
+        }
+        continue;
+
+    object_key:
+        if (input[pos] != '"') {
+            json_validator_fail(result, pos, pos >= length ? "Unexpected end of input"
+                                                           : "Expected string key in object");
+            break;
+        }
+        {
+            const size_t key_start = pos;
+            if (!json_validator_check_string(input, length, &pos, result)) {
+                break;
+            }
+            stack[depth - 1].entries++;
+            if (stats && !json_stats_add_key(stats, input + key_start + 1, pos - key_start - 2)) {
+                json_validator_fail(result, key_start, "Out of memory");
+                break;
+            }
+        }
+        pos = json_validator_skip_whitespace(input, pos);
+        if (input[pos] != ':') {
+            json_validator_fail(result, pos, "Expected ':' after object key");
+            break;
+        }
+        pos = json_validator_skip_whitespace(input, pos + 1);
+    }
+
+done:
+    if (stack != local_stack) {
+        free(stack);
+    }
+    if (!result->valid) {
+        json_validator_locate_error(input, result);
+    }
+    return result->valid;
+}
+
+/**
+ * @brief Validates a complete JSON document without building it
+ * @param input The input text, NUL-terminated at input[length]
+ * @param length Input length in bytes
+ * @param result Receives validity and, on failure, the first error position
+ * @return true if the input is one well-formed document
+ */
+bool json_validator_check(const char *input, size_t length, json_check_result_t *result) {
+    return json_validator_scan(input, length, result, NULL);
+}
+
+/**
+ * @brief Validates a document and gathers its statistics in the same pass
+ * @param input The input text, NUL-terminated at input[length]
+ * @param length Input length in bytes
+ * @param result Receives validity and, on failure, the first error position
+ * @param stats Initialized statistics to update
+ * @return true if the input is one well-formed document
+ */
+bool json_validator_collect_stats(const char *input, size_t length, json_check_result_t *result,
+                                  json_stats_t *stats) {
+    return json_validator_scan(input, length, result, stats);
+}
+
+/**
+ * @brief Finds the closing quote of a string without decoding it
+ * @param input The input text
+ * @param length Total input length
+ * @param pos Offset just after the opening quote
+ * @return Offset of the closing quote, or length if the string is unterminated
+ */
+size_t json_validator_skip_string(const char *input, size_t length, size_t pos) {
+    while (true) {
+        pos = json_validator_find_string_special(input, pos, length);
+        if (pos >= length || input[pos] == '"') {
+            return pos;
+        }
+        pos += 2;   // skip the escaped character
+    }
+}
+
+/**
+ * @brief Finds the bracket (or comma) ending a raw container or entry
+ * 
+ * Only strings and bracket nesting are tracked; nothing is validated.
+ * 
+ * @param input The input text
+ * @param length Total input length
+ * @param cursor Offset inside the container
+ * @param stop_at_comma Whether a comma at the starting level also ends the scan
+ * @param commas Receives the number of commas passed at the starting level
+ * @return Offset of the closing bracket or comma, or length if there is none
+ */
+static size_t json_validator_find_raw_end(const char *input, size_t length, size_t cursor,
+                                          bool stop_at_comma, size_t *commas) {
+    size_t nesting = 0;
+    *commas = 0;
+
+    while (true) {
+        cursor = json_validator_find_structural(input, cursor, length);
+        if (cursor >= length) {
+            return length;
+        }
+
+        switch (input[cursor]) {
+            case '"':
+                cursor = json_validator_skip_string(input, length, cursor + 1);
+                if (cursor >= length) {
+                    return length;
+                }
+                break;
+            case '[':
+            case '{':
+                nesting++;
+                break;
+            case ']':
+            case '}':
+                if (nesting == 0) {
+                    return cursor;
+                }
+                nesting--;
+                break;
+            default:
+                if (nesting == 0) {
+                    if (stop_at_comma) {
+                        return cursor;
+                    }
+                    (*commas)++;
+                }
+                break;
+        }
+        cursor++;
+    }
+}
+
+/**
+ * @brief Skips the rest of an open container without validating it
+ * 
+ * Only strings and bracket nesting are tracked, so this runs at scanning
+ * speed; malformed content inside the skipped range goes unnoticed.
+ * 
+ * @param input The input text
+ * @param length Total input length
+ * @param pos Offset just after the container's opening bracket or a
+ *        separating comma; advanced past the closing bracket
+ * @param entries Receives the number of entries skipped
+ * @return true if the closing bracket was found
+ */
+bool json_validator_skip_container(const char *input, size_t length, size_t *pos, size_t *entries) {
+    const size_t start = json_validator_skip_whitespace(input, *pos);
+    const bool empty = input[start] == '}' || input[start] == ']';
+    size_t commas;
+    const size_t end = json_validator_find_raw_end(input, length, start, false, &commas);
+    if (end >= length) {
+        return false;
+    }
+    *pos = end + 1;
+    *entries = empty ? 0 : commas + 1;
+    return true;
+}
+
+/**
+ * @brief Skips one array element or object member without validating it
+ * @param input The input text
+ * @param length Total input length
+ * @param pos Offset of the entry; advanced to the comma or closing
+ *        bracket that ends it
+ * @return true if the end of the entry was found
+ */
+bool json_validator_skip_entry(const char *input, size_t length, size_t *pos) {
+    size_t commas;
+    const size_t end = json_validator_find_raw_end(input, length, *pos, true, &commas);
+    if (end >= length) {
+        return false;
+    }
+    *pos = end;
+    return true;
+}
@@ -0,0 +1,499 @@
+/**
+ * @file verify.c
+ * @brief Round-trip verification of written output against the parsed document
+ *
+ * The written S-expressions are mapped read-only and passed through the
+ * reverse converter with a digest attached to its JSON writer, so no text
+ * and no second tree are produced: every finished subtree folds into the
+ * running hash of its parent. Each time a top-level entry finishes, its
+ * hash is compared with the hash of the same entry in the parsed document,
+ * which is worked out on the spot. Memory use is one frame per open
+ * container on the output side.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "json_to_sexpr.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Starting hash for each kind of node */
+#define DIGEST_SEED 0xcbf29ce484222325ULL
+#define DIGEST_PRIME 0x100000001b3ULL
+
+/**
+ * @brief Adds bytes to an FNV-1a hash
+ * @param hash The hash so far
+ * @param text The bytes
+ * @param length Number of bytes
+ * @return The updated hash
+ */
+static uint64_t json_digest_add_bytes(uint64_t hash, const char *text, size_t length) {
+    for (size_t position = 0; position < length; position++) {
+        hash = (hash ^ (unsigned char)text[position]) * DIGEST_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * @brief Starts the hash of a node of the given kind
+ * @param tag One byte naming the kind of node
+ * @return The initial hash
+ */
+static uint64_t json_digest_start(char tag) {
+    return (DIGEST_SEED ^ (unsigned char)tag) * DIGEST_PRIME;
+}
+
+/**
+ * @brief Folds one hash into another, order-sensitively
+ * @param hash The running hash
+ * @param child The hash to fold in
+ * @return The combined hash
+ */
+static uint64_t json_digest_combine(uint64_t hash, uint64_t child) {
+    hash ^= child + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    return hash * DIGEST_PRIME;
+}
+
+/**
+ * @brief Hashes a complete string or key
+ * @param tag 's' for a string value, 'k' for a key
+ * @param text The string bytes
+ * @param length Number of bytes
+ * @return The hash
+ */
+static uint64_t json_digest_hash_text(char tag, const char *text, size_t length) {
+    return json_digest_add_bytes(json_digest_start(tag), text, length);
+}
+
+static uint64_t json_digest_hash_value(const json_value_t *value);
+
+/**
+ * @brief Hashes one element of a packed array or record column
+ * @param typed_array The array holding the element
+ * @param index Element position
+ * @return The hash the written element produces
+ */
+static uint64_t json_digest_hash_typed_item(const json_typed_array_t *typed_array, size_t index) {
+    char text[MAX_NUMBER_TEXT];
+    size_t length = 0;
+    switch (typed_array->kind) {
+        case TYPED_ARRAY_INT64:
+            length = output_formatter_format_integer(typed_array->items.integers[index], text);
+            break;
+        case TYPED_ARRAY_DOUBLE:
+            length = output_formatter_format_number(typed_array->items.doubles[index], text);
+            break;
+        case TYPED_ARRAY_BOOLEAN:
+            return json_typed_array_get_boolean(typed_array, index) ? json_digest_hash_text('l', "true", 4)
+                                                                    : json_digest_hash_text('l', "false", 5);
+        case TYPED_ARRAY_VALUE:
+            return json_digest_hash_value(typed_array->items.values[index]);
+    }
+    return json_digest_hash_text('l', text, length);
+}
+
+/**
+ * @brief Hashes one columnar record as the equivalent object
+ * @param record_array The record array
+ * @param record_index Record position
+ * @return The hash of the written object
+ */
+static uint64_t json_digest_hash_record(const json_record_array_t *record_array, size_t record_index) {
+    uint64_t hash = json_digest_start('{');
+    for (size_t key_index = 0; key_index < record_array->key_count; key_index++) {
+        const char *key = record_array->keys[key_index];
+        const uint64_t entry = json_digest_combine(
+            json_digest_hash_text('k', key, strlen(key)),
+            json_digest_hash_typed_item(record_array->columns[key_index], record_index));
+        hash = json_digest_combine(hash, entry);
+    }
+    return json_digest_combine(hash, '}');
+}
+
+/**
+ * @brief Hashes one object member (key and value together)
+ * @param member The member
+ * @return The entry hash
+ */
+static uint64_t json_digest_hash_member(const json_member_t *member) {
+    const uint64_t key_hash = member->key ? json_digest_hash_text('k', member->key, strlen(member->key))
+                                          : json_digest_start('e');
+    return json_digest_combine(key_hash, json_digest_hash_value(member->value));
+}
+
+/**
+ * @brief Hashes a parsed subtree exactly as its written form hashes
+ * @param value The subtree (NULL is written as nil)
+ * @return The hash
+ */
+static uint64_t json_digest_hash_value(const json_value_t *value) {
+    char text[MAX_NUMBER_TEXT];
+    uint64_t hash;
+
+    if (value == NULL) {
+        return json_digest_hash_text('l', "null", 4);
+    }
+    switch (value->type) {
+        case JSON_OBJECT:
+            hash = json_digest_start('{');
+            for (const json_member_t *member = value->data.object; member; member = member->next) {
+                hash = json_digest_combine(hash, json_digest_hash_member(member));
+            }
+            return json_digest_combine(hash, '}');
+        case JSON_ARRAY:
+            hash = json_digest_start('[');
+            for (const json_element_t *element = value->data.array; element; element = element->next) {
+                hash = json_digest_combine(hash, json_digest_hash_value(element->value));
+            }
+            return json_digest_combine(hash, ']');
+        case JSON_TYPED_ARRAY:
+            hash = json_digest_start('[');
+            for (size_t index = 0; index < value->data.typed_array->count; index++) {
+                hash = json_digest_combine(hash, json_digest_hash_typed_item(value->data.typed_array, index));
+            }
+            return json_digest_combine(hash, ']');
+        case JSON_RECORD_ARRAY:
+            hash = json_digest_start('[');
+            for (size_t index = 0; index < value->data.record_array->record_count; index++) {
+                hash = json_digest_combine(hash, json_digest_hash_record(value->data.record_array, index));
+            }
+            return json_digest_combine(hash, ']');
+        case JSON_STRING:
+            return json_digest_hash_text('s', value->data.string, strlen(value->data.string));
+        case JSON_NUMBER:
+            return json_digest_hash_text('l', text, output_formatter_format_number(value->data.number, text));
+        case JSON_BOOLEAN:
+            return value->data.boolean ? json_digest_hash_text('l', "true", 4)
+                                       : json_digest_hash_text('l', "false", 5);
+        case JSON_ELIDED:
+            return json_digest_start('e');
+        default:
+            return json_digest_hash_text('l', "null", 4);
+    }
+}
+
+/**
+ * @brief Finds a member key that the reverse converter cannot read back
+ * @param value The subtree to search (may be NULL)
+ * @return The first such key, or NULL if every key reads back
+ */
+static const char *json_verify_find_unreadable_key(const json_value_t *value) {
+    const char *key = NULL;
+    if (value == NULL) {
+        return NULL;
+    }
+    switch (value->type) {
+        case JSON_OBJECT:
+            for (const json_member_t *member = value->data.object; member && !key; member = member->next) {
+                if (member->key && !sexpr_reader_key_is_readable(member->key, strlen(member->key))) {
+                    key = member->key;
+                } else {
+                    key = json_verify_find_unreadable_key(member->value);
+                }
+            }
+            break;
+        case JSON_ARRAY:
+            for (const json_element_t *element = value->data.array; element && !key; element = element->next) {
+                key = json_verify_find_unreadable_key(element->value);
+            }
+            break;
+        case JSON_TYPED_ARRAY:
+            if (value->data.typed_array->kind == TYPED_ARRAY_VALUE) {
+                for (size_t index = 0; index < value->data.typed_array->count && !key; index++) {
+                    key = json_verify_find_unreadable_key(value->data.typed_array->items.values[index]);
+                }
+            }
+            break;
+        case JSON_RECORD_ARRAY:
+            for (size_t key_index = 0; key_index < value->data.record_array->key_count && !key; key_index++) {
+                const char *record_key = value->data.record_array->keys[key_index];
+                const json_typed_array_t *column = value->data.record_array->columns[key_index];
+                if (!sexpr_reader_key_is_readable(record_key, strlen(record_key))) {
+                    key = record_key;
+                }
+                for (size_t index = 0; column->kind == TYPED_ARRAY_VALUE && index < column->count && !key; index++) {
+                    key = json_verify_find_unreadable_key(column->items.values[index]);
+                }
+            }
+            break;
+        default:
+            break;
+    }
+    return key;
+}
+
+/**
+ * @brief Prepares a digest that checks against a parsed document
+ * @param digest The digest to initialize
+ * @param document The expected document
+ * @return true on success, false on allocation failure
+ */
+bool json_digest_initialize(json_digest_t *digest, const json_value_t *document) {
+    memset(digest, 0, sizeof(*digest));
+    digest->document = document;
+    if (document && document->type == JSON_OBJECT) {
+        digest->next_member = document->data.object;
+    } else if (document && document->type == JSON_ARRAY) {
+        digest->next_element = document->data.array;
+    }
+    digest->capacity = MAX_DEPTH;
+    digest->frames = malloc(digest->capacity * sizeof(json_digest_frame_t));
+    if (!digest->frames) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Frees the digest's frame stack
+ * @param digest The digest to release
+ */
+void json_digest_release(json_digest_t *digest) {
+    free(digest->frames);
+    digest->frames = NULL;
+}
+
+/**
+ * @brief Compares a finished top-level entry with the document's entry
+ * @param digest The digest
+ * @param entry_hash Hash of the entry read from the output
+ */
+static void json_digest_check_entry(json_digest_t *digest, uint64_t entry_hash) {
+    const json_value_t *document = digest->document;
+    const size_t index = digest->entries++;
+    if (digest->failed) {
+        return;
+    }
+
+    bool present = true;
+    uint64_t expected = 0;
+    if (document == NULL) {
+        present = false;
+    } else if (document->type == JSON_OBJECT) {
+        present = digest->next_member != NULL;
+        if (present) {
+            expected = json_digest_hash_member(digest->next_member);
+            digest->next_member = digest->next_member->next;
+        }
+    } else if (document->type == JSON_ARRAY) {
+        present = digest->next_element != NULL;
+        if (present) {
+            expected = json_digest_hash_value(digest->next_element->value);
+            digest->next_element = digest->next_element->next;
+        }
+    } else if (document->type == JSON_TYPED_ARRAY) {
+        present = index < document->data.typed_array->count;
+        if (present) {
+            expected = json_digest_hash_typed_item(document->data.typed_array, index);
+        }
+    } else if (document->type == JSON_RECORD_ARRAY) {
+        present = index < document->data.record_array->record_count;
+        if (present) {
+            expected = json_digest_hash_record(document->data.record_array, index);
+        }
+    } else {
+        present = false;
+    }
+
+    if (!present || expected != entry_hash) {
+        fprintf(stderr, "Error: Verification failed: top-level entry %lu does not match the input\n",
+                (unsigned long)index);
+        digest->failed = true;
+    }
+}
+
+/**
+ * @brief Folds a finished value into its parent
+ * @param digest The digest
+ * @param hash Hash of the finished value
+ */
+static void json_digest_add_value(json_digest_t *digest, uint64_t hash) {
+    if (digest->overflow > 0) {
+        return;
+    }
+    if (digest->depth == 0) {
+        digest->root_hash = hash;
+        digest->complete = true;
+        return;
+    }
+    json_digest_frame_t *frame = &digest->frames[digest->depth - 1];
+    const uint64_t entry = frame->has_key ? json_digest_combine(frame->key_hash, hash) : hash;
+    frame->has_key = false;
+    frame->hash = json_digest_combine(frame->hash, entry);
+    if (digest->depth == 1) {
+        json_digest_check_entry(digest, entry);
+    }
+}
+
+/**
+ * @brief Opens a container
+ * @param digest The digest
+ * @param bracket '{' or '['
+ */
+void json_digest_begin_container(json_digest_t *digest, char bracket) {
+    if (digest->overflow > 0) {
+        digest->overflow++;
+        return;
+    }
+    if (digest->depth == digest->capacity) {
+        json_digest_frame_t *frames = realloc(digest->frames,
+                                              digest->capacity * 2 * sizeof(json_digest_frame_t));
+        if (!frames) {
+            // Nothing deeper is hashed; the verification fails instead
+            if (!digest->failed) {
+                fprintf(stderr, "Error: Out of memory\n");
+            }
+            digest->failed = true;
+            digest->overflow++;
+            return;
+        }
+        digest->frames = frames;
+        digest->capacity *= 2;
+    }
+    json_digest_frame_t *frame = &digest->frames[digest->depth++];
+    frame->hash = json_digest_start(bracket);
+    frame->has_key = false;
+}
+
+/**
+ * @brief Closes the innermost container
+ * @param digest The digest
+ * @param bracket '}' or ']'
+ */
+void json_digest_end_container(json_digest_t *digest, char bracket) {
+    if (digest->overflow > 0) {
+        digest->overflow--;
+        return;
+    }
+    const uint64_t hash = json_digest_combine(digest->frames[--digest->depth].hash, (unsigned char)bracket);
+    json_digest_add_value(digest, hash);
+}
+
+/**
+ * @brief Records the key of the next member
+ * @param digest The digest
+ * @param key The key bytes
+ * @param length Length of the key
+ */
+void json_digest_key(json_digest_t *digest, const char *key, size_t length) {
+    if (digest->overflow > 0) {
+        return;
+    }
+    json_digest_frame_t *frame = &digest->frames[digest->depth - 1];
+    frame->key_hash = json_digest_hash_text('k', key, length);
+    frame->has_key = true;
+}
+
+/**
+ * @brief Starts a string value
+ * @param digest The digest
+ */
+void json_digest_begin_string(json_digest_t *digest) {
+    digest->string_hash = json_digest_start('s');
+}
+
+/**
+ * @brief Adds decoded bytes to the current string
+ * @param digest The digest
+ * @param text The bytes
+ * @param length Number of bytes
+ */
+void json_digest_string_bytes(json_digest_t *digest, const char *text, size_t length) {
+    digest->string_hash = json_digest_add_bytes(digest->string_hash, text, length);
+}
+
+/**
+ * @brief Finishes the current string value
+ * @param digest The digest
+ */
+void json_digest_end_string(json_digest_t *digest) {
+    json_digest_add_value(digest, digest->string_hash);
+}
+
+/**
+ * @brief Adds a number or keyword value in its JSON spelling
+ * @param digest The digest
+ * @param text The value text
+ * @param length Length of the text
+ */
+void json_digest_literal(json_digest_t *digest, const char *text, size_t length) {
+    json_digest_add_value(digest, json_digest_hash_text('l', text, length));
+}
+
+/**
+ * @brief Re-reads written output and checks it against the parsed document
+ *
+ * Reports the first mismatching top-level entry, or the position where
+ * the output stops being readable, on stderr. A document with a key the
+ * reader cannot recover (see sexpr_reader_key_is_readable) is reported as
+ * unverifiable without reading the output.
+ *
+ * @param document The parsed document that was written
+ * @param filename The output file
+ * @param entries Receives the number of top-level entries checked
+ * @return true if the output converts back to the document
+ */
+bool json_verify_output(const json_value_t *document, const char *filename, size_t *entries) {
+    *entries = 0;
+
+    // A key the reader would split is not a conversion error; it cannot be checked
+    const char *unreadable = json_verify_find_unreadable_key(document);
+    if (unreadable) {
+        fprintf(stderr, "Error: Output cannot be verified: the key \"%s\" does not read back from "
+                "S-expressions\n", unreadable);
+        return false;
+    }
+
+    const int descriptor = open(filename, O_RDONLY);
+    if (descriptor < 0) {
+        perror("Error opening output file for verification");
+        return false;
+    }
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || status.st_size == 0) {
+        fprintf(stderr, "Error: Verification failed: %s is empty\n", filename);
+        close(descriptor);
+        return false;
+    }
+    const size_t size = (size_t)status.st_size;
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (mapping == MAP_FAILED) {
+        perror("Error mapping output file for verification");
+        return false;
+    }
+    posix_madvise(mapping, size, POSIX_MADV_SEQUENTIAL);
+
+    json_digest_t digest;
+    json_writer_t *writer = malloc(sizeof(json_writer_t));
+    bool success = writer != NULL && json_digest_initialize(&digest, document);
+    if (!writer) {
+        fprintf(stderr, "Error: Out of memory\n");
+    }
+
+    if (success) {
+        json_check_result_t result;
+        json_writer_initialize(writer, NULL);
+        writer->digest = &digest;
+        if (!sexpr_reader_convert(mapping, size, writer, &result)) {
+            fprintf(stderr, "Error: Verification failed: %s at line %d, column %d (byte offset %lu)\n",
+                    result.message, result.line, result.column, (unsigned long)result.error_offset);
+            success = false;
+        } else if (!digest.failed && digest.root_hash != json_digest_hash_value(document)) {
+            fprintf(stderr, "Error: Verification failed: the document does not match the input\n");
+            success = false;
+        }
+        success = success && !digest.failed;
+        *entries = digest.entries;
+        json_digest_release(&digest);
+    }
+
+    free(writer);
+    munmap(mapping, size);
+    return success;
+}